@@ -38,6 +38,7 @@ void AlphaAnyHit(inout HitInfo payload, Attributes attrib)
     float4 diffuse = float4(1, 1, 0, 1);
     if (material.hasDiffuseTexture)
     {
+        // Transparent objects keep level 0 of their albedo resident, see Tracer::AddObject
         diffuse = albedo.Load(int3(coord, 0));
     }
 
@@ -136,6 +136,7 @@ bool IsShadowed(float3 lightDir, float3 origin, float maxDist, float3 normal)
     ShadowHitInfo shadowPayload;
     shadowPayload.isHit = false;
     
+    // Hit group record 2 * InstanceIndex(), the shadow record of the object that was hit
     TraceRay(
 		SceneBVH,
 		RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH | RAY_FLAG_CULL_NON_OPAQUE,
@@ -214,12 +215,13 @@ float4 LaunchRecursive(float3 dir, uint currentDepth, float3 origin)
     for (int k = 0; k < K; k++)
         payload.node[k] = n;
                 
+    // Hit group record 2 * InstanceIndex() + 1, the instance selects the records of its object
     TraceRay(
 		    SceneBVH,
 		    RAY_FLAG_FORCE_OPAQUE,
 		    0xFF,
 		    1,
-		    1,
+		    0,
 		    1,
 		    ray,
 		    payload
@@ -230,7 +232,9 @@ float4 LaunchRecursive(float3 dir, uint currentDepth, float3 origin)
 
 float3 CalcMappedNormal(VertexAttributes vertex, int2 coord)
 {
-    float3 mapping = (normals.Load(int3(coord, 0)).rgb - 0.5) * 2;
+    // Normal maps are stored as RG8, Z is always positive in tangent space
+    float2 mappingXY = (normals.Load(int3(coord, 0)).xy - 0.5) * 2;
+    float3 mapping = float3(mappingXY, sqrt(saturate(1 - dot(mappingXY, mappingXY))));
     return normalize(mapping.x * vertex.tangent + mapping.y * vertex.binormal + mapping.z * vertex.normal);
 }
 
@@ -276,7 +280,8 @@ void ClosestHit(inout HitInfo payload, Attributes attrib)
     float3 diffuse = material.DiffuseColor;
     if (material.hasDiffuseTexture)
     {
-        diffuse *= albedo.SampleLevel(BilinearClamp, vertex.uv, lod).rgb;
+        // The resource may start further down the chain, its level 0 is mip albedoMinMip
+        diffuse *= albedo.SampleLevel(BilinearClamp, vertex.uv, max(lod - material.albedoMinMip, 0)).rgb;
     }
 
     float3 color = diffuse * material.AmbientColor;
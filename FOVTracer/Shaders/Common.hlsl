@@ -53,10 +53,28 @@ struct MaterialCB
     float Shininess;
     
     float RefractIndex;
+    uint albedoMinMip;
 };
 
 ConstantBuffer<MaterialCB> material : register(b1);
 
+// Instance placement comes from the TLAS instance of the object, InstanceIndex() is the scene object index
+float3 InstanceToWorldPoint(float3 p)
+{
+    return mul(ObjectToWorld3x4(), float4(p, 1));
+}
+
+float3 InstanceToWorldVector(float3 v)
+{
+    return mul((float3x3) ObjectToWorld3x4(), v);
+}
+
+float3 InstanceToWorldNormal(float3 n)
+{
+    // Inverse transpose of the object to world matrix
+    return mul(n, (float3x3) WorldToObject3x4());
+}
+
 struct TraceParamsCB
 {
     float elapsedTimeSeconds;
@@ -120,6 +138,29 @@ uint3 GetIndices(uint triangleIndex)
 	return indices.Load3(address);
 }
 
+// Vertex buffer layout, set by the application from VertexLayout (VertexFormat.h). Defaults match the full 56 byte Vertex.
+#ifndef VERTEX_PACKED
+#define VERTEX_PACKED 0
+#define VERTEX_STRIDE 56
+#define VERTEX_TEXCOORD_OFFSET 12
+#define VERTEX_NORMAL_OFFSET 20
+#define VERTEX_TANGENT_OFFSET 32
+#define VERTEX_BINORMAL_OFFSET 44
+#define VERTEX_TANGENT_FRAME_OFFSET 0
+#endif
+
+// Tangent frame stored as a snorm16 quaternion, the sign of w is the binormal handedness
+void DecodeTangentFrame(uint2 packed, out float3 tangent, out float3 binormal, out float3 normal)
+{
+    int4 s = int4(asint(packed.x << 16) >> 16, asint(packed.x) >> 16, asint(packed.y << 16) >> 16, asint(packed.y) >> 16);
+    float4 q = normalize(max(float4(s) / 32767.0, -1.0));
+    float handedness = q.w < 0 ? -1.0 : 1.0;
+
+    tangent = float3(1 - 2 * (q.y * q.y + q.z * q.z), 2 * (q.x * q.y + q.w * q.z), 2 * (q.x * q.z - q.w * q.y));
+    binormal = float3(2 * (q.x * q.y - q.w * q.z), 1 - 2 * (q.x * q.x + q.z * q.z), 2 * (q.y * q.z + q.w * q.x)) * handedness;
+    normal = float3(2 * (q.x * q.z + q.w * q.y), 2 * (q.y * q.z - q.w * q.x), 1 - 2 * (q.x * q.x + q.y * q.y));
+}
+
 VertexAttributes GetVertexAttributes(uint triangleIndex, float3 barycentrics)
 {
 	uint3 indices = GetIndices(triangleIndex);
@@ -134,21 +175,34 @@ VertexAttributes GetVertexAttributes(uint triangleIndex, float3 barycentrics)
 
 	for (uint i = 0; i < 3; i++)
 	{
-		int address = (indices[i] * 14) * 4;
+		int address = indices[i] * VERTEX_STRIDE;
         float3 vpos = asfloat(vertices.Load3(address));
         v.position += vpos * barycentrics[i];
         vps[i] = vpos;
-		address += (3 * 4);
-		v.uv += asfloat(vertices.Load2(address)) * barycentrics[i];
-		address += (2 * 4);
-		v.normal += asfloat(vertices.Load3(address)) * barycentrics[i];
-        address += (3 * 4);
-        v.tangent += asfloat(vertices.Load3(address)) * barycentrics[i];
-        address += (3 * 4);
-        v.binormal += asfloat(vertices.Load3(address)) * barycentrics[i];
+#if VERTEX_PACKED
+        uint packedUV = vertices.Load(address + VERTEX_TEXCOORD_OFFSET);
+        v.uv += float2(f16tof32(packedUV), f16tof32(packedUV >> 16)) * barycentrics[i];
+
+        float3 tangent, binormal, normal;
+        DecodeTangentFrame(vertices.Load2(address + VERTEX_TANGENT_FRAME_OFFSET), tangent, binormal, normal);
+        v.normal += normal * barycentrics[i];
+        v.tangent += tangent * barycentrics[i];
+        v.binormal += binormal * barycentrics[i];
+#else
+		v.uv += asfloat(vertices.Load2(address + VERTEX_TEXCOORD_OFFSET)) * barycentrics[i];
+		v.normal += asfloat(vertices.Load3(address + VERTEX_NORMAL_OFFSET)) * barycentrics[i];
+        v.tangent += asfloat(vertices.Load3(address + VERTEX_TANGENT_OFFSET)) * barycentrics[i];
+        v.binormal += asfloat(vertices.Load3(address + VERTEX_BINORMAL_OFFSET)) * barycentrics[i];
+#endif
     }
 
-    v.triCross = cross(vps[1] - vps[0], vps[2] - vps[0]);
+    // Vertex data is shared between instances, bring it from object to world space
+    v.position = InstanceToWorldPoint(v.position);
+    v.normal = InstanceToWorldNormal(v.normal);
+    v.tangent = InstanceToWorldVector(v.tangent);
+    v.binormal = InstanceToWorldVector(v.binormal);
+
+    v.triCross = cross(InstanceToWorldVector(vps[1] - vps[0]), InstanceToWorldVector(vps[2] - vps[0]));
 
 	return v;
 }
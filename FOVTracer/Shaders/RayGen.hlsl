@@ -96,12 +96,13 @@ void RayGen()
                 payload.node[k] = n;
                 
 
+            // Hit group record 2 * InstanceIndex() + 1, the instance selects the records of its object
             TraceRay(
 		    SceneBVH,
 		    RAY_FLAG_NONE,
 		    0xFF,
 		    1,
-		    1,
+		    0,
 		    1,
 		    ray,
 		    payload
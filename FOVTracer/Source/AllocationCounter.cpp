@@ -0,0 +1,69 @@
+#include "pch.h"
+#include "AllocationCounter.h"
+#include "Benchmarks.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	std::atomic<bool> IsCounting{ false };
+	std::atomic<uint64_t> NumAllocations{ 0 };
+	std::atomic<uint64_t> NumBytes{ 0 };
+}
+
+namespace AllocationCounter
+{
+	bool IsAvailable()
+	{
+		return RUN_LOAD_BENCHMARKS != 0;
+	}
+
+	void Begin()
+	{
+		NumAllocations.store(0, std::memory_order_relaxed);
+		NumBytes.store(0, std::memory_order_relaxed);
+		IsCounting.store(true, std::memory_order_release);
+	}
+
+	Counts End()
+	{
+		IsCounting.store(false, std::memory_order_release);
+
+		Counts Result;
+		Result.NumAllocations = NumAllocations.load(std::memory_order_relaxed);
+		Result.NumBytes = NumBytes.load(std::memory_order_relaxed);
+		return Result;
+	}
+}
+
+#if RUN_LOAD_BENCHMARKS
+
+// Array and nothrow forms forward to these, aligned forms aren't counted
+void* operator new(std::size_t Size)
+{
+	if (IsCounting.load(std::memory_order_relaxed))
+	{
+		NumAllocations.fetch_add(1, std::memory_order_relaxed);
+		NumBytes.fetch_add(Size, std::memory_order_relaxed);
+	}
+
+	void* Memory = std::malloc(Size > 0 ? Size : 1);
+	if (!Memory)
+		throw std::bad_alloc();
+
+	return Memory;
+}
+
+void operator delete(void* Memory) noexcept
+{
+	std::free(Memory);
+}
+
+void operator delete(void* Memory, std::size_t) noexcept
+{
+	std::free(Memory);
+}
+
+#endif
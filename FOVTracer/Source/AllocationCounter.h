@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+* Counts every global operator new of the process while it is enabled, on all threads. The replacement operators live in
+* AllocationCounter.cpp and cost one relaxed load per allocation while counting is off. They are only compiled in with
+* RUN_LOAD_BENCHMARKS, other builds keep the CRT allocator and count nothing.
+* Meant for benchmarks that check how often a load goes to the heap, so only one Begin/End pair may be active at a time.
+*/
+namespace AllocationCounter
+{
+	/**
+	* False if this build doesn't replace operator new, End then always returns zero counts.
+	*/
+	bool IsAvailable();
+
+	struct Counts
+	{
+		uint64_t NumAllocations = 0;
+		uint64_t NumBytes = 0;
+	};
+
+	/**
+	* Resets the counts and starts counting.
+	*/
+	void Begin();
+
+	/**
+	* Stops counting and returns what was allocated since Begin.
+	*/
+	Counts End();
+}
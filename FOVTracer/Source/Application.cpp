@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "Application.h"
 #include "Log.h"
+#include "Benchmarks.h"
+#include "HostResidency.h"
 
 #include "imgui/imgui_impl_win32.h"
 
@@ -8,6 +10,16 @@
 #include <iostream>
 #include <fstream>
 
+// Loads the scene and its textures in the background and starts rendering as soon as the meshes are in
+#define STREAM_SCENE_LOAD 0
+
+// Builds a LOD chain for every mesh after loading, the CPU acceleration structure traces instances at the LOD their
+// eccentricity allows. Not used by the streamed load.
+#define BUILD_MESH_LODS 0
+
+// Streamed objects handed to the tracer per frame, each batch builds BLASes for its new meshes and rebuilds the TLAS in place
+static const uint32_t MaxStreamedObjectsPerFrame = 512;
+
 int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPWSTR lpCmdLine, _In_ int nCmdShow)
 {
 	UNREFERENCED_PARAMETER(hPrevInstance);
@@ -24,6 +36,8 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 
 void Application::Init(LONG width, LONG height, HINSTANCE& instance, LPCWSTR title)
 {
+	InitStart = std::chrono::high_resolution_clock::now();
+
 	HRESULT HR = AppWindow::Create(width, height, instance, Window, title);
 	Utils::Validate(HR, L"Error: Failed to create window!");
 
@@ -39,7 +53,34 @@ void Application::Init(LONG width, LONG height, HINSTANCE& instance, LPCWSTR tit
 
 	Log::Init();
 
-	RayScene.LoadFromPath(Utils::GetResourcePath("SunTemple/SunTemple.fbx"), false);
+#if RUN_LOAD_BENCHMARKS
+	Benchmarks::RunMeshCacheBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunMeshOptimizerBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunVertexPackingBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunMeshletBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunMeshLODBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunTextureDecodeBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunTextureFormatBenchmark();
+	Benchmarks::RunTextureMipBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunTextureCompressionBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunTextureEncodeBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunTextureCopyBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunTextureResidencyBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunCPUBVHBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunWideBVHBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunRayPacketBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunTwoLevelASBenchmark(Benchmarks::GetDefaultScenes());
+	Benchmarks::RunRefitBenchmark(Benchmarks::GetDefaultScenes());
+#endif
+
+#if STREAM_SCENE_LOAD
+	// The tracer needs something to build its pipeline around, so wait for the first batch of meshes but not the rest or the textures
+	RayScene.LoadFromPathStreamed(Utils::GetResourcePath("SunTemple/SunTemple.fbx"), false);
+	RayScene.WaitForStreamedObjects();
+	RayScene.PublishStreamedObjects(MaxStreamedObjectsPerFrame);
+#else
+	RayScene.LoadFromPath(Utils::GetResourcePath("SunTemple/SunTemple.fbx"), false, false, BUILD_MESH_LODS != 0);
+#endif
 	//RayScene.LoadFromPath(Utils::GetResourcePath("cornell_box/CornellBox-Sphere.obj"), false);
 	//RayScene.LoadFromPath(Utils::GetResourcePath("sibenik/sibenik.obj"), true);
 	//RayScene.LoadFromPath(Utils::GetResourcePath("San_Miguel/san-miguel-low-poly.obj"), false);
@@ -57,6 +98,7 @@ void Application::Init(LONG width, LONG height, HINSTANCE& instance, LPCWSTR tit
 	Config.Width = width;
 	Config.Instance = instance;
 	Config.Vsync = false;
+	Config.StreamTextures = STREAM_SCENE_LOAD != 0;
 
 	WindowHeight = ViewportHeight = static_cast<float>(height);
 	WindowWidth = ViewportWidth = static_cast<float>(width);
@@ -235,6 +277,7 @@ void Application::Run()
 			SceneCamera.Orientation = Quaternion(Orientation.X, Orientation.Y, Orientation.Z);
 		}
 
+		RayScene.PublishStreamedObjects(MaxStreamedObjectsPerFrame);
 		RayTracer.Update(RayScene, TraceParams, ComputeParams, jitterStrength);
 
 		//// --- Rendering ---
@@ -251,6 +294,11 @@ void Application::Run()
 			ImGui::Text("Compute time: %.3f ms", ComputeTimeMS);
 			ImGui::Text("DLSS time: %.3f ms", DLSSTimeMS);
 			ImGui::Text("Total time: %.3f ms", RaytraceTimeMS + ComputeTimeMS + DLSSTimeMS);
+			ImGui::Text("Time to first frame: %.1f ms", TimeToFirstFrameMS);
+			ImGui::Text("Host copies: %.1f MB textures, %.1f MB meshes", HostResidency::GetGlobal().GetResidentBytes(HostMemoryCategory::Textures) / (1024.0 * 1024.0),
+				HostResidency::GetGlobal().GetResidentBytes(HostMemoryCategory::Meshes) / (1024.0 * 1024.0));
+			ImGui::Text("Albedo mips: %.1f MB of %.1f MB resident", RayTracer.GetTextureResidency().GetResidentBytes() / (1024.0 * 1024.0),
+				RayTracer.GetTextureResidency().GetFullChainBytes() / (1024.0 * 1024.0));
 			ImGui::SliderInt("Sqrt spp", reinterpret_cast<int*>(&TraceParams.sqrtSamplesPerPixel), 0, 10);
 			ImGui::SliderInt("Recursion depth", reinterpret_cast<int*>(&TraceParams.recursionDepth), 1, 4);
 			ImGui::Checkbox("Indirect illumination (Expensive!)", reinterpret_cast<bool*>(&TraceParams.useIndirectIllum));
@@ -332,6 +380,19 @@ void Application::Run()
 		ImGui::Render();
 		float ScreenCaptureTime = RayTracer.Render(InputHandler->IsKeyJustPressed(P_KEY), scrShotSqrtSamples, scrShotDisableFOV, scrShotDisableDLSS, nScrShot, scrShotDepth, TakingVideo, !ComputeParams.disableTAA);
 
+		if (FrameCount == 0)
+		{
+			TimeToFirstFrameMS = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - InitStart).count();
+			CORE_INFO("Time to first frame: {0:.1f} ms", TimeToFirstFrameMS);
+		}
+
+		if (!IsSceneLoaded && !RayScene.IsStreaming() && !RayTracer.HasPendingTextures())
+		{
+			IsSceneLoaded = true;
+			float LoadMS = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - InitStart).count();
+			CORE_INFO("Scene fully loaded after {0:.1f} ms, {1} objects", LoadMS, RayScene.GetNumSceneObjects());
+		}
+
 
 		if (InputHandler->IsKeyJustPressed(V_KEY))
 		{
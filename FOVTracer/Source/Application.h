@@ -6,6 +6,8 @@
 #include "Input.h"
 #include "imgui/imgui.h"
 
+#include <chrono>
+
 #define ImTextureID ImU64
 
 class Application
@@ -50,6 +52,9 @@ public:
 	float RaytraceTimeMS = 0.0f;
 	float ComputeTimeMS = 0.0f;
 	float DLSSTimeMS = 0.0f;
+
+	// From the start of Init to the end of the first rendered frame
+	float TimeToFirstFrameMS = 0.0f;
 private:
 	HWND Window = nullptr;
 	ImGuiContext* UIContext = nullptr;
@@ -60,5 +65,8 @@ private:
 	float WindowHeight = 0.0f;
 
 	bool IsDLSSEnabled = false;
+
+	std::chrono::high_resolution_clock::time_point InitStart;
+	bool IsSceneLoaded = false;
 };
 
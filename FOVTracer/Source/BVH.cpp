@@ -0,0 +1,450 @@
+#include "pch.h"
+#include "BVH.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+BoundingBox::BoundingBox()
+{
+	const float Max = std::numeric_limits<float>::max();
+	Min = Vector3f(Max, Max, Max);
+	this->Max = Vector3f(-Max, -Max, -Max);
+}
+
+void BoundingBox::Grow(const Vector3f& Point)
+{
+	Min = Vector3f(Math::min(Min.X, Point.X), Math::min(Min.Y, Point.Y), Math::min(Min.Z, Point.Z));
+	Max = Vector3f(Math::max(Max.X, Point.X), Math::max(Max.Y, Point.Y), Math::max(Max.Z, Point.Z));
+}
+
+void BoundingBox::Grow(const BoundingBox& Other)
+{
+	Grow(Other.Min);
+	Grow(Other.Max);
+}
+
+Vector3f BoundingBox::GetCenter() const
+{
+	return Vector3f((Min.X + Max.X) * 0.5f, (Min.Y + Max.Y) * 0.5f, (Min.Z + Max.Z) * 0.5f);
+}
+
+float BoundingBox::GetSurfaceArea() const
+{
+	if (!IsValid())
+		return 0.0f;
+
+	float DX = Max.X - Min.X;
+	float DY = Max.Y - Min.Y;
+	float DZ = Max.Z - Min.Z;
+	return 2.0f * (DX * DY + DY * DZ + DZ * DX);
+}
+
+void BVH::Clear()
+{
+	Nodes.clear();
+	PrimitiveIndices.clear();
+	Depth = 0;
+}
+
+struct BVH::BuildContext
+{
+	Span<const BoundingBox> PrimitiveBounds;
+	std::vector<Vector3f> Centers;
+	BVHBuildSettings Settings;
+
+	std::atomic<uint32_t> NumNodes{ 1 };
+	std::atomic<uint32_t> Depth{ 0 };
+};
+
+namespace
+{
+	// Big nodes gather their bounds and bins in chunks of this many primitives, one pool task each
+	const uint32_t BuildChunkSize = 16384;
+
+	struct SAHBin
+	{
+		BoundingBox Bounds;
+		uint32_t Count = 0;
+	};
+
+	float GetAxis(const Vector3f& V, uint32_t Axis)
+	{
+		return Axis == 0 ? V.X : (Axis == 1 ? V.Y : V.Z);
+	}
+
+	uint32_t CeilLog2(uint32_t Value)
+	{
+		uint32_t Log = 0;
+		while ((1ull << Log) < Value)
+			Log++;
+
+		return Log;
+	}
+}
+
+void BVH::Build(Span<const BoundingBox> PrimitiveBounds, uint32_t MaxLeafSize)
+{
+	BVHBuildSettings Settings;
+	Settings.MaxLeafSize = MaxLeafSize;
+	Build(PrimitiveBounds, Settings);
+}
+
+void BVH::Build(Span<const BoundingBox> PrimitiveBounds, const BVHBuildSettings& Settings)
+{
+	Clear();
+
+	uint32_t NumPrimitives = static_cast<uint32_t>(PrimitiveBounds.size());
+	if (NumPrimitives == 0)
+		return;
+
+	BuildContext Context;
+	Context.PrimitiveBounds = PrimitiveBounds;
+	Context.Settings = Settings;
+	Context.Settings.MaxLeafSize = Math::max(Settings.MaxLeafSize, 1u);
+	Context.Settings.NumBins = Math::max(Settings.NumBins, 2u);
+
+	Context.Centers.resize(NumPrimitives);
+	PrimitiveIndices.resize(NumPrimitives);
+
+	auto const InitChunk = [&](uint32_t Chunk)
+	{
+		uint32_t End = Math::min(NumPrimitives, (Chunk + 1) * BuildChunkSize);
+		for (uint32_t i = Chunk * BuildChunkSize; i < End; i++)
+		{
+			Context.Centers[i] = PrimitiveBounds[i].GetCenter();
+			PrimitiveIndices[i] = i;
+		}
+	};
+
+	uint32_t NumChunks = (NumPrimitives + BuildChunkSize - 1) / BuildChunkSize;
+	if (Settings.ParallelThreshold > 0 && NumPrimitives >= Settings.ParallelThreshold)
+		ThreadPool::GetGlobal().ParallelFor(NumChunks, InitChunk);
+	else
+		for (uint32_t Chunk = 0; Chunk < NumChunks; Chunk++)
+			InitChunk(Chunk);
+
+	// A binary tree with at least one primitive per leaf never has more than 2N - 1 nodes. Subtrees claim their
+	// child pairs from the counter, so the size is fixed for the whole build
+	Nodes.resize(static_cast<size_t>(NumPrimitives) * 2 - 1);
+
+	BuildNode(Context, 0, 0, NumPrimitives, 1);
+
+	Nodes.resize(Context.NumNodes.load());
+	Depth = Context.Depth.load();
+}
+
+void BVH::BuildNode(BuildContext& Context, uint32_t NodeIndex, uint32_t First, uint32_t Count, uint32_t NodeDepth)
+{
+	const BVHBuildSettings& Settings = Context.Settings;
+	const bool IsParallel = Settings.ParallelThreshold > 0 && Count >= Settings.ParallelThreshold;
+
+	uint32_t PreviousDepth = Context.Depth.load();
+	while (PreviousDepth < NodeDepth && !Context.Depth.compare_exchange_weak(PreviousDepth, NodeDepth))
+	{
+	}
+
+	uint32_t NumChunks = IsParallel ? (Count + BuildChunkSize - 1) / BuildChunkSize : 1;
+	uint32_t ChunkSize = IsParallel ? BuildChunkSize : Count;
+
+	std::vector<BoundingBox> ChunkBounds(NumChunks);
+	std::vector<BoundingBox> ChunkCenterBounds(NumChunks);
+
+	auto const BoundChunk = [&](uint32_t Chunk)
+	{
+		uint32_t Begin = First + Chunk * ChunkSize;
+		uint32_t End = Math::min(First + Count, Begin + ChunkSize);
+		for (uint32_t i = Begin; i < End; i++)
+		{
+			ChunkBounds[Chunk].Grow(Context.PrimitiveBounds[PrimitiveIndices[i]]);
+			ChunkCenterBounds[Chunk].Grow(Context.Centers[PrimitiveIndices[i]]);
+		}
+	};
+
+	if (IsParallel)
+		ThreadPool::GetGlobal().ParallelFor(NumChunks, BoundChunk);
+	else
+		BoundChunk(0);
+
+	BoundingBox Bounds;
+	BoundingBox CenterBounds;
+	for (uint32_t Chunk = 0; Chunk < NumChunks; Chunk++)
+	{
+		Bounds.Grow(ChunkBounds[Chunk]);
+		CenterBounds.Grow(ChunkCenterBounds[Chunk]);
+	}
+
+	BVHNode& Node = Nodes[NodeIndex];
+	Node.BoundsMin = Bounds.Min;
+	Node.BoundsMax = Bounds.Max;
+	Node.LeftFirst = First;
+	Node.Count = Count;
+
+	if (Count == 1)
+		return;
+
+	Vector3f CenterExtent = CenterBounds.Max - CenterBounds.Min;
+
+	// SAH splits can peel off a single primitive per level, only take them while a median split could still finish
+	// the subtree within MaxDepth levels
+	bool UseSAH = Settings.SplitMethod == BVHSplitMethod::BinnedSAH && NodeDepth + CeilLog2(Count) < MaxDepth;
+
+	uint32_t SplitAxis = 0;
+	uint32_t SplitBin = 0;
+	bool HasSAHSplit = false;
+
+	if (UseSAH)
+	{
+		const uint32_t NumBins = Settings.NumBins;
+		std::vector<SAHBin> ChunkBins(static_cast<size_t>(NumChunks) * 3 * NumBins);
+
+		auto const BinChunk = [&](uint32_t Chunk)
+		{
+			SAHBin* Bins = &ChunkBins[static_cast<size_t>(Chunk) * 3 * NumBins];
+
+			uint32_t Begin = First + Chunk * ChunkSize;
+			uint32_t End = Math::min(First + Count, Begin + ChunkSize);
+			for (uint32_t Axis = 0; Axis < 3; Axis++)
+			{
+				float Extent = GetAxis(CenterExtent, Axis);
+				if (Extent <= 0.0f)
+					continue;
+
+				float AxisMin = GetAxis(CenterBounds.Min, Axis);
+				float Scale = NumBins / Extent;
+				for (uint32_t i = Begin; i < End; i++)
+				{
+					uint32_t Primitive = PrimitiveIndices[i];
+					uint32_t Bin = Math::min(NumBins - 1, static_cast<uint32_t>((GetAxis(Context.Centers[Primitive], Axis) - AxisMin) * Scale));
+					Bins[Axis * NumBins + Bin].Bounds.Grow(Context.PrimitiveBounds[Primitive]);
+					Bins[Axis * NumBins + Bin].Count++;
+				}
+			}
+		};
+
+		if (IsParallel)
+			ThreadPool::GetGlobal().ParallelFor(NumChunks, BinChunk);
+		else
+			BinChunk(0);
+
+		for (uint32_t Chunk = 1; Chunk < NumChunks; Chunk++)
+		{
+			for (uint32_t b = 0; b < 3 * NumBins; b++)
+			{
+				const SAHBin& Other = ChunkBins[static_cast<size_t>(Chunk) * 3 * NumBins + b];
+				ChunkBins[b].Bounds.Grow(Other.Bounds);
+				ChunkBins[b].Count += Other.Count;
+			}
+		}
+
+		float InvArea = 1.0f / Math::max(Bounds.GetSurfaceArea(), std::numeric_limits<float>::min());
+		float BestCost = std::numeric_limits<float>::max();
+		std::vector<float> RightCosts(NumBins);
+
+		for (uint32_t Axis = 0; Axis < 3; Axis++)
+		{
+			if (GetAxis(CenterExtent, Axis) <= 0.0f)
+				continue;
+
+			const SAHBin* Bins = &ChunkBins[Axis * NumBins];
+
+			// Split b puts bins [0, b) on the left, RightCosts[b] is the area weighted count of bins [b, NumBins)
+			BoundingBox RightBounds;
+			uint32_t RightCount = 0;
+			for (uint32_t b = NumBins - 1; b > 0; b--)
+			{
+				RightBounds.Grow(Bins[b].Bounds);
+				RightCount += Bins[b].Count;
+				RightCosts[b] = RightCount > 0 ? RightBounds.GetSurfaceArea() * RightCount : -1.0f;
+			}
+
+			BoundingBox LeftBounds;
+			uint32_t LeftCount = 0;
+			for (uint32_t b = 1; b < NumBins; b++)
+			{
+				LeftBounds.Grow(Bins[b - 1].Bounds);
+				LeftCount += Bins[b - 1].Count;
+				if (LeftCount == 0 || RightCosts[b] < 0.0f)
+					continue;
+
+				float Cost = Settings.TraversalCost + Settings.IntersectionCost * (LeftBounds.GetSurfaceArea() * LeftCount + RightCosts[b]) * InvArea;
+				if (Cost < BestCost)
+				{
+					BestCost = Cost;
+					SplitAxis = Axis;
+					SplitBin = b;
+					HasSAHSplit = true;
+				}
+			}
+		}
+
+		if (Count <= Settings.MaxLeafSize && (!HasSAHSplit || Settings.IntersectionCost * Count <= BestCost))
+			return;
+	}
+	else if (Count <= Settings.MaxLeafSize)
+	{
+		return;
+	}
+
+	uint32_t LeftCount = 0;
+	if (HasSAHSplit)
+	{
+		float AxisMin = GetAxis(CenterBounds.Min, SplitAxis);
+		float Scale = Settings.NumBins / GetAxis(CenterExtent, SplitAxis);
+
+		auto Middle = std::partition(PrimitiveIndices.begin() + First, PrimitiveIndices.begin() + First + Count, [&](uint32_t Primitive)
+		{
+			uint32_t Bin = Math::min(Settings.NumBins - 1, static_cast<uint32_t>((GetAxis(Context.Centers[Primitive], SplitAxis) - AxisMin) * Scale));
+			return Bin < SplitBin;
+		});
+
+		LeftCount = static_cast<uint32_t>(Middle - (PrimitiveIndices.begin() + First));
+	}
+
+	// Median split, also for nodes whose centroids all coincide
+	if (LeftCount == 0 || LeftCount == Count)
+	{
+		uint32_t Axis = CenterExtent.X >= CenterExtent.Y && CenterExtent.X >= CenterExtent.Z ? 0 : (CenterExtent.Y >= CenterExtent.Z ? 1 : 2);
+
+		LeftCount = Count / 2;
+		std::nth_element(PrimitiveIndices.begin() + First, PrimitiveIndices.begin() + First + LeftCount, PrimitiveIndices.begin() + First + Count,
+			[&](uint32_t A, uint32_t B) { return GetAxis(Context.Centers[A], Axis) < GetAxis(Context.Centers[B], Axis); });
+	}
+
+	uint32_t Left = Context.NumNodes.fetch_add(2);
+	Node.LeftFirst = Left;
+	Node.Count = 0;
+
+	auto const BuildChild = [&](uint32_t Child)
+	{
+		if (Child == 0)
+			BuildNode(Context, Left, First, LeftCount, NodeDepth + 1);
+		else
+			BuildNode(Context, Left + 1, First + LeftCount, Count - LeftCount, NodeDepth + 1);
+	};
+
+	if (IsParallel)
+	{
+		ThreadPool::GetGlobal().ParallelFor(2, BuildChild);
+	}
+	else
+	{
+		BuildChild(0);
+		BuildChild(1);
+	}
+}
+
+void BVH::Refit(Span<const BoundingBox> PrimitiveBounds, const BVHBuildSettings& Settings)
+{
+	if (Nodes.empty())
+		return;
+
+	// Splitting a few levels deeper than there are threads keeps the pool busy when the tree is lopsided
+	uint32_t ParallelDepth = 0;
+	if (Settings.ParallelThreshold > 0 && PrimitiveIndices.size() >= Settings.ParallelThreshold)
+		ParallelDepth = CeilLog2(ThreadPool::GetGlobal().GetNumThreads()) + 2;
+
+	RefitNode(PrimitiveBounds, 0, ParallelDepth);
+}
+
+void BVH::RefitNode(Span<const BoundingBox> PrimitiveBounds, uint32_t NodeIndex, uint32_t ParallelDepth)
+{
+	BoundingBox Bounds;
+
+	if (Nodes[NodeIndex].IsLeaf())
+	{
+		const BVHNode& Leaf = Nodes[NodeIndex];
+		for (uint32_t i = Leaf.LeftFirst; i < Leaf.LeftFirst + Leaf.Count; i++)
+			Bounds.Grow(PrimitiveBounds[PrimitiveIndices[i]]);
+	}
+	else
+	{
+		uint32_t Left = Nodes[NodeIndex].LeftFirst;
+		if (ParallelDepth > 0)
+		{
+			ThreadPool::GetGlobal().ParallelFor(2, [&](uint32_t Child) { RefitNode(PrimitiveBounds, Left + Child, ParallelDepth - 1); });
+		}
+		else
+		{
+			RefitNode(PrimitiveBounds, Left, 0);
+			RefitNode(PrimitiveBounds, Left + 1, 0);
+		}
+
+		for (uint32_t Child = Left; Child < Left + 2; Child++)
+		{
+			Bounds.Grow(Nodes[Child].BoundsMin);
+			Bounds.Grow(Nodes[Child].BoundsMax);
+		}
+	}
+
+	Nodes[NodeIndex].BoundsMin = Bounds.Min;
+	Nodes[NodeIndex].BoundsMax = Bounds.Max;
+}
+
+float BVH::GetSAHCost(float TraversalCost, float IntersectionCost) const
+{
+	if (Nodes.empty())
+		return 0.0f;
+
+	auto const GetArea = [](const BVHNode& Node)
+	{
+		BoundingBox Bounds;
+		Bounds.Min = Node.BoundsMin;
+		Bounds.Max = Node.BoundsMax;
+		return Bounds.GetSurfaceArea();
+	};
+
+	float RootArea = GetArea(Nodes[0]);
+	if (RootArea <= 0.0f)
+		return IntersectionCost * Nodes[0].Count;
+
+	double Cost = 0.0;
+	for (const BVHNode& Node : Nodes)
+	{
+		float Weight = GetArea(Node) / RootArea;
+		Cost += Node.IsLeaf() ? Weight * IntersectionCost * Node.Count : Weight * TraversalCost;
+	}
+
+	return static_cast<float>(Cost);
+}
+
+bool IntersectTriangle(const Vector3f& Origin, const Vector3f& Direction, const Vector3f& A, const Vector3f& B, const Vector3f& C, float& TMax)
+{
+	float U, V;
+	return IntersectTriangle(Origin, Direction, A, B, C, TMax, U, V);
+}
+
+bool IntersectTriangle(const Vector3f& Origin, const Vector3f& Direction, const Vector3f& A, const Vector3f& B, const Vector3f& C, float& TMax, float& OutU, float& OutV)
+{
+	const float Epsilon = 1e-9f;
+
+	Vector3f Edge1(B.X - A.X, B.Y - A.Y, B.Z - A.Z);
+	Vector3f Edge2(C.X - A.X, C.Y - A.Y, C.Z - A.Z);
+	Vector3f Dir = Direction;
+
+	Vector3f P = Dir.Cross(Edge2);
+	float Det = Edge1.Dot(P);
+	if (Det > -Epsilon && Det < Epsilon)
+		return false;
+
+	float InvDet = 1.0f / Det;
+	Vector3f S(Origin.X - A.X, Origin.Y - A.Y, Origin.Z - A.Z);
+	float U = S.Dot(P) * InvDet;
+	if (U < 0.0f || U > 1.0f)
+		return false;
+
+	Vector3f Q = S.Cross(Edge1);
+	float V = Dir.Dot(Q) * InvDet;
+	if (V < 0.0f || U + V > 1.0f)
+		return false;
+
+	float T = Edge2.Dot(Q) * InvDet;
+	if (T <= 0.0f || T >= TMax)
+		return false;
+
+	TMax = T;
+	OutU = U;
+	OutV = V;
+	return true;
+}
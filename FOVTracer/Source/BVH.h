@@ -0,0 +1,392 @@
+#pragma once
+
+#include "Math.h"
+#include "Span.h"
+#include "RayPacket.h"
+
+#include <cstdint>
+#include <vector>
+
+struct BoundingBox
+{
+	BoundingBox();
+
+	void Grow(const Vector3f& Point);
+	void Grow(const BoundingBox& Other);
+
+	Vector3f GetCenter() const;
+	float GetSurfaceArea() const;
+	bool IsValid() const { return Min.X <= Max.X; }
+
+	Vector3f Min;
+	Vector3f Max;
+};
+
+/**
+* 32 byte node. Interior nodes have Count 0 and their children at LeftFirst and LeftFirst + 1,
+* leaves hold Count primitives starting at LeftFirst in the primitive index list.
+*/
+struct BVHNode
+{
+	Vector3f BoundsMin;
+	uint32_t LeftFirst = 0;
+	Vector3f BoundsMax;
+	uint32_t Count = 0;
+
+	bool IsLeaf() const { return Count > 0; }
+};
+
+struct BVHTraversalStats
+{
+	uint64_t NodesVisited = 0;
+	uint64_t PrimitivesTested = 0;
+};
+
+enum class BVHSplitMethod : uint32_t
+{
+	Median,		// centroid median of the longest axis
+	BinnedSAH	// cheapest of NumBins candidate planes per axis under the surface area heuristic
+};
+
+struct BVHBuildSettings
+{
+	BVHSplitMethod SplitMethod = BVHSplitMethod::BinnedSAH;
+
+	/**
+	* Leaves never hold more primitives than this. With SAH smaller nodes are still split if that is cheaper.
+	*/
+	uint32_t MaxLeafSize = 4;
+
+	uint32_t NumBins = 16;
+
+	/**
+	* SAH cost of visiting a node and of testing a primitive.
+	*/
+	float TraversalCost = 1.0f;
+	float IntersectionCost = 1.0f;
+
+	/**
+	* Nodes with at least this many primitives are binned in parallel and build their two subtrees as separate thread pool
+	* tasks. 0 builds everything on the calling thread.
+	*/
+	uint32_t ParallelThreshold = 4096;
+
+	/**
+	* Updates whose refit pushes the SAH cost past this multiple of the cost after the last build rebuild the tree instead.
+	*/
+	float MaxRefitSAHGrowth = 1.5f;
+};
+
+/**
+* Binary bounding volume hierarchy over abstract primitives given by their bounds. What a primitive is, a triangle or a whole
+* meshlet, is up to the caller, it is only ever referred to by its index.
+*/
+class BVH
+{
+public:
+	/**
+	* Builds the tree top down. Node order depends on how the pool ran the subtrees, the tree itself doesn't.
+	*/
+	void Build(Span<const BoundingBox> PrimitiveBounds, const BVHBuildSettings& Settings);
+
+	/**
+	* Binned SAH with the default settings and leaves of at most MaxLeafSize primitives.
+	*/
+	void Build(Span<const BoundingBox> PrimitiveBounds, uint32_t MaxLeafSize);
+
+	/**
+	* Recomputes the node bounds bottom up for primitives that moved, keeping the topology. PrimitiveBounds has to hold as many
+	* primitives as the build. The subtrees near the root are refit as separate thread pool tasks under the same threshold as
+	* the build.
+	*/
+	void Refit(Span<const BoundingBox> PrimitiveBounds, const BVHBuildSettings& Settings);
+
+	void Clear();
+
+	Span<const BVHNode> GetNodes() const { return Span<const BVHNode>(Nodes.data(), Nodes.size()); }
+	Span<const uint32_t> GetPrimitiveIndices() const { return Span<const uint32_t>(PrimitiveIndices.data(), PrimitiveIndices.size()); }
+
+	uint32_t GetNumNodes() const { return static_cast<uint32_t>(Nodes.size()); }
+	uint32_t GetNumLeaves() const { return (GetNumNodes() + 1) / 2; }
+	uint32_t GetDepth() const { return Depth; }
+
+	/**
+	* Expected cost of a random ray under the surface area heuristic: every node is weighted by its surface area relative to
+	* the root, interior nodes cost TraversalCost and leaves IntersectionCost per primitive.
+	*/
+	float GetSAHCost(float TraversalCost, float IntersectionCost) const;
+
+	/**
+	* Walks the tree along a ray, nearer child first. IntersectPrimitive(PrimitiveIndex, TMax) tests one primitive and
+	* shortens TMax on a hit, nodes beyond TMax are skipped. Returns true if any primitive reported a hit.
+	*/
+	template<class IntersectFunc>
+	bool Traverse(Vector3f Origin, Vector3f Direction, float& TMax, IntersectFunc&& IntersectPrimitive, BVHTraversalStats& Stats) const
+	{
+		return TraverseImpl<false>(Origin, Direction, TMax, IntersectPrimitive, Stats);
+	}
+
+	/**
+	* Like Traverse, but stops at the first primitive that reports a hit. For occlusion rays.
+	*/
+	template<class IntersectFunc>
+	bool TraverseAny(Vector3f Origin, Vector3f Direction, float& TMax, IntersectFunc&& IntersectPrimitive, BVHTraversalStats& Stats) const
+	{
+		return TraverseImpl<true>(Origin, Direction, TMax, IntersectPrimitive, Stats);
+	}
+
+	/**
+	* Walks the tree with a coherent prepared packet, nearer child first for the first ray still active in a node. Nodes outside
+	* the packet's frustum are skipped with one test, rays that miss a node are skipped until the first one that hits it.
+	* IntersectPrimitive(RayIndex, PrimitiveIndex, TMax) tests one ray of the packet against one primitive and shortens
+	* Packet.TMax[RayIndex] on a hit. Returns false without tracing anything for an incoherent packet.
+	*/
+	template<class IntersectFunc>
+	bool TraversePacket(RayPacket& Packet, IntersectFunc&& IntersectPrimitive, BVHTraversalStats& Stats) const;
+
+	/**
+	* Traversal keeps its stack on the stack, builds fall back to median splits to stay within this depth.
+	*/
+	static constexpr uint32_t MaxDepth = 64;
+
+private:
+	struct BuildContext;
+
+	void BuildNode(BuildContext& Context, uint32_t NodeIndex, uint32_t First, uint32_t Count, uint32_t NodeDepth);
+
+	void RefitNode(Span<const BoundingBox> PrimitiveBounds, uint32_t NodeIndex, uint32_t ParallelDepth);
+
+	template<bool FirstHitOnly, class IntersectFunc>
+	bool TraverseImpl(Vector3f Origin, Vector3f Direction, float& TMax, IntersectFunc& IntersectPrimitive, BVHTraversalStats& Stats) const;
+
+	static bool IntersectBounds(const BVHNode& Node, const Vector3f& Origin, const Vector3f& InvDirection, float TMax, float& OutTMin);
+
+	/**
+	* Interval test of the whole packet, false only if no ray of it can hit the node.
+	*/
+	static bool IntersectPacketBounds(const BVHNode& Node, const RayPacket& Packet, float PacketTMax);
+
+	std::vector<BVHNode> Nodes;
+	std::vector<uint32_t> PrimitiveIndices;
+	uint32_t Depth = 0;
+};
+
+/**
+* Moeller-Trumbore ray triangle test. On a hit closer than TMax, TMax is set to the hit distance and true is returned.
+*/
+bool IntersectTriangle(const Vector3f& Origin, const Vector3f& Direction, const Vector3f& A, const Vector3f& B, const Vector3f& C, float& TMax);
+
+/**
+* Same test, also returning the barycentrics of the hit. U and V weight B and C like DXR barycentrics.
+*/
+bool IntersectTriangle(const Vector3f& Origin, const Vector3f& Direction, const Vector3f& A, const Vector3f& B, const Vector3f& C, float& TMax, float& OutU, float& OutV);
+
+inline bool BVH::IntersectBounds(const BVHNode& Node, const Vector3f& Origin, const Vector3f& InvDirection, float TMax, float& OutTMin)
+{
+	float TX1 = (Node.BoundsMin.X - Origin.X) * InvDirection.X;
+	float TX2 = (Node.BoundsMax.X - Origin.X) * InvDirection.X;
+	float TNear = Math::min(TX1, TX2);
+	float TFar = Math::max(TX1, TX2);
+
+	float TY1 = (Node.BoundsMin.Y - Origin.Y) * InvDirection.Y;
+	float TY2 = (Node.BoundsMax.Y - Origin.Y) * InvDirection.Y;
+	TNear = Math::max(TNear, Math::min(TY1, TY2));
+	TFar = Math::min(TFar, Math::max(TY1, TY2));
+
+	float TZ1 = (Node.BoundsMin.Z - Origin.Z) * InvDirection.Z;
+	float TZ2 = (Node.BoundsMax.Z - Origin.Z) * InvDirection.Z;
+	TNear = Math::max(TNear, Math::min(TZ1, TZ2));
+	TFar = Math::min(TFar, Math::max(TZ1, TZ2));
+
+	OutTMin = TNear;
+	return TFar >= Math::max(TNear, 0.0f) && TNear < TMax;
+}
+
+template<bool FirstHitOnly, class IntersectFunc>
+bool BVH::TraverseImpl(Vector3f Origin, Vector3f Direction, float& TMax, IntersectFunc& IntersectPrimitive, BVHTraversalStats& Stats) const
+{
+	if (Nodes.empty())
+		return false;
+
+	const float Huge = 1e30f;
+	Vector3f InvDirection(
+		Direction.X != 0.0f ? 1.0f / Direction.X : Huge,
+		Direction.Y != 0.0f ? 1.0f / Direction.Y : Huge,
+		Direction.Z != 0.0f ? 1.0f / Direction.Z : Huge);
+
+	float TMin;
+	if (!IntersectBounds(Nodes[0], Origin, InvDirection, TMax, TMin))
+		return false;
+
+	uint32_t Stack[MaxDepth];
+	uint32_t StackSize = 0;
+	uint32_t NodeIndex = 0;
+	bool Hit = false;
+
+	while (true)
+	{
+		const BVHNode& Node = Nodes[NodeIndex];
+		Stats.NodesVisited++;
+
+		if (Node.IsLeaf())
+		{
+			for (uint32_t i = 0; i < Node.Count; i++)
+			{
+				Stats.PrimitivesTested++;
+				Hit |= IntersectPrimitive(PrimitiveIndices[Node.LeftFirst + i], TMax);
+
+				if (FirstHitOnly && Hit)
+					return true;
+			}
+		}
+		else
+		{
+			uint32_t Near = Node.LeftFirst;
+			uint32_t Far = Node.LeftFirst + 1;
+			float TNear, TFar;
+			bool HitNear = IntersectBounds(Nodes[Near], Origin, InvDirection, TMax, TNear);
+			bool HitFar = IntersectBounds(Nodes[Far], Origin, InvDirection, TMax, TFar);
+
+			if (HitNear && HitFar)
+			{
+				if (TFar < TNear)
+					std::swap(Near, Far);
+
+				Stack[StackSize++] = Far;
+				NodeIndex = Near;
+				continue;
+			}
+			else if (HitNear || HitFar)
+			{
+				NodeIndex = HitNear ? Near : Far;
+				continue;
+			}
+		}
+
+		// Pop until a node that still overlaps the shortened ray
+		bool Found = false;
+		while (StackSize > 0)
+		{
+			NodeIndex = Stack[--StackSize];
+			if (IntersectBounds(Nodes[NodeIndex], Origin, InvDirection, TMax, TMin))
+			{
+				Found = true;
+				break;
+			}
+		}
+
+		if (!Found)
+			break;
+	}
+
+	return Hit;
+}
+
+inline bool BVH::IntersectPacketBounds(const BVHNode& Node, const RayPacket& Packet, float PacketTMax)
+{
+	const float Mins[3] = { Node.BoundsMin.X, Node.BoundsMin.Y, Node.BoundsMin.Z };
+	const float Maxs[3] = { Node.BoundsMax.X, Node.BoundsMax.Y, Node.BoundsMax.Z };
+
+	float TNear = 0.0f;
+	float TFar = PacketTMax;
+	for (uint32_t Axis = 0; Axis < 3; Axis++)
+	{
+		// Smallest distance to the near plane and largest to the far plane along the shared sign of the directions, over
+		// all origins of the packet
+		float NearLow, FarHigh;
+		if (Packet.IsNegative[Axis])
+		{
+			NearLow = Packet.OriginMin[Axis] - Maxs[Axis];
+			FarHigh = Packet.OriginMax[Axis] - Mins[Axis];
+		}
+		else
+		{
+			NearLow = Mins[Axis] - Packet.OriginMax[Axis];
+			FarHigh = Maxs[Axis] - Packet.OriginMin[Axis];
+		}
+
+		// Earliest any ray can enter the slab and latest any ray can leave it
+		float Enter = NearLow * (NearLow >= 0.0f ? Packet.InvDirectionMin[Axis] : Packet.InvDirectionMax[Axis]);
+		float Leave = FarHigh * (FarHigh >= 0.0f ? Packet.InvDirectionMax[Axis] : Packet.InvDirectionMin[Axis]);
+
+		TNear = Math::max(TNear, Enter);
+		TFar = Math::min(TFar, Leave);
+	}
+
+	return TNear <= TFar;
+}
+
+template<class IntersectFunc>
+bool BVH::TraversePacket(RayPacket& Packet, IntersectFunc&& IntersectPrimitive, BVHTraversalStats& Stats) const
+{
+	if (Nodes.empty() || !Packet.IsCoherent)
+		return false;
+
+	struct PacketEntry
+	{
+		uint32_t NodeIndex;
+		uint32_t FirstActive;
+	};
+
+	auto const GetOrigin = [&](uint32_t Ray) { return Vector3f(Packet.OriginX[Ray], Packet.OriginY[Ray], Packet.OriginZ[Ray]); };
+	auto const GetInvDirection = [&](uint32_t Ray) { return Vector3f(Packet.InvDirectionX[Ray], Packet.InvDirectionY[Ray], Packet.InvDirectionZ[Ray]); };
+
+	// Every interior node pops itself and pushes both children
+	PacketEntry Stack[MaxDepth + 1];
+	uint32_t StackSize = 0;
+	Stack[StackSize++] = { 0, 0 };
+	bool Hit = false;
+
+	while (StackSize > 0)
+	{
+		const PacketEntry Entry = Stack[--StackSize];
+		const BVHNode& Node = Nodes[Entry.NodeIndex];
+		Stats.NodesVisited++;
+
+		float PacketTMax = 0.0f;
+		for (uint32_t r = Entry.FirstActive; r < Packet.NumRays; r++)
+			PacketTMax = Math::max(PacketTMax, Packet.TMax[r]);
+
+		if (!IntersectPacketBounds(Node, Packet, PacketTMax))
+			continue;
+
+		float TMin;
+		uint32_t First = Entry.FirstActive;
+		while (First < Packet.NumRays && !IntersectBounds(Node, GetOrigin(First), GetInvDirection(First), Packet.TMax[First], TMin))
+			First++;
+
+		if (First == Packet.NumRays)
+			continue;
+
+		if (Node.IsLeaf())
+		{
+			for (uint32_t r = First; r < Packet.NumRays; r++)
+			{
+				if (r > First && !IntersectBounds(Node, GetOrigin(r), GetInvDirection(r), Packet.TMax[r], TMin))
+					continue;
+
+				for (uint32_t i = 0; i < Node.Count; i++)
+				{
+					Stats.PrimitivesTested++;
+					Hit |= IntersectPrimitive(r, PrimitiveIndices[Node.LeftFirst + i], Packet.TMax[r]);
+				}
+			}
+
+			continue;
+		}
+
+		// The children are ordered for the first active ray, the rest of a coherent packet mostly agrees
+		uint32_t Near = Node.LeftFirst;
+		uint32_t Far = Node.LeftFirst + 1;
+		float TNear, TFar;
+		IntersectBounds(Nodes[Near], GetOrigin(First), GetInvDirection(First), Packet.TMax[First], TNear);
+		IntersectBounds(Nodes[Far], GetOrigin(First), GetInvDirection(First), Packet.TMax[First], TFar);
+		if (TFar < TNear)
+			std::swap(Near, Far);
+
+		Stack[StackSize++] = { Far, First };
+		Stack[StackSize++] = { Near, First };
+	}
+
+	return Hit;
+}
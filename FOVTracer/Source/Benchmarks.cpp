@@ -0,0 +1,1809 @@
+#include "pch.h"
+#include "Benchmarks.h"
+#include "Utils.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "VertexFormat.h"
+#include "Scene.h"
+#include "BVH.h"
+#include "CPUAccelerationStructure.h"
+#include "LogPolarRays.h"
+#include "TextureCache.h"
+#include "TextureFormat.h"
+#include "TextureMips.h"
+#include "TextureCompression.h"
+#include "TextureResidency.h"
+#include "ThreadPool.h"
+#include "AllocationCounter.h"
+#include "Log.h"
+
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <random>
+#include <limits>
+#include <cstring>
+#include <filesystem>
+
+namespace Benchmarks
+{
+	template<class Func>
+	static double TimeMS(Func&& F)
+	{
+		auto const Start = std::chrono::high_resolution_clock::now();
+		F();
+		auto const End = std::chrono::high_resolution_clock::now();
+
+		return std::chrono::duration<double, std::milli>(End - Start).count();
+	}
+
+	static BoundingBox GetBounds(Span<const Vector3f> Positions)
+	{
+		BoundingBox Bounds;
+		for (size_t v = 0; v < Positions.size(); v++)
+			Bounds.Grow(Positions[v]);
+
+		return Bounds;
+	}
+
+	/**
+	* Seeded random rays starting anywhere inside the bounds of Positions, so every run traces the same rays.
+	*/
+	static void GenerateRays(Span<const Vector3f> Positions, uint32_t NumRays, std::vector<Vector3f>& OutOrigins, std::vector<Vector3f>& OutDirections)
+	{
+		BoundingBox SceneBounds = GetBounds(Positions);
+
+		std::mt19937 Random(1234);
+		std::uniform_real_distribution<float> Unit(0.0f, 1.0f);
+		OutOrigins.resize(NumRays);
+		OutDirections.resize(NumRays);
+		for (uint32_t r = 0; r < NumRays; r++)
+		{
+			OutOrigins[r] = Vector3f(
+				SceneBounds.Min.X + (SceneBounds.Max.X - SceneBounds.Min.X) * Unit(Random),
+				SceneBounds.Min.Y + (SceneBounds.Max.Y - SceneBounds.Min.Y) * Unit(Random),
+				SceneBounds.Min.Z + (SceneBounds.Max.Z - SceneBounds.Min.Z) * Unit(Random));
+
+			float CosTheta = 1.0f - 2.0f * Unit(Random);
+			float SinTheta = std::sqrt(Math::max(1.0f - CosTheta * CosTheta, 0.0f));
+			float Phi = 2.0f * 3.14159265f * Unit(Random);
+			OutDirections[r] = Vector3f(SinTheta * std::cos(Phi), SinTheta * std::sin(Phi), CosTheta);
+		}
+	}
+
+	struct PinholeRays
+	{
+		Vector3f Eye;
+		std::vector<Vector3f> Directions;
+	};
+
+	/**
+	* Primary rays of a 60 degree pinhole camera in the middle of the scene geometry looking down +Z, one per pixel row by row.
+	*/
+	static PinholeRays GeneratePinholeRays(const ::Scene& BenchScene, uint32_t Width, uint32_t Height)
+	{
+		const float TanHalfFov = std::tan(0.5f * 60.0f * 3.14159265f / 180.0f);
+		Vector3f Forward(0.0f, 0.0f, 1.0f);
+		Vector3f Right(1.0f, 0.0f, 0.0f);
+		Vector3f Up(0.0f, 1.0f, 0.0f);
+
+		PinholeRays Rays;
+		Rays.Eye = GetBounds(BenchScene.Geometry.GetPositions()).GetCenter();
+		Rays.Directions.resize(static_cast<size_t>(Width) * Height);
+		for (uint32_t y = 0; y < Height; y++)
+		{
+			for (uint32_t x = 0; x < Width; x++)
+			{
+				float NDCX = (2.0f * (x + 0.5f) / Width - 1.0f) * TanHalfFov * Width / Height;
+				float NDCY = (1.0f - 2.0f * (y + 0.5f) / Height) * TanHalfFov;
+				Rays.Directions[static_cast<size_t>(y) * Width + x] = (Forward + Right * NDCX + Up * NDCY).Normalized();
+			}
+		}
+
+		return Rays;
+	}
+
+	/**
+	* One line of a result file, the values separated by spaces.
+	*/
+	template<class... ValueTypes>
+	static std::string FormatRow(const ValueTypes&... Values)
+	{
+		std::ostringstream Row;
+		const char* Separator = "";
+		((Row << Separator << Values, Separator = " "), ...);
+		return Row.str();
+	}
+
+	/**
+	* Writes ../Data/<Name>.txt, the column names of Header on the first line and then one line per row.
+	*/
+	static void WriteBenchmarkResults(const std::string& Name, const std::string& Header, const std::vector<std::string>& Rows)
+	{
+		std::ofstream ResultFile("../Data/" + Name + ".txt");
+		ResultFile << Header << '\n';
+		for (const std::string& Row : Rows)
+			ResultFile << Row << '\n';
+	}
+
+	/**
+	* Loads the scene of a benchmark into OutScene along with its world space geometry. False if nothing could be loaded, the
+	* scene should be skipped then.
+	*/
+	static bool LoadBenchmarkScene(const BenchmarkScene& Scene, ::Scene& OutScene)
+	{
+		OutScene.LoadFromPath(Scene.Path, Scene.GenVertexNormals);
+		if (OutScene.GetNumSceneObjects() == 0)
+		{
+			CORE_ERROR("Skipping {0}, load failed", Scene.Path);
+			return false;
+		}
+
+		OutScene.BuildGeometry();
+		return true;
+	}
+
+	std::vector<BenchmarkScene> GetDefaultScenes()
+	{
+		return {
+			{ Utils::GetResourcePath("SunTemple/SunTemple.fbx"), false },
+			{ Utils::GetResourcePath("sponza/sponza.obj"), false },
+			{ Utils::GetResourcePath("sibenik/sibenik.obj"), true },
+		};
+	}
+
+	void RunMeshCacheBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== MESH CACHE BENCHMARK ====");
+
+		std::vector<std::string> Rows;
+
+		if (!AllocationCounter::IsAvailable())
+			CORE_WARN("This build doesn't count heap allocations, build with RUN_LOAD_BENCHMARKS to check the warm loads");
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			std::string CachePath = MeshCache::GetCachePath(Scene.Path);
+			std::remove(CachePath.c_str());
+
+			GeometryArena ColdArena;
+			std::vector<StaticMesh> ColdMeshes;
+			std::vector<MeshInstance> ColdInstances;
+			bool ColdSucceeded = false;
+			AllocationCounter::Begin();
+			double ColdMS = TimeMS([&]() { ColdSucceeded = Utils::LoadStaticMeshes(Scene.Path, ColdArena, ColdMeshes, ColdInstances, Scene.GenVertexNormals); });
+			const AllocationCounter::Counts ColdAllocations = AllocationCounter::End();
+
+			if (!ColdSucceeded)
+			{
+				CORE_ERROR("Skipping {0}, cold load failed", Scene.Path);
+				continue;
+			}
+
+			GeometryArena WarmArena;
+			std::vector<StaticMesh> WarmMeshes;
+			std::vector<MeshInstance> WarmInstances;
+			AllocationCounter::Begin();
+			double WarmMS = TimeMS([&]() { Utils::LoadStaticMeshes(Scene.Path, WarmArena, WarmMeshes, WarmInstances, Scene.GenVertexNormals); });
+			const AllocationCounter::Counts WarmAllocations = AllocationCounter::End();
+
+			uint64_t CacheBytes = 0;
+			FILE* CacheFile = fopen(CachePath.c_str(), "rb");
+			if (CacheFile)
+			{
+				fseek(CacheFile, 0, SEEK_END);
+				CacheBytes = static_cast<uint64_t>(ftell(CacheFile));
+				fclose(CacheFile);
+			}
+
+			if (WarmMeshes.size() != ColdMeshes.size() || WarmInstances.size() != ColdInstances.size())
+				CORE_ERROR("Warm load of {0} returned {1} meshes and {2} instances, expected {3} and {4}",
+					Scene.Path, WarmMeshes.size(), WarmInstances.size(), ColdMeshes.size(), ColdInstances.size());
+
+			CORE_INFO("{0}: cold {1:.1f} ms, warm {2:.1f} ms ({3:.1f}x), cache {4} bytes",
+				Scene.Path, ColdMS, WarmMS, ColdMS / Math::max(WarmMS, 0.001), CacheBytes);
+
+			// Everything the load allocated on any thread. The warm arena maps the cache file instead of allocating its data
+			const size_t NumWarmMeshes = Math::max<size_t>(WarmMeshes.size(), 1);
+			CORE_INFO("{0}: cold load made {1} heap allocations, warm load {2} ({3:.2f} per mesh) for {4:.1f} MB, the geometry arena maps {5:.1f} MB",
+				Scene.Path, ColdAllocations.NumAllocations, WarmAllocations.NumAllocations, static_cast<double>(WarmAllocations.NumAllocations) / NumWarmMeshes,
+				WarmAllocations.NumBytes / (1024.0 * 1024.0), WarmArena.GetSizeInBytes() / (1024.0 * 1024.0));
+
+			// Material names and texture paths are std::strings every mesh owns a copy of, copying them once more shows how many
+			// of the warm allocations they account for. One of the copies here is the vector itself.
+			std::vector<Material> MaterialCopies;
+			AllocationCounter::Begin();
+			MaterialCopies.reserve(WarmMeshes.size());
+			for (const StaticMesh& Mesh : WarmMeshes)
+				MaterialCopies.push_back(Mesh.MeshMaterial);
+			const uint64_t MaterialAllocations = Math::max<uint64_t>(AllocationCounter::End().NumAllocations, 1) - 1;
+
+			// Everything else has to be per load, not per mesh
+			const uint64_t OtherAllocations = WarmAllocations.NumAllocations - Math::min(MaterialAllocations, WarmAllocations.NumAllocations);
+			const char* CheckResult = "uncounted";
+			if (AllocationCounter::IsAvailable())
+			{
+				CheckResult = OtherAllocations < WarmMeshes.size() ? "passed" : "failed";
+				if (OtherAllocations >= WarmMeshes.size())
+					CORE_ERROR("{0}: warm load made {1} heap allocations besides the material strings for {2} meshes, it should make none per mesh",
+						Scene.Path, OtherAllocations, WarmMeshes.size());
+			}
+
+			Rows.push_back(FormatRow(Scene.Path, ColdMS, WarmMS, ColdMS / Math::max(WarmMS, 0.001), CacheBytes, ColdAllocations.NumAllocations,
+				WarmAllocations.NumAllocations, WarmAllocations.NumBytes, WarmArena.GetSizeInBytes(), MaterialAllocations, CheckResult));
+		}
+
+		WriteBenchmarkResults("mesh_cache_times", "scene cold_ms warm_ms speedup cache_bytes cold_allocs warm_allocs warm_alloc_bytes arena_bytes "
+			"material_allocs per_mesh_check", Rows);
+	}
+
+	void RunMeshOptimizerBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== MESH OPTIMIZER BENCHMARK ====");
+
+		std::vector<std::string> Rows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			// Imported without the mesh cache, whose meshes are read only spans into the mapped file
+			GeometryArena Arena;
+			std::vector<StaticMesh> Meshes;
+			std::vector<MeshInstance> Instances;
+			if (!Utils::LoadStaticMeshes(Scene.Path, Arena, Meshes, Instances, Scene.GenVertexNormals, false, false))
+			{
+				CORE_ERROR("Skipping {0}, load failed", Scene.Path);
+				continue;
+			}
+
+			uint64_t NumTriangles = 0;
+			uint64_t VerticesBefore = 0;
+			uint64_t VerticesAfter = 0;
+			double WeightedACMRBefore = 0.0;
+			double WeightedACMRAfter = 0.0;
+
+			double OptimizeMS = TimeMS([&]()
+			{
+				for (StaticMesh& Mesh : Meshes)
+				{
+					MeshOptimizer::OptimizeStats Stats = MeshOptimizer::Optimize(Mesh);
+
+					NumTriangles += Stats.NumTriangles;
+					VerticesBefore += Stats.VerticesBefore;
+					VerticesAfter += Stats.VerticesAfter;
+					WeightedACMRBefore += static_cast<double>(Stats.ACMRBefore) * Stats.NumTriangles;
+					WeightedACMRAfter += static_cast<double>(Stats.ACMRAfter) * Stats.NumTriangles;
+				}
+			});
+
+			double ACMRBefore = WeightedACMRBefore / Math::max(NumTriangles, uint64_t(1));
+			double ACMRAfter = WeightedACMRAfter / Math::max(NumTriangles, uint64_t(1));
+
+			CORE_INFO("{0}: {1} tris, vertices {2} -> {3}, ACMR {4:.3f} -> {5:.3f}, {6:.1f} ms",
+				Scene.Path, NumTriangles, VerticesBefore, VerticesAfter, ACMRBefore, ACMRAfter, OptimizeMS);
+
+			Rows.push_back(FormatRow(Scene.Path, NumTriangles, VerticesBefore, VerticesAfter, ACMRBefore, ACMRAfter, OptimizeMS));
+		}
+
+		WriteBenchmarkResults("mesh_optimizer_stats", "scene triangles vertices_before vertices_after acmr_before acmr_after optimize_ms", Rows);
+	}
+
+	void RunVertexPackingBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== VERTEX PACKING BENCHMARK ====");
+
+		VertexLayout FullLayout = VertexLayout::Get(VertexFormat::Full);
+		VertexLayout PackedLayout = VertexLayout::Get(VertexFormat::Packed);
+
+		std::vector<std::string> Rows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			GeometryArena Arena;
+			std::vector<StaticMesh> Meshes;
+			std::vector<MeshInstance> Instances;
+			if (!Utils::LoadStaticMeshes(Scene.Path, Arena, Meshes, Instances, Scene.GenVertexNormals))
+			{
+				CORE_ERROR("Skipping {0}, load failed", Scene.Path);
+				continue;
+			}
+
+			uint64_t NumVertices = 0;
+			for (const StaticMesh& Mesh : Meshes)
+				NumVertices += Mesh.Vertices.size();
+
+			std::vector<PackedVertex> Packed(NumVertices);
+			double EncodeMS = TimeMS([&]()
+			{
+				PackedVertex* Out = Packed.data();
+				for (const StaticMesh& Mesh : Meshes)
+				{
+					VertexPacking::EncodeVertices(Mesh.Vertices, Out);
+					Out += Mesh.Vertices.size();
+				}
+			});
+
+			VertexPacking::RoundTripError Error;
+			for (const StaticMesh& Mesh : Meshes)
+				VertexPacking::MeasureRoundTripError(Mesh.Vertices, Error);
+
+			uint64_t FullBytes = NumVertices * FullLayout.Stride;
+			uint64_t PackedBytes = NumVertices * PackedLayout.Stride;
+
+			CORE_INFO("{0}: {1} vertices, {2} -> {3} bytes, encode {4:.1f} ms", Scene.Path, NumVertices, FullBytes, PackedBytes, EncodeMS);
+			CORE_INFO("    max error: position {0}, uv {1}, normal {2:.4f} deg (mean {3:.4f}), tangent {4:.4f} deg, binormal {5:.4f} deg, {6} handedness flips",
+				Error.MaxPositionError, Error.MaxTexcoordError, Error.MaxNormalDegrees, Error.MeanNormalDegrees,
+				Error.MaxTangentDegrees, Error.MaxBinormalDegrees, Error.NumHandednessFlips);
+
+			Rows.push_back(FormatRow(Scene.Path, NumVertices, FullBytes, PackedBytes, EncodeMS, Error.MaxPositionError, Error.MaxTexcoordError,
+				Error.MaxNormalDegrees, Error.MeanNormalDegrees, Error.MaxTangentDegrees, Error.MaxBinormalDegrees, Error.NumHandednessFlips));
+		}
+
+		WriteBenchmarkResults("vertex_packing_stats", "scene vertices full_bytes packed_bytes encode_ms max_pos_err max_uv_err max_normal_deg "
+			"mean_normal_deg max_tangent_deg max_binormal_deg handedness_flips", Rows);
+	}
+
+	void RunMeshletBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== MESHLET BVH BENCHMARK ====");
+
+		const uint32_t NumRays = 100000;
+		const uint32_t TriangleLeafSize = 4;
+
+		std::vector<std::string> Rows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			::Scene BenchScene;
+			if (!LoadBenchmarkScene(Scene, BenchScene))
+				continue;
+
+			double MeshletMS = TimeMS([&]() { BenchScene.BuildMeshlets(); });
+
+			const SceneGeometry& Geometry = BenchScene.Geometry;
+			Span<const Vector3f> Positions = Geometry.GetPositions();
+			Span<const uint32_t> Indices = Geometry.GetIndices();
+			uint32_t NumTriangles = Geometry.GetNumTriangles();
+
+			// Meshlets are per mesh, every object gets its own world space copy of the cluster bounds
+			struct ClusterRef
+			{
+				uint32_t ObjectIndex;
+				uint32_t MeshletIndex;
+			};
+
+			std::vector<ClusterRef> Clusters;
+			uint64_t NumCullableCones = 0;
+			for (uint32_t i = 0; i < BenchScene.GetNumSceneObjects(); i++)
+			{
+				const MeshletData& Data = *BenchScene.SceneObjects[i].Mesh.Meshlets;
+				for (uint32_t m = 0; m < Data.Meshlets.size(); m++)
+				{
+					Clusters.push_back({ i, m });
+					NumCullableCones += Data.Meshlets[m].ConeCutoff > 0.0f ? 1 : 0;
+				}
+			}
+
+			CORE_INFO("{0}: {1} meshlets for {2} triangles, {3:.1f} triangles per meshlet, {4:.1f}% with a usable normal cone, built in {5:.1f} ms",
+				Scene.Path, Clusters.size(), NumTriangles, static_cast<double>(NumTriangles) / Math::max(Clusters.size(), size_t(1)),
+				100.0 * NumCullableCones / Math::max(Clusters.size(), size_t(1)), MeshletMS);
+
+			BVH TriangleBVH;
+			double TriangleBuildMS = TimeMS([&]()
+			{
+				std::vector<BoundingBox> Bounds(NumTriangles);
+				for (uint32_t t = 0; t < NumTriangles; t++)
+				{
+					for (uint32_t k = 0; k < 3; k++)
+						Bounds[t].Grow(Positions[Indices[static_cast<size_t>(t) * 3 + k]]);
+				}
+
+				TriangleBVH.Build(Span<const BoundingBox>(Bounds.data(), Bounds.size()), TriangleLeafSize);
+			});
+
+			BVH ClusterBVH;
+			double ClusterBuildMS = TimeMS([&]()
+			{
+				std::vector<BoundingBox> Bounds(Clusters.size());
+				for (size_t c = 0; c < Clusters.size(); c++)
+				{
+					const MeshletData& Data = *BenchScene.SceneObjects[Clusters[c].ObjectIndex].Mesh.Meshlets;
+					const Meshlet& Cluster = Data.Meshlets[Clusters[c].MeshletIndex];
+					uint32_t FirstVertex = Geometry.GetMeshFirstVertex(Clusters[c].ObjectIndex);
+
+					for (uint32_t v = 0; v < Cluster.VertexCount; v++)
+						Bounds[c].Grow(Positions[FirstVertex + Data.VertexIndices[Cluster.VertexOffset + v]]);
+				}
+
+				ClusterBVH.Build(Span<const BoundingBox>(Bounds.data(), Bounds.size()), 1);
+			});
+
+			// Same seeded rays for both trees
+			std::vector<Vector3f> Origins;
+			std::vector<Vector3f> Directions;
+			GenerateRays(Positions, NumRays, Origins, Directions);
+
+			auto const TestTriangle = [&](uint32_t Ray, uint32_t Triangle, float& TMax)
+			{
+				size_t Base = static_cast<size_t>(Triangle) * 3;
+				return IntersectTriangle(Origins[Ray], Directions[Ray], Positions[Indices[Base]], Positions[Indices[Base + 1]], Positions[Indices[Base + 2]], TMax);
+			};
+
+			std::vector<float> TriangleHits(NumRays);
+			BVHTraversalStats TriangleStats;
+			double TriangleTraceMS = TimeMS([&]()
+			{
+				for (uint32_t r = 0; r < NumRays; r++)
+				{
+					float TMax = std::numeric_limits<float>::max();
+					TriangleBVH.Traverse(Origins[r], Directions[r], TMax, [&](uint32_t Triangle, float& T) { return TestTriangle(r, Triangle, T); }, TriangleStats);
+					TriangleHits[r] = TMax;
+				}
+			});
+
+			// Cluster leaves count a test per triangle of the meshlet rather than one per primitive
+			uint64_t ClusterTrianglesTested = 0;
+			uint32_t NumMismatches = 0;
+			BVHTraversalStats ClusterStats;
+			double ClusterTraceMS = TimeMS([&]()
+			{
+				for (uint32_t r = 0; r < NumRays; r++)
+				{
+					float TMax = std::numeric_limits<float>::max();
+					ClusterBVH.Traverse(Origins[r], Directions[r], TMax, [&](uint32_t ClusterIndex, float& T)
+					{
+						const ClusterRef& Ref = Clusters[ClusterIndex];
+						const MeshletData& Data = *BenchScene.SceneObjects[Ref.ObjectIndex].Mesh.Meshlets;
+						const Meshlet& Cluster = Data.Meshlets[Ref.MeshletIndex];
+						uint32_t FirstVertex = Geometry.GetMeshFirstVertex(Ref.ObjectIndex);
+
+						bool Hit = false;
+						for (uint32_t t = 0; t < Cluster.TriangleCount; t++)
+						{
+							size_t Base = (static_cast<size_t>(Cluster.TriangleOffset) + t) * 3;
+							const uint32_t* Local = Data.VertexIndices.data() + Cluster.VertexOffset;
+							Hit |= IntersectTriangle(Origins[r], Directions[r],
+								Positions[FirstVertex + Local[Data.LocalIndices[Base]]],
+								Positions[FirstVertex + Local[Data.LocalIndices[Base + 1]]],
+								Positions[FirstVertex + Local[Data.LocalIndices[Base + 2]]], T);
+						}
+
+						ClusterTrianglesTested += Cluster.TriangleCount;
+						return Hit;
+					}, ClusterStats);
+
+					NumMismatches += TMax != TriangleHits[r] ? 1 : 0;
+				}
+			});
+
+			if (NumMismatches > 0)
+				CORE_WARN("{0} of {1} rays hit at a different distance with meshlet leaves", NumMismatches, NumRays);
+
+			double TriangleNodesPerRay = static_cast<double>(TriangleStats.NodesVisited) / NumRays;
+			double TriangleTestsPerRay = static_cast<double>(TriangleStats.PrimitivesTested) / NumRays;
+			double ClusterNodesPerRay = static_cast<double>(ClusterStats.NodesVisited) / NumRays;
+			double ClusterTestsPerRay = static_cast<double>(ClusterTrianglesTested) / NumRays;
+
+			CORE_INFO("    triangle leaves: {0} nodes, depth {1}, build {2:.1f} ms, {3:.1f} nodes and {4:.1f} triangles per ray, trace {5:.1f} ms",
+				TriangleBVH.GetNumNodes(), TriangleBVH.GetDepth(), TriangleBuildMS, TriangleNodesPerRay, TriangleTestsPerRay, TriangleTraceMS);
+			CORE_INFO("    meshlet leaves:  {0} nodes, depth {1}, build {2:.1f} ms, {3:.1f} nodes and {4:.1f} triangles per ray, trace {5:.1f} ms",
+				ClusterBVH.GetNumNodes(), ClusterBVH.GetDepth(), ClusterBuildMS, ClusterNodesPerRay, ClusterTestsPerRay, ClusterTraceMS);
+
+			Rows.push_back(FormatRow(Scene.Path, "triangles", NumTriangles, TriangleBVH.GetNumNodes(), TriangleBVH.GetDepth(), 0.0, TriangleBuildMS,
+				TriangleNodesPerRay, TriangleTestsPerRay, TriangleTraceMS, 0));
+			Rows.push_back(FormatRow(Scene.Path, "meshlets", Clusters.size(), ClusterBVH.GetNumNodes(), ClusterBVH.GetDepth(), MeshletMS, ClusterBuildMS,
+				ClusterNodesPerRay, ClusterTestsPerRay, ClusterTraceMS, NumMismatches));
+		}
+
+		WriteBenchmarkResults("meshlet_bvh_stats", "scene leaves primitives nodes depth meshlet_ms build_ms nodes_per_ray triangles_per_ray trace_ms "
+			"mismatches", Rows);
+	}
+
+	void RunMeshLODBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== MESH LOD BENCHMARK ====");
+
+		const uint32_t NumRays = 100000;
+		const uint32_t LeafSize = 4;
+		const float PixelErrors[] = { 0.5f, 1.0f, 2.0f, 4.0f };
+
+		std::vector<std::string> Rows;
+		std::vector<std::string> SelectionRows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			::Scene BenchScene;
+			if (!LoadBenchmarkScene(Scene, BenchScene))
+				continue;
+
+			MeshSimplifier::SimplifySettings Settings;
+			double LODMS = TimeMS([&]() { BenchScene.BuildLODs(Settings); });
+
+			const SceneGeometry& Geometry = BenchScene.Geometry;
+			Span<const Vector3f> Positions = Geometry.GetPositions();
+			uint32_t NumObjects = BenchScene.GetNumSceneObjects();
+
+			std::vector<Vector3f> Origins;
+			std::vector<Vector3f> Directions;
+			GenerateRays(Positions, NumRays, Origins, Directions);
+
+			CORE_INFO("{0}: LOD chains for {1} objects built in {2:.1f} ms", Scene.Path, NumObjects, LODMS);
+
+			// Every object at the same LOD, or its coarsest one if the chain is shorter
+			for (uint32_t LOD = 0; LOD <= Settings.MaxLevels; LOD++)
+			{
+				std::vector<uint32_t> Indices;
+				float MaxError = 0.0f;
+				for (uint32_t i = 0; i < NumObjects; i++)
+				{
+					const StaticMesh& Mesh = BenchScene.SceneObjects[i].Mesh;
+					uint32_t Level = Math::min(LOD, Mesh.LODs->GetNumLODs() - 1);
+					uint32_t FirstVertex = Geometry.GetMeshFirstVertex(i);
+
+					if (Level == 0)
+					{
+						for (uint32_t Index : Mesh.Indices)
+							Indices.push_back(Index + FirstVertex);
+					}
+					else
+					{
+						const MeshLODLevel& LODLevel = Mesh.LODs->Levels[Level - 1];
+						for (uint32_t Index : LODLevel.Indices)
+							Indices.push_back(Index + FirstVertex);
+
+						MaxError = Math::max(MaxError, LODLevel.Error);
+					}
+				}
+
+				uint32_t NumTriangles = static_cast<uint32_t>(Indices.size() / 3);
+
+				BVH LODBVH;
+				double BuildMS = TimeMS([&]()
+				{
+					std::vector<BoundingBox> Bounds(NumTriangles);
+					for (uint32_t t = 0; t < NumTriangles; t++)
+					{
+						for (uint32_t k = 0; k < 3; k++)
+							Bounds[t].Grow(Positions[Indices[static_cast<size_t>(t) * 3 + k]]);
+					}
+
+					LODBVH.Build(Span<const BoundingBox>(Bounds.data(), Bounds.size()), LeafSize);
+				});
+
+				BVHTraversalStats Stats;
+				double TraceMS = TimeMS([&]()
+				{
+					for (uint32_t r = 0; r < NumRays; r++)
+					{
+						float TMax = std::numeric_limits<float>::max();
+						LODBVH.Traverse(Origins[r], Directions[r], TMax, [&](uint32_t Triangle, float& T)
+						{
+							size_t Base = static_cast<size_t>(Triangle) * 3;
+							return IntersectTriangle(Origins[r], Directions[r], Positions[Indices[Base]], Positions[Indices[Base + 1]], Positions[Indices[Base + 2]], T);
+						}, Stats);
+					}
+				});
+
+				double NodesPerRay = static_cast<double>(Stats.NodesVisited) / NumRays;
+				double TrianglesPerRay = static_cast<double>(Stats.PrimitivesTested) / NumRays;
+
+				CORE_INFO("    LOD {0}: {1} triangles, max error {2:.4f}, BVH build {3:.1f} ms, {4:.1f} nodes and {5:.1f} triangles per ray, trace {6:.1f} ms",
+					LOD, NumTriangles, MaxError, BuildMS, NodesPerRay, TrianglesPerRay, TraceMS);
+
+				Rows.push_back(FormatRow(Scene.Path, LOD, NumTriangles, MaxError, LODMS, BuildMS, NodesPerRay, TrianglesPerRay, TraceMS));
+			}
+
+			// A foveated view from the middle of the scene, traced through the two level structure with every instance at LOD 0
+			// and at the LOD SelectLODs picks for where it is seen
+			BoundingBox SceneBounds;
+			for (size_t v = 0; v < Positions.size(); v++)
+				SceneBounds.Grow(Positions[v]);
+
+			CPUTopLevelAS TwoLevel;
+			TwoLevel.Build(BenchScene);
+
+			PrimaryRayCamera Camera;
+			Camera.Foveation.LaunchWidth = 640.0f;
+			Camera.Foveation.LaunchHeight = 360.0f;
+			Camera.Position = SceneBounds.GetCenter();
+
+			std::vector<RayPacket> Packets;
+			LogPolarRays::BuildPackets(Camera, LogPolarRays::PacketSettings(), Packets);
+
+			auto const TraceView = [&](std::vector<float>& OutHits)
+			{
+				OutHits.clear();
+				BVHTraversalStats Stats;
+				return TimeMS([&]()
+				{
+					for (const RayPacket& Packet : Packets)
+					{
+						for (uint32_t r = 0; r < Packet.NumRays; r++)
+						{
+							Vector3f Origin(Packet.OriginX[r], Packet.OriginY[r], Packet.OriginZ[r]);
+							Vector3f Direction(Packet.DirectionX[r], Packet.DirectionY[r], Packet.DirectionZ[r]);
+
+							CPURayHit Hit;
+							OutHits.push_back(TwoLevel.TraceClosest(Origin, Direction, Packet.TMax[r], Hit, Stats) ? Hit.T : -1.0f);
+						}
+					}
+				});
+			};
+
+			std::vector<float> FullHits;
+			double FullMS = TraceView(FullHits);
+			const uint32_t FullTriangles = TwoLevel.GetBuildStats().NumSelectedTriangles;
+
+			for (float PixelError : PixelErrors)
+			{
+				uint32_t NumSimplified = TwoLevel.SelectLODs(Camera, PixelError);
+				const uint32_t NumTriangles = TwoLevel.GetBuildStats().NumSelectedTriangles;
+
+				std::vector<float> LODHits;
+				double LODMS = TraceView(LODHits);
+
+				// Rays that found geometry with one and not the other, the distances are expected to move a little
+				uint32_t NumMismatches = 0;
+				for (size_t r = 0; r < FullHits.size(); r++)
+					NumMismatches += (FullHits[r] < 0.0f) != (LODHits[r] < 0.0f) ? 1 : 0;
+
+				CORE_INFO("    {0} pixel error: {1} of {2} instances simplified, {3} of {4} triangles, trace {5:.1f} ms instead of {6:.1f} ms, {7} hits changed",
+					PixelError, NumSimplified, TwoLevel.GetNumInstances(), NumTriangles, FullTriangles, LODMS, FullMS, NumMismatches);
+				SelectionRows.push_back(FormatRow(Scene.Path, PixelError, NumSimplified, NumTriangles, FullTriangles, FullHits.size(), FullMS, LODMS,
+					NumMismatches));
+			}
+		}
+
+		WriteBenchmarkResults("mesh_lod_stats", "scene lod triangles max_error lod_build_ms bvh_build_ms nodes_per_ray triangles_per_ray trace_ms", Rows);
+		WriteBenchmarkResults("mesh_lod_selection", "scene pixel_error simplified_instances triangles full_triangles rays full_ms lod_ms "
+			"hit_mismatches", SelectionRows);
+	}
+
+	void RunTextureDecodeBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== TEXTURE DECODE BENCHMARK ====");
+
+		std::vector<std::string> Rows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			GeometryArena Arena;
+			std::vector<StaticMesh> Meshes;
+			std::vector<MeshInstance> Instances;
+			if (!Utils::LoadStaticMeshes(Scene.Path, Arena, Meshes, Instances, Scene.GenVertexNormals))
+			{
+				CORE_ERROR("Skipping {0}, load failed", Scene.Path);
+				continue;
+			}
+
+			// Every texture reference the tracer would load, duplicates included
+			std::vector<std::string> References;
+			for (const StaticMesh& Mesh : Meshes)
+			{
+				const Material& Mat = Mesh.MeshMaterial;
+				std::string Paths[3] = { Mat.TexturePath, Mat.NormalMapPath, Mesh.HasTransparency ? Mat.OpacityMapPath : std::string() };
+				for (const std::string& Path : Paths)
+				{
+					if (!Path.empty())
+						References.push_back(Path);
+				}
+			}
+
+			std::vector<std::string> UniquePaths;
+			{
+				std::unordered_map<std::string, std::string> Unique;
+				for (const std::string& Path : References)
+					Unique.emplace(TextureCache::NormalizePath(Path), Path);
+
+				for (auto const& Entry : Unique)
+					UniquePaths.push_back(Entry.second);
+			}
+
+			// Serial baseline decodes every file once on this thread, like the old load path at best
+			uint64_t DecodedBytes = 0;
+			double SerialMS = TimeMS([&]()
+			{
+				for (const std::string& Path : UniquePaths)
+					DecodedBytes += Utils::LoadTexture(Path, 4).pixels.Size();
+			});
+
+			// Decode only, same work as the serial baseline
+			TextureCacheSettings DecodeOnly;
+			DecodeOnly.GenerateMips = false;
+			DecodeOnly.UseDiskCache = false;
+
+			uint32_t NumDecodes = 0;
+			double CacheMS = TimeMS([&]()
+			{
+				TextureCache Cache(DecodeOnly);
+				std::vector<TextureHandle> Handles;
+				Handles.reserve(References.size());
+				for (const std::string& Path : References)
+					Handles.push_back(Cache.Request(Path));
+
+				for (const TextureHandle& Handle : Handles)
+					Handle.Get();
+
+				NumDecodes = Cache.GetNumDecodes();
+			});
+
+			if (NumDecodes != UniquePaths.size())
+				CORE_ERROR("Texture cache decoded {0} files, expected {1}", NumDecodes, UniquePaths.size());
+
+			uint32_t NumThreads = ThreadPool::GetGlobal().GetNumThreads();
+			CORE_INFO("{0}: {1} references to {2} textures, {3:.1f} MB decoded, serial {4:.1f} ms, cache {5:.1f} ms ({6:.1f}x on {7} threads)",
+				Scene.Path, References.size(), UniquePaths.size(), DecodedBytes / (1024.0 * 1024.0), SerialMS, CacheMS, SerialMS / Math::max(CacheMS, 0.001), NumThreads);
+
+			Rows.push_back(FormatRow(Scene.Path, References.size(), UniquePaths.size(), DecodedBytes, SerialMS, CacheMS, SerialMS / Math::max(CacheMS, 0.001),
+				NumThreads));
+		}
+
+		WriteBenchmarkResults("texture_decode_times", "scene references unique_textures decoded_bytes serial_ms cache_ms speedup threads", Rows);
+	}
+
+	void RunTextureFormatBenchmark()
+	{
+		CORE_WARN("==== TEXTURE FORMAT BENCHMARK ====");
+
+		std::vector<std::string> Rows;
+
+		// Odd width so no SIMD path ends on a block boundary
+		const size_t Width = 4093;
+		const size_t Height = 4096;
+		const size_t NumPixels = Width * Height;
+		const uint32_t NumRuns = 5;
+
+		std::mt19937 Rng(1234);
+		std::vector<uint8_t> Source(NumPixels * 4);
+		for (uint8_t& Byte : Source)
+			Byte = static_cast<uint8_t>(Rng());
+
+		std::vector<uint8_t> Reference(NumPixels * 4);
+		std::vector<uint8_t> Result(NumPixels * 4);
+
+		const TextureFormat::SimdLevel Supported = TextureFormat::GetSupportedSimdLevel();
+		CORE_INFO("CPU supports {0}", TextureFormat::GetSimdLevelName(Supported));
+
+		for (uint32_t Channels = 1; Channels <= 4; Channels++)
+		{
+			TextureFormat::ExpandFunc ScalarExpand = TextureFormat::GetExpander(Channels, TextureFormat::SimdLevel::Scalar);
+			ScalarExpand(Source.data(), Reference.data(), NumPixels);
+
+			double ScalarMS = 0.0;
+			for (uint32_t Level = 0; Level <= static_cast<uint32_t>(Supported); Level++)
+			{
+				TextureFormat::ExpandFunc Expand = TextureFormat::GetExpander(Channels, static_cast<TextureFormat::SimdLevel>(Level));
+
+				// Short images cover the scalar tails, each is written into a copy of the source so any overrun shows up
+				uint32_t Mismatches = 0;
+				for (size_t Count = 0; Count < 67; Count++)
+				{
+					std::vector<uint8_t> Small(Source.begin(), Source.begin() + Count * Channels);
+					std::vector<uint8_t> Out(Count * 4 + 64, 0xCD);
+					Expand(Small.data(), Out.data(), Count);
+
+					bool Matches = memcmp(Out.data(), Reference.data(), Count * 4) == 0;
+					for (size_t i = Count * 4; i < Out.size(); i++)
+						Matches = Matches && Out[i] == 0xCD;
+
+					if (!Matches)
+						Mismatches++;
+				}
+
+				double BestMS = std::numeric_limits<double>::max();
+				for (uint32_t Run = 0; Run < NumRuns; Run++)
+					BestMS = Math::min(BestMS, TimeMS([&]() { Expand(Source.data(), Result.data(), NumPixels); }));
+
+				if (memcmp(Result.data(), Reference.data(), NumPixels * 4) != 0)
+					Mismatches++;
+
+				if (Level == 0)
+					ScalarMS = BestMS;
+
+				// Bytes read plus bytes written
+				double GBps = (NumPixels * (Channels + 4)) / (Math::max(BestMS, 0.001) * 1e6);
+				const char* LevelName = TextureFormat::GetSimdLevelName(static_cast<TextureFormat::SimdLevel>(Level));
+
+				if (Mismatches > 0)
+					CORE_ERROR("{0} channel {1} expander differs from the scalar one in {2} cases", Channels, LevelName, Mismatches);
+
+				CORE_INFO("{0} -> 4 channels {1}: {2:.2f} ms, {3:.2f} GB/s, {4:.2f}x scalar", Channels, LevelName, BestMS, GBps, ScalarMS / Math::max(BestMS, 0.001));
+
+				Rows.push_back(FormatRow(Channels, LevelName, NumPixels, BestMS, GBps, ScalarMS / Math::max(BestMS, 0.001), Mismatches));
+			}
+		}
+
+		WriteBenchmarkResults("texture_format_throughput", "channels level pixels ms gbps speedup mismatches", Rows);
+	}
+
+	void RunTextureMipBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== TEXTURE MIP BENCHMARK ====");
+
+		std::vector<std::string> Rows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			GeometryArena Arena;
+			std::vector<StaticMesh> Meshes;
+			std::vector<MeshInstance> Instances;
+			if (!Utils::LoadStaticMeshes(Scene.Path, Arena, Meshes, Instances, Scene.GenVertexNormals))
+			{
+				CORE_ERROR("Skipping {0}, load failed", Scene.Path);
+				continue;
+			}
+
+			std::unordered_map<std::string, std::string> Unique;
+			for (const StaticMesh& Mesh : Meshes)
+			{
+				const Material& Mat = Mesh.MeshMaterial;
+				std::string Paths[3] = { Mat.TexturePath, Mat.NormalMapPath, Mesh.HasTransparency ? Mat.OpacityMapPath : std::string() };
+				for (const std::string& Path : Paths)
+				{
+					if (!Path.empty())
+						Unique.emplace(TextureCache::NormalizePath(Path), Path);
+				}
+			}
+
+			std::vector<TextureInfo> Decoded;
+			for (auto const& Entry : Unique)
+				Decoded.push_back(Utils::LoadTexture(Entry.second, 4));
+
+			uint64_t Level0Bytes = 0;
+			uint64_t ChainBytes = 0;
+			for (const TextureInfo& Info : Decoded)
+			{
+				Level0Bytes += Info.pixels.Size();
+				ChainBytes += TextureMips::GetMipChainSize(Info.width, Info.height, TextureMips::GetNumMipLevels(Info.width, Info.height));
+			}
+
+			// Every configuration works on fresh copies of the decoded level 0
+			double FilterMS[4] = {};
+			for (uint32_t Config = 0; Config < 4; Config++)
+			{
+				TextureMips::MipSettings Settings;
+				Settings.Filter = Config < 2 ? TextureMips::MipFilter::Box : TextureMips::MipFilter::Kaiser;
+				Settings.SRGB = (Config & 1) != 0;
+
+				for (const TextureInfo& Info : Decoded)
+				{
+					TextureInfo Copy = Info;
+					FilterMS[Config] += TimeMS([&]() { TextureMips::GenerateMipChain(Copy, Settings); });
+				}
+			}
+
+			// Cold decodes and writes a fresh disk cache, warm then maps those entries back in
+			TextureCacheSettings CacheSettings;
+			CacheSettings.DiskCacheDirectory = "../Data/TextureMipBenchmarkCache";
+
+			std::error_code Error;
+			std::filesystem::remove_all(CacheSettings.DiskCacheDirectory, Error);
+
+			uint64_t DiskBytes = 0;
+			auto LoadAll = [&]()
+			{
+				return TimeMS([&]()
+				{
+					TextureCache Cache(CacheSettings);
+					std::vector<TextureHandle> Handles;
+					for (auto const& Entry : Unique)
+						Handles.push_back(Cache.Request(Entry.second));
+
+					for (const TextureHandle& Handle : Handles)
+						Handle.Get();
+
+					DiskBytes = Cache.GetDiskCache()->GetSizeInBytes();
+				});
+			};
+
+			double ColdMS = LoadAll();
+			double WarmMS = LoadAll();
+
+			CORE_INFO("{0}: {1} textures, {2:.1f} MB level 0, {3:.1f} MB with mips", Scene.Path, Unique.size(), Level0Bytes / (1024.0 * 1024.0), ChainBytes / (1024.0 * 1024.0));
+			CORE_INFO("Mips box {0:.1f} ms, box sRGB {1:.1f} ms, Kaiser {2:.1f} ms, Kaiser sRGB {3:.1f} ms", FilterMS[0], FilterMS[1], FilterMS[2], FilterMS[3]);
+			CORE_INFO("Cache load cold {0:.1f} ms, warm {1:.1f} ms, {2:.1f} MB on disk", ColdMS, WarmMS, DiskBytes / (1024.0 * 1024.0));
+
+			std::filesystem::remove_all(CacheSettings.DiskCacheDirectory, Error);
+
+			Rows.push_back(FormatRow(Scene.Path, Unique.size(), Level0Bytes, ChainBytes, FilterMS[0], FilterMS[1], FilterMS[2], FilterMS[3], ColdMS, WarmMS,
+				DiskBytes));
+		}
+
+		WriteBenchmarkResults("texture_mip_times", "scene textures level0_bytes chain_bytes box_ms box_srgb_ms kaiser_ms kaiser_srgb_ms cold_load_ms "
+			"warm_load_ms disk_bytes", Rows);
+	}
+
+	void RunTextureCompressionBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== TEXTURE COMPRESSION BENCHMARK ====");
+
+		std::vector<std::string> Rows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			GeometryArena Arena;
+			std::vector<StaticMesh> Meshes;
+			std::vector<MeshInstance> Instances;
+			if (!Utils::LoadStaticMeshes(Scene.Path, Arena, Meshes, Instances, Scene.GenVertexNormals))
+			{
+				CORE_ERROR("Skipping {0}, load failed", Scene.Path);
+				continue;
+			}
+
+			std::unordered_map<std::string, std::string> Unique;
+			for (const StaticMesh& Mesh : Meshes)
+			{
+				const Material& Mat = Mesh.MeshMaterial;
+				std::string Paths[3] = { Mat.TexturePath, Mat.NormalMapPath, Mesh.HasTransparency ? Mat.OpacityMapPath : std::string() };
+				for (const std::string& Path : Paths)
+				{
+					if (!Path.empty())
+						Unique.emplace(TextureCache::NormalizePath(Path), Path);
+				}
+			}
+
+			// Both runs build the same mip chains, only KeepBlockCompressed differs
+			TextureCacheSettings Settings;
+			Settings.UseDiskCache = false;
+			Settings.Compress = false;
+
+			uint32_t NumNative = 0;
+			double TimesMS[2] = {};
+			uint64_t ResidentBytes[2] = {};
+			for (uint32_t Config = 0; Config < 2; Config++)
+			{
+				Settings.KeepBlockCompressed = Config == 1;
+
+				for (auto const& Entry : Unique)
+				{
+					TextureInfo Info;
+					TimesMS[Config] += TimeMS([&]() { Info = TextureCache::LoadTexture(Entry.second, TextureFormat::TextureUsage::Albedo, Settings, nullptr); });
+					ResidentBytes[Config] += Info.pixels.Size();
+
+					if (Config == 1 && TextureFormat::IsBlockCompressed(Info.format))
+						NumNative++;
+				}
+			}
+
+			double Ratio = static_cast<double>(ResidentBytes[0]) / Math::max(ResidentBytes[1], static_cast<uint64_t>(1));
+
+			CORE_INFO("{0}: {1} textures, {2} kept block compressed", Scene.Path, Unique.size(), NumNative);
+			CORE_INFO("RGBA8 {0:.1f} ms, {1:.1f} MB, native {2:.1f} ms, {3:.1f} MB ({4:.2f}x smaller)", TimesMS[0], ResidentBytes[0] / (1024.0 * 1024.0),
+				TimesMS[1], ResidentBytes[1] / (1024.0 * 1024.0), Ratio);
+
+			Rows.push_back(FormatRow(Scene.Path, Unique.size(), NumNative, TimesMS[0], ResidentBytes[0], TimesMS[1], ResidentBytes[1], Ratio));
+		}
+
+		WriteBenchmarkResults("texture_compression", "scene textures native rgba8_ms rgba8_bytes native_ms native_bytes ratio", Rows);
+	}
+
+	void RunTextureEncodeBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== TEXTURE ENCODE BENCHMARK ====");
+
+		std::vector<std::string> Rows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			GeometryArena Arena;
+			std::vector<StaticMesh> Meshes;
+			std::vector<MeshInstance> Instances;
+			if (!Utils::LoadStaticMeshes(Scene.Path, Arena, Meshes, Instances, Scene.GenVertexNormals))
+			{
+				CORE_ERROR("Skipping {0}, load failed", Scene.Path);
+				continue;
+			}
+
+			std::unordered_map<std::string, std::pair<std::string, TextureFormat::TextureUsage>> Unique;
+			for (const StaticMesh& Mesh : Meshes)
+			{
+				const Material& Mat = Mesh.MeshMaterial;
+				std::string Paths[3] = { Mat.TexturePath, Mat.NormalMapPath, Mesh.HasTransparency ? Mat.OpacityMapPath : std::string() };
+				TextureFormat::TextureUsage Usages[3] = { TextureFormat::TextureUsage::Albedo, TextureFormat::TextureUsage::Normal, TextureFormat::TextureUsage::Opacity };
+				for (uint32_t i = 0; i < 3; i++)
+				{
+					if (!Paths[i].empty())
+						Unique.emplace(TextureCache::GetKey(TextureCache::NormalizePath(Paths[i]), Usages[i]), std::make_pair(Paths[i], Usages[i]));
+				}
+			}
+
+			// The same chains the texture cache would compress, DDS files decompressed as well so they get encoded too
+			TextureCacheSettings Settings;
+			Settings.UseDiskCache = false;
+			Settings.KeepBlockCompressed = false;
+			Settings.Compress = false;
+
+			uint32_t NumEncoded = 0;
+			uint64_t TotalPixels = 0;
+			double TotalMS = 0.0;
+			double TotalPSNR = 0.0;
+
+			for (auto const& Entry : Unique)
+			{
+				const TextureInfo Source = TextureCache::LoadTexture(Entry.second.first, Entry.second.second, Settings, nullptr);
+
+				std::vector<DXGI_FORMAT> Formats = { TextureCompression::ChooseFormat(Source, Entry.second.second, false) };
+				if (Entry.second.second == TextureFormat::TextureUsage::Albedo)
+					Formats.push_back(TextureCompression::ChooseFormat(Source, Entry.second.second, true));
+
+				for (DXGI_FORMAT Format : Formats)
+				{
+					TextureInfo Compressed = Source;
+					TextureCompression::CompressionStats Stats;
+					if (Format == DXGI_FORMAT_UNKNOWN || !TextureCompression::CompressTexture(Compressed, Format, &Stats))
+						continue;
+
+					double MPixelsPerSecond = Stats.NumPixels / (Math::max(Stats.EncodeMS, 0.001) * 1000.0);
+					const char* UsageName = TextureFormat::GetUsageName(Entry.second.second);
+					const char* FormatName = TextureCompression::GetFormatName(Format);
+
+					CORE_TRACE("{0} ({1}) to {2}: {3:.1f} ms, {4:.1f} MPixel/s, PSNR {5:.2f} dB", Entry.second.first, UsageName, FormatName, Stats.EncodeMS, MPixelsPerSecond, Stats.PSNR);
+
+					Rows.push_back(FormatRow(Scene.Path, Entry.second.first, UsageName, FormatName, Stats.NumPixels, Compressed.pixels.Size(), Stats.EncodeMS,
+						MPixelsPerSecond, Stats.PSNR));
+
+					NumEncoded++;
+					TotalPixels += Stats.NumPixels;
+					TotalMS += Stats.EncodeMS;
+					TotalPSNR += Stats.PSNR;
+				}
+			}
+
+			CORE_INFO("{0}: {1} encodes of {2} textures, {3:.1f} MPixel/s on average, mean PSNR {4:.2f} dB", Scene.Path, NumEncoded, Unique.size(),
+				TotalPixels / (Math::max(TotalMS, 0.001) * 1000.0), TotalPSNR / Math::max(NumEncoded, 1u));
+		}
+
+		WriteBenchmarkResults("texture_encode", "scene texture usage format pixels bytes ms mpixels_per_s psnr", Rows);
+	}
+
+	void RunTextureCopyBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== TEXTURE COPY BENCHMARK ====");
+
+		// Only growing the chain behind an adopted level 0 should ever have to copy texels
+		const uint64_t MaxCopiesPerLoad = 1;
+
+		std::vector<std::string> Rows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			GeometryArena Arena;
+			std::vector<StaticMesh> Meshes;
+			std::vector<MeshInstance> Instances;
+			if (!Utils::LoadStaticMeshes(Scene.Path, Arena, Meshes, Instances, Scene.GenVertexNormals))
+			{
+				CORE_ERROR("Skipping {0}, load failed", Scene.Path);
+				continue;
+			}
+
+			std::unordered_map<std::string, std::pair<std::string, TextureFormat::TextureUsage>> Unique;
+			for (const StaticMesh& Mesh : Meshes)
+			{
+				const Material& Mat = Mesh.MeshMaterial;
+				std::string Paths[3] = { Mat.TexturePath, Mat.NormalMapPath, Mesh.HasTransparency ? Mat.OpacityMapPath : std::string() };
+				TextureFormat::TextureUsage Usages[3] = { TextureFormat::TextureUsage::Albedo, TextureFormat::TextureUsage::Normal, TextureFormat::TextureUsage::Opacity };
+				for (uint32_t i = 0; i < 3; i++)
+				{
+					if (!Paths[i].empty())
+						Unique.emplace(TextureCache::GetKey(TextureCache::NormalizePath(Paths[i]), Usages[i]), std::make_pair(Paths[i], Usages[i]));
+				}
+			}
+
+			// Cold decodes and writes a fresh disk cache, warm maps the entries back in
+			TextureCacheSettings CacheSettings;
+			CacheSettings.DiskCacheDirectory = "../Data/TextureCopyBenchmarkCache";
+
+			std::error_code Error;
+			std::filesystem::remove_all(CacheSettings.DiskCacheDirectory, Error);
+
+			const char* PassNames[2] = { "cold", "warm" };
+			for (uint32_t Pass = 0; Pass < 2; Pass++)
+			{
+				TextureCache Cache(CacheSettings);
+				std::unordered_map<std::string, TextureResource> Textures;
+
+				uint64_t NumCopies = 0;
+				uint64_t NumCopiedBytes = 0;
+				uint64_t MaxCopies = 0;
+				uint32_t NumFailed = 0;
+
+				// One load at a time, the copy counters are shared by every thread
+				for (auto const& Entry : Unique)
+				{
+					const uint64_t CopiesBefore = ImageBuffer::GetNumCopies();
+					const uint64_t BytesBefore = ImageBuffer::GetNumCopiedBytes();
+
+					// The same hops as Tracer::LoadTexture: the decode, its result into a resource, that into the map and back out by value
+					TextureResource NewTexture;
+					NewTexture.textureInfo = Cache.Request(Entry.second.first, Entry.second.second).Get();
+					Cache.Release(Entry.second.first, Entry.second.second);
+					const TextureResource Returned = Textures.insert_or_assign(Entry.first, std::move(NewTexture)).first->second;
+
+					const uint64_t Copies = ImageBuffer::GetNumCopies() - CopiesBefore;
+					NumCopies += Copies;
+					NumCopiedBytes += ImageBuffer::GetNumCopiedBytes() - BytesBefore;
+					MaxCopies = Math::max(MaxCopies, Copies);
+
+					if (Copies > MaxCopiesPerLoad)
+					{
+						CORE_ERROR("{0} ({1}) copied its pixels {2} times on the {3} load, expected at most {4}", Entry.second.first,
+							TextureFormat::GetUsageName(Entry.second.second), Copies, PassNames[Pass], MaxCopiesPerLoad);
+						NumFailed++;
+					}
+				}
+
+				CORE_INFO("{0} {1}: {2} loads, {3} pixel copies ({4:.1f} MB), at most {5} per load", Scene.Path, PassNames[Pass], Unique.size(), NumCopies,
+					NumCopiedBytes / (1024.0 * 1024.0), MaxCopies);
+
+				Rows.push_back(FormatRow(Scene.Path, PassNames[Pass], Unique.size(), NumCopies, NumCopiedBytes, MaxCopies, NumFailed));
+			}
+
+			std::filesystem::remove_all(CacheSettings.DiskCacheDirectory, Error);
+		}
+
+		WriteBenchmarkResults("texture_copies", "scene pass loads copies copied_bytes max_copies_per_load failed_loads", Rows);
+	}
+
+	void RunTextureResidencyBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== TEXTURE RESIDENCY BENCHMARK ====");
+
+		const float KernelAlphas[] = { 0.0f, 1.0f, 2.0f, 4.0f };	// 0 runs without foveation
+		const char* PoseNames[4] = { "+x", "-x", "+z", "-z" };
+		const Vector3f PoseDirections[4] = { Vector3f(1.0f, 0.0f, 0.0f), Vector3f(-1.0f, 0.0f, 0.0f), Vector3f(0.0f, 0.0f, 1.0f), Vector3f(0.0f, 0.0f, -1.0f) };
+
+		std::vector<std::string> Rows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			GeometryArena Arena;
+			std::vector<StaticMesh> Meshes;
+			std::vector<MeshInstance> Instances;
+			if (!Utils::LoadStaticMeshes(Scene.Path, Arena, Meshes, Instances, Scene.GenVertexNormals))
+			{
+				CORE_ERROR("Skipping {0}, load failed", Scene.Path);
+				continue;
+			}
+
+			// Chains as the tracer would upload them, the same mip bytes and top level limits as Tracer::AddAlbedoResidency
+			TextureCache Cache;
+			std::unordered_map<std::string, std::pair<std::vector<uint64_t>, uint32_t>> Textures;
+			for (const StaticMesh& Mesh : Meshes)
+			{
+				const std::string& Path = Mesh.MeshMaterial.TexturePath;
+				const std::string Key = TextureCache::GetKey(Path, TextureFormat::TextureUsage::Albedo);
+				if (Path.empty() || Textures.count(Key) > 0)
+					continue;
+
+				const TextureInfo& Info = Cache.Request(Path, TextureFormat::TextureUsage::Albedo).Get();
+
+				std::vector<uint64_t> MipBytes;
+				for (const TextureMip& Mip : Info.mips)
+					MipBytes.push_back(TextureFormat::GetSurfaceSize(Info.format, Mip.width, Mip.height));
+				if (MipBytes.empty())
+					MipBytes.push_back(TextureFormat::GetSurfaceSize(Info.format, Info.width, Info.height));
+
+				uint32_t MaxTopMip = Info.mips.empty() ? 0 : TextureResidency::GetMaxTopMip(Info.width, Info.height, static_cast<uint32_t>(Info.mips.size()),
+					TextureFormat::IsBlockCompressed(Info.format));
+
+				Textures.emplace(Key, std::make_pair(std::move(MipBytes), MaxTopMip));
+				Cache.Release(Path, TextureFormat::TextureUsage::Albedo);
+			}
+
+			BoundingBox SceneBounds;
+			std::vector<std::pair<std::string, BoundingBox>> Objects;
+			for (const MeshInstance& Instance : Instances)
+			{
+				const StaticMesh& Mesh = Meshes[Instance.MeshIndex];
+				if (Mesh.MeshMaterial.TexturePath.empty())
+					continue;
+
+				BoundingBox WorldBounds;
+				for (const Vertex& V : Mesh.Vertices)
+					WorldBounds.Grow(Instance.ObjectToWorld.TransformPoint(V.Position));
+
+				SceneBounds.Grow(WorldBounds);
+				Objects.emplace_back(TextureCache::GetKey(Mesh.MeshMaterial.TexturePath, TextureFormat::TextureUsage::Albedo), WorldBounds);
+			}
+
+			for (uint32_t Pose = 0; Pose < 4; Pose++)
+			{
+				for (float Alpha : KernelAlphas)
+				{
+					// Every texture starts whole and drops what the first estimate doesn't need
+					TextureResidency Residency;
+					TextureResidency::ResidencySettings Settings;
+					Settings.DowngradeDelayFrames = 1;
+					Settings.MaxChangesPerFrame = ~0u;
+					Settings.BatchFrames = 1;
+					Residency.SetSettings(Settings);
+
+					for (auto const& Texture : Textures)
+						Residency.AddTexture(Texture.first, Texture.second.first, Texture.second.second, 0);
+					for (auto const& Object : Objects)
+						Residency.AddObject(Object.first, Object.second);
+
+					TextureLODView View;
+					View.Position = SceneBounds.GetCenter();
+					View.Forward = PoseDirections[Pose];
+					View.Right = View.Up.Cross(View.Forward).Normalized();
+					View.Up = View.Forward.Cross(View.Right);
+					View.IsFoveated = Alpha > 0.0f;
+					View.Foveation.KernelAlpha = Alpha;
+
+					double UpdateMS = TimeMS([&]() { Residency.Update(View); });
+					const uint64_t FullBytes = Residency.GetFullChainBytes();
+					const uint64_t ResidentBytes = Residency.GetResidentBytes();
+
+					// Only what has to come back right away, the downgrades wait for the delay
+					Settings.DowngradeDelayFrames = ~0u;
+					Residency.SetSettings(Settings);
+					View.Foveation.FovealCenterX = 0.1f;
+					View.Foveation.FovealCenterY = 0.1f;
+					const size_t NumGazeUpgrades = Residency.Update(View).size();
+					const uint64_t GazeMoveBytes = Residency.GetResidentBytes() - ResidentBytes;
+
+					CORE_INFO("{0} {1} alpha {2}: {3:.1f} MB of {4:.1f} MB albedo resident ({5:.1f}%), estimate took {6:.2f} ms, a gaze jump streams in {7} textures ({8:.1f} MB)",
+						Scene.Path, PoseNames[Pose], Alpha, ResidentBytes / (1024.0 * 1024.0), FullBytes / (1024.0 * 1024.0), 100.0 * ResidentBytes / Math::max<uint64_t>(FullBytes, 1),
+						UpdateMS, NumGazeUpgrades, GazeMoveBytes / (1024.0 * 1024.0));
+
+					Rows.push_back(FormatRow(Scene.Path, PoseNames[Pose], Alpha, Textures.size(), FullBytes / (1024.0 * 1024.0),
+						ResidentBytes / (1024.0 * 1024.0), UpdateMS, NumGazeUpgrades, GazeMoveBytes / (1024.0 * 1024.0)));
+				}
+			}
+		}
+
+		WriteBenchmarkResults("texture_residency", "scene pose kernel_alpha textures full_mb resident_mb update_ms gaze_move_textures gaze_move_mb", Rows);
+	}
+
+	void RunCPUBVHBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== CPU BVH BENCHMARK ====");
+
+		const uint32_t NumRays = 100000;
+
+		struct BuildConfig
+		{
+			const char* Name;
+			BVHSplitMethod SplitMethod;
+			uint32_t ParallelThreshold;
+		};
+
+		const BuildConfig Configs[] = {
+			{ "median", BVHSplitMethod::Median, 0 },
+			{ "sah_serial", BVHSplitMethod::BinnedSAH, 0 },
+			{ "sah_parallel", BVHSplitMethod::BinnedSAH, BVHBuildSettings().ParallelThreshold },
+		};
+
+		std::vector<std::string> Rows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			::Scene BenchScene;
+			if (!LoadBenchmarkScene(Scene, BenchScene))
+				continue;
+
+			Span<const SceneObject> Objects(BenchScene.SceneObjects.data(), BenchScene.SceneObjects.size());
+
+			std::vector<Vector3f> Origins;
+			std::vector<Vector3f> Directions;
+			GenerateRays(BenchScene.Geometry.GetPositions(), NumRays, Origins, Directions);
+
+			// Closest hits of the first config, every other tree has to find the same triangles
+			std::vector<uint32_t> ReferenceHits;
+
+			for (const BuildConfig& Config : Configs)
+			{
+				BVHBuildSettings Settings;
+				Settings.SplitMethod = Config.SplitMethod;
+				Settings.ParallelThreshold = Config.ParallelThreshold;
+
+				CPUBottomLevelAS AS;
+				AS.Build(BenchScene.Geometry, Objects, Settings);
+				AS.SetLayout(CPUBVHLayout::Binary);
+				const CPUASBuildStats& Stats = AS.GetBuildStats();
+
+				// Any hit accepts everything, there are no alpha textures on the CPU. It still runs for every candidate
+				// on transparent geometry, like the any hit shader does
+				uint64_t NumAnyHits = 0;
+				auto const AnyHit = [&](const CPURayHit&)
+				{
+					NumAnyHits++;
+					return true;
+				};
+
+				std::vector<uint32_t> Hits(NumRays);
+				BVHTraversalStats ClosestStats;
+				double ClosestMS = TimeMS([&]()
+				{
+					for (uint32_t r = 0; r < NumRays; r++)
+					{
+						CPURayHit Hit;
+						Hits[r] = AS.TraceClosest(Origins[r], Directions[r], std::numeric_limits<float>::max(), Hit, AnyHit, ClosestStats) ? Hit.TriangleIndex : ~0u;
+					}
+				});
+
+				uint32_t NumAnyMisses = 0;
+				BVHTraversalStats AnyStats;
+				double AnyMS = TimeMS([&]()
+				{
+					for (uint32_t r = 0; r < NumRays; r++)
+					{
+						CPURayHit Hit;
+						bool IsHit = AS.TraceAny(Origins[r], Directions[r], std::numeric_limits<float>::max(), Hit, AnyHit, AnyStats);
+						NumAnyMisses += IsHit != (Hits[r] != ~0u) ? 1 : 0;
+					}
+				});
+
+				if (ReferenceHits.empty())
+					ReferenceHits = Hits;
+
+				// Coplanar duplicates can make either triangle the closest one, the distance would be the same
+				uint32_t NumMismatches = NumAnyMisses;
+				for (uint32_t r = 0; r < NumRays; r++)
+					NumMismatches += (Hits[r] == ~0u) != (ReferenceHits[r] == ~0u) ? 1 : 0;
+
+				if (NumMismatches > 0)
+					CORE_ERROR("{0} {1}: {2} rays disagree with the {3} tree or between closest and any hit", Scene.Path, Config.Name, NumMismatches, Configs[0].Name);
+
+				uint32_t NumThreads = Config.ParallelThreshold > 0 ? ThreadPool::GetGlobal().GetNumThreads() : 1;
+
+				CORE_INFO("{0} {1}: {2} triangles ({3} opaque, {4} transparent geometries) built in {5:.1f} ms on {6} threads, {7} nodes, {8} leaves, depth {9}, SAH cost {10:.2f}",
+					Scene.Path, Config.Name, Stats.NumTriangles, Stats.NumOpaqueGeometries, Stats.NumTransparentGeometries, Stats.BuildMS, NumThreads,
+					Stats.NumNodes, Stats.NumLeaves, Stats.Depth, Stats.SAHCost);
+				CORE_INFO("{0} {1}: {2:.1f} nodes and {3:.1f} triangles per closest hit ray, {4:.1f} ms closest, {5:.1f} ms any hit for {6} rays",
+					Scene.Path, Config.Name, static_cast<double>(ClosestStats.NodesVisited) / NumRays, static_cast<double>(ClosestStats.PrimitivesTested) / NumRays,
+					ClosestMS, AnyMS, NumRays);
+
+				Rows.push_back(FormatRow(Scene.Path, Config.Name, NumThreads, Stats.NumTriangles, Stats.NumOpaqueGeometries, Stats.NumTransparentGeometries,
+					Stats.BuildMS, Stats.NumNodes, Stats.NumLeaves, Stats.Depth, Stats.SAHCost, static_cast<double>(ClosestStats.NodesVisited) / NumRays,
+					static_cast<double>(ClosestStats.PrimitivesTested) / NumRays, static_cast<double>(NumAnyHits) / NumRays, ClosestMS, AnyMS, NumMismatches));
+			}
+		}
+
+		WriteBenchmarkResults("cpu_bvh", "scene config threads triangles opaque transparent build_ms nodes leaves depth sah_cost nodes_per_ray "
+			"triangles_per_ray any_hits_per_ray closest_ms any_ms mismatches", Rows);
+	}
+
+	void RunWideBVHBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== WIDE BVH BENCHMARK ====");
+
+		const uint32_t Width = 320;
+		const uint32_t Height = 180;
+		const float TanHalfFov = std::tan(0.5f * 60.0f * 3.14159265f / 180.0f);
+		const char* PoseNames[4] = { "+x", "-x", "+z", "-z" };
+		const Vector3f PoseDirections[4] = { Vector3f(1.0f, 0.0f, 0.0f), Vector3f(-1.0f, 0.0f, 0.0f), Vector3f(0.0f, 0.0f, 1.0f), Vector3f(0.0f, 0.0f, -1.0f) };
+		const Vector3f SunDirection = Vector3f(0.3f, 1.0f, 0.2f).Normalized();
+
+		const char* LayoutNames[2] = { "binary", "wide" };
+		const CPUBVHLayout Layouts[2] = { CPUBVHLayout::Binary, CPUBVHLayout::Wide };
+
+		CORE_INFO("Wide BVH child tests run on {0}", WideBVH::IsUsingAVX2() ? "AVX2" : "scalar code");
+
+		std::vector<std::string> Rows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			::Scene BenchScene;
+			if (!LoadBenchmarkScene(Scene, BenchScene))
+				continue;
+
+			CPUBottomLevelAS AS;
+			AS.Build(BenchScene.Geometry, Span<const SceneObject>(BenchScene.SceneObjects.data(), BenchScene.SceneObjects.size()));
+			const CPUASBuildStats& BuildStats = AS.GetBuildStats();
+
+			Span<const Vector3f> Positions = BenchScene.Geometry.GetPositions();
+			BoundingBox SceneBounds;
+			for (size_t v = 0; v < Positions.size(); v++)
+				SceneBounds.Grow(Positions[v]);
+
+			for (uint32_t Pose = 0; Pose < 4; Pose++)
+			{
+				Vector3f Forward = PoseDirections[Pose];
+				Vector3f Up(0.0f, 1.0f, 0.0f);
+				Vector3f Right = Up.Cross(Forward).Normalized();
+				Up = Forward.Cross(Right);
+
+				Vector3f Eye = SceneBounds.GetCenter();
+				std::vector<Vector3f> Directions(Width * Height);
+				for (uint32_t y = 0; y < Height; y++)
+				{
+					for (uint32_t x = 0; x < Width; x++)
+					{
+						float NDCX = (2.0f * (x + 0.5f) / Width - 1.0f) * TanHalfFov * Width / Height;
+						float NDCY = (1.0f - 2.0f * (y + 0.5f) / Height) * TanHalfFov;
+						Directions[y * Width + x] = (Forward + Right * NDCX + Up * NDCY).Normalized();
+					}
+				}
+
+				// Shadow rays towards the sun from every primary hit, pulled back a little so they don't start behind the surface
+				std::vector<uint32_t> PrimaryHits[2];
+				std::vector<Vector3f> ShadowOrigins;
+
+				for (uint32_t l = 0; l < 2; l++)
+				{
+					AS.SetLayout(Layouts[l]);
+					PrimaryHits[l].resize(Directions.size());
+
+					BVHTraversalStats PrimaryStats;
+					double PrimaryMS = TimeMS([&]()
+					{
+						for (size_t r = 0; r < Directions.size(); r++)
+						{
+							CPURayHit Hit;
+							PrimaryHits[l][r] = AS.TraceClosest(Eye, Directions[r], std::numeric_limits<float>::max(), Hit, PrimaryStats) ? Hit.TriangleIndex : ~0u;
+
+							if (l == 0 && PrimaryHits[l][r] != ~0u)
+								ShadowOrigins.push_back(Eye + Directions[r] * (Hit.T * 0.999f));
+						}
+					});
+
+					uint32_t NumShadowed = 0;
+					BVHTraversalStats ShadowStats;
+					double ShadowMS = TimeMS([&]()
+					{
+						for (const Vector3f& Origin : ShadowOrigins)
+						{
+							CPURayHit Hit;
+							NumShadowed += AS.TraceAny(Origin, SunDirection, std::numeric_limits<float>::max(), Hit, ShadowStats) ? 1 : 0;
+						}
+					});
+
+					// Closest hits can only differ between coplanar duplicates, which then hit at the same distance either way
+					uint32_t NumMismatches = 0;
+					for (size_t r = 0; r < Directions.size(); r++)
+						NumMismatches += (PrimaryHits[l][r] == ~0u) != (PrimaryHits[0][r] == ~0u) ? 1 : 0;
+
+					if (NumMismatches > 0)
+						CORE_ERROR("{0} {1} {2}: {3} primary rays disagree with the binary tree", Scene.Path, PoseNames[Pose], LayoutNames[l], NumMismatches);
+
+					const size_t NumShadowRays = ShadowOrigins.size();
+					const double PrimaryMRays = Directions.size() / Math::max(PrimaryMS, 0.001) / 1000.0;
+					const double ShadowMRays = NumShadowRays / Math::max(ShadowMS, 0.001) / 1000.0;
+					const double PrimaryNodes = static_cast<double>(PrimaryStats.NodesVisited) / Directions.size();
+					const double ShadowNodes = static_cast<double>(ShadowStats.NodesVisited) / Math::max<size_t>(NumShadowRays, 1);
+
+					CORE_INFO("{0} {1} {2}: primary {3:.2f} Mrays/s ({4:.1f} nodes per ray), shadow {5:.2f} Mrays/s ({6:.1f} nodes per ray, {7:.1f}% shadowed)",
+						Scene.Path, PoseNames[Pose], LayoutNames[l], PrimaryMRays, PrimaryNodes, ShadowMRays, ShadowNodes, 100.0 * NumShadowed / Math::max<size_t>(NumShadowRays, 1));
+
+					Rows.push_back(FormatRow(Scene.Path, PoseNames[Pose], LayoutNames[l], l == 1 && WideBVH::IsUsingAVX2() ? "avx2" : "scalar",
+						BuildStats.NumNodes, BuildStats.NumWideNodes, Directions.size(), PrimaryMRays, PrimaryNodes, NumShadowRays, ShadowMRays, ShadowNodes,
+						NumMismatches));
+				}
+			}
+		}
+
+		WriteBenchmarkResults("wide_bvh", "scene pose layout simd nodes wide_nodes primary_rays primary_mrays_per_s primary_nodes_per_ray shadow_rays "
+			"shadow_mrays_per_s shadow_nodes_per_ray mismatches", Rows);
+	}
+
+	void RunRayPacketBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== RAY PACKET BENCHMARK ====");
+
+		// 0 traces the plain screen space grid without foveation
+		const float KernelAlphas[] = { 0.0f, 1.0f, 2.0f, 4.0f, 6.0f };
+		const char* PoseNames[4] = { "+x", "-x", "+z", "-z" };
+		const Vector3f PoseDirections[4] = { Vector3f(1.0f, 0.0f, 0.0f), Vector3f(-1.0f, 0.0f, 0.0f), Vector3f(0.0f, 0.0f, 1.0f), Vector3f(0.0f, 0.0f, -1.0f) };
+
+		LogPolarRays::PacketSettings Settings;
+
+		std::vector<std::string> Rows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			::Scene BenchScene;
+			if (!LoadBenchmarkScene(Scene, BenchScene))
+				continue;
+
+			// Packets walk the binary tree, so the single rays do too
+			CPUBottomLevelAS AS;
+			AS.Build(BenchScene.Geometry, Span<const SceneObject>(BenchScene.SceneObjects.data(), BenchScene.SceneObjects.size()));
+			AS.SetLayout(CPUBVHLayout::Binary);
+
+			Span<const Vector3f> Positions = BenchScene.Geometry.GetPositions();
+			BoundingBox SceneBounds;
+			for (size_t v = 0; v < Positions.size(); v++)
+				SceneBounds.Grow(Positions[v]);
+
+			for (uint32_t Pose = 0; Pose < 4; Pose++)
+			{
+				for (float Alpha : KernelAlphas)
+				{
+					PrimaryRayCamera Camera;
+					Camera.Foveation.LaunchWidth = 640.0f;
+					Camera.Foveation.LaunchHeight = 360.0f;
+					Camera.Foveation.KernelAlpha = Alpha;
+					Camera.IsFoveated = Alpha > 0.0f;
+					Camera.Position = SceneBounds.GetCenter();
+					Camera.Forward = PoseDirections[Pose];
+					Camera.Right = Camera.Up.Cross(Camera.Forward).Normalized();
+					Camera.Up = Camera.Forward.Cross(Camera.Right);
+
+					std::vector<RayPacket> Packets;
+					const uint32_t NumCoherent = LogPolarRays::BuildPackets(Camera, Settings, Packets);
+
+					uint32_t NumRays = 0;
+					for (const RayPacket& Packet : Packets)
+						NumRays += Packet.NumRays;
+
+					std::vector<float> SingleHits;
+					SingleHits.reserve(NumRays);
+					BVHTraversalStats SingleStats;
+					double SingleMS = TimeMS([&]()
+					{
+						for (const RayPacket& Packet : Packets)
+						{
+							for (uint32_t r = 0; r < Packet.NumRays; r++)
+							{
+								Vector3f Origin(Packet.OriginX[r], Packet.OriginY[r], Packet.OriginZ[r]);
+								Vector3f Direction(Packet.DirectionX[r], Packet.DirectionY[r], Packet.DirectionZ[r]);
+
+								CPURayHit Hit;
+								SingleHits.push_back(AS.TraceClosest(Origin, Direction, Packet.TMax[r], Hit, SingleStats) ? Hit.T : -1.0f);
+							}
+						}
+					});
+
+					std::vector<RayPacket> TracedPackets = Packets;
+					std::vector<float> PacketHits;
+					PacketHits.reserve(NumRays);
+					BVHTraversalStats PacketStats;
+					double PacketMS = TimeMS([&]()
+					{
+						for (RayPacket& Packet : TracedPackets)
+						{
+							CPURayHit Hits[RayPacket::MaxRays];
+							uint32_t HitMask = AS.TraceClosestPacket(Packet, Hits, PacketStats);
+							for (uint32_t r = 0; r < Packet.NumRays; r++)
+								PacketHits.push_back((HitMask & (1u << r)) != 0 ? Hits[r].T : -1.0f);
+						}
+					});
+
+					uint32_t NumMismatches = 0;
+					for (uint32_t r = 0; r < NumRays; r++)
+						NumMismatches += SingleHits[r] != PacketHits[r] ? 1 : 0;
+
+					if (NumMismatches > 0)
+						CORE_ERROR("{0} {1} alpha {2}: {3} packet rays hit at another distance than traced alone", Scene.Path, PoseNames[Pose], Alpha, NumMismatches);
+
+					const double SingleMRays = NumRays / Math::max(SingleMS, 0.001) / 1000.0;
+					const double PacketMRays = NumRays / Math::max(PacketMS, 0.001) / 1000.0;
+					const double SingleNodes = static_cast<double>(SingleStats.NodesVisited) / Math::max(NumRays, 1u);
+					const double PacketNodes = static_cast<double>(PacketStats.NodesVisited) / Math::max(NumRays, 1u);
+
+					CORE_INFO("{0} {1} alpha {2}: {3} rays in {4} packets, {5:.1f}% coherent, single {6:.2f} Mrays/s, packets {7:.2f} Mrays/s ({8:.2f}x), {9:.1f} vs {10:.2f} node visits per ray",
+						Scene.Path, PoseNames[Pose], Alpha, NumRays, Packets.size(), 100.0 * NumCoherent / Math::max<size_t>(Packets.size(), 1), SingleMRays, PacketMRays,
+						PacketMRays / Math::max(SingleMRays, 1e-6), SingleNodes, PacketNodes);
+
+					Rows.push_back(FormatRow(Scene.Path, PoseNames[Pose], Alpha, NumRays, Packets.size(), NumCoherent, SingleMRays, PacketMRays,
+						PacketMRays / Math::max(SingleMRays, 1e-6), SingleNodes, PacketNodes, NumMismatches));
+				}
+			}
+		}
+
+		WriteBenchmarkResults("ray_packets", "scene pose kernel_alpha rays packets coherent_packets single_mrays_per_s packet_mrays_per_s speedup "
+			"single_nodes_per_ray packet_nodes_per_ray mismatches", Rows);
+	}
+
+	void RunTwoLevelASBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== TWO LEVEL AS BENCHMARK ====");
+
+		const uint32_t Width = 320;
+		const uint32_t Height = 180;
+		const uint32_t MovedObjectStride = 4;
+		const uint32_t NumRebuilds = 20;
+		const char* StateNames[2] = { "static", "moved" };
+
+		std::vector<std::string> Rows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			::Scene BenchScene;
+			if (!LoadBenchmarkScene(Scene, BenchScene))
+				continue;
+
+			CPUBottomLevelAS Monolithic;
+			CPUTopLevelAS TwoLevel;
+			TwoLevel.Build(BenchScene);
+			TwoLevel.LogBuildStats();
+			const CPUTLASBuildStats& TwoLevelStats = TwoLevel.GetBuildStats();
+
+			BoundingBox SceneBounds = GetBounds(BenchScene.Geometry.GetPositions());
+			const PinholeRays Rays = GeneratePinholeRays(BenchScene, Width, Height);
+			const Vector3f& Eye = Rays.Eye;
+			const std::vector<Vector3f>& Directions = Rays.Directions;
+
+			// Moved objects slide along x by a hundredth of the scene
+			Vector3f Extent = SceneBounds.Max - SceneBounds.Min;
+			const float Offset = 0.01f * Extent.X;
+
+			for (uint32_t State = 0; State < 2; State++)
+			{
+				float TopLevelMS = TwoLevelStats.TopLevelBuildMS;
+				if (State == 1)
+				{
+					for (uint32_t i = 0; i < BenchScene.SceneObjects.size(); i += MovedObjectStride)
+					{
+						Transform3x4& ObjectToWorld = BenchScene.SceneObjects[i].ObjectToWorld;
+						ObjectToWorld.M[0][3] += Offset;
+						TwoLevel.SetInstanceTransform(i, ObjectToWorld);
+					}
+
+					TopLevelMS = static_cast<float>(TimeMS([&]()
+					{
+						for (uint32_t r = 0; r < NumRebuilds; r++)
+							TwoLevel.RebuildTopLevel();
+					}) / NumRebuilds);
+
+					BenchScene.BuildGeometry();
+				}
+
+				double MonolithicBuildMS = TimeMS([&]()
+				{
+					Monolithic.Build(BenchScene.Geometry, Span<const SceneObject>(BenchScene.SceneObjects.data(), BenchScene.SceneObjects.size()));
+				});
+
+				std::vector<uint32_t> MonolithicHits(Directions.size());
+				BVHTraversalStats MonolithicStats;
+				double MonolithicMS = TimeMS([&]()
+				{
+					for (size_t r = 0; r < Directions.size(); r++)
+					{
+						CPURayHit Hit;
+						MonolithicHits[r] = Monolithic.TraceClosest(Eye, Directions[r], std::numeric_limits<float>::max(), Hit, MonolithicStats) ? Hit.GeometryIndex : ~0u;
+					}
+				});
+
+				std::vector<uint32_t> TwoLevelHits(Directions.size());
+				BVHTraversalStats TwoLevelTraversalStats;
+				double TwoLevelMS = TimeMS([&]()
+				{
+					for (size_t r = 0; r < Directions.size(); r++)
+					{
+						CPURayHit Hit;
+						TwoLevelHits[r] = TwoLevel.TraceClosest(Eye, Directions[r], std::numeric_limits<float>::max(), Hit, TwoLevelTraversalStats) ? Hit.GeometryIndex : ~0u;
+					}
+				});
+
+				// Rays grazing an edge can land on either side after the trip through instance space, so only hit or miss is compared
+				uint32_t NumMismatches = 0;
+				for (size_t r = 0; r < Directions.size(); r++)
+					NumMismatches += (MonolithicHits[r] == ~0u) != (TwoLevelHits[r] == ~0u) ? 1 : 0;
+
+				if (NumMismatches > 0)
+					CORE_ERROR("{0} {1}: {2} primary rays disagree between the monolithic and the two level structure", Scene.Path, StateNames[State], NumMismatches);
+
+				const double MonolithicMRays = Directions.size() / Math::max(MonolithicMS, 0.001) / 1000.0;
+				const double TwoLevelMRays = Directions.size() / Math::max(TwoLevelMS, 0.001) / 1000.0;
+				const double MonolithicNodes = static_cast<double>(MonolithicStats.NodesVisited) / Directions.size();
+				const double TwoLevelNodes = static_cast<double>(TwoLevelTraversalStats.NodesVisited) / Directions.size();
+
+				CORE_INFO("{0} {1}: monolithic build {2:.1f} ms, top level build {3:.3f} ms, monolithic {4:.2f} Mrays/s ({5:.1f} nodes per ray), two level {6:.2f} Mrays/s ({7:.1f} nodes per ray)",
+					Scene.Path, StateNames[State], MonolithicBuildMS, TopLevelMS, MonolithicMRays, MonolithicNodes, TwoLevelMRays, TwoLevelNodes);
+
+				Rows.push_back(FormatRow(Scene.Path, StateNames[State], TwoLevelStats.NumInstances, TwoLevelStats.NumBottomLevels,
+					TwoLevelStats.NumUniqueTriangles, TwoLevelStats.NumInstancedTriangles, MonolithicBuildMS, TwoLevelStats.BottomLevelBuildMS, TopLevelMS,
+					MonolithicMRays, TwoLevelMRays, MonolithicNodes, TwoLevelNodes, NumMismatches));
+			}
+		}
+
+		WriteBenchmarkResults("two_level_as", "scene state objects bottom_levels unique_triangles instanced_triangles monolithic_build_ms bottom_level_build_ms "
+			"top_level_build_ms monolithic_mrays_per_s two_level_mrays_per_s monolithic_nodes_per_ray two_level_nodes_per_ray mismatches", Rows);
+	}
+
+	void RunRefitBenchmark(const std::vector<BenchmarkScene>& Scenes)
+	{
+		CORE_WARN("==== REFIT BENCHMARK ====");
+
+		const uint32_t Width = 320;
+		const uint32_t Height = 180;
+		const float AnimatedFractions[] = { 0.1f, 0.25f, 0.5f };
+		const uint32_t NumFrames = 8;
+
+		std::vector<std::string> Rows;
+
+		for (const BenchmarkScene& Scene : Scenes)
+		{
+			::Scene BenchScene;
+			if (!LoadBenchmarkScene(Scene, BenchScene))
+				continue;
+
+			const uint32_t NumObjects = static_cast<uint32_t>(BenchScene.SceneObjects.size());
+			std::vector<Transform3x4> RestTransforms(NumObjects);
+			for (uint32_t i = 0; i < NumObjects; i++)
+				RestTransforms[i] = BenchScene.SceneObjects[i].ObjectToWorld;
+
+			BoundingBox SceneBounds = GetBounds(BenchScene.Geometry.GetPositions());
+			const PinholeRays Rays = GeneratePinholeRays(BenchScene, Width, Height);
+			const Vector3f& Eye = Rays.Eye;
+			const std::vector<Vector3f>& Directions = Rays.Directions;
+
+			auto const CountNodes = [&](const CPUBottomLevelAS& AS)
+			{
+				BVHTraversalStats TraversalStats;
+				for (size_t r = 0; r < Directions.size(); r++)
+				{
+					CPURayHit Hit;
+					AS.TraceClosest(Eye, Directions[r], std::numeric_limits<float>::max(), Hit, TraversalStats);
+				}
+
+				return static_cast<double>(TraversalStats.NodesVisited) / Directions.size();
+			};
+
+			// Every frame an animated object drifts another half percent of the scene diagonal along its own direction
+			Vector3f Diagonal = SceneBounds.Max - SceneBounds.Min;
+			const float Step = 0.005f * Diagonal.Length();
+
+			CPUTopLevelAS TwoLevel;
+			CPUTopLevelAS TwoLevelRebuilt;
+			TwoLevel.Build(BenchScene);
+			TwoLevelRebuilt.Build(BenchScene);
+
+			for (float Fraction : AnimatedFractions)
+			{
+				// Same hash every run, so the animated set only grows with the fraction
+				std::vector<uint32_t> AnimatedObjects;
+				for (uint32_t i = 0; i < NumObjects; i++)
+				{
+					if ((i * 2654435761u) % 1000u < static_cast<uint32_t>(Fraction * 1000.0f))
+						AnimatedObjects.push_back(i);
+				}
+
+				for (uint32_t i = 0; i < NumObjects; i++)
+				{
+					BenchScene.SceneObjects[i].ObjectToWorld = RestTransforms[i];
+					TwoLevel.SetInstanceTransform(i, RestTransforms[i]);
+					TwoLevelRebuilt.SetInstanceTransform(i, RestTransforms[i]);
+				}
+
+				BenchScene.BuildGeometry();
+				TwoLevel.RebuildTopLevel();
+
+				CPUBottomLevelAS Updated;
+				CPUBottomLevelAS Rebuilt;
+				Updated.Build(BenchScene.Geometry, Span<const SceneObject>(BenchScene.SceneObjects.data(), BenchScene.SceneObjects.size()));
+
+				for (uint32_t Frame = 1; Frame <= NumFrames; Frame++)
+				{
+					for (uint32_t i : AnimatedObjects)
+					{
+						Transform Animation;
+						Animation.Translate(Vector3f(std::cos(i * 2.4f), 0.3f * std::sin(i * 1.3f), std::sin(i * 2.4f)) * (Frame * Step));
+
+						Transform3x4 ObjectToWorld = Animation.GetMatrix() * RestTransforms[i];
+						BenchScene.SceneObjects[i].ObjectToWorld = ObjectToWorld;
+						TwoLevel.SetInstanceTransform(i, ObjectToWorld);
+						TwoLevelRebuilt.SetInstanceTransform(i, ObjectToWorld);
+					}
+
+					double GeometryMS = TimeMS([&]() { BenchScene.BuildGeometry(); });
+
+					Span<const SceneObject> Objects(BenchScene.SceneObjects.data(), BenchScene.SceneObjects.size());
+					bool IsUpdateRebuilt = Updated.Update(BenchScene.Geometry, Objects);
+					double RebuildMS = TimeMS([&]() { Rebuilt.Build(BenchScene.Geometry, Objects); });
+
+					bool IsTopLevelRebuilt = TwoLevel.UpdateTopLevel();
+					TwoLevelRebuilt.RebuildTopLevel();
+
+					const CPUASBuildStats& UpdateStats = Updated.GetBuildStats();
+					const CPUTLASBuildStats& TopLevelStats = TwoLevel.GetBuildStats();
+					const double UpdateNodes = CountNodes(Updated);
+					const double RebuildNodes = CountNodes(Rebuilt);
+
+					CORE_INFO("{0} {1:.0f}% frame {2}: update {3:.1f} ms{4}, rebuild {5:.1f} ms, SAH growth {6:.2f}, {7:.1f} vs {8:.1f} nodes per ray, top level update {9:.3f} ms{10} vs rebuild {11:.3f} ms",
+						Scene.Path, Fraction * 100.0f, Frame, UpdateStats.UpdateMS, IsUpdateRebuilt ? " (rebuilt)" : "", RebuildMS, UpdateStats.RefitSAHGrowth,
+						UpdateNodes, RebuildNodes, TopLevelStats.TopLevelUpdateMS, IsTopLevelRebuilt ? " (rebuilt)" : "", TwoLevelRebuilt.GetBuildStats().TopLevelBuildMS);
+
+					Rows.push_back(FormatRow(Scene.Path, Fraction, Frame, AnimatedObjects.size(), GeometryMS, UpdateStats.UpdateMS, RebuildMS,
+						UpdateStats.RefitSAHGrowth, IsUpdateRebuilt ? 1 : 0, UpdateNodes, RebuildNodes, TopLevelStats.TopLevelUpdateMS,
+						TwoLevelRebuilt.GetBuildStats().TopLevelBuildMS, TopLevelStats.TopLevelRefitSAHGrowth, IsTopLevelRebuilt ? 1 : 0));
+				}
+			}
+		}
+
+		WriteBenchmarkResults("refit", "scene animated_fraction frame animated_objects geometry_ms update_ms rebuild_ms sah_growth update_rebuilt "
+			"update_nodes_per_ray rebuild_nodes_per_ray top_level_update_ms top_level_rebuild_ms top_level_sah_growth top_level_update_rebuilt", Rows);
+	}
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Runs the load benchmarks below before the scene is loaded. Also swaps in the counting operator new of AllocationCounter,
+// builds without it keep the CRT allocator
+#define RUN_LOAD_BENCHMARKS 0
+
+/**
+* Offline load and build benchmarks. Results are logged and written to ../Data/ next to the frame time captures.
+*/
+namespace Benchmarks
+{
+	struct BenchmarkScene
+	{
+		std::string Path;
+		bool GenVertexNormals = false;
+	};
+
+	/**
+	* The scenes we usually benchmark with, SunTemple, sponza and sibenik.
+	*/
+	std::vector<BenchmarkScene> GetDefaultScenes();
+
+	/**
+	* Measures a cold load (Assimp import + cache write) against a warm load from the mesh cache for each scene, and counts the
+	* heap allocations each one makes through AllocationCounter. A warm load that allocates once per mesh or more, not counting
+	* the material strings every mesh copies, logs an error and is marked failed.
+	*/
+	void RunMeshCacheBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Runs MeshOptimizer on every mesh of each scene and reports vertex counts, ACMR and optimisation time.
+	*/
+	void RunMeshOptimizerBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Compares full and packed vertex memory per scene and reports the packed round-trip error.
+	*/
+	void RunVertexPackingBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Builds meshlets for each scene and compares a BVH with triangle leaves against one with a meshlet per leaf.
+	* Reports build times and nodes visited and triangles tested per ray for random closest hit rays inside the scene.
+	*/
+	void RunMeshletBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Builds LOD chains for each scene and traces the same random rays against every LOD. Then traces a foveated view through
+	* CPUTopLevelAS with every instance at full detail and with the LODs SelectLODs picks, for a few foveal error budgets.
+	*/
+	void RunMeshLODBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Decodes the textures of each scene once serially and once through a TextureCache on the thread pool.
+	*/
+	void RunTextureDecodeBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Checks every SIMD channel expander against the scalar one and measures their throughput on synthetic images.
+	*/
+	void RunTextureFormatBenchmark();
+
+	/**
+	* Times CPU mip chain generation of every scene texture with each filter, and a full texture cache load with and without
+	* the mip chains already on disk.
+	*/
+	void RunTextureMipBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Loads every scene texture decompressed to RGBA8 and again with DDS block compression and mips kept, and compares the
+	* load times and the bytes that end up on the GPU.
+	*/
+	void RunTextureCompressionBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Encodes the uncompressed chain of every scene texture with the format the texture cache would pick, and BC7 for albedo,
+	* and reports encode throughput and PSNR per texture.
+	*/
+	void RunTextureEncodeBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Loads every scene texture through a TextureCache and on into a resource map the way the tracer does, cold and from the
+	* disk cache, and counts the pixel buffer copies of each load. Logs an error for every load with more than one.
+	*/
+	void RunTextureCopyBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Runs the albedo mip residency estimate for a few camera poses inside each scene, without foveation and with foveation at
+	* several kernel alphas. Reports the resident bytes against the full chains, and what streams back in when the gaze jumps
+	* from the centre to a corner of the screen.
+	*/
+	void RunTextureResidencyBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Builds a CPU bottom level acceleration structure for each scene with median splits, with binned SAH on one thread and
+	* with binned SAH on the thread pool. Reports build times, tree shape and SAH cost, and traces the same random rays with
+	* closest and any hit queries through each tree.
+	*/
+	void RunCPUBVHBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Traces primary rays from a few camera poses inside each scene and shadow rays from their hits towards a fixed sun,
+	* through the binary CPU BVH and its 8 wide collapse, and reports rays per second and nodes visited per ray.
+	*/
+	void RunWideBVHBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Traces the primary rays of a log-polar launch from a few camera poses inside each scene, once ray by ray and once in
+	* packets of 4x4 launch pixels, for several kernel alphas. Reports rays per second, the share of packets coherent enough
+	* to trace together and node visits per ray.
+	*/
+	void RunRayPacketBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Builds each scene as one CPU bottom level structure over the world space triangles and as a two level structure with a
+	* bottom level per unique mesh. Moves every fourth object, then rebuilds only the top level on one side and everything on
+	* the other. Reports build and rebuild times, and traces the same primary rays through both before and after the move.
+	*/
+	void RunTwoLevelASBenchmark(const std::vector<BenchmarkScene>& Scenes);
+
+	/**
+	* Animates a fraction of the objects of each scene for a few frames, each frame moving them further from where they
+	* started. Updates a monolithic CPU structure and the top level of a two level one by refitting, with the SAH growth check
+	* free to rebuild, next to full rebuilds of both. Reports update and rebuild times, SAH growth and nodes visited per ray.
+	* The SAH growth is measured before the rebuild decision, so a rebuilt frame shows the growth that triggered it next to
+	* its rebuilt flag.
+	*/
+	void RunRefitBenchmark(const std::vector<BenchmarkScene>& Scenes);
+}
@@ -0,0 +1,543 @@
+#include "pch.h"
+#include "CPUAccelerationStructure.h"
+#include "SceneObject.h"
+#include "Scene.h"
+#include "LogPolarRays.h"
+#include "ThreadPool.h"
+#include "Log.h"
+
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	const uint32_t TriangleChunkSize = 16384;
+
+	bool AcceptHit(const CPURayHit&)
+	{
+		return true;
+	}
+
+	// Simplified levels index the vertices of the full mesh, so only the index list changes
+	Span<const uint32_t> GetLODIndices(const StaticMesh& Mesh, uint32_t LOD)
+	{
+		if (LOD == 0 || !Mesh.LODs || LOD > Mesh.LODs->Levels.size())
+			return Span<const uint32_t>(Mesh.Indices.data(), Mesh.Indices.size());
+
+		const std::vector<uint32_t>& Indices = Mesh.LODs->Levels[LOD - 1].Indices;
+		return Span<const uint32_t>(Indices.data(), Indices.size());
+	}
+
+	template<class ChunkFunc>
+	void ForEachTriangleChunk(uint32_t NumTriangles, const BVHBuildSettings& Settings, ChunkFunc&& Func)
+	{
+		uint32_t NumChunks = (NumTriangles + TriangleChunkSize - 1) / TriangleChunkSize;
+		auto const RunChunk = [&](uint32_t Chunk)
+		{
+			Func(Chunk * TriangleChunkSize, Math::min(NumTriangles, (Chunk + 1) * TriangleChunkSize));
+		};
+
+		if (Settings.ParallelThreshold > 0 && NumTriangles >= Settings.ParallelThreshold)
+			ThreadPool::GetGlobal().ParallelFor(NumChunks, RunChunk);
+		else
+			for (uint32_t Chunk = 0; Chunk < NumChunks; Chunk++)
+				RunChunk(Chunk);
+	}
+}
+
+void CPUBottomLevelAS::Build(const SceneGeometry& Geometry, Span<const SceneObject> Objects, const BVHBuildSettings& Settings)
+{
+	auto Start = std::chrono::high_resolution_clock::now();
+
+	Clear();
+	BuildSettings = Settings;
+
+	uint32_t NumGeometries = static_cast<uint32_t>(Objects.size());
+	uint32_t NumTriangles = Geometry.GetNumTriangles();
+
+	GeometryFlags.resize(NumGeometries);
+	GeometryFirstTriangles.assign(NumGeometries, 0);
+	for (uint32_t i = 0; i < NumGeometries; i++)
+	{
+		GeometryFlags[i] = GetGeometryFlags(Objects[i].Mesh);
+
+		if (GeometryFlags[i] == CPUGeometryFlags::Opaque)
+			Stats.NumOpaqueGeometries++;
+		else
+			Stats.NumTransparentGeometries++;
+	}
+
+	Span<const uint32_t> MeshIDs = Geometry.GetTriangleMeshIDs();
+
+	// Triangles of a mesh are contiguous, walk backwards so each geometry ends up with its lowest triangle
+	for (uint32_t t = NumTriangles; t-- > 0;)
+		GeometryFirstTriangles[MeshIDs[t]] = t;
+
+	TriangleGeometries.assign(MeshIDs.begin(), MeshIDs.end());
+	GatherTriangles(Geometry);
+
+	BuildTrees();
+
+	Stats.BuildMS = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - Start).count();
+}
+
+void CPUBottomLevelAS::Build(const StaticMesh& Mesh, const BVHBuildSettings& Settings, uint32_t LOD)
+{
+	auto Start = std::chrono::high_resolution_clock::now();
+
+	Clear();
+	BuildSettings = Settings;
+	BuiltLOD = LOD;
+
+	Span<const uint32_t> Indices = GetLODIndices(Mesh, LOD);
+	uint32_t NumTriangles = static_cast<uint32_t>(Indices.size() / 3);
+
+	GeometryFlags.push_back(GetGeometryFlags(Mesh));
+	GeometryFirstTriangles.push_back(0);
+	if (GeometryFlags[0] == CPUGeometryFlags::Opaque)
+		Stats.NumOpaqueGeometries++;
+	else
+		Stats.NumTransparentGeometries++;
+
+	TriangleGeometries.assign(NumTriangles, 0);
+	GatherTriangles(Mesh, Indices);
+
+	BuildTrees();
+
+	Stats.BuildMS = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - Start).count();
+}
+
+bool CPUBottomLevelAS::Update(const SceneGeometry& Geometry, Span<const SceneObject> Objects)
+{
+	if (Geometry.GetNumTriangles() != Triangles.size() || Objects.size() != GeometryFlags.size())
+	{
+		Build(Geometry, Objects, BuildSettings);
+		return true;
+	}
+
+	auto Start = std::chrono::high_resolution_clock::now();
+
+	GatherTriangles(Geometry);
+	bool IsRebuilt = UpdateTrees();
+
+	Stats.UpdateMS = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - Start).count();
+	return IsRebuilt;
+}
+
+bool CPUBottomLevelAS::Update(const StaticMesh& Mesh)
+{
+	Span<const uint32_t> Indices = GetLODIndices(Mesh, BuiltLOD);
+	if (Indices.size() / 3 != Triangles.size())
+	{
+		Build(Mesh, BuildSettings, BuiltLOD);
+		return true;
+	}
+
+	auto Start = std::chrono::high_resolution_clock::now();
+
+	GatherTriangles(Mesh, Indices);
+	bool IsRebuilt = UpdateTrees();
+
+	Stats.UpdateMS = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - Start).count();
+	return IsRebuilt;
+}
+
+void CPUBottomLevelAS::GatherTriangles(const SceneGeometry& Geometry)
+{
+	Span<const Vector3f> Positions = Geometry.GetPositions();
+	Span<const uint32_t> Indices = Geometry.GetIndices();
+
+	Triangles.resize(Geometry.GetNumTriangles());
+	ForEachTriangleChunk(static_cast<uint32_t>(Triangles.size()), BuildSettings, [&](uint32_t First, uint32_t End)
+	{
+		for (uint32_t t = First; t < End; t++)
+		{
+			Triangle& Tri = Triangles[t];
+			Tri.A = Positions[Indices[static_cast<size_t>(t) * 3 + 0]];
+			Tri.B = Positions[Indices[static_cast<size_t>(t) * 3 + 1]];
+			Tri.C = Positions[Indices[static_cast<size_t>(t) * 3 + 2]];
+		}
+	});
+}
+
+void CPUBottomLevelAS::GatherTriangles(const StaticMesh& Mesh, Span<const uint32_t> Indices)
+{
+	Triangles.resize(Indices.size() / 3);
+	ForEachTriangleChunk(static_cast<uint32_t>(Triangles.size()), BuildSettings, [&](uint32_t First, uint32_t End)
+	{
+		for (uint32_t t = First; t < End; t++)
+		{
+			Triangle& Tri = Triangles[t];
+			Tri.A = Mesh.Vertices[Indices[static_cast<size_t>(t) * 3 + 0]].Position;
+			Tri.B = Mesh.Vertices[Indices[static_cast<size_t>(t) * 3 + 1]].Position;
+			Tri.C = Mesh.Vertices[Indices[static_cast<size_t>(t) * 3 + 2]].Position;
+		}
+	});
+}
+
+void CPUBottomLevelAS::GetTriangleBounds(std::vector<BoundingBox>& OutBounds) const
+{
+	OutBounds.assign(Triangles.size(), BoundingBox());
+	ForEachTriangleChunk(static_cast<uint32_t>(Triangles.size()), BuildSettings, [&](uint32_t First, uint32_t End)
+	{
+		for (uint32_t t = First; t < End; t++)
+		{
+			OutBounds[t].Grow(Triangles[t].A);
+			OutBounds[t].Grow(Triangles[t].B);
+			OutBounds[t].Grow(Triangles[t].C);
+		}
+	});
+}
+
+void CPUBottomLevelAS::BuildTrees()
+{
+	uint32_t NumTriangles = static_cast<uint32_t>(Triangles.size());
+	std::vector<BoundingBox> TriangleBounds;
+	GetTriangleBounds(TriangleBounds);
+
+	Tree.Build(Span<const BoundingBox>(TriangleBounds.data(), TriangleBounds.size()), BuildSettings);
+	WideTree.Build(Tree);
+
+	Stats.NumTriangles = NumTriangles;
+	Stats.NumNodes = Tree.GetNumNodes();
+	Stats.NumLeaves = Tree.GetNumLeaves();
+	Stats.Depth = Tree.GetDepth();
+	Stats.SAHCost = Tree.GetSAHCost(BuildSettings.TraversalCost, BuildSettings.IntersectionCost);
+	Stats.RefitSAHCost = Stats.SAHCost;
+	Stats.RefitSAHGrowth = 1.0f;
+	Stats.NumRefits = 0;
+	Stats.NumWideNodes = WideTree.GetNumNodes();
+	Stats.WideDepth = WideTree.GetDepth();
+}
+
+bool CPUBottomLevelAS::UpdateTrees()
+{
+	std::vector<BoundingBox> TriangleBounds;
+	GetTriangleBounds(TriangleBounds);
+
+	Tree.Refit(Span<const BoundingBox>(TriangleBounds.data(), TriangleBounds.size()), BuildSettings);
+
+	float RefitSAHCost = Tree.GetSAHCost(BuildSettings.TraversalCost, BuildSettings.IntersectionCost);
+	float RefitSAHGrowth = RefitSAHCost / Math::max(Stats.SAHCost, 0.001f);
+	if (RefitSAHCost > Stats.SAHCost * BuildSettings.MaxRefitSAHGrowth)
+	{
+		auto Start = std::chrono::high_resolution_clock::now();
+
+		CORE_TRACE("CPU BLAS: SAH cost grew from {0:.2f} to {1:.2f} over {2} refits, rebuilding", Stats.SAHCost, RefitSAHCost, Stats.NumRefits + 1);
+		BuildTrees();
+
+		Stats.BuildMS = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - Start).count();
+		Stats.RefitSAHGrowth = RefitSAHGrowth;
+		return true;
+	}
+
+	// The collapse picks which children to open by area, so the wide tree is collapsed again rather than refit
+	WideTree.Build(Tree);
+
+	Stats.RefitSAHCost = RefitSAHCost;
+	Stats.RefitSAHGrowth = RefitSAHGrowth;
+	Stats.NumRefits++;
+	Stats.NumWideNodes = WideTree.GetNumNodes();
+	Stats.WideDepth = WideTree.GetDepth();
+	return false;
+}
+
+void CPUBottomLevelAS::Clear()
+{
+	Tree.Clear();
+	WideTree.Clear();
+	Triangles.clear();
+	TriangleGeometries.clear();
+	GeometryFlags.clear();
+	GeometryFirstTriangles.clear();
+	BuiltLOD = 0;
+	Stats = CPUASBuildStats();
+}
+
+bool CPUBottomLevelAS::TraceClosest(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, BVHTraversalStats& TraversalStats) const
+{
+	return TraceClosest(Origin, Direction, TMax, OutHit, AcceptHit, TraversalStats);
+}
+
+bool CPUBottomLevelAS::TraceAny(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, BVHTraversalStats& TraversalStats) const
+{
+	return TraceAny(Origin, Direction, TMax, OutHit, AcceptHit, TraversalStats);
+}
+
+uint32_t CPUBottomLevelAS::TraceClosestPacket(RayPacket& Packet, CPURayHit OutHits[RayPacket::MaxRays], BVHTraversalStats& TraversalStats) const
+{
+	return TraceClosestPacket(Packet, OutHits, AcceptHit, TraversalStats);
+}
+
+CPUGeometryFlags CPUBottomLevelAS::GetGeometryFlags(const StaticMesh& Mesh)
+{
+	return !Mesh.HasTransparency ? CPUGeometryFlags::Opaque : CPUGeometryFlags::NoDuplicateAnyHitInvocation;
+}
+
+void CPUBottomLevelAS::LogBuildStats() const
+{
+	CORE_INFO("CPU BLAS: {0} triangles in {1} opaque and {2} transparent geometries, built in {3:.1f} ms", Stats.NumTriangles,
+		Stats.NumOpaqueGeometries, Stats.NumTransparentGeometries, Stats.BuildMS);
+	CORE_INFO("CPU BLAS: {0} nodes, {1} leaves, depth {2}, SAH cost {3:.2f}, {4} wide nodes of depth {5}", Stats.NumNodes, Stats.NumLeaves,
+		Stats.Depth, Stats.SAHCost, Stats.NumWideNodes, Stats.WideDepth);
+}
+
+void CPUTopLevelAS::Build(Scene& InScene, const BVHBuildSettings& Settings)
+{
+	auto Start = std::chrono::high_resolution_clock::now();
+
+	Clear();
+
+	std::vector<const StaticMesh*> UniqueMeshes;
+	std::vector<uint32_t> ObjectMeshIDs;
+	if (!InScene.LockHostMeshes())
+	{
+		CORE_ERROR("CPU TLAS: the scene meshes couldn't be reloaded, nothing was built");
+		return;
+	}
+
+	InScene.GetUniqueMeshes(UniqueMeshes, ObjectMeshIDs);
+
+	// Simplified levels are laid out after each other, mesh by mesh
+	const uint32_t NumMeshes = static_cast<uint32_t>(UniqueMeshes.size());
+	LODChains.resize(NumMeshes);
+	FirstLODBottomLevels.resize(NumMeshes);
+	std::vector<uint32_t> LODMeshes;
+	for (uint32_t i = 0; i < NumMeshes; i++)
+	{
+		LODChains[i] = UniqueMeshes[i]->LODs;
+		FirstLODBottomLevels[i] = static_cast<uint32_t>(LODMeshes.size());
+		if (LODChains[i])
+			LODMeshes.insert(LODMeshes.end(), LODChains[i]->Levels.size(), i);
+	}
+
+	// Meshes are built side by side, big ones still split their own build across the pool
+	BottomLevels.resize(NumMeshes);
+	LODBottomLevels.resize(LODMeshes.size());
+	ThreadPool::GetGlobal().ParallelFor(NumMeshes + static_cast<uint32_t>(LODMeshes.size()), [&](uint32_t i)
+	{
+		if (i < NumMeshes)
+		{
+			BottomLevels[i].SetLayout(Layout);
+			BottomLevels[i].Build(*UniqueMeshes[i], Settings);
+			return;
+		}
+
+		const uint32_t LODIndex = i - NumMeshes;
+		const uint32_t MeshID = LODMeshes[LODIndex];
+		LODBottomLevels[LODIndex].SetLayout(Layout);
+		LODBottomLevels[LODIndex].Build(*UniqueMeshes[MeshID], Settings, LODIndex - FirstLODBottomLevels[MeshID] + 1);
+	});
+
+	InScene.UnlockHostMeshes();
+
+	uint32_t NumInstances = static_cast<uint32_t>(InScene.SceneObjects.size());
+	Instances.resize(NumInstances);
+
+	// Same triangle order as SceneGeometry::Build
+	uint32_t FirstTriangle = 0;
+	for (uint32_t i = 0; i < NumInstances; i++)
+	{
+		CPUInstance& Instance = Instances[i];
+		Instance.ObjectToWorld = InScene.SceneObjects[i].ObjectToWorld;
+		Instance.WorldToObject = Instance.ObjectToWorld.GetInverse();
+		Instance.BottomLevelIndex = ObjectMeshIDs[i];
+		Instance.FirstTriangle = FirstTriangle;
+
+		FirstTriangle += BottomLevels[Instance.BottomLevelIndex].GetBuildStats().NumTriangles;
+	}
+
+	Stats.BottomLevelBuildMS = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - Start).count();
+	Stats.NumBottomLevels = static_cast<uint32_t>(BottomLevels.size());
+	Stats.NumInstances = NumInstances;
+	Stats.NumInstancedTriangles = FirstTriangle;
+	Stats.NumSelectedTriangles = FirstTriangle;
+	Stats.NumLODBottomLevels = static_cast<uint32_t>(LODBottomLevels.size());
+	for (const CPUBottomLevelAS& BottomLevel : BottomLevels)
+		Stats.NumUniqueTriangles += BottomLevel.GetBuildStats().NumTriangles;
+
+	// A few thousand boxes at most, not worth the pool
+	TopLevelSettings = Settings;
+	TopLevelSettings.ParallelThreshold = 0;
+	RebuildTopLevel();
+}
+
+void CPUTopLevelAS::Clear()
+{
+	BottomLevels.clear();
+	LODBottomLevels.clear();
+	FirstLODBottomLevels.clear();
+	LODChains.clear();
+	Instances.clear();
+	InstanceBounds.clear();
+	Tree.Clear();
+	Stats = CPUTLASBuildStats();
+}
+
+void CPUTopLevelAS::SetInstanceTransform(uint32_t InstanceIndex, const Transform3x4& ObjectToWorld)
+{
+	CPUInstance& Instance = Instances[InstanceIndex];
+	Instance.ObjectToWorld = ObjectToWorld;
+	Instance.WorldToObject = ObjectToWorld.GetInverse();
+}
+
+void CPUTopLevelAS::RebuildTopLevel()
+{
+	auto Start = std::chrono::high_resolution_clock::now();
+
+	UpdateInstanceBounds();
+	Tree.Build(Span<const BoundingBox>(InstanceBounds.data(), InstanceBounds.size()), TopLevelSettings);
+
+	Stats.TopLevelBuildMS = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - Start).count();
+	Stats.NumTopLevelNodes = Tree.GetNumNodes();
+	Stats.TopLevelDepth = Tree.GetDepth();
+	Stats.TopLevelSAHCost = Tree.GetSAHCost(TopLevelSettings.TraversalCost, TopLevelSettings.IntersectionCost);
+	Stats.TopLevelRefitSAHCost = Stats.TopLevelSAHCost;
+	Stats.TopLevelRefitSAHGrowth = 1.0f;
+	Stats.NumTopLevelRefits = 0;
+}
+
+bool CPUTopLevelAS::UpdateTopLevel()
+{
+	auto Start = std::chrono::high_resolution_clock::now();
+
+	UpdateInstanceBounds();
+	Tree.Refit(Span<const BoundingBox>(InstanceBounds.data(), InstanceBounds.size()), TopLevelSettings);
+
+	float RefitSAHCost = Tree.GetSAHCost(TopLevelSettings.TraversalCost, TopLevelSettings.IntersectionCost);
+	float RefitSAHGrowth = RefitSAHCost / Math::max(Stats.TopLevelSAHCost, 0.001f);
+	bool IsRebuilt = RefitSAHCost > Stats.TopLevelSAHCost * TopLevelSettings.MaxRefitSAHGrowth;
+	if (IsRebuilt)
+	{
+		CORE_TRACE("CPU TLAS: SAH cost grew from {0:.2f} to {1:.2f} over {2} refits, rebuilding", Stats.TopLevelSAHCost, RefitSAHCost,
+			Stats.NumTopLevelRefits + 1);
+		RebuildTopLevel();
+	}
+	else
+	{
+		Stats.TopLevelRefitSAHCost = RefitSAHCost;
+		Stats.NumTopLevelRefits++;
+	}
+
+	Stats.TopLevelRefitSAHGrowth = RefitSAHGrowth;
+	Stats.TopLevelUpdateMS = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - Start).count();
+	return IsRebuilt;
+}
+
+bool CPUTopLevelAS::UpdateBottomLevel(uint32_t BottomLevelIndex, const StaticMesh& Mesh)
+{
+	const uint32_t NumLevels = LODChains[BottomLevelIndex] ? static_cast<uint32_t>(LODChains[BottomLevelIndex]->Levels.size()) : 0;
+	for (uint32_t Level = 0; Level < NumLevels; Level++)
+		LODBottomLevels[FirstLODBottomLevels[BottomLevelIndex] + Level].Update(Mesh);
+
+	return BottomLevels[BottomLevelIndex].Update(Mesh);
+}
+
+uint32_t CPUTopLevelAS::SelectLODs(const PrimaryRayCamera& Camera, float PixelError)
+{
+	const float RadiansToDegrees = 180.0f / 3.14159265f;
+
+	Vector3f Eye = Camera.Position;
+	Vector3f Gaze = LogPolarRays::GetGazeDirection(Camera);
+
+	Stats.NumSimplifiedInstances = 0;
+	Stats.NumSelectedTriangles = 0;
+	for (size_t i = 0; i < Instances.size(); i++)
+	{
+		CPUInstance& Instance = Instances[i];
+		const std::shared_ptr<const MeshLODChain>& Chain = LODChains[Instance.BottomLevelIndex];
+		Instance.LOD = 0;
+
+		if (Chain)
+		{
+			// Closest point of the instance box and its smallest angle to the gaze, anything the box could show is covered
+			const BoundingBox& Bounds = InstanceBounds[i];
+			Vector3f Center = Bounds.GetCenter();
+			Vector3f HalfExtent((Bounds.Max.X - Bounds.Min.X) * 0.5f, (Bounds.Max.Y - Bounds.Min.Y) * 0.5f, (Bounds.Max.Z - Bounds.Min.Z) * 0.5f);
+			float Radius = HalfExtent.Length();
+			Vector3f ToCenter = Center - Eye;
+			float CenterDistance = ToCenter.Length();
+
+			if (CenterDistance > Radius)
+			{
+				float CenterAngle = std::acos(Math::min(Math::max(ToCenter.Dot(Gaze) / CenterDistance, -1.0f), 1.0f));
+				float Eccentricity = Math::max(CenterAngle - std::asin(Radius / CenterDistance), 0.0f) * RadiansToDegrees;
+
+				// The error bound is in object space, instances scaled up show it larger
+				float Scale = Instance.ObjectToWorld.TransformVector(Vector3f(1.0f, 1.0f, 1.0f)).Length() / std::sqrt(3.0f);
+				float MaxError = MeshLOD::GetErrorForEccentricity(Camera.Foveation, Eccentricity, CenterDistance - Radius, PixelError);
+				Instance.LOD = MeshLOD::SelectLOD(*Chain, MaxError / Math::max(Scale, 1e-6f));
+			}
+		}
+
+		Stats.NumSimplifiedInstances += Instance.LOD > 0 ? 1 : 0;
+		Stats.NumSelectedTriangles += GetInstanceBottomLevel(Instance).GetBuildStats().NumTriangles;
+	}
+
+	return Stats.NumSimplifiedInstances;
+}
+
+void CPUTopLevelAS::ResetLODs()
+{
+	for (CPUInstance& Instance : Instances)
+		Instance.LOD = 0;
+
+	Stats.NumSimplifiedInstances = 0;
+	Stats.NumSelectedTriangles = Stats.NumInstancedTriangles;
+}
+
+void CPUTopLevelAS::UpdateInstanceBounds()
+{
+	InstanceBounds.resize(Instances.size());
+	for (size_t i = 0; i < Instances.size(); i++)
+	{
+		const CPUInstance& Instance = Instances[i];
+		Span<const BVHNode> Nodes = BottomLevels[Instance.BottomLevelIndex].GetBVH().GetNodes();
+
+		BoundingBox& Bounds = InstanceBounds[i] = BoundingBox();
+		if (Nodes.size() == 0)
+		{
+			// Never hit, but keeps the box valid for the build
+			Bounds.Grow(Instance.ObjectToWorld.TransformPoint(Vector3f(0.0f, 0.0f, 0.0f)));
+			continue;
+		}
+
+		const BVHNode& Root = Nodes[0];
+		for (uint32_t Corner = 0; Corner < 8; Corner++)
+		{
+			Vector3f Point((Corner & 1) ? Root.BoundsMax.X : Root.BoundsMin.X, (Corner & 2) ? Root.BoundsMax.Y : Root.BoundsMin.Y,
+				(Corner & 4) ? Root.BoundsMax.Z : Root.BoundsMin.Z);
+			Bounds.Grow(Instance.ObjectToWorld.TransformPoint(Point));
+		}
+	}
+}
+
+bool CPUTopLevelAS::TraceClosest(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, BVHTraversalStats& TraversalStats) const
+{
+	return TraceClosest(Origin, Direction, TMax, OutHit, AcceptHit, TraversalStats);
+}
+
+bool CPUTopLevelAS::TraceAny(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, BVHTraversalStats& TraversalStats) const
+{
+	return TraceAny(Origin, Direction, TMax, OutHit, AcceptHit, TraversalStats);
+}
+
+void CPUTopLevelAS::SetLayout(CPUBVHLayout InLayout)
+{
+	Layout = InLayout;
+	for (CPUBottomLevelAS& BottomLevel : BottomLevels)
+		BottomLevel.SetLayout(InLayout);
+	for (CPUBottomLevelAS& BottomLevel : LODBottomLevels)
+		BottomLevel.SetLayout(InLayout);
+}
+
+void CPUTopLevelAS::LogBuildStats() const
+{
+	CORE_INFO("CPU TLAS: {0} bottom levels with {1} triangles built in {2:.1f} ms, {3} instances with {4} triangles", Stats.NumBottomLevels,
+		Stats.NumUniqueTriangles, Stats.BottomLevelBuildMS, Stats.NumInstances, Stats.NumInstancedTriangles);
+	CORE_INFO("CPU TLAS: top level of {0} nodes, depth {1}, built in {2:.3f} ms", Stats.NumTopLevelNodes, Stats.TopLevelDepth,
+		Stats.TopLevelBuildMS);
+	if (Stats.NumLODBottomLevels > 0)
+		CORE_INFO("CPU TLAS: {0} LOD bottom levels, {1} instances simplified to {2} traced triangles", Stats.NumLODBottomLevels,
+			Stats.NumSimplifiedInstances, Stats.NumSelectedTriangles);
+}
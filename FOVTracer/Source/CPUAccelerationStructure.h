@@ -0,0 +1,509 @@
+#pragma once
+
+#include "BVH.h"
+#include "WideBVH.h"
+#include "SceneGeometry.h"
+#include "Transform.h"
+
+#include <cstdint>
+#include <vector>
+
+class SceneObject;
+class Scene;
+struct PrimaryRayCamera;
+
+/**
+* Mirrors D3D12_RAYTRACING_GEOMETRY_FLAGS. Opaque geometry never runs the any hit function, the rest runs it at most once
+* per primitive and ray since the BVH references every triangle exactly once.
+*/
+enum class CPUGeometryFlags : uint32_t
+{
+	None = 0,
+	Opaque = 1,
+	NoDuplicateAnyHitInvocation = 2
+};
+
+/**
+* U and V weight the second and third vertex like DXR barycentrics. GeometryIndex is the scene object, PrimitiveIndex the
+* triangle within it and TriangleIndex the triangle in SceneGeometry. A bottom level structure built over a single mesh
+* reports geometry 0 and its own triangle index, CPUTopLevelAS maps them back to the scene.
+* Hits on a simplified LOD have PrimitiveIndex in the indices of that level and no TriangleIndex, SceneGeometry only holds
+* the full meshes.
+*/
+struct CPURayHit
+{
+	float T = 0.0f;
+	float U = 0.0f;
+	float V = 0.0f;
+	uint32_t GeometryIndex = ~0u;
+	uint32_t PrimitiveIndex = ~0u;
+	uint32_t TriangleIndex = ~0u;
+	uint32_t LOD = 0;
+};
+
+/**
+* Which tree the trace functions walk. Both are built, the wide one is collapsed from the binary one.
+*/
+enum class CPUBVHLayout : uint32_t
+{
+	Binary,
+	Wide
+};
+
+struct CPUASBuildStats
+{
+	float BuildMS = 0.0f;
+	uint32_t NumTriangles = 0;
+	uint32_t NumOpaqueGeometries = 0;
+	uint32_t NumTransparentGeometries = 0;
+	uint32_t NumNodes = 0;
+	uint32_t NumLeaves = 0;
+	uint32_t Depth = 0;
+	float SAHCost = 0.0f;
+	uint32_t NumWideNodes = 0;
+	uint32_t WideDepth = 0;
+
+	/**
+	* Set by Update. SAHCost stays the cost after the last build, RefitSAHCost is the cost of the current tree.
+	* RefitSAHGrowth is how much the last refit grew the cost over SAHCost before deciding on a rebuild, so it keeps
+	* the growth that triggered one.
+	*/
+	float UpdateMS = 0.0f;
+	float RefitSAHCost = 0.0f;
+	float RefitSAHGrowth = 1.0f;
+	uint32_t NumRefits = 0;
+};
+
+/**
+* Single CPU acceleration structure over the whole scene: one triangle geometry per scene object, flagged opaque unless its
+* material has transparency like DXR::Create_Bottom_Level_AS does, over the world space triangles of SceneGeometry.
+* For hosts without a raytracing GPU and for measuring what the driver's build is up against.
+*/
+class CPUBottomLevelAS
+{
+public:
+	/**
+	* Objects has to be what Geometry was built from.
+	*/
+	void Build(const SceneGeometry& Geometry, Span<const SceneObject> Objects, const BVHBuildSettings& Settings = BVHBuildSettings());
+
+	/**
+	* A single geometry over the object space triangles of Mesh, for instancing under a CPUTopLevelAS. The mesh data has to be
+	* resident. LOD picks a level of Mesh.LODs instead of the full mesh.
+	*/
+	void Build(const StaticMesh& Mesh, const BVHBuildSettings& Settings = BVHBuildSettings(), uint32_t LOD = 0);
+
+	/**
+	* Takes the new positions of the triangles the structure was built from and refits both trees. Rebuilds instead once the
+	* refit SAH cost grew past MaxRefitSAHGrowth of the build settings, or if the triangle count changed. Returns true if it
+	* rebuilt. A mesh structure keeps the LOD it was built with.
+	*/
+	bool Update(const SceneGeometry& Geometry, Span<const SceneObject> Objects);
+	bool Update(const StaticMesh& Mesh);
+
+	void Clear();
+
+	/**
+	* Closest hit in (0, TMax). AnyHit(const CPURayHit&) is called for candidate hits on non-opaque geometry and returns false
+	* to ignore the hit, like IgnoreHit() in an any hit shader.
+	*/
+	template<class AnyHitFunc>
+	bool TraceClosest(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, AnyHitFunc&& AnyHit, BVHTraversalStats& Stats) const;
+
+	/**
+	* Any accepted hit in (0, TMax), like a shadow ray with ACCEPT_FIRST_HIT_AND_END_SEARCH.
+	*/
+	template<class AnyHitFunc>
+	bool TraceAny(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, AnyHitFunc&& AnyHit, BVHTraversalStats& Stats) const;
+
+	/**
+	* Closest hits of all rays of a prepared packet, returns a bit per ray that hit. Coherent packets walk the binary tree
+	* together, the rays of incoherent ones are traced one by one through the current layout.
+	*/
+	template<class AnyHitFunc>
+	uint32_t TraceClosestPacket(RayPacket& Packet, CPURayHit OutHits[RayPacket::MaxRays], AnyHitFunc&& AnyHit, BVHTraversalStats& Stats) const;
+
+	/**
+	* Treats every geometry as opaque.
+	*/
+	bool TraceClosest(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, BVHTraversalStats& Stats) const;
+	bool TraceAny(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, BVHTraversalStats& Stats) const;
+	uint32_t TraceClosestPacket(RayPacket& Packet, CPURayHit OutHits[RayPacket::MaxRays], BVHTraversalStats& Stats) const;
+
+	void SetLayout(CPUBVHLayout InLayout) { Layout = InLayout; }
+	CPUBVHLayout GetLayout() const { return Layout; }
+
+	CPUGeometryFlags GetGeometryFlags(uint32_t GeometryIndex) const { return GeometryFlags[GeometryIndex]; }
+	const BVH& GetBVH() const { return Tree; }
+	const WideBVH& GetWideBVH() const { return WideTree; }
+	const CPUASBuildStats& GetBuildStats() const { return Stats; }
+
+	/**
+	* Same rule as Create_Bottom_Level_AS.
+	*/
+	static CPUGeometryFlags GetGeometryFlags(const StaticMesh& Mesh);
+
+	void LogBuildStats() const;
+
+private:
+	struct Triangle
+	{
+		Vector3f A;
+		Vector3f B;
+		Vector3f C;
+	};
+
+	template<bool FirstHitOnly, class AnyHitFunc>
+	bool Trace(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, AnyHitFunc& AnyHit, BVHTraversalStats& TraversalStats) const;
+
+	void GatherTriangles(const SceneGeometry& Geometry);
+	void GatherTriangles(const StaticMesh& Mesh, Span<const uint32_t> Indices);
+	void GetTriangleBounds(std::vector<BoundingBox>& OutBounds) const;
+
+	/**
+	* Bounds Triangles and builds both trees and the stats with BuildSettings, the Build functions only gather the triangles
+	* and geometries.
+	*/
+	void BuildTrees();
+
+	/**
+	* Refits or rebuilds the trees over the updated Triangles, see Update.
+	*/
+	bool UpdateTrees();
+
+	/**
+	* Ray triangle test with the geometry flags applied. On an accepted hit HitT and OutHit are updated.
+	*/
+	template<class AnyHitFunc>
+	bool IntersectTriangleWithFlags(const Vector3f& Origin, const Vector3f& Direction, uint32_t TriangleIndex, float& HitT, CPURayHit& OutHit, AnyHitFunc& AnyHit) const;
+
+	BVH Tree;
+	WideBVH WideTree;
+	CPUBVHLayout Layout = CPUBVHLayout::Wide;
+	BVHBuildSettings BuildSettings;
+
+	// Indexed by the triangle index of SceneGeometry
+	std::vector<Triangle> Triangles;
+	std::vector<uint32_t> TriangleGeometries;
+
+	std::vector<CPUGeometryFlags> GeometryFlags;
+	std::vector<uint32_t> GeometryFirstTriangles;
+
+	// Level of the mesh a single mesh structure was built over
+	uint32_t BuiltLOD = 0;
+
+	CPUASBuildStats Stats;
+};
+
+template<class AnyHitFunc>
+bool CPUBottomLevelAS::IntersectTriangleWithFlags(const Vector3f& Origin, const Vector3f& Direction, uint32_t TriangleIndex, float& HitT, CPURayHit& OutHit, AnyHitFunc& AnyHit) const
+{
+	const Triangle& Tri = Triangles[TriangleIndex];
+
+	CPURayHit Candidate;
+	Candidate.T = HitT;
+	if (!IntersectTriangle(Origin, Direction, Tri.A, Tri.B, Tri.C, Candidate.T, Candidate.U, Candidate.V))
+		return false;
+
+	Candidate.GeometryIndex = TriangleGeometries[TriangleIndex];
+	Candidate.PrimitiveIndex = TriangleIndex - GeometryFirstTriangles[Candidate.GeometryIndex];
+	Candidate.TriangleIndex = TriangleIndex;
+
+	if (GeometryFlags[Candidate.GeometryIndex] != CPUGeometryFlags::Opaque && !AnyHit(static_cast<const CPURayHit&>(Candidate)))
+		return false;
+
+	HitT = Candidate.T;
+	OutHit = Candidate;
+	return true;
+}
+
+template<bool FirstHitOnly, class AnyHitFunc>
+bool CPUBottomLevelAS::Trace(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, AnyHitFunc& AnyHit, BVHTraversalStats& TraversalStats) const
+{
+	auto const IntersectPrimitive = [&](uint32_t TriangleIndex, float& HitT)
+	{
+		return IntersectTriangleWithFlags(Origin, Direction, TriangleIndex, HitT, OutHit, AnyHit);
+	};
+
+	if (Layout == CPUBVHLayout::Wide)
+	{
+		if (FirstHitOnly)
+			return WideTree.TraverseAny(Origin, Direction, TMax, IntersectPrimitive, TraversalStats);
+
+		return WideTree.Traverse(Origin, Direction, TMax, IntersectPrimitive, TraversalStats);
+	}
+
+	if (FirstHitOnly)
+		return Tree.TraverseAny(Origin, Direction, TMax, IntersectPrimitive, TraversalStats);
+
+	return Tree.Traverse(Origin, Direction, TMax, IntersectPrimitive, TraversalStats);
+}
+
+template<class AnyHitFunc>
+bool CPUBottomLevelAS::TraceClosest(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, AnyHitFunc&& AnyHit, BVHTraversalStats& TraversalStats) const
+{
+	return Trace<false>(Origin, Direction, TMax, OutHit, AnyHit, TraversalStats);
+}
+
+template<class AnyHitFunc>
+bool CPUBottomLevelAS::TraceAny(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, AnyHitFunc&& AnyHit, BVHTraversalStats& TraversalStats) const
+{
+	return Trace<true>(Origin, Direction, TMax, OutHit, AnyHit, TraversalStats);
+}
+
+template<class AnyHitFunc>
+uint32_t CPUBottomLevelAS::TraceClosestPacket(RayPacket& Packet, CPURayHit OutHits[RayPacket::MaxRays], AnyHitFunc&& AnyHit, BVHTraversalStats& TraversalStats) const
+{
+	uint32_t HitMask = 0;
+
+	if (!Packet.IsCoherent)
+	{
+		for (uint32_t r = 0; r < Packet.NumRays; r++)
+		{
+			Vector3f Origin(Packet.OriginX[r], Packet.OriginY[r], Packet.OriginZ[r]);
+			Vector3f Direction(Packet.DirectionX[r], Packet.DirectionY[r], Packet.DirectionZ[r]);
+			if (Trace<false>(Origin, Direction, Packet.TMax[r], OutHits[r], AnyHit, TraversalStats))
+			{
+				Packet.TMax[r] = OutHits[r].T;
+				HitMask |= 1u << r;
+			}
+		}
+
+		return HitMask;
+	}
+
+	Tree.TraversePacket(Packet, [&](uint32_t Ray, uint32_t TriangleIndex, float& HitT)
+	{
+		Vector3f Origin(Packet.OriginX[Ray], Packet.OriginY[Ray], Packet.OriginZ[Ray]);
+		Vector3f Direction(Packet.DirectionX[Ray], Packet.DirectionY[Ray], Packet.DirectionZ[Ray]);
+		if (!IntersectTriangleWithFlags(Origin, Direction, TriangleIndex, HitT, OutHits[Ray], AnyHit))
+			return false;
+
+		HitMask |= 1u << Ray;
+		return true;
+	}, TraversalStats);
+
+	return HitMask;
+}
+
+/**
+* One level up from CPUBottomLevelAS::Build(const StaticMesh&): an instance per scene object with its object to world
+* transform.
+*/
+struct CPUInstance
+{
+	Transform3x4 ObjectToWorld;
+	Transform3x4 WorldToObject;
+	uint32_t BottomLevelIndex = 0;
+
+	/**
+	* First triangle of the object in SceneGeometry, for filling in CPURayHit::TriangleIndex.
+	*/
+	uint32_t FirstTriangle = 0;
+
+	/**
+	* Level of the mesh the instance is traced with, set by CPUTopLevelAS::SelectLODs.
+	*/
+	uint32_t LOD = 0;
+};
+
+struct CPUTLASBuildStats
+{
+	float BottomLevelBuildMS = 0.0f;
+	float TopLevelBuildMS = 0.0f;
+	uint32_t NumBottomLevels = 0;
+	uint32_t NumInstances = 0;
+
+	/**
+	* Triangles stored in the bottom levels and triangles in the scene after instancing.
+	*/
+	uint32_t NumUniqueTriangles = 0;
+	uint32_t NumInstancedTriangles = 0;
+
+	uint32_t NumTopLevelNodes = 0;
+	uint32_t TopLevelDepth = 0;
+
+	/**
+	* Set by UpdateTopLevel, like the CPUASBuildStats of a bottom level.
+	*/
+	float TopLevelUpdateMS = 0.0f;
+	float TopLevelSAHCost = 0.0f;
+	float TopLevelRefitSAHCost = 0.0f;
+	float TopLevelRefitSAHGrowth = 1.0f;
+	uint32_t NumTopLevelRefits = 0;
+
+	/**
+	* Bottom levels over simplified LODs, and what the last SelectLODs picked: instances coarser than LOD 0 and the
+	* triangles all instances trace with.
+	*/
+	uint32_t NumLODBottomLevels = 0;
+	uint32_t NumSimplifiedInstances = 0;
+	uint32_t NumSelectedTriangles = 0;
+};
+
+/**
+* Two level CPU acceleration structure, the same split DXR::Create_Top_Level_AS does with one instance per scene object.
+* Every unique mesh gets an object space CPUBottomLevelAS, built in parallel, and a BVH over the world bounds
+* of the instances sits on top. Rays are moved into instance space when they enter an instance, so when only transforms
+* change, RebuildTopLevel touches one box per instance instead of any geometry.
+* Meshes with a LOD chain get a bottom level per simplified level as well, SelectLODs decides which one an instance traces.
+*/
+class CPUTopLevelAS
+{
+public:
+	/**
+	* One instance per scene object, in order, so hits report the same GeometryIndex as CPUBottomLevelAS over the whole scene.
+	* Locks the host meshes of the scene while the bottom levels are built, and stays empty if they can't be reloaded.
+	*/
+	void Build(Scene& InScene, const BVHBuildSettings& Settings = BVHBuildSettings());
+
+	void Clear();
+
+	/**
+	* Only takes effect after RebuildTopLevel.
+	*/
+	void SetInstanceTransform(uint32_t InstanceIndex, const Transform3x4& ObjectToWorld);
+
+	/**
+	* Rebuilds the instance BVH from the bottom level root bounds and the current transforms.
+	*/
+	void RebuildTopLevel();
+
+	/**
+	* Refits the instance BVH to the current transforms and bottom level bounds instead, with the same SAH growth check as
+	* CPUBottomLevelAS::Update. Returns true if it rebuilt.
+	*/
+	bool UpdateTopLevel();
+
+	/**
+	* For meshes whose vertices moved, Mesh has to be the one the bottom level was built from. The instances only see the new
+	* bounds after UpdateTopLevel or RebuildTopLevel. The LOD bottom levels of the mesh are refit along with it.
+	*/
+	bool UpdateBottomLevel(uint32_t BottomLevelIndex, const StaticMesh& Mesh);
+
+	/**
+	* Picks the coarsest LOD of every instance whose error stays below what the foveated image resolves where the instance is
+	* seen, see MeshLOD::GetErrorForEccentricity. PixelError is the error allowed in the fovea. The instance boxes stay those
+	* of LOD 0, simplified levels never leave them, so the top level doesn't change. Returns the number of instances coarser
+	* than LOD 0.
+	*/
+	uint32_t SelectLODs(const PrimaryRayCamera& Camera, float PixelError = 1.0f);
+
+	/**
+	* Traces every instance with its full mesh again.
+	*/
+	void ResetLODs();
+
+	/**
+	* Same contracts as the CPUBottomLevelAS trace functions, with the hit in scene terms.
+	*/
+	template<class AnyHitFunc>
+	bool TraceClosest(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, AnyHitFunc&& AnyHit, BVHTraversalStats& Stats) const;
+
+	template<class AnyHitFunc>
+	bool TraceAny(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, AnyHitFunc&& AnyHit, BVHTraversalStats& Stats) const;
+
+	/**
+	* Treats every geometry as opaque.
+	*/
+	bool TraceClosest(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, BVHTraversalStats& Stats) const;
+	bool TraceAny(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, BVHTraversalStats& Stats) const;
+
+	/**
+	* Layout of every bottom level, the top level is always walked as a binary tree.
+	*/
+	void SetLayout(CPUBVHLayout InLayout);
+
+	uint32_t GetNumInstances() const { return static_cast<uint32_t>(Instances.size()); }
+	const CPUInstance& GetInstance(uint32_t InstanceIndex) const { return Instances[InstanceIndex]; }
+	const CPUBottomLevelAS& GetBottomLevel(uint32_t BottomLevelIndex) const { return BottomLevels[BottomLevelIndex]; }
+	const BVH& GetBVH() const { return Tree; }
+	const CPUTLASBuildStats& GetBuildStats() const { return Stats; }
+
+	void LogBuildStats() const;
+
+private:
+	template<bool FirstHitOnly, class AnyHitFunc>
+	bool Trace(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, AnyHitFunc& AnyHit, BVHTraversalStats& TraversalStats) const;
+
+	void UpdateInstanceBounds();
+
+	const CPUBottomLevelAS& GetInstanceBottomLevel(const CPUInstance& Instance) const
+	{
+		return Instance.LOD == 0 ? BottomLevels[Instance.BottomLevelIndex] : LODBottomLevels[FirstLODBottomLevels[Instance.BottomLevelIndex] + Instance.LOD - 1];
+	}
+
+	std::vector<CPUBottomLevelAS> BottomLevels;
+	std::vector<CPUInstance> Instances;
+
+	// Simplified levels of all meshes, those of bottom level i start at FirstLODBottomLevels[i]. LODChains is parallel to
+	// BottomLevels and null for meshes without LODs.
+	std::vector<CPUBottomLevelAS> LODBottomLevels;
+	std::vector<uint32_t> FirstLODBottomLevels;
+	std::vector<std::shared_ptr<const MeshLODChain>> LODChains;
+
+	// Parallel to Instances
+	std::vector<BoundingBox> InstanceBounds;
+
+	BVH Tree;
+	BVHBuildSettings TopLevelSettings;
+	CPUBVHLayout Layout = CPUBVHLayout::Wide;
+
+	CPUTLASBuildStats Stats;
+};
+
+template<bool FirstHitOnly, class AnyHitFunc>
+bool CPUTopLevelAS::Trace(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, AnyHitFunc& AnyHit, BVHTraversalStats& TraversalStats) const
+{
+	auto const IntersectInstance = [&](uint32_t InstanceIndex, float& HitT)
+	{
+		const CPUInstance& Instance = Instances[InstanceIndex];
+
+		// The direction isn't normalized again, so distances along the ray stay in world units
+		Vector3f LocalOrigin = Instance.WorldToObject.TransformPoint(Origin);
+		Vector3f LocalDirection = Instance.WorldToObject.TransformVector(Direction);
+
+		auto const ToScene = [&](CPURayHit& Hit)
+		{
+			Hit.GeometryIndex = InstanceIndex;
+			Hit.TriangleIndex = Instance.LOD == 0 ? Instance.FirstTriangle + Hit.PrimitiveIndex : ~0u;
+			Hit.LOD = Instance.LOD;
+		};
+
+		auto InstanceAnyHit = [&](const CPURayHit& LocalHit)
+		{
+			CPURayHit Hit = LocalHit;
+			ToScene(Hit);
+			return AnyHit(static_cast<const CPURayHit&>(Hit));
+		};
+
+		const CPUBottomLevelAS& BottomLevel = GetInstanceBottomLevel(Instance);
+		CPURayHit Hit;
+		bool IsHit = FirstHitOnly ? BottomLevel.TraceAny(LocalOrigin, LocalDirection, HitT, Hit, InstanceAnyHit, TraversalStats)
+			: BottomLevel.TraceClosest(LocalOrigin, LocalDirection, HitT, Hit, InstanceAnyHit, TraversalStats);
+		if (!IsHit)
+			return false;
+
+		ToScene(Hit);
+		HitT = Hit.T;
+		OutHit = Hit;
+		return true;
+	};
+
+	if (FirstHitOnly)
+		return Tree.TraverseAny(Origin, Direction, TMax, IntersectInstance, TraversalStats);
+
+	return Tree.Traverse(Origin, Direction, TMax, IntersectInstance, TraversalStats);
+}
+
+template<class AnyHitFunc>
+bool CPUTopLevelAS::TraceClosest(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, AnyHitFunc&& AnyHit, BVHTraversalStats& TraversalStats) const
+{
+	return Trace<false>(Origin, Direction, TMax, OutHit, AnyHit, TraversalStats);
+}
+
+template<class AnyHitFunc>
+bool CPUTopLevelAS::TraceAny(const Vector3f& Origin, const Vector3f& Direction, float TMax, CPURayHit& OutHit, AnyHitFunc&& AnyHit, BVHTraversalStats& TraversalStats) const
+{
+	return Trace<true>(Origin, Direction, TMax, OutHit, AnyHit, TraversalStats);
+}
@@ -5,6 +5,36 @@
 #include "Math.h"
 #include "Application.h"
 
+VertexLayoutDefines::VertexLayoutDefines(const VertexLayout& layout)
+{
+	const std::pair<LPCWSTR, uint32_t> layoutValues[] =
+	{
+		{ L"VERTEX_PACKED", layout.Format == VertexFormat::Packed ? 1u : 0u },
+		{ L"VERTEX_STRIDE", layout.Stride },
+		{ L"VERTEX_TEXCOORD_OFFSET", layout.TexcoordOffset },
+		{ L"VERTEX_NORMAL_OFFSET", layout.NormalOffset },
+		{ L"VERTEX_TANGENT_OFFSET", layout.TangentOffset },
+		{ L"VERTEX_BINORMAL_OFFSET", layout.BinormalOffset },
+		{ L"VERTEX_TANGENT_FRAME_OFFSET", layout.TangentFrameOffset },
+	};
+
+	// Fill the strings first, the defines point into them
+	for (const auto& value : layoutValues)
+	{
+		names.push_back(value.first);
+		values.push_back(std::to_wstring(value.second));
+	}
+
+	for (size_t i = 0; i < names.size(); i++)
+		defines.push_back({ names[i].c_str(), values[i].c_str() });
+}
+
+void VertexLayoutDefines::Apply(D3D12ShaderInfo& info)
+{
+	info.defines = defines.data();
+	info.defineCount = static_cast<UINT32>(defines.size());
+}
+
 namespace D3DShaders
 {
 
@@ -792,15 +822,19 @@ namespace D3DResources
 		// Describe the texture
 		textureResource.resourceDesc.Width = textureInfo.width;
 		textureResource.resourceDesc.Height = textureInfo.height;
-		textureResource.resourceDesc.MipLevels = static_cast<UINT>(floor(log2(fminf(
-													static_cast<float>(textureResource.textureInfo.height),
-													static_cast<float>(textureResource.textureInfo.width))))
-													+ 1);
+		// A CPU generated chain is uploaded as is, otherwise make room for the full chain for Generate_Mips to fill in
+		textureResource.resourceDesc.MipLevels = textureInfo.mips.empty() ?
+													static_cast<UINT16>(floor(log2(fmaxf(
+													static_cast<float>(textureInfo.height),
+													static_cast<float>(textureInfo.width))))
+													+ 1) :
+													static_cast<UINT16>(textureInfo.mips.size());
 		textureResource.resourceDesc.DepthOrArraySize = 1;
 		textureResource.resourceDesc.SampleDesc.Count = 1;
-		textureResource.resourceDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		textureResource.resourceDesc.Format = textureInfo.format;
 		textureResource.resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-		textureResource.resourceDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+		// Only Generate_Mips writes to textures, block compressed formats can't have unordered access at all
+		textureResource.resourceDesc.Flags = textureInfo.mips.empty() ? D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS : D3D12_RESOURCE_FLAG_NONE;
 		textureResource.resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
 
 		// Create the texture resource
@@ -810,9 +844,13 @@ namespace D3DResources
 		textureResource.texture->SetName(L"Texture");
 #endif
 
+		// Rows of the upload buffer are padded to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT, every mip we have gets its own footprint
+		UINT64 uploadSize = 0;
+		d3d.Device->GetCopyableFootprints(&textureResource.resourceDesc, 0, Math::max(static_cast<UINT>(textureInfo.mips.size()), 1u), 0, nullptr, nullptr, nullptr, &uploadSize);
+
 		// Describe the resource
 		D3D12_RESOURCE_DESC resourceDesc = {};
-		resourceDesc.Width = textureInfo.height * textureInfo.width * textureInfo.stride;
+		resourceDesc.Width = uploadSize;
 		resourceDesc.Height = 1;
 		resourceDesc.DepthOrArraySize = 1;
 		resourceDesc.MipLevels = 1;
@@ -833,41 +871,59 @@ namespace D3DResources
 	}
 
 	/**
-	 * Copy a texture from the CPU to the GPU upload heap, then schedule a copy to the default heap.
+	 * Copy a texture and its mips from the CPU to the GPU upload heap, then schedule a copy to the default heap.
 	 */
 	void Upload_Texture(D3D12Global& d3d, ID3D12Resource* destResource, ID3D12Resource* srcResource, const TextureInfo& texture)
 	{
-		// Copy the pixel data to the upload heap resource
+		const UINT numMips = Math::max(static_cast<UINT>(texture.mips.size()), 1u);
+		const UINT maxMips = 16;
+
+		if (numMips > maxMips)
+		{
+			CORE_ERROR("Texture has {0} mips, only {1} can be uploaded", numMips, maxMips);
+			return;
+		}
+
+		// Describe the upload heap resource locations for the copies
+		D3D12_RESOURCE_DESC destDesc = destResource->GetDesc();
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprints[maxMips] = {};
+		UINT numRows[maxMips] = {};
+		UINT64 rowSizes[maxMips] = {};
+		d3d.Device->GetCopyableFootprints(&destDesc, 0, numMips, 0, footprints, numRows, rowSizes, nullptr);
+
+		// Copy the pixel data to the upload heap resource, row by row since the footprint rows are padded
 		UINT8* pData;
 		HRESULT hr = srcResource->Map(0, nullptr, reinterpret_cast<void**>(&pData));
-		memcpy(pData, texture.pixels.data(), texture.width * texture.height * texture.stride);
-		srcResource->Unmap(0, nullptr);
+		Utils::Validate(hr, L"Error: failed to map texture upload heap!");
 
-		// Describe the upload heap resource location for the copy
-		D3D12_SUBRESOURCE_FOOTPRINT subresource = {};
-		subresource.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-		subresource.Width = texture.width;
-		subresource.Height = texture.height;
-		subresource.RowPitch = /*ALIGN(D3D12_TEXTURE_DATA_PITCH_ALIGNMENT,*/ texture.width * texture.stride/*)*/;
-		subresource.Depth = 1;
+		for (UINT mip = 0; mip < numMips; mip++)
+		{
+			const size_t srcOffset = texture.mips.empty() ? 0 : texture.mips[mip].offset;
+			// A row of a block compressed format is a row of 4x4 blocks, the footprint already accounts for that
+			const size_t srcRowPitch = static_cast<size_t>(rowSizes[mip]);
 
-		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
-		footprint.Offset = texture.offset;
-		footprint.Footprint = subresource;
+			for (UINT row = 0; row < numRows[mip]; row++)
+				memcpy(pData + footprints[mip].Offset + row * footprints[mip].Footprint.RowPitch, texture.pixels.Data() + srcOffset + row * srcRowPitch, srcRowPitch);
+		}
+
+		srcResource->Unmap(0, nullptr);
 
-		D3D12_TEXTURE_COPY_LOCATION source = {};
-		source.pResource = srcResource;
-		source.PlacedFootprint = footprint;
-		source.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+		for (UINT mip = 0; mip < numMips; mip++)
+		{
+			D3D12_TEXTURE_COPY_LOCATION source = {};
+			source.pResource = srcResource;
+			source.PlacedFootprint = footprints[mip];
+			source.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
 
-		// Describe the default heap resource location for the copy
-		D3D12_TEXTURE_COPY_LOCATION destination = {};
-		destination.pResource = destResource;
-		destination.SubresourceIndex = 0;
-		destination.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+			// Describe the default heap resource location for the copy
+			D3D12_TEXTURE_COPY_LOCATION destination = {};
+			destination.pResource = destResource;
+			destination.SubresourceIndex = mip;
+			destination.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
 
-		// Copy the buffer resource from the upload heap to the texture resource on the default heap
-		d3d.CmdList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+			// Copy the buffer resource from the upload heap to the texture resource on the default heap
+			d3d.CmdList->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+		}
 
 		// Transition the texture to a shader resource
 		D3D12_RESOURCE_BARRIER barrier = {};
@@ -882,7 +938,7 @@ namespace D3DResources
 
 	void Generate_Mips(TextureResource& textureResource, D3D12Global& d3d, D3D12Compute& dxComp)
 	{
-		//Calculate mipmap levels from texture resolution, assume power of 2 resolution for now
+		//Only used for textures that come without a CPU generated chain, see TextureMips
 		int MaxMipLevels = textureResource.resourceDesc.MipLevels;
 
 		D3D12::Submit_CmdList(d3d);
@@ -944,7 +1000,7 @@ namespace D3DResources
 
 			//Write new UAV to uav slot of mip heap
 			//destTextureUAVDesc.Texture2D.MipSlice = 0;
-			destTextureUAVDesc.Texture2D.MipSlice = static_cast<UINT>(mipLevel);
+			destTextureUAVDesc.Texture2D.MipSlice = static_cast<UINT>(mipLevel + 1);
 			d3d.Device->CreateUnorderedAccessView(textureResource.texture, nullptr, &destTextureUAVDesc, CPUhandle);
 			CPUhandle.ptr += handleIncrement;
 
@@ -963,7 +1019,7 @@ namespace D3DResources
 			d3d.CmdList->SetComputeRootDescriptorTable(2, GPUhandle);
 
 			//Dispatch compute on dimensions of destination tex
-			d3d.CmdList->Dispatch(Math::max(dstWidth / 8, 1u), Math::max(dstWidth / 8, 1u), 1);
+			d3d.CmdList->Dispatch((dstWidth + 7) / 8, (dstHeight + 7) / 8, 1);
 			
 			//barrier to wait on the texture to be freed up again
 			d3d.CmdList->ResourceBarrier(1, &uavBarrier);
@@ -985,8 +1041,10 @@ namespace D3DResources
 	{
 		const StaticMesh& model = sceneObj.Mesh;
 
+		VertexLayout layout = VertexLayout::Get(DX12Constants::vertex_format);
+
 		// Create the vertex buffer resource
-		D3D12BufferCreateInfo info(((UINT)model.Vertices.size() * sizeof(Vertex)), D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_STATE_GENERIC_READ);
+		D3D12BufferCreateInfo info(((UINT)model.Vertices.size() * layout.Stride), D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_STATE_GENERIC_READ);
 		Create_Buffer(d3d, info, &resources.sceneObjResources[index].vertexBuffer);
 #if NAME_D3D_RESOURCES
 		resources.sceneObjResources[index].vertexBuffer->SetName(L"Vertex Buffer");
@@ -998,12 +1056,15 @@ namespace D3DResources
 		HRESULT hr = resources.sceneObjResources[index].vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin));
 		Utils::Validate(hr, L"Error: failed to map vertex buffer!");
 
-		memcpy(pVertexDataBegin, model.Vertices.data(), info.size);
+		if (layout.Format == VertexFormat::Packed)
+			VertexPacking::EncodeVertices(model.Vertices, reinterpret_cast<PackedVertex*>(pVertexDataBegin));
+		else
+			memcpy(pVertexDataBegin, model.Vertices.data(), info.size);
 		resources.sceneObjResources[index].vertexBuffer->Unmap(0, nullptr);
 
 		// Initialize the vertex buffer view
 		resources.sceneObjResources[index].vertexBufferView.BufferLocation = resources.sceneObjResources[index].vertexBuffer->GetGPUVirtualAddress();
-		resources.sceneObjResources[index].vertexBufferView.StrideInBytes = sizeof(Vertex);
+		resources.sceneObjResources[index].vertexBufferView.StrideInBytes = layout.Stride;
 		resources.sceneObjResources[index].vertexBufferView.SizeInBytes = static_cast<UINT>(info.size);
 	}
 
@@ -1114,7 +1175,8 @@ namespace D3DResources
 //#if NAME_D3D_RESOURCES
 //		resources.sceneObjResources[index].materialCB->SetName(L"Material Constant Buffer");
 //#endif
-		UINT8* pData;
+		// Stays mapped so streamed textures can update the resolution later
+		UINT8*& pData = resources.sceneObjResources[index].materialCBStart;
 		HRESULT hr = resources.sceneObjResources[index].materialCB->Map(0, nullptr, reinterpret_cast<void**>(&pData));
 		Utils::Validate(hr, L"Error: failed to map Material constant buffer!");
 
@@ -1250,6 +1312,7 @@ namespace D3DResources
 		{
 			if (resources.sceneObjResources[i].materialCB) resources.sceneObjResources[i].materialCB->Unmap(0, nullptr);
 			if (resources.sceneObjResources[i].materialCBStart) resources.sceneObjResources[i].materialCBStart = nullptr;
+			// Shared buffers hold one reference per object, see Tracer::AddObject
 			SAFE_RELEASE(resources.sceneObjResources[i].vertexBuffer);
 			SAFE_RELEASE(resources.sceneObjResources[i].indexBuffer);
 			SAFE_RELEASE(resources.sceneObjResources[i].materialCB);
@@ -1293,154 +1356,215 @@ namespace DXR
 {
 
 	/**
-	* Create the bottom level acceleration structure.
+	* Room for Needed, doubling what was there before so streamed additions don't reallocate every time.
 	*/
-	void Create_Bottom_Level_AS(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources, Scene& scene)
+	static UINT GrowCapacity(UINT Current, UINT Needed)
 	{
+		return Current > 0 ? Math::max(Needed, Current * 2) : Math::max(Needed, 1u);
+	}
 
-		std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geometryDescs;
+	/**
+	* Create a bottom level acceleration structure for every mesh that doesn't have one yet.
+	* Objects sharing vertex buffers are instances of one mesh and share its BLAS, placement is left to the TLAS.
+	*/
+	void Create_Bottom_Level_AS(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources, Scene& scene)
+	{
+		// Build buffers of earlier calls are done by now, callers wait for the GPU before adding geometry
+		for (AccelerationStructureBuffer& blas : dxr.BLAS)
+		{
+			SAFE_RELEASE(blas.pScratch);
+			SAFE_RELEASE(blas.pResult);
+		}
 
-		for (int i = 0; i < scene.SceneObjects.size(); i++)
+		const uint32_t firstNewBLAS = static_cast<uint32_t>(dxr.BLAS.size());
+		for (size_t i = dxr.objectBLAS.size(); i < scene.SceneObjects.size(); i++)
 		{
+			ID3D12Resource* vertexBuffer = resources.sceneObjResources[i].vertexBuffer;
+			auto const existing = dxr.meshBLAS.find(vertexBuffer);
+			if (existing != dxr.meshBLAS.end())
+			{
+				dxr.objectBLAS.push_back(existing->second);
+				continue;
+			}
+
 			StaticMesh& model = scene.SceneObjects[i].Mesh;
 
-			// Describe the geometry that goes in the bottom acceleration structure(s)
+			// Describe the geometry that goes in the bottom acceleration structure, in object space. Counts come from the buffer
+			// views, the host copy of the mesh may already be dropped.
 			D3D12_RAYTRACING_GEOMETRY_DESC geometryDesc;
 			geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
-			geometryDesc.Triangles.VertexBuffer.StartAddress = resources.sceneObjResources[i].vertexBuffer->GetGPUVirtualAddress();
+			geometryDesc.Triangles.VertexBuffer.StartAddress = vertexBuffer->GetGPUVirtualAddress();
 			geometryDesc.Triangles.VertexBuffer.StrideInBytes = resources.sceneObjResources[i].vertexBufferView.StrideInBytes;
-			geometryDesc.Triangles.VertexCount = static_cast<UINT>(model.Vertices.size());
+			geometryDesc.Triangles.VertexCount = resources.sceneObjResources[i].vertexBufferView.SizeInBytes / resources.sceneObjResources[i].vertexBufferView.StrideInBytes;
 			geometryDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
 			geometryDesc.Triangles.IndexBuffer = resources.sceneObjResources[i].indexBuffer->GetGPUVirtualAddress();
 			geometryDesc.Triangles.IndexFormat = resources.sceneObjResources[i].indexBufferView.Format;
-			geometryDesc.Triangles.IndexCount = static_cast<UINT>(model.Indices.size());
+			geometryDesc.Triangles.IndexCount = resources.sceneObjResources[i].indexBufferView.SizeInBytes / sizeof(UINT);
 			geometryDesc.Triangles.Transform3x4 = 0;
-			geometryDesc.Flags = !scene.SceneObjects[i].Mesh.HasTransparency ? D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE : D3D12_RAYTRACING_GEOMETRY_FLAG_NO_DUPLICATE_ANYHIT_INVOCATION;
+			geometryDesc.Flags = !model.HasTransparency ? D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE : D3D12_RAYTRACING_GEOMETRY_FLAG_NO_DUPLICATE_ANYHIT_INVOCATION;
 
-			geometryDescs.push_back(geometryDesc);
-		}
-		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_COMPACTION;
+			D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_COMPACTION;
 
-		// Get the size requirements for the BLAS buffers
-		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS ASInputs = {};
-		ASInputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
-		ASInputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-		ASInputs.pGeometryDescs = geometryDescs.data();
-		ASInputs.NumDescs = static_cast<UINT>(geometryDescs.size());
-		ASInputs.Flags = buildFlags;
+			// Get the size requirements for the BLAS buffers
+			D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS ASInputs = {};
+			ASInputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+			ASInputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+			ASInputs.pGeometryDescs = &geometryDesc;
+			ASInputs.NumDescs = 1;
+			ASInputs.Flags = buildFlags;
 
-		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO ASPreBuildInfo = {};
-		d3d.Device->GetRaytracingAccelerationStructurePrebuildInfo(&ASInputs, &ASPreBuildInfo);
+			D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO ASPreBuildInfo = {};
+			d3d.Device->GetRaytracingAccelerationStructurePrebuildInfo(&ASInputs, &ASPreBuildInfo);
 
-		ASPreBuildInfo.ScratchDataSizeInBytes = ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, ASPreBuildInfo.ScratchDataSizeInBytes);
-		ASPreBuildInfo.ResultDataMaxSizeInBytes = ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, ASPreBuildInfo.ResultDataMaxSizeInBytes);
+			ASPreBuildInfo.ScratchDataSizeInBytes = ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, ASPreBuildInfo.ScratchDataSizeInBytes);
+			ASPreBuildInfo.ResultDataMaxSizeInBytes = ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, ASPreBuildInfo.ResultDataMaxSizeInBytes);
 
-		// Create the BLAS scratch buffer
-		D3D12BufferCreateInfo bufferInfo(ASPreBuildInfo.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-		bufferInfo.alignment = Math::max(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
-		D3DResources::Create_Buffer(d3d, bufferInfo, &dxr.BLAS.pScratch);
+			AccelerationStructureBuffer blas;
 
+			// Create the BLAS scratch buffer
+			D3D12BufferCreateInfo bufferInfo(ASPreBuildInfo.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+			bufferInfo.alignment = Math::max(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+			D3DResources::Create_Buffer(d3d, bufferInfo, &blas.pScratch);
 #if NAME_D3D_RESOURCES
-		dxr.BLAS.pScratch->SetName(L"DXR BLAS Scratch");
+			blas.pScratch->SetName(L"DXR BLAS Scratch");
 #endif
 
-		// Create the BLAS buffer
-		bufferInfo.size = ASPreBuildInfo.ResultDataMaxSizeInBytes;
-		bufferInfo.state = D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE;
-		D3DResources::Create_Buffer(d3d, bufferInfo, &dxr.BLAS.pResult);
+			// Create the BLAS buffer and the one it gets compacted into
+			bufferInfo.size = ASPreBuildInfo.ResultDataMaxSizeInBytes;
+			bufferInfo.state = D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE;
+			D3DResources::Create_Buffer(d3d, bufferInfo, &blas.pResult);
+			D3DResources::Create_Buffer(d3d, bufferInfo, &blas.pCompactResult);
 #if NAME_D3D_RESOURCES
-		dxr.BLAS.pResult->SetName(L"DXR BLAS");
+			blas.pResult->SetName(L"DXR BLAS");
+			blas.pCompactResult->SetName(L"DXR BLAS Compacted");
 #endif
 
-		// Describe and build the bottom level acceleration structure
-		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
-		buildDesc.Inputs = ASInputs;
-		buildDesc.ScratchAccelerationStructureData = dxr.BLAS.pScratch->GetGPUVirtualAddress();
-		buildDesc.DestAccelerationStructureData = dxr.BLAS.pResult->GetGPUVirtualAddress();
+			// Describe and build the bottom level acceleration structure, the builds don't depend on each other
+			D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
+			buildDesc.Inputs = ASInputs;
+			buildDesc.ScratchAccelerationStructureData = blas.pScratch->GetGPUVirtualAddress();
+			buildDesc.DestAccelerationStructureData = blas.pResult->GetGPUVirtualAddress();
 
-		d3d.CmdList->BuildRaytracingAccelerationStructure(&buildDesc, 0, nullptr);
-		
+			d3d.CmdList->BuildRaytracingAccelerationStructure(&buildDesc, 0, nullptr);
+
+			dxr.meshBLAS.emplace(vertexBuffer, static_cast<uint32_t>(dxr.BLAS.size()));
+			dxr.objectBLAS.push_back(static_cast<uint32_t>(dxr.BLAS.size()));
+			dxr.BLAS.push_back(blas);
+		}
+
+		if (firstNewBLAS == dxr.BLAS.size())
+			return;
 
-		// Wait for the BLAS build to complete
+		// Wait for the BLAS builds to complete
 		D3D12_RESOURCE_BARRIER uavBarrier;
 		uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-		uavBarrier.UAV.pResource = dxr.BLAS.pResult;
+		uavBarrier.UAV.pResource = nullptr;
 		uavBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
 		d3d.CmdList->ResourceBarrier(1, &uavBarrier);
 
-		D3DResources::Create_Buffer(d3d, bufferInfo, &dxr.BLAS.pCompactResult);
-		d3d.CmdList->CopyRaytracingAccelerationStructure(dxr.BLAS.pCompactResult->GetGPUVirtualAddress(), dxr.BLAS.pResult->GetGPUVirtualAddress(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_COPY_MODE_COMPACT);
+		for (size_t i = firstNewBLAS; i < dxr.BLAS.size(); i++)
+			d3d.CmdList->CopyRaytracingAccelerationStructure(dxr.BLAS[i].pCompactResult->GetGPUVirtualAddress(), dxr.BLAS[i].pResult->GetGPUVirtualAddress(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_COPY_MODE_COMPACT);
 
 		d3d.CmdList->ResourceBarrier(1, &uavBarrier);
+
+		CORE_TRACE("Built {0} BLASes, {1} for {2} scene objects", dxr.BLAS.size() - firstNewBLAS, dxr.BLAS.size(), dxr.objectBLAS.size());
 	}
 
 	/**
 	* Create the top level acceleration structure and its associated buffers.
+	* Every scene object is one instance of its mesh's BLAS, placed by its object to world transform. The instance index is the
+	* object index and each instance owns a shadow and a primary hit group record, see Create_Shader_Table.
+	* Returns true if the TLAS buffers were created anew, anything that points at the old ones has to be rewritten.
 	*/
-	void Create_Top_Level_AS(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources)
+	bool Create_Top_Level_AS(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources, Scene& scene)
 	{
-		// Describe the TLAS geometry instance(s)
-		D3D12_RAYTRACING_INSTANCE_DESC instanceDesc = {};
-		instanceDesc.InstanceID = 0;
-		instanceDesc.InstanceContributionToHitGroupIndex = 0;
-		instanceDesc.InstanceMask = 0xFF;
-		instanceDesc.Transform[0][0] = instanceDesc.Transform[1][1] = instanceDesc.Transform[2][2] = 1;
-		instanceDesc.AccelerationStructure = dxr.BLAS.pCompactResult->GetGPUVirtualAddress();
-		instanceDesc.Flags = D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_FRONT_COUNTERCLOCKWISE;
+		const UINT numInstances = static_cast<UINT>(dxr.objectBLAS.size());
+
+		// Rebuilt in place while the instances fit, so streamed objects don't move the TLAS the descriptors point at
+		const bool isNewTLAS = dxr.TLAS.pResult == nullptr || numInstances > dxr.tlasInstanceCapacity;
+		if (isNewTLAS)
+		{
+			SAFE_RELEASE(dxr.TLAS.pScratch);
+			SAFE_RELEASE(dxr.TLAS.pResult);
+			SAFE_RELEASE(dxr.TLAS.pInstanceDesc);
+			dxr.tlasInstanceCapacity = GrowCapacity(dxr.tlasInstanceCapacity, numInstances);
+		}
+
+		// Describe the TLAS geometry instances
+		std::vector<D3D12_RAYTRACING_INSTANCE_DESC> instanceDescs(numInstances);
+		for (UINT i = 0; i < numInstances; i++)
+		{
+			D3D12_RAYTRACING_INSTANCE_DESC& instanceDesc = instanceDescs[i];
+			instanceDesc.InstanceID = i;
+			instanceDesc.InstanceContributionToHitGroupIndex = i * DX12Constants::hit_groups_per_instance;
+			instanceDesc.InstanceMask = 0xFF;
+			memcpy(instanceDesc.Transform, scene.SceneObjects[i].ObjectToWorld.M, sizeof(instanceDesc.Transform));
+			instanceDesc.AccelerationStructure = dxr.BLAS[dxr.objectBLAS[i]].pCompactResult->GetGPUVirtualAddress();
+			instanceDesc.Flags = D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_FRONT_COUNTERCLOCKWISE;
+		}
 
 		// Create the TLAS instance buffer
-		D3D12BufferCreateInfo instanceBufferInfo;
-		instanceBufferInfo.size = sizeof(D3D12_RAYTRACING_INSTANCE_DESC);
-		instanceBufferInfo.heapType = D3D12_HEAP_TYPE_UPLOAD;
-		instanceBufferInfo.flags = D3D12_RESOURCE_FLAG_NONE;
-		instanceBufferInfo.state = D3D12_RESOURCE_STATE_GENERIC_READ;
-		D3DResources::Create_Buffer(d3d, instanceBufferInfo, &dxr.TLAS.pInstanceDesc);
+		if (isNewTLAS)
+		{
+			D3D12BufferCreateInfo instanceBufferInfo;
+			instanceBufferInfo.size = static_cast<UINT64>(dxr.tlasInstanceCapacity) * sizeof(D3D12_RAYTRACING_INSTANCE_DESC);
+			instanceBufferInfo.heapType = D3D12_HEAP_TYPE_UPLOAD;
+			instanceBufferInfo.flags = D3D12_RESOURCE_FLAG_NONE;
+			instanceBufferInfo.state = D3D12_RESOURCE_STATE_GENERIC_READ;
+			D3DResources::Create_Buffer(d3d, instanceBufferInfo, &dxr.TLAS.pInstanceDesc);
 #if NAME_D3D_RESOURCES
-		dxr.TLAS.pInstanceDesc->SetName(L"DXR TLAS Instance Descriptors");
+			dxr.TLAS.pInstanceDesc->SetName(L"DXR TLAS Instance Descriptors");
 #endif
+		}
 
 		// Copy the instance data to the buffer
 		UINT8* pData;
 		dxr.TLAS.pInstanceDesc->Map(0, nullptr, (void**)&pData);
-		memcpy(pData, &instanceDesc, sizeof(D3D12_RAYTRACING_INSTANCE_DESC));
+		memcpy(pData, instanceDescs.data(), instanceDescs.size() * sizeof(D3D12_RAYTRACING_INSTANCE_DESC));
 		dxr.TLAS.pInstanceDesc->Unmap(0, nullptr);
 
 		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS buildFlags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE;
 
-		// Get the size requirements for the TLAS buffers
 		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS ASInputs = {};
 		ASInputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
 		ASInputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
 		ASInputs.InstanceDescs = dxr.TLAS.pInstanceDesc->GetGPUVirtualAddress();
-		ASInputs.NumDescs = 1;
 		ASInputs.Flags = buildFlags;
 
-		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO ASPreBuildInfo = {};
-		d3d.Device->GetRaytracingAccelerationStructurePrebuildInfo(&ASInputs, &ASPreBuildInfo);
+		if (isNewTLAS)
+		{
+			// Get the size requirements for the TLAS buffers, sized for every instance they have room for
+			ASInputs.NumDescs = dxr.tlasInstanceCapacity;
+
+			D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO ASPreBuildInfo = {};
+			d3d.Device->GetRaytracingAccelerationStructurePrebuildInfo(&ASInputs, &ASPreBuildInfo);
 
-		ASPreBuildInfo.ResultDataMaxSizeInBytes = ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, ASPreBuildInfo.ResultDataMaxSizeInBytes);
-		ASPreBuildInfo.ScratchDataSizeInBytes = ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, ASPreBuildInfo.ScratchDataSizeInBytes);
+			ASPreBuildInfo.ResultDataMaxSizeInBytes = ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, ASPreBuildInfo.ResultDataMaxSizeInBytes);
+			ASPreBuildInfo.ScratchDataSizeInBytes = ALIGN(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, ASPreBuildInfo.ScratchDataSizeInBytes);
 
-		// Set TLAS size
-		dxr.tlasSize = ASPreBuildInfo.ResultDataMaxSizeInBytes;
+			// Set TLAS size
+			dxr.tlasSize = ASPreBuildInfo.ResultDataMaxSizeInBytes;
 
-		// Create TLAS scratch buffer
-		D3D12BufferCreateInfo bufferInfo(ASPreBuildInfo.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
-		bufferInfo.alignment = Math::max(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
-		D3DResources::Create_Buffer(d3d, bufferInfo, &dxr.TLAS.pScratch);
+			// Create TLAS scratch buffer
+			D3D12BufferCreateInfo bufferInfo(ASPreBuildInfo.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+			bufferInfo.alignment = Math::max(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+			D3DResources::Create_Buffer(d3d, bufferInfo, &dxr.TLAS.pScratch);
 #if NAME_D3D_RESOURCES
-		dxr.TLAS.pScratch->SetName(L"DXR TLAS Scratch");
+			dxr.TLAS.pScratch->SetName(L"DXR TLAS Scratch");
 #endif
 
-		// Create the TLAS buffer
-		bufferInfo.size = ASPreBuildInfo.ResultDataMaxSizeInBytes;
-		bufferInfo.state = D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE;
-		D3DResources::Create_Buffer(d3d, bufferInfo, &dxr.TLAS.pResult);
+			// Create the TLAS buffer
+			bufferInfo.size = ASPreBuildInfo.ResultDataMaxSizeInBytes;
+			bufferInfo.state = D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE;
+			D3DResources::Create_Buffer(d3d, bufferInfo, &dxr.TLAS.pResult);
 #if NAME_D3D_RESOURCES
-		dxr.TLAS.pResult->SetName(L"DXR TLAS");
+			dxr.TLAS.pResult->SetName(L"DXR TLAS");
 #endif
+		}
 
 		// Describe and build the TLAS
+		ASInputs.NumDescs = numInstances;
+
 		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
 		buildDesc.Inputs = ASInputs;
 		buildDesc.ScratchAccelerationStructureData = dxr.TLAS.pScratch->GetGPUVirtualAddress();
@@ -1454,6 +1578,8 @@ namespace DXR
 		uavBarrier.UAV.pResource = dxr.TLAS.pResult;
 		uavBarrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
 		d3d.CmdList->ResourceBarrier(1, &uavBarrier);
+
+		return isNewTLAS;
 	}
 
 	/**
@@ -1553,8 +1679,15 @@ namespace DXR
 	{
 		// Load and compile the Closest Hit shader
 		dxr.hit = HitProgram(L"Hit");
+		VertexLayoutDefines layoutDefines(VertexLayout::Get(DX12Constants::vertex_format));
+
 		dxr.hit.chs = RtProgram(D3D12ShaderInfo(L"Shaders\\ClosestHit.hlsl", L"", L"lib_6_3"));
+		layoutDefines.Apply(dxr.hit.chs.info);
 		D3DShaders::Compile_Shader(shaderCompiler, dxr.hit.chs);
+
+		// layoutDefines owns the define strings, don't keep pointers to them around
+		dxr.hit.chs.info.defines = nullptr;
+		dxr.hit.chs.info.defineCount = 0;
 	}
 
 	/**
@@ -1563,8 +1696,15 @@ namespace DXR
 	void Add_Alpha_AnyHit_Program(D3D12Global& d3d, DXRGlobal& dxr, D3D12ShaderCompilerInfo& shaderCompiler)
 	{
 		// Load and compile the Closest Hit shader
+		VertexLayoutDefines layoutDefines(VertexLayout::Get(DX12Constants::vertex_format));
+
 		dxr.hit.ahs = RtProgram(D3D12ShaderInfo(L"Shaders\\AlphaAnyHit.hlsl", L"", L"lib_6_3"));
+		layoutDefines.Apply(dxr.hit.ahs.info);
 		D3DShaders::Compile_Shader(shaderCompiler, dxr.hit.ahs);
+
+		// layoutDefines owns the define strings, don't keep pointers to them around
+		dxr.hit.ahs.info.defines = nullptr;
+		dxr.hit.ahs.info.defineCount = 0;
 	}
 
 	void Add_Shadow_AnyHit_Program(D3D12Global& d3d, DXRGlobal& dxr, D3D12ShaderCompilerInfo& shaderCompiler)
@@ -1846,16 +1986,17 @@ namespace DXR
 
 	/**
 	* Create the DXR shader table.
+	* The table is kept while the scene objects fit, then only the hit records of objects from firstObject on are written.
 	*/
-	void Create_Shader_Table(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources)
+	void Create_Shader_Table(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources, uint32_t firstObject)
 	{
 		/*
 		The Shader Table layout is as follows:
 			Entry 0 - Ray Generation shader
-			Entry 1 - Miss shader
-			ntry 2 - Shadow miss
-			Entry 3 - Shadow hit
-			NSceneObjs ClosestHit entries
+			Entry 1 - Central ray generation shader
+			Entry 2 - Shadow miss
+			Entry 3 - Miss shader
+			NSceneObjs Shadow hit and ClosestHit entry pairs, one pair per TLAS instance
 		All shader records in the Shader Table must have the same size, so shader record size will be based on the largest required entry.
 		The ray generation program requires the largest entry:
 			32 bytes - D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES
@@ -1866,71 +2007,86 @@ namespace DXR
 
 		uint32_t shaderIdSize = D3D12_SHADER_IDENTIFIER_SIZE_IN_BYTES;
 		uint32_t shaderTableSize = 0;
+		const uint32_t numObjects = static_cast<uint32_t>(resources.sceneObjResources.size());
 
 		dxr.shaderTableRecordSize = shaderIdSize;
 		dxr.shaderTableRecordSize += 8;							// CBV/SRV/UAV descriptor table
 		dxr.shaderTableRecordSize = ALIGN(D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT, dxr.shaderTableRecordSize);
 
-		shaderTableSize = (dxr.shaderTableRecordSize * (5 + static_cast<uint32_t>(resources.sceneObjResources.size())));		// 5 shader records in the table
-		shaderTableSize = ALIGN(D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT, shaderTableSize);
+		if (dxr.shaderTable == nullptr || numObjects > dxr.shaderTableCapacity)
+		{
+			SAFE_RELEASE(dxr.shaderTable);
+			dxr.shaderTableCapacity = GrowCapacity(dxr.shaderTableCapacity, numObjects);
+			firstObject = 0;
+
+			shaderTableSize = (dxr.shaderTableRecordSize * (4 + DX12Constants::hit_groups_per_instance * dxr.shaderTableCapacity));		// 4 shader records ahead of the hit groups
+			shaderTableSize = ALIGN(D3D12_RAYTRACING_SHADER_TABLE_BYTE_ALIGNMENT, shaderTableSize);
 
-		// Create the shader table buffer
-		D3D12BufferCreateInfo bufferInfo(shaderTableSize, D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_STATE_GENERIC_READ);
-		D3DResources::Create_Buffer(d3d, bufferInfo, &dxr.shaderTable);
+			// Create the shader table buffer
+			D3D12BufferCreateInfo bufferInfo(shaderTableSize, D3D12_HEAP_TYPE_UPLOAD, D3D12_RESOURCE_STATE_GENERIC_READ);
+			D3DResources::Create_Buffer(d3d, bufferInfo, &dxr.shaderTable);
 #if NAME_D3D_RESOURCES
-		dxr.shaderTable->SetName(L"DXR Shader Table");
+			dxr.shaderTable->SetName(L"DXR Shader Table");
 #endif
+		}
 
 		// Map the buffer
-		uint8_t* pData;
-		HRESULT hr = dxr.shaderTable->Map(0, nullptr, (void**)&pData);
+		uint8_t* pTable;
+		HRESULT hr = dxr.shaderTable->Map(0, nullptr, (void**)&pTable);
 		Utils::Validate(hr, L"Error: failed to map shader table!");
+		uint8_t* pData = pTable;
 
-		//GEN
+		// The raygen and miss records only change when the descriptor heap does, which rewrites from the first object
+		if (firstObject == 0)
+		{
+			//GEN
 
-		// Gen Shader Record 0 - Ray Generation program and local root parameter data (descriptor table with constant buffer and IB/VB pointers)
-		memcpy(pData, dxr.rtpsoInfo->GetShaderIdentifier(L"RayGen_12"), shaderIdSize);
+			// Gen Shader Record 0 - Ray Generation program and local root parameter data (descriptor table with constant buffer and IB/VB pointers)
+			memcpy(pData, dxr.rtpsoInfo->GetShaderIdentifier(L"RayGen_12"), shaderIdSize);
 
-		// Set the root parameter data. Point to start of descriptor heap.
-		*reinterpret_cast<D3D12_GPU_DESCRIPTOR_HANDLE*>(pData + shaderIdSize) = resources.descriptorHeap->GetGPUDescriptorHandleForHeapStart();
+			// Set the root parameter data. Point to start of descriptor heap.
+			*reinterpret_cast<D3D12_GPU_DESCRIPTOR_HANDLE*>(pData + shaderIdSize) = resources.descriptorHeap->GetGPUDescriptorHandleForHeapStart();
 
-		// Gen Shader Record 1 - Ray Generation program and local root parameter data (descriptor table with constant buffer and IB/VB pointers)
-		pData += dxr.shaderTableRecordSize;
-		memcpy(pData, dxr.rtpsoInfo->GetShaderIdentifier(L"RayGen_Central"), shaderIdSize);
+			// Gen Shader Record 1 - Ray Generation program and local root parameter data (descriptor table with constant buffer and IB/VB pointers)
+			pData += dxr.shaderTableRecordSize;
+			memcpy(pData, dxr.rtpsoInfo->GetShaderIdentifier(L"RayGen_Central"), shaderIdSize);
 
-		// Set the root parameter data. Point to start of descriptor heap.
-		*reinterpret_cast<D3D12_GPU_DESCRIPTOR_HANDLE*>(pData + shaderIdSize) = resources.descriptorHeap->GetGPUDescriptorHandleForHeapStart();
+			// Set the root parameter data. Point to start of descriptor heap.
+			*reinterpret_cast<D3D12_GPU_DESCRIPTOR_HANDLE*>(pData + shaderIdSize) = resources.descriptorHeap->GetGPUDescriptorHandleForHeapStart();
 
-		//MISS
+			//MISS
 
-		// Shader Miss Record 0 - Shadow Miss program (no local root arguments to set)
-		pData += dxr.shaderTableRecordSize;
-		memcpy(pData, dxr.rtpsoInfo->GetShaderIdentifier(L"Shadow_Miss_5"), shaderIdSize);
+			// Shader Miss Record 0 - Shadow Miss program (no local root arguments to set)
+			pData += dxr.shaderTableRecordSize;
+			memcpy(pData, dxr.rtpsoInfo->GetShaderIdentifier(L"Shadow_Miss_5"), shaderIdSize);
 
-		// Shader Miss Record 1 - Miss program (no local root arguments to set)
-		pData += dxr.shaderTableRecordSize;
-		memcpy(pData, dxr.rtpsoInfo->GetShaderIdentifier(L"Miss_5"), shaderIdSize);
+			// Shader Miss Record 1 - Miss program (no local root arguments to set)
+			pData += dxr.shaderTableRecordSize;
+			memcpy(pData, dxr.rtpsoInfo->GetShaderIdentifier(L"Miss_5"), shaderIdSize);
+		}
 
 
 		//HIT
 
-		// Shader HitGroup Record 0 - Shadow Hit program (no local root arguments to set)
-		pData += dxr.shaderTableRecordSize;
-		memcpy(pData, dxr.rtpsoInfo->GetShaderIdentifier(L"ShadowHitGroup"), shaderIdSize);
-
-
-		//// Set the root parameter data. Point to start of descriptor heap.
-		//*reinterpret_cast<D3D12_GPU_DESCRIPTOR_HANDLE*>(pData + shaderIdSize) = resources.sceneObjResources[0].descriptorHeap->GetGPUDescriptorHandleForHeapStart();
-
+		// Instance i of the TLAS starts at hit group record 2 * i, so the records of an object pick up its descriptors
 		UINT handleIncrement = d3d.Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV) * DX12Constants::descriptors_per_shader;
 		D3D12_GPU_DESCRIPTOR_HANDLE handle = resources.descriptorHeap->GetGPUDescriptorHandleForHeapStart();
-		for (int i = 0; i < resources.sceneObjResources.size(); i++)
+		handle.ptr += static_cast<UINT64>(firstObject) * handleIncrement;
+
+		// Step to the record ahead of the first one written, the loop advances before each record
+		pData = pTable + dxr.shaderTableRecordSize * (3 + DX12Constants::hit_groups_per_instance * firstObject);
+		for (uint32_t i = firstObject; i < numObjects; i++)
 		{
-			// Shader HitGroup Record 1 - Closest Hit program and local root parameter data (descriptor table with constant buffer and IB/VB pointers)
+			// Shader HitGroup Record 2i - Shadow Hit program, ray contribution 0
 			pData += dxr.shaderTableRecordSize;
-			memcpy(pData, dxr.rtpsoInfo->GetShaderIdentifier(L"HitGroup"), shaderIdSize);
+			memcpy(pData, dxr.rtpsoInfo->GetShaderIdentifier(L"ShadowHitGroup"), shaderIdSize);
+			*reinterpret_cast<D3D12_GPU_DESCRIPTOR_HANDLE*>(pData + shaderIdSize) = handle;
 
+			// Shader HitGroup Record 2i + 1 - Closest Hit program and local root parameter data (descriptor table with constant buffer and IB/VB pointers), ray contribution 1
+			pData += dxr.shaderTableRecordSize;
+			memcpy(pData, dxr.rtpsoInfo->GetShaderIdentifier(L"HitGroup"), shaderIdSize);
 			*reinterpret_cast<D3D12_GPU_DESCRIPTOR_HANDLE*>(pData + shaderIdSize) = handle;
+
 			handle.ptr += handleIncrement;
 		}
 
@@ -1961,29 +2117,56 @@ namespace DXR
 	//	d3d.Device->CreateUnorderedAccessView(resources.DXROutput[1], nullptr, &uavDesc, handle);
 	//}     
 
+	static void Create_Diffuse_SRV(D3D12Global& d3d, D3D12Resources& resources, uint32_t object, D3D12_CPU_DESCRIPTOR_HANDLE handle)
+	{
+		auto& diffuseTex = resources.Textures[resources.sceneObjResources[object].diffuseTexKey];
+
+		D3D12_SHADER_RESOURCE_VIEW_DESC textureSRVDesc = {};
+		textureSRVDesc.Format = diffuseTex.resourceDesc.Format != DXGI_FORMAT_UNKNOWN ? diffuseTex.resourceDesc.Format : DXGI_FORMAT_R8G8B8A8_UNORM;
+		textureSRVDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		textureSRVDesc.Texture2D.MipLevels = diffuseTex.resourceDesc.MipLevels;
+		textureSRVDesc.Texture2D.MostDetailedMip = 0;
+		textureSRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+
+		d3d.Device->CreateShaderResourceView(diffuseTex.texture, &textureSRVDesc, handle);
+	}
+
 	/**
 	* Create the DXR descriptor heap for CBVs, SRVs, and the output UAV.
+	* The heap is kept while the scene objects fit, then only the blocks of objects from firstObject on are written.
+	* Returns true if the heap was created anew, every block and the shader table then have to be rewritten.
 	*/
-	void Create_Descriptor_Heaps(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources, Scene& scene)
+	bool Create_Descriptor_Heaps(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources, Scene& scene, uint32_t firstObject)
 	{
-		D3D12_DESCRIPTOR_HEAP_DESC desc = {};
-		desc.NumDescriptors = DX12Constants::descriptors_per_shader * static_cast<UINT>(resources.sceneObjResources.size());
-		desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-		desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+		const UINT numObjects = static_cast<UINT>(resources.sceneObjResources.size());
 
-		// Create the descriptor heap
-		HRESULT hr = d3d.Device->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&resources.descriptorHeap));
-		Utils::Validate(hr, L"Error: failed to create DXR CBV/SRV/UAV descriptor heap!");
+		const bool isNewHeap = resources.descriptorHeap == nullptr || numObjects > resources.descriptorHeapCapacity;
+		if (isNewHeap)
+		{
+			SAFE_RELEASE(resources.descriptorHeap);
+			resources.descriptorHeapCapacity = GrowCapacity(resources.descriptorHeapCapacity, numObjects);
+			firstObject = 0;
 
-		// Get the descriptor heap handle and increment size
-		D3D12_CPU_DESCRIPTOR_HANDLE handle = resources.descriptorHeap->GetCPUDescriptorHandleForHeapStart();
-		UINT handleIncrement = d3d.Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+			D3D12_DESCRIPTOR_HEAP_DESC desc = {};
+			desc.NumDescriptors = DX12Constants::descriptors_per_shader * resources.descriptorHeapCapacity;
+			desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+			desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+
+			// Create the descriptor heap
+			HRESULT hr = d3d.Device->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&resources.descriptorHeap));
+			Utils::Validate(hr, L"Error: failed to create DXR CBV/SRV/UAV descriptor heap!");
 
 #if NAME_D3D_RESOURCES
-		resources.descriptorHeap->SetName(L"DXR Descriptor Heap");
+			resources.descriptorHeap->SetName(L"DXR Descriptor Heap");
 #endif
+		}
+
+		// Get the descriptor heap handle and increment size
+		UINT handleIncrement = d3d.Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		D3D12_CPU_DESCRIPTOR_HANDLE handle = resources.descriptorHeap->GetCPUDescriptorHandleForHeapStart();
+		handle.ptr += static_cast<SIZE_T>(firstObject) * DX12Constants::descriptors_per_shader * handleIncrement;
 
-		for (int i = 0; i < scene.SceneObjects.size(); i++)
+		for (int i = firstObject; i < scene.SceneObjects.size(); i++)
 		{
 			// Describe the CBV/SRV/UAV heap
 			// Need 8 entries per scene object:
@@ -2061,7 +2244,7 @@ namespace DXR
 			indexSRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
 			indexSRVDesc.Buffer.StructureByteStride = 0;
 			indexSRVDesc.Buffer.FirstElement = 0;
-			indexSRVDesc.Buffer.NumElements = (static_cast<UINT>(scene.SceneObjects[i].Mesh.Indices.size()) * sizeof(UINT)) / sizeof(float);
+			indexSRVDesc.Buffer.NumElements = resources.sceneObjResources[i].indexBufferView.SizeInBytes / sizeof(float);
 			indexSRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 
 			d3d.Device->CreateShaderResourceView(resources.sceneObjResources[i].indexBuffer, &indexSRVDesc, handle);
@@ -2074,24 +2257,15 @@ namespace DXR
 			vertexSRVDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
 			vertexSRVDesc.Buffer.StructureByteStride = 0;
 			vertexSRVDesc.Buffer.FirstElement = 0;
-			vertexSRVDesc.Buffer.NumElements = (static_cast<UINT>(scene.SceneObjects[i].Mesh.Vertices.size()) * sizeof(Vertex)) / sizeof(float);
+			vertexSRVDesc.Buffer.NumElements = resources.sceneObjResources[i].vertexBufferView.SizeInBytes / sizeof(float);
 			vertexSRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 
 			d3d.Device->CreateShaderResourceView(resources.sceneObjResources[i].vertexBuffer, &vertexSRVDesc, handle);
 			handle.ptr += handleIncrement;
 
 
-			auto& diffuseTex = resources.Textures[resources.sceneObjResources[i].diffuseTexKey];
-
 			// Create the material texture SRV
-			D3D12_SHADER_RESOURCE_VIEW_DESC textureSRVDesc = {};
-			textureSRVDesc.Format = diffuseTex.resourceDesc.Format != DXGI_FORMAT_UNKNOWN ? diffuseTex.resourceDesc.Format : DXGI_FORMAT_R8G8B8A8_UNORM;
-			textureSRVDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-			textureSRVDesc.Texture2D.MipLevels = diffuseTex.resourceDesc.MipLevels;
-			textureSRVDesc.Texture2D.MostDetailedMip = 0;
-			textureSRVDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-
-			d3d.Device->CreateShaderResourceView(diffuseTex.texture, &textureSRVDesc, handle);
+			Create_Diffuse_SRV(d3d, resources, i, handle);
 			handle.ptr += handleIncrement;
 
 
@@ -2123,7 +2297,7 @@ namespace DXR
 			handle.ptr += handleIncrement;
 
 
-			auto& blueNoiseTex = resources.Textures[Utils::GetResourcePath(DX12Constants::blue_noise_tex_path)];
+			auto& blueNoiseTex = resources.Textures[resources.blueNoiseTexKey];
 
 			// Create the blueNoise map SRV
 			D3D12_SHADER_RESOURCE_VIEW_DESC blueNoiseSRVDesc = {};
@@ -2136,6 +2310,29 @@ namespace DXR
 			d3d.Device->CreateShaderResourceView(blueNoiseTex.texture, &blueNoiseSRVDesc, handle);
 			handle.ptr += handleIncrement;
 		}
+
+		return isNewHeap;
+	}
+
+	void Update_Diffuse_Descriptors(D3D12Global& d3d, D3D12Resources& resources, const std::vector<uint32_t>& objects)
+	{
+		if (resources.descriptorHeap == nullptr)
+			return;
+
+		// The heap stays where it is, so the shader table records pointing into it stay valid
+		UINT handleIncrement = d3d.Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		D3D12_CPU_DESCRIPTOR_HANDLE heapStart = resources.descriptorHeap->GetCPUDescriptorHandleForHeapStart();
+
+		for (uint32_t object : objects)
+		{
+			// Objects past the heap get all their descriptors written once it grows
+			if (object >= resources.descriptorHeapCapacity)
+				continue;
+
+			D3D12_CPU_DESCRIPTOR_HANDLE handle = heapStart;
+			handle.ptr += (static_cast<SIZE_T>(object) * DX12Constants::descriptors_per_shader + DX12Constants::diffuse_descriptor_offset) * handleIncrement;
+			Create_Diffuse_SRV(d3d, resources, object, handle);
+		}
 	}
 
 	void Create_DLSS_Output(D3D12Global& d3d, D3D12Resources& resources)
@@ -2264,7 +2461,7 @@ namespace DXR
 		desc.MissShaderTable.StrideInBytes = dxr.shaderTableRecordSize;
 
 		desc.HitGroupTable.StartAddress = desc.MissShaderTable.StartAddress + desc.MissShaderTable.SizeInBytes;
-		desc.HitGroupTable.SizeInBytes = dxr.shaderTableRecordSize * (1 + resources.sceneObjResources.size());			// Only a single Hit program entry
+		desc.HitGroupTable.SizeInBytes = dxr.shaderTableRecordSize * DX12Constants::hit_groups_per_instance * resources.sceneObjResources.size();		// Shadow and closest hit per instance
 		desc.HitGroupTable.StrideInBytes = dxr.shaderTableRecordSize;
 
 		desc.Width = d3d.Width;
@@ -2522,23 +2719,39 @@ namespace DXR
 	}
 
 	/**
-	 * Release DXR resources.
+	 * Release the acceleration structures so they can be built again.
 	 */
-	void Destroy(DXRGlobal& dxr)
+	void Destroy_Acceleration_Structures(DXRGlobal& dxr)
 	{
 		SAFE_RELEASE(dxr.TLAS.pScratch);
 		SAFE_RELEASE(dxr.TLAS.pResult);
 		SAFE_RELEASE(dxr.TLAS.pInstanceDesc);
+		dxr.tlasInstanceCapacity = 0;
+		for (AccelerationStructureBuffer& blas : dxr.BLAS)
+		{
+			SAFE_RELEASE(blas.pScratch);
+			SAFE_RELEASE(blas.pResult);
+			SAFE_RELEASE(blas.pCompactResult);
+		}
+		dxr.BLAS.clear();
+		dxr.objectBLAS.clear();
+		dxr.meshBLAS.clear();
+	}
+
+	/**
+	 * Release DXR resources.
+	 */
+	void Destroy(DXRGlobal& dxr)
+	{
+		Destroy_Acceleration_Structures(dxr);
 		SAFE_RELEASE(dxr.shaderTable);
+		dxr.shaderTableCapacity = 0;
 		SAFE_RELEASE(dxr.rgs.blob);
 		SAFE_RELEASE(dxr.rgs.pRootSignature);
 		SAFE_RELEASE(dxr.miss.blob);
 		SAFE_RELEASE(dxr.hit.chs.blob);
 		SAFE_RELEASE(dxr.rtpso);
 		SAFE_RELEASE(dxr.rtpsoInfo);
-		SAFE_RELEASE(dxr.BLAS.pScratch);
-		SAFE_RELEASE(dxr.BLAS.pResult);
-		SAFE_RELEASE(dxr.BLAS.pInstanceDesc);
 	}
 
 }
\ No newline at end of file
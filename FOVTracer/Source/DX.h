@@ -2,6 +2,9 @@
 
 #include "ResourceManagement.h"
 #include "Scene.h"
+#include "VertexFormat.h"
+#include "TextureFormat.h"
+#include "ImageBuffer.h"
 
 #include "imgui/imgui_impl_dx12.h"
 
@@ -22,14 +25,19 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <memory>
 
 #define NAME_D3D_RESOURCES 1
 #define NUM_HISTORY_BUFFER 5
+#define USE_PACKED_VERTICES 0
 
 namespace DX12Constants
 {
 	constexpr uint32_t descriptors_per_shader = 14 + NUM_HISTORY_BUFFER;
+	constexpr uint32_t diffuse_descriptor_offset = 10 + NUM_HISTORY_BUFFER;	// diffuse texture SRV within an object's descriptors
+	constexpr uint32_t hit_groups_per_instance = 2;		// shadow and primary hit group records, in that order
 	const std::string blue_noise_tex_path = "FreeBlueNoiseTextures/Data/128_128/LDR_LLL1_0.png";
+	const VertexFormat vertex_format = USE_PACKED_VERTICES ? VertexFormat::Packed : VertexFormat::Full;
 }
 
 static const D3D12_HEAP_PROPERTIES UploadHeapProperties =
@@ -114,13 +122,23 @@ struct ComputeParams
 	float fpsAvg = 0;
 };
 
+struct TextureMip
+{
+	int width = 0;
+	int height = 0;
+	size_t offset = 0;			// in bytes from the start of TextureInfo::pixels
+};
+
 struct TextureInfo
 {
-	std::vector<UINT8> pixels;
+	ImageBuffer pixels;				// every mip level back to back, level 0 first. Copies of a TextureInfo share the texels
 	int width = 0;
 	int height = 0;
-	int stride = 0;
+	int stride = 0;					// bytes per pixel, or per 4x4 block for block compressed formats
 	int offset = 0;
+	std::vector<TextureMip> mips;	// empty if pixels only holds level 0
+	DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	TextureFormat::TextureUsage usage = TextureFormat::TextureUsage::Albedo;
 };
 
 struct MaterialCB
@@ -140,6 +158,8 @@ struct MaterialCB
 	float Shininess = 1.0f;
 
 	float RefractIndex = 0.0f;
+	uint32_t albedoMinMip = 0;		// first mip of the chain the albedo resource holds, see TextureResidency
+	float padding[2];
 };
 
 struct ViewCB
@@ -292,7 +312,11 @@ struct D3D12Resources
 	ID3D12Resource* TimestampReadBack;
 
 	std::vector<SceneObjectResource> sceneObjResources;
-	std::unordered_map<std::string, TextureResource> Textures;
+	std::unordered_map<std::string, TextureResource> Textures;	// keyed by TextureCache::GetKey
+	std::string blueNoiseTexKey;
+
+	// Instances of a mesh share the vertex and index buffers of the first object that uploaded it
+	std::unordered_map<const Vertex*, uint32_t> meshBufferOwners;
 
 	ID3D12Resource* viewCB = nullptr;
 	ViewCB viewCBData;
@@ -304,6 +328,7 @@ struct D3D12Resources
 
 	ID3D12DescriptorHeap* rtvHeap = nullptr;
 	ID3D12DescriptorHeap* descriptorHeap = nullptr;
+	UINT descriptorHeapCapacity = 0;					// scene objects the descriptor heap has blocks for
 	ID3D12DescriptorHeap* uiHeap = nullptr;
 	ID3D12DescriptorHeap* cpuOnlyHeap = nullptr;
 	ID3D12QueryHeap* queryHeap = nullptr;
@@ -343,6 +368,20 @@ struct AccelerationStructureBuffer
 	ID3D12Resource* pInstanceDesc = nullptr;	// only used in top-level AS
 };
 
+/**
+* Shader defines for the vertex buffer layout read by GetVertexAttributes in Common.hlsl.
+*/
+struct VertexLayoutDefines
+{
+	std::vector<std::wstring> values;
+	std::vector<std::wstring> names;
+	std::vector<DxcDefine> defines;
+
+	VertexLayoutDefines(const VertexLayout& layout);
+
+	void Apply(D3D12ShaderInfo& info);
+};
+
 struct RtProgram
 {
 	D3D12ShaderInfo			info = {};
@@ -412,11 +451,15 @@ struct HitProgram
 struct DXRGlobal
 {
 	AccelerationStructureBuffer						TLAS;
-	AccelerationStructureBuffer						BLAS;
+	std::vector<AccelerationStructureBuffer>		BLAS;			// one per unique mesh
+	std::vector<uint32_t>							objectBLAS;		// BLAS of every scene object, the TLAS has one instance per object
+	std::unordered_map<ID3D12Resource*, uint32_t>	meshBLAS;		// vertex buffer to BLAS, instances share the buffers of their mesh
 	uint64_t										tlasSize;
+	UINT											tlasInstanceCapacity = 0;	// instances the TLAS buffers are sized for
 
 	ID3D12Resource* shaderTable = nullptr;
 	uint32_t										shaderTableRecordSize = 0;
+	UINT											shaderTableCapacity = 0;	// scene objects the shader table has hit records for
 
 	RtProgram										rgs;
 	RtProgram										rgsCentral;
@@ -505,15 +548,16 @@ namespace D3DResources
 namespace DXR
 {
 	void Create_Bottom_Level_AS(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources, Scene& model);
-	void Create_Top_Level_AS(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources);
+	bool Create_Top_Level_AS(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources, Scene& scene);
 	void Create_RayGen_Program(D3D12Global& d3d, DXRGlobal& dxr, D3D12ShaderCompilerInfo& shaderCompiler);
 	void Create_Miss_Program(D3D12Global& d3d, DXRGlobal& dxr, D3D12ShaderCompilerInfo& shaderCompiler);
 	void Create_Closest_Hit_Program(D3D12Global& d3d, DXRGlobal& dxr, D3D12ShaderCompilerInfo& shaderCompiler);
 	void Create_Pipeline_State_Object(D3D12Global& d3d, DXRGlobal& dxr);
-	void Create_Shader_Table(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources);
+	void Create_Shader_Table(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources, uint32_t firstObject = 0);
 
 	//void Create_Non_Shader_Visible_Heap(D3D12Global& d3d, D3D12Resources& resources);
-	void Create_Descriptor_Heaps(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources, Scene& scene); // Creates raytracing shader heap
+	bool Create_Descriptor_Heaps(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources, Scene& scene, uint32_t firstObject = 0); // Creates raytracing shader heap
+	void Update_Diffuse_Descriptors(D3D12Global& d3d, D3D12Resources& resources, const std::vector<uint32_t>& objects); // Rewrites the diffuse texture SRV of objects in place
 
 	void Create_DLSS_Output(D3D12Global& d3d, D3D12Resources& resources);
 	void Create_DXR_Output(D3D12Global& d3d, D3D12Resources& resources);
@@ -524,5 +568,6 @@ namespace DXR
 
 	void Build_Command_List(D3D12Global& d3d, DXRGlobal& dxr, D3D12Resources& resources, D3D12Compute& dxComp, DLSSConfig& dlssConfig, bool scrshotRequested, bool dlssPreScrshot, bool clearTAA, bool TAAEnabled);
 
+	void Destroy_Acceleration_Structures(DXRGlobal& dxr);
 	void Destroy(DXRGlobal& dxr);
 }
\ No newline at end of file
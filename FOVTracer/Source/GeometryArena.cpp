@@ -0,0 +1,116 @@
+#include "pch.h"
+#include "GeometryArena.h"
+#include "Log.h"
+
+#include <algorithm>
+
+void GeometryArena::Reserve(size_t NumVertices, size_t NumIndices)
+{
+	Clear();
+
+	// Fresh vectors so the old buffers are actually released
+	Vertices = std::vector<Vertex>(NumVertices);
+	Indices = std::vector<uint32_t>(NumIndices);
+}
+
+Span<Vertex> GeometryArena::AllocateVertices(size_t Count)
+{
+	if (VerticesUsed + Count > Vertices.size())
+	{
+		CORE_ERROR("Geometry arena is out of vertices, {0} requested with {1} of {2} used", Count, VerticesUsed, Vertices.size());
+		return Span<Vertex>();
+	}
+
+	Span<Vertex> Result(Vertices.data() + VerticesUsed, Count);
+	VerticesUsed += Count;
+
+	return Result;
+}
+
+Span<uint32_t> GeometryArena::AllocateIndices(size_t Count)
+{
+	if (IndicesUsed + Count > Indices.size())
+	{
+		CORE_ERROR("Geometry arena is out of indices, {0} requested with {1} of {2} used", Count, IndicesUsed, Indices.size());
+		return Span<uint32_t>();
+	}
+
+	Span<uint32_t> Result(Indices.data() + IndicesUsed, Count);
+	IndicesUsed += Count;
+
+	return Result;
+}
+
+void GeometryArena::Adopt(std::shared_ptr<const MappedFile> File)
+{
+	Clear();
+	AdoptedFile = std::move(File);
+}
+
+Span<Vertex> GeometryArena::AdoptVertices(Span<const Vertex> Mapped)
+{
+	if (!AdoptedFile || Mapped.data() < reinterpret_cast<const Vertex*>(AdoptedFile->Data()) ||
+		Mapped.data() + Mapped.size() > reinterpret_cast<const Vertex*>(AdoptedFile->Data() + AdoptedFile->Size()))
+	{
+		CORE_ERROR("Geometry arena can't adopt {0} vertices outside of its mapped file", Mapped.size());
+		return Span<Vertex>();
+	}
+
+	VerticesUsed += Mapped.size();
+	AdoptedBytes += Mapped.size_bytes();
+
+	return Span<Vertex>(const_cast<Vertex*>(Mapped.data()), Mapped.size());
+}
+
+Span<uint32_t> GeometryArena::AdoptIndices(Span<const uint32_t> Mapped)
+{
+	if (!AdoptedFile || Mapped.data() < reinterpret_cast<const uint32_t*>(AdoptedFile->Data()) ||
+		Mapped.data() + Mapped.size() > reinterpret_cast<const uint32_t*>(AdoptedFile->Data() + AdoptedFile->Size()))
+	{
+		CORE_ERROR("Geometry arena can't adopt {0} indices outside of its mapped file", Mapped.size());
+		return Span<uint32_t>();
+	}
+
+	IndicesUsed += Mapped.size();
+	AdoptedBytes += Mapped.size_bytes();
+
+	return Span<uint32_t>(const_cast<uint32_t*>(Mapped.data()), Mapped.size());
+}
+
+void GeometryArena::Compact(Span<StaticMesh> Meshes)
+{
+	size_t VertexOffset = 0;
+	size_t IndexOffset = 0;
+
+	for (StaticMesh& Mesh : Meshes)
+	{
+		// Ranges only ever move towards the start, so copying forwards never overwrites data that is still needed
+		Vertex* pVertices = Vertices.data() + VertexOffset;
+		if (Mesh.Vertices.data() != pVertices)
+			std::copy(Mesh.Vertices.begin(), Mesh.Vertices.end(), pVertices);
+
+		uint32_t* pIndices = Indices.data() + IndexOffset;
+		if (Mesh.Indices.data() != pIndices)
+			std::copy(Mesh.Indices.begin(), Mesh.Indices.end(), pIndices);
+
+		Mesh.Vertices = Span<Vertex>(pVertices, Mesh.Vertices.size());
+		Mesh.Indices = Span<uint32_t>(pIndices, Mesh.Indices.size());
+
+		VertexOffset += Mesh.Vertices.size();
+		IndexOffset += Mesh.Indices.size();
+	}
+
+	VerticesUsed = VertexOffset;
+	IndicesUsed = IndexOffset;
+}
+
+void GeometryArena::Clear()
+{
+	Vertices = std::vector<Vertex>();
+	Indices = std::vector<uint32_t>();
+	AdoptedFile.reset();
+
+	VerticesUsed = 0;
+	IndicesUsed = 0;
+	AdoptedBytes = 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "StaticMesh.h"
+#include "MappedFile.h"
+#include "Span.h"
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+
+/**
+* Owns the vertex and index data of a set of meshes in two contiguous buffers.
+* The buffers are sized once by Reserve, after which meshes get their ranges without touching the heap.
+* Alternatively the arena adopts a memory mapped file and hands out ranges of it in place.
+* Spans handed out stay valid until the next Reserve, Adopt or Clear.
+*/
+class GeometryArena
+{
+public:
+	GeometryArena() = default;
+	GeometryArena(const GeometryArena&) = delete;
+	GeometryArena& operator=(const GeometryArena&) = delete;
+
+	/**
+	* Allocates room for NumVertices and NumIndices. Invalidates everything handed out before.
+	*/
+	void Reserve(size_t NumVertices, size_t NumIndices);
+
+	/**
+	* Returns an empty span and logs an error if the reserved space runs out.
+	*/
+	Span<Vertex> AllocateVertices(size_t Count);
+	Span<uint32_t> AllocateIndices(size_t Count);
+
+	/**
+	* Keeps File mapped instead of allocating buffers. Invalidates everything handed out before.
+	*/
+	void Adopt(std::shared_ptr<const MappedFile> File);
+
+	/**
+	* Ranges of the adopted file as mesh spans. The mapping is read only, so the data must not be written through them.
+	*/
+	Span<Vertex> AdoptVertices(Span<const Vertex> Mapped);
+	Span<uint32_t> AdoptIndices(Span<const uint32_t> Mapped);
+
+	/**
+	* Moves the ranges of Meshes together in order and gives the space that is left back to the arena.
+	* Meshes must be sorted by their position in the arena, which is the allocation order.
+	*/
+	void Compact(Span<StaticMesh> Meshes);
+
+	void Clear();
+
+	size_t GetNumVertices() const { return VerticesUsed; }
+	size_t GetNumIndices() const { return IndicesUsed; }
+	size_t GetSizeInBytes() const { return Vertices.capacity() * sizeof(Vertex) + Indices.capacity() * sizeof(uint32_t) + AdoptedBytes; }
+
+private:
+	std::vector<Vertex> Vertices;
+	std::vector<uint32_t> Indices;
+
+	std::shared_ptr<const MappedFile> AdoptedFile;
+	size_t AdoptedBytes = 0;
+
+	size_t VerticesUsed = 0;
+	size_t IndicesUsed = 0;
+};
@@ -0,0 +1,279 @@
+#include "pch.h"
+#include "HostResidency.h"
+#include "Log.h"
+
+void HostResidency::Add(const std::string& Key, HostMemoryCategory Category, uint64_t Bytes, ReleaseFunc Release, ReloadFunc Reload)
+{
+	std::unique_lock<std::mutex> Lock(Mutex);
+
+	auto Existing = WaitUntilIdle(Lock, Key);
+	if (Existing != Entries.end())
+	{
+		Entry& Old = Existing->second;
+		if (Old.IsResident)
+		{
+			ResidentBytes[static_cast<uint32_t>(Old.Category)] -= Old.Bytes;
+			LRU.erase(Old.LRUPosition);
+		}
+
+		Entries.erase(Existing);
+	}
+
+	Entry& E = Entries[Key];
+	E.Category = Category;
+	E.Bytes = Bytes;
+	E.IsResident = true;
+	E.ReleaseCopy = std::move(Release);
+	E.ReloadCopy = std::move(Reload);
+
+	LRU.push_front(Key);
+	E.LRUPosition = LRU.begin();
+	ResidentBytes[static_cast<uint32_t>(Category)] += Bytes;
+
+	std::vector<PendingRelease> Releases;
+	EnforceBudget(Releases);
+	RunReleases(Lock, Releases);
+}
+
+void HostResidency::Release(const std::string& Key)
+{
+	std::unique_lock<std::mutex> Lock(Mutex);
+
+	auto Found = WaitUntilIdle(Lock, Key);
+	if (Found == Entries.end() || !Found->second.IsResident)
+		return;
+
+	// Whoever locked it is still reading, the copy goes once the last lock is gone and the budget asks for it
+	if (Found->second.LockCount > 0)
+		return;
+
+	std::vector<PendingRelease> Releases;
+	DropCopy(Key, Found->second, Releases);
+	RunReleases(Lock, Releases);
+}
+
+bool HostResidency::Lock(const std::string& Key)
+{
+	std::unique_lock<std::mutex> Lock(Mutex);
+
+	auto Found = WaitUntilIdle(Lock, Key);
+	if (Found == Entries.end())
+		return false;
+
+	Entry& E = Found->second;
+	if (E.IsResident)
+	{
+		LRU.splice(LRU.begin(), LRU, E.LRUPosition);
+	}
+	else
+	{
+		// The reload can take a full import or decode, everything else carries on meanwhile. Busy entries can't be
+		// removed or replaced, so E stays valid.
+		E.IsBusy = true;
+		ReloadFunc Reload = E.ReloadCopy;
+
+		Lock.unlock();
+		const uint64_t Bytes = Reload ? Reload() : 0;
+		Lock.lock();
+
+		E.IsBusy = false;
+		IdleCondition.notify_all();
+
+		if (Bytes == 0)
+		{
+			CORE_WARN("Couldn't reload the host copy of {0}", Key);
+			return false;
+		}
+
+		E.Bytes = Bytes;
+		E.IsResident = true;
+		LRU.push_front(Key);
+		E.LRUPosition = LRU.begin();
+		ResidentBytes[static_cast<uint32_t>(E.Category)] += Bytes;
+		NumReloads++;
+	}
+
+	E.LockCount++;
+
+	std::vector<PendingRelease> Releases;
+	EnforceBudget(Releases);
+	RunReleases(Lock, Releases);
+
+	return true;
+}
+
+void HostResidency::Unlock(const std::string& Key)
+{
+	std::unique_lock<std::mutex> Lock(Mutex);
+
+	auto Found = Entries.find(Key);
+	if (Found == Entries.end() || Found->second.LockCount == 0)
+		return;
+
+	if (--Found->second.LockCount > 0)
+		return;
+
+	std::vector<PendingRelease> Releases;
+	EnforceBudget(Releases);
+	RunReleases(Lock, Releases);
+}
+
+void HostResidency::Remove(const std::string& Key)
+{
+	std::unique_lock<std::mutex> Lock(Mutex);
+
+	// A release or reload that is still running would call into an owner that is going away
+	auto Found = WaitUntilIdle(Lock, Key);
+	if (Found == Entries.end())
+		return;
+
+	if (Found->second.IsResident)
+	{
+		ResidentBytes[static_cast<uint32_t>(Found->second.Category)] -= Found->second.Bytes;
+		LRU.erase(Found->second.LRUPosition);
+	}
+
+	Entries.erase(Found);
+}
+
+void HostResidency::SetBudget(uint64_t InBudgetBytes)
+{
+	std::unique_lock<std::mutex> Lock(Mutex);
+
+	BudgetBytes = InBudgetBytes;
+
+	std::vector<PendingRelease> Releases;
+	EnforceBudget(Releases);
+	RunReleases(Lock, Releases);
+}
+
+uint64_t HostResidency::GetResidentBytes(HostMemoryCategory Category) const
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	return ResidentBytes[static_cast<uint32_t>(Category)];
+}
+
+uint64_t HostResidency::GetResidentBytes() const
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	uint64_t Total = 0;
+	for (uint64_t Bytes : ResidentBytes)
+		Total += Bytes;
+
+	return Total;
+}
+
+void HostResidency::LogReport() const
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	uint32_t NumResident[static_cast<uint32_t>(HostMemoryCategory::Count)] = {};
+	uint32_t NumDropped[static_cast<uint32_t>(HostMemoryCategory::Count)] = {};
+	for (auto const& Pair : Entries)
+	{
+		uint32_t Category = static_cast<uint32_t>(Pair.second.Category);
+		if (Pair.second.IsResident)
+			NumResident[Category]++;
+		else
+			NumDropped[Category]++;
+	}
+
+	uint64_t Total = 0;
+	for (uint32_t c = 0; c < static_cast<uint32_t>(HostMemoryCategory::Count); c++)
+	{
+		CORE_INFO("Host {0}: {1:.1f} MB resident, {2} copies resident, {3} dropped", GetCategoryName(static_cast<HostMemoryCategory>(c)),
+			ResidentBytes[c] / (1024.0 * 1024.0), NumResident[c], NumDropped[c]);
+		Total += ResidentBytes[c];
+	}
+
+	CORE_INFO("Host total: {0:.1f} MB resident of a {1:.1f} MB budget, {2} evictions, {3} reloads", Total / (1024.0 * 1024.0),
+		BudgetBytes / (1024.0 * 1024.0), NumEvictions.load(), NumReloads.load());
+}
+
+const char* HostResidency::GetCategoryName(HostMemoryCategory Category)
+{
+	switch (Category)
+	{
+	case HostMemoryCategory::Textures:
+		return "textures";
+	case HostMemoryCategory::Meshes:
+		return "meshes";
+	default:
+		return "unknown";
+	}
+}
+
+HostResidency& HostResidency::GetGlobal()
+{
+	static HostResidency Instance;
+	return Instance;
+}
+
+void HostResidency::DropCopy(const std::string& Key, Entry& E, std::vector<PendingRelease>& OutReleases)
+{
+	// Key may be the LRU node erased below
+	if (E.ReleaseCopy)
+	{
+		E.IsBusy = true;
+		OutReleases.push_back({ Key, E.ReleaseCopy });
+	}
+
+	ResidentBytes[static_cast<uint32_t>(E.Category)] -= E.Bytes;
+	LRU.erase(E.LRUPosition);
+	E.IsResident = false;
+}
+
+void HostResidency::EnforceBudget(std::vector<PendingRelease>& OutReleases)
+{
+	uint64_t Total = 0;
+	for (uint64_t Bytes : ResidentBytes)
+		Total += Bytes;
+
+	// Locked copies are skipped, the budget can stay exceeded until they are unlocked
+	auto It = LRU.end();
+	while (Total > BudgetBytes && It != LRU.begin())
+	{
+		--It;
+
+		Entry& E = Entries.at(*It);
+		if (E.LockCount > 0)
+			continue;
+
+		auto Next = It;
+		++Next;
+
+		Total -= E.Bytes;
+		DropCopy(*It, E, OutReleases);
+		NumEvictions++;
+
+		It = Next;
+	}
+}
+
+void HostResidency::RunReleases(std::unique_lock<std::mutex>& Lock, std::vector<PendingRelease>& Releases)
+{
+	if (Releases.empty())
+		return;
+
+	Lock.unlock();
+	for (PendingRelease& Pending : Releases)
+		Pending.Release();
+	Lock.lock();
+
+	for (const PendingRelease& Pending : Releases)
+		Entries.at(Pending.Key).IsBusy = false;
+
+	IdleCondition.notify_all();
+}
+
+std::unordered_map<std::string, HostResidency::Entry>::iterator HostResidency::WaitUntilIdle(std::unique_lock<std::mutex>& Lock, const std::string& Key)
+{
+	IdleCondition.wait(Lock, [this, &Key]()
+	{
+		auto Found = Entries.find(Key);
+		return Found == Entries.end() || !Found->second.IsBusy;
+	});
+
+	return Entries.find(Key);
+}
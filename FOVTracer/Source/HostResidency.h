@@ -0,0 +1,138 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <cstdint>
+
+enum class HostMemoryCategory : uint32_t
+{
+	Textures,
+	Meshes,
+	Count
+};
+
+/**
+* Keeps track of CPU copies of data that already lives on the GPU. Owners register a copy with a function that drops it and
+* one that loads it back, usually from the texture or mesh cache. Copies are released as soon as they are consumed, whatever
+* is reloaded later stays resident until the budget is exceeded, then the least recently used copies are dropped first.
+* Release and reload functions run outside the residency lock on the thread whose call triggered them, so a slow reload only
+* holds up callers that need the same key. They must not lock or release their own key.
+*/
+class HostResidency
+{
+public:
+	/**
+	* Drops the copy.
+	*/
+	using ReleaseFunc = std::function<void()>;
+
+	/**
+	* Loads the copy back in and returns its size in bytes, 0 if it couldn't be loaded.
+	*/
+	using ReloadFunc = std::function<uint64_t()>;
+
+	static constexpr uint64_t DefaultBudgetBytes = 1024ull * 1024 * 1024;
+
+	HostResidency() = default;
+	HostResidency(const HostResidency&) = delete;
+	HostResidency& operator=(const HostResidency&) = delete;
+
+	/**
+	* Registers the resident copy of Key, or replaces the registration if Key is known already. Enforces the budget.
+	*/
+	void Add(const std::string& Key, HostMemoryCategory Category, uint64_t Bytes, ReleaseFunc Release, ReloadFunc Reload);
+
+	/**
+	* Drops the copy of Key now, a later Lock reloads it.
+	*/
+	void Release(const std::string& Key);
+
+	/**
+	* Reloads the copy of Key if it was dropped and keeps it from being evicted until the matching Unlock. Locks nest.
+	* Returns false if Key is unknown or the reload failed.
+	*/
+	bool Lock(const std::string& Key);
+	void Unlock(const std::string& Key);
+
+	/**
+	* Forgets Key without calling its release function, for owners that free the data themselves.
+	*/
+	void Remove(const std::string& Key);
+
+	/**
+	* 0 keeps nothing once it's unlocked.
+	*/
+	void SetBudget(uint64_t InBudgetBytes);
+	uint64_t GetBudget() const { return BudgetBytes; }
+
+	uint64_t GetResidentBytes(HostMemoryCategory Category) const;
+	uint64_t GetResidentBytes() const;
+
+	uint32_t GetNumEvictions() const { return NumEvictions; }
+	uint32_t GetNumReloads() const { return NumReloads; }
+
+	/**
+	* Logs the resident bytes and the number of resident and dropped copies per category.
+	*/
+	void LogReport() const;
+
+	static const char* GetCategoryName(HostMemoryCategory Category);
+
+	/**
+	* Shared by the whole application.
+	*/
+	static HostResidency& GetGlobal();
+
+private:
+	struct Entry
+	{
+		HostMemoryCategory Category = HostMemoryCategory::Textures;
+		uint64_t Bytes = 0;
+		bool IsResident = false;
+		bool IsBusy = false;		// its release or reload function is running
+		uint32_t LockCount = 0;
+		ReleaseFunc ReleaseCopy;
+		ReloadFunc ReloadCopy;
+		std::list<std::string>::iterator LRUPosition;
+	};
+
+	struct PendingRelease
+	{
+		std::string Key;
+		ReleaseFunc Release;
+	};
+
+	/**
+	* Takes the copy of E off the books and marks it busy, the release function runs later in RunReleases.
+	*/
+	void DropCopy(const std::string& Key, Entry& E, std::vector<PendingRelease>& OutReleases);
+	void EnforceBudget(std::vector<PendingRelease>& OutReleases);
+
+	/**
+	* Calls the release functions with the lock dropped and clears the busy flags once they are done.
+	*/
+	void RunReleases(std::unique_lock<std::mutex>& Lock, std::vector<PendingRelease>& Releases);
+
+	/**
+	* Waits until no release or reload of Key is running. Returns the entry, or Entries.end() if Key is unknown.
+	*/
+	std::unordered_map<std::string, Entry>::iterator WaitUntilIdle(std::unique_lock<std::mutex>& Lock, const std::string& Key);
+
+	mutable std::mutex Mutex;
+	std::condition_variable IdleCondition;
+	std::unordered_map<std::string, Entry> Entries;
+
+	// Resident copies, most recently used at the front
+	std::list<std::string> LRU;
+
+	uint64_t BudgetBytes = DefaultBudgetBytes;
+	uint64_t ResidentBytes[static_cast<uint32_t>(HostMemoryCategory::Count)] = {};
+	std::atomic<uint32_t> NumEvictions{ 0 };
+	std::atomic<uint32_t> NumReloads{ 0 };
+};
@@ -0,0 +1,124 @@
+#include "pch.h"
+#include "ImageBuffer.h"
+
+#include <atomic>
+#include <cstring>
+
+namespace
+{
+	std::atomic<uint64_t> NumCopies{ 0 };
+	std::atomic<uint64_t> NumCopiedBytes{ 0 };
+
+	void CountCopy(size_t Bytes)
+	{
+		if (Bytes == 0)
+			return;
+
+		NumCopies++;
+		NumCopiedBytes += Bytes;
+	}
+}
+
+ImageBuffer::ImageBuffer(size_t Size)
+{
+	auto Bytes = std::make_shared<std::vector<uint8_t>>(Size);
+	Owned = Bytes.get();
+	DataPtr = Bytes->data();
+	NumBytes = Size;
+	Owner = std::move(Bytes);
+}
+
+ImageBuffer::ImageBuffer(std::shared_ptr<const void> InOwner, const uint8_t* Data, size_t Size) :
+	Owner(std::move(InOwner)), DataPtr(Data), NumBytes(Size)
+{
+}
+
+ImageBuffer::ImageBuffer(ImageBuffer&& Other) noexcept
+{
+	*this = std::move(Other);
+}
+
+ImageBuffer& ImageBuffer::operator=(ImageBuffer&& Other) noexcept
+{
+	if (this != &Other)
+	{
+		Owner = std::move(Other.Owner);
+		Owned = Other.Owned;
+		DataPtr = Other.DataPtr;
+		NumBytes = Other.NumBytes;
+
+		Other.Owned = nullptr;
+		Other.DataPtr = nullptr;
+		Other.NumBytes = 0;
+	}
+
+	return *this;
+}
+
+ImageBuffer ImageBuffer::Copy(const uint8_t* Data, size_t Size)
+{
+	ImageBuffer Result(Size);
+	if (Size > 0)
+		memcpy(Result.Owned->data(), Data, Size);
+
+	CountCopy(Size);
+	return Result;
+}
+
+uint8_t* ImageBuffer::MutableData()
+{
+	if (!IsUnique())
+		MakeUnique(NumBytes);
+
+	return Owned ? Owned->data() : nullptr;
+}
+
+void ImageBuffer::Resize(size_t NewSize)
+{
+	if (!IsUnique())
+	{
+		MakeUnique(NewSize);
+		return;
+	}
+
+	// Growing past the allocation moves the kept bytes
+	if (NewSize > Owned->capacity())
+		CountCopy(NumBytes);
+
+	Owned->resize(NewSize);
+	DataPtr = Owned->data();
+	NumBytes = NewSize;
+}
+
+void ImageBuffer::Reset()
+{
+	Owner.reset();
+	Owned = nullptr;
+	DataPtr = nullptr;
+	NumBytes = 0;
+}
+
+void ImageBuffer::MakeUnique(size_t NewSize)
+{
+	auto Bytes = std::make_shared<std::vector<uint8_t>>(NewSize);
+
+	const size_t Kept = NewSize < NumBytes ? NewSize : NumBytes;
+	if (Kept > 0)
+		memcpy(Bytes->data(), DataPtr, Kept);
+	CountCopy(Kept);
+
+	Owned = Bytes.get();
+	DataPtr = Bytes->data();
+	NumBytes = NewSize;
+	Owner = std::move(Bytes);
+}
+
+uint64_t ImageBuffer::GetNumCopies()
+{
+	return NumCopies;
+}
+
+uint64_t ImageBuffer::GetNumCopiedBytes()
+{
+	return NumCopiedBytes;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+* Texel bytes of an image. Copies of a buffer share the same bytes through a refcounted owner, which is either a vector the
+* buffer allocated itself or whatever the bytes were adopted from: an stb_image allocation, a DirectXTex ScratchImage or a
+* memory mapped file. Handing an image on therefore never copies its texels. Writes go through MutableData() or Resize(),
+* which only copy when the bytes are adopted or still shared with another buffer.
+*/
+class ImageBuffer
+{
+public:
+	ImageBuffer() {}
+
+	/**
+	* Owned, zero filled bytes.
+	*/
+	explicit ImageBuffer(size_t Size);
+
+	/**
+	* Adopts Data without copying. Owner keeps the bytes alive and frees them once the last buffer that refers to them is gone.
+	*/
+	ImageBuffer(std::shared_ptr<const void> InOwner, const uint8_t* Data, size_t Size);
+
+	ImageBuffer(const ImageBuffer&) = default;
+	ImageBuffer& operator=(const ImageBuffer&) = default;
+	ImageBuffer(ImageBuffer&& Other) noexcept;
+	ImageBuffer& operator=(ImageBuffer&& Other) noexcept;
+
+	/**
+	* Owned copy of Size bytes at Data.
+	*/
+	static ImageBuffer Copy(const uint8_t* Data, size_t Size);
+
+	const uint8_t* Data() const { return DataPtr; }
+	size_t Size() const { return NumBytes; }
+	bool Empty() const { return NumBytes == 0; }
+
+	/**
+	* True if the bytes belong to the buffer alone, so writing them doesn't copy.
+	*/
+	bool IsUnique() const { return Owned != nullptr && Owner.use_count() == 1; }
+
+	/**
+	* Writable bytes, copied first if they are adopted or shared.
+	*/
+	uint8_t* MutableData();
+
+	/**
+	* Keeps the first min(Size(), NewSize) bytes, new bytes are zero. Copies if the bytes are adopted, shared, or grow past the
+	* allocation.
+	*/
+	void Resize(size_t NewSize);
+
+	void Reset();
+
+	/**
+	* Deep copies made by every buffer since startup, texels rewritten into another layout aren't counted.
+	*/
+	static uint64_t GetNumCopies();
+	static uint64_t GetNumCopiedBytes();
+
+private:
+	void MakeUnique(size_t NewSize);
+
+	std::shared_ptr<const void> Owner;
+	std::vector<uint8_t>* Owned = nullptr;	// the vector behind Owner if the buffer allocated the bytes itself
+	const uint8_t* DataPtr = nullptr;
+	size_t NumBytes = 0;
+};
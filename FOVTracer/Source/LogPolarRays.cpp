@@ -0,0 +1,115 @@
+#include "pch.h"
+#include "LogPolarRays.h"
+
+#include <cmath>
+
+namespace LogPolarRays
+{
+	static const float PI = 3.14159265f;
+
+	// L maps the last column to the farthest screen corner from the gaze point, B spreads the rows over a full turn
+	static void GetLogPolarConstants(const FoveationInfo& Info, float& OutL, float& OutB)
+	{
+		float FovealX = Info.FovealCenterX * Info.LaunchWidth;
+		float FovealY = Info.FovealCenterY * Info.LaunchHeight;
+		float CornerX = Math::max(FovealX, Info.LaunchWidth - FovealX);
+		float CornerY = Math::max(FovealY, Info.LaunchHeight - FovealY);
+
+		OutL = std::log(std::sqrt(CornerX * CornerX + CornerY * CornerY));
+		OutB = 2.0f * PI / Info.LaunchHeight;
+	}
+
+	Vector3f GetRayDirection(const PrimaryRayCamera& Camera, float IndexX, float IndexY)
+	{
+		const FoveationInfo& Info = Camera.Foveation;
+
+		float DX = IndexX / Info.LaunchWidth * 2.0f - 1.0f;
+		float DY = IndexY / Info.LaunchHeight * 2.0f - 1.0f;
+
+		if (Camera.IsFoveated)
+		{
+			float L, B;
+			GetLogPolarConstants(Info, L, B);
+
+			float Radius = std::exp(L * std::pow(IndexX / Info.LaunchWidth, std::fabs(Info.KernelAlpha)));
+			float ScreenX = Radius * std::cos(B * IndexY) + Info.FovealCenterX * Info.LaunchWidth;
+			float ScreenY = Radius * std::sin(B * IndexY) + Info.FovealCenterY * Info.LaunchHeight;
+
+			DX = ScreenX / Info.LaunchWidth * 2.0f - 1.0f;
+			DY = ScreenY / Info.LaunchHeight * 2.0f - 1.0f;
+		}
+
+		const float Aspect = Info.LaunchWidth / Info.LaunchHeight;
+		const float TanHalfFov = std::tan(Info.VerticalFOV * 0.5f * PI / 180.0f);
+
+		Vector3f Forward = Camera.Forward;
+		Vector3f Right = Camera.Right;
+		Vector3f Up = Camera.Up;
+		return (Right * (DX * TanHalfFov * Aspect) - Up * (DY * TanHalfFov) + Forward).Normalized();
+	}
+
+	Vector3f GetGazeDirection(const PrimaryRayCamera& Camera)
+	{
+		const FoveationInfo& Info = Camera.Foveation;
+
+		// The centre of the log-polar mapping, where the radius is zero
+		float DX = Info.FovealCenterX * 2.0f - 1.0f;
+		float DY = Info.FovealCenterY * 2.0f - 1.0f;
+
+		const float Aspect = Info.LaunchWidth / Info.LaunchHeight;
+		const float TanHalfFov = std::tan(Info.VerticalFOV * 0.5f * PI / 180.0f);
+
+		Vector3f Forward = Camera.Forward;
+		Vector3f Right = Camera.Right;
+		Vector3f Up = Camera.Up;
+		return (Right * (DX * TanHalfFov * Aspect) - Up * (DY * TanHalfFov) + Forward).Normalized();
+	}
+
+	uint32_t GetFirstColumn(const PrimaryRayCamera& Camera)
+	{
+		const FoveationInfo& Info = Camera.Foveation;
+		if (!Camera.IsFoveated)
+			return 0;
+
+		float L, B;
+		GetLogPolarConstants(Info, L, B);
+
+		float Diagonal = std::sqrt(Info.LaunchWidth * Info.LaunchWidth + Info.LaunchHeight * Info.LaunchHeight);
+		float R = std::round(Diagonal * Camera.FoveationAreaThreshold * 0.5f);
+		if (R <= 1.0f)
+			return 0;
+
+		float Column = std::floor(std::pow(std::log(R) / L, 1.0f / std::fabs(Info.KernelAlpha)) * Info.LaunchWidth);
+		return static_cast<uint32_t>(Math::min(Column, Info.LaunchWidth));
+	}
+
+	uint32_t BuildPackets(const PrimaryRayCamera& Camera, const PacketSettings& Settings, std::vector<RayPacket>& OutPackets)
+	{
+		OutPackets.clear();
+
+		const uint32_t Width = static_cast<uint32_t>(Camera.Foveation.LaunchWidth);
+		const uint32_t Height = static_cast<uint32_t>(Camera.Foveation.LaunchHeight);
+		const uint32_t TileWidth = Math::max(Math::min(Settings.TileWidth, RayPacket::MaxRays), 1u);
+		const uint32_t TileHeight = Math::max(Math::min(Settings.TileHeight, RayPacket::MaxRays / TileWidth), 1u);
+		const uint32_t FirstColumn = GetFirstColumn(Camera);
+
+		uint32_t NumCoherent = 0;
+		for (uint32_t TileY = 0; TileY < Height; TileY += TileHeight)
+		{
+			for (uint32_t TileX = FirstColumn; TileX < Width; TileX += TileWidth)
+			{
+				RayPacket Packet;
+				for (uint32_t y = TileY; y < Math::min(TileY + TileHeight, Height); y++)
+				{
+					for (uint32_t x = TileX; x < Math::min(TileX + TileWidth, Width); x++)
+						Packet.AddRay(Camera.Position, GetRayDirection(Camera, x + 0.5f, y + 0.5f), Camera.TMax);
+				}
+
+				NumCoherent += Packet.Prepare(Settings.MinDirectionCos) ? 1 : 0;
+				OutPackets.push_back(Packet);
+			}
+		}
+
+		return NumCoherent;
+	}
+}
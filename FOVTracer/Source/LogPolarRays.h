@@ -0,0 +1,71 @@
+#pragma once
+
+#include "MeshLOD.h"
+#include "RayPacket.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+* Camera and foveation state RayGen.hlsl builds its primary rays from. The basis matches the view matrix Update_View_CB builds.
+*/
+struct PrimaryRayCamera
+{
+	FoveationInfo Foveation;
+
+	Vector3f Position;
+	Vector3f Forward = Vector3f(0.0f, 0.0f, 1.0f);
+	Vector3f Right = Vector3f(1.0f, 0.0f, 0.0f);
+	Vector3f Up = Vector3f(0.0f, 1.0f, 0.0f);
+
+	bool IsFoveated = true;
+
+	/**
+	* TracerParameters::foveationAreaThreshold, the columns inside it are left to RayGenCentral.
+	*/
+	float FoveationAreaThreshold = 0.0f;
+
+	float TMax = 5000.0f;
+};
+
+/**
+* CPU side of the primary ray setup in RayGen.hlsl. In the log-polar buffer a column is a radius around the gaze point and
+* a row an angle, so a few neighbouring launch indices in both directions make a tight bundle of rays.
+*/
+namespace LogPolarRays
+{
+	struct PacketSettings
+	{
+		/**
+		* Launch columns and rows per packet, at most RayPacket::MaxRays rays together.
+		*/
+		uint32_t TileWidth = 4;
+		uint32_t TileHeight = 4;
+
+		/**
+		* Packets whose directions spread wider than this are traced ray by ray.
+		*/
+		float MinDirectionCos = 0.99f;
+	};
+
+	/**
+	* GetRayDir of RayGen.hlsl, Index is the launch index plus the sample offset within the pixel.
+	*/
+	Vector3f GetRayDirection(const PrimaryRayCamera& Camera, float IndexX, float IndexY);
+
+	/**
+	* Ray through the gaze point, TracerParameters::fovealCenter on the screen.
+	*/
+	Vector3f GetGazeDirection(const PrimaryRayCamera& Camera);
+
+	/**
+	* First column RayGen traces, 0 unless a foveation area threshold is set.
+	*/
+	uint32_t GetFirstColumn(const PrimaryRayCamera& Camera);
+
+	/**
+	* One ray through the centre of every traced launch pixel, packed tile by tile and prepared. Returns the number of coherent
+	* packets.
+	*/
+	uint32_t BuildPackets(const PrimaryRayCamera& Camera, const PacketSettings& Settings, std::vector<RayPacket>& OutPackets);
+}
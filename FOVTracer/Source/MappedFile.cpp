@@ -0,0 +1,80 @@
+#include "pch.h"
+#include "MappedFile.h"
+
+MappedFile::MappedFile(MappedFile&& Other) noexcept
+{
+	*this = std::move(Other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& Other) noexcept
+{
+	if (this != &Other)
+	{
+		Close();
+
+		FileHandle = Other.FileHandle;
+		MappingHandle = Other.MappingHandle;
+		View = Other.View;
+		FileSize = Other.FileSize;
+
+		Other.FileHandle = INVALID_HANDLE_VALUE;
+		Other.MappingHandle = NULL;
+		Other.View = nullptr;
+		Other.FileSize = 0;
+	}
+
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::string& Path)
+{
+	Close();
+
+	std::wstring WidePath(Path.begin(), Path.end());
+	FileHandle = CreateFileW(WidePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (FileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER Size = {};
+	if (!GetFileSizeEx(FileHandle, &Size) || Size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	FileSize = static_cast<uint64_t>(Size.QuadPart);
+
+	MappingHandle = CreateFileMappingW(FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!MappingHandle)
+	{
+		Close();
+		return false;
+	}
+
+	View = reinterpret_cast<const uint8_t*>(MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (!View)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (View) UnmapViewOfFile(View);
+	if (MappingHandle) CloseHandle(MappingHandle);
+	if (FileHandle != INVALID_HANDLE_VALUE) CloseHandle(FileHandle);
+
+	View = nullptr;
+	MappingHandle = NULL;
+	FileHandle = INVALID_HANDLE_VALUE;
+	FileSize = 0;
+}
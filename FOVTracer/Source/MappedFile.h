@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Platform.h"
+
+#include <string>
+#include <cstdint>
+
+/**
+* Read-only memory mapping of a file. Move-only, the view is released on destruction.
+*/
+class MappedFile
+{
+public:
+	MappedFile() {}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& Other) noexcept;
+	MappedFile& operator=(MappedFile&& Other) noexcept;
+	~MappedFile();
+
+	/**
+	* Maps the whole file at Path. Returns false if the file is missing or empty.
+	*/
+	bool Open(const std::string& Path);
+
+	void Close();
+
+	const uint8_t* Data() const { return View; }
+	uint64_t Size() const { return FileSize; }
+	bool IsOpen() const { return View != nullptr; }
+
+private:
+	HANDLE FileHandle = INVALID_HANDLE_VALUE;
+	HANDLE MappingHandle = NULL;
+	const uint8_t* View = nullptr;
+	uint64_t FileSize = 0;
+};
@@ -0,0 +1,374 @@
+#include "pch.h"
+#include "MeshCache.h"
+#include "Log.h"
+#include "ResourceManagement.h"
+
+#include <fstream>
+#include <cstdio>
+
+/*
+* File layout, every section starts on a 16 byte boundary:
+*	FileHeader
+*	MeshRecord[NumMeshes]
+*	MeshInstance[NumInstances]
+*	Vertex[TotalVertices]
+*	uint32_t[TotalIndices]
+*	char[StringBytes]		- material names and texture paths, not null terminated
+*/
+
+namespace
+{
+	constexpr uint32_t CacheMagic = 0x4D564F46; // "FOVM"
+	constexpr uint64_t SectionAlignment = 16;
+
+	enum MeshRecordFlags : uint32_t
+	{
+		HasMaterialFlag = 1 << 0,
+		HasNormalsFlag = 1 << 1,
+		HasTexcoordsFlag = 1 << 2,
+		HasTangentsFlag = 1 << 3,
+		HasBinormalsFlag = 1 << 4,
+		HasTransparencyFlag = 1 << 5,
+	};
+
+	struct FileHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint64_t SourceHash;
+		uint32_t LoadFlags;
+		uint32_t GenVertexNormals;
+		uint32_t OptimizeMeshes;
+		uint32_t VertexSize;
+		uint32_t NumMeshes;
+		uint32_t NumInstances;
+		uint64_t MeshTableOffset;
+		uint64_t InstanceDataOffset;
+		uint64_t VertexDataOffset;
+		uint64_t IndexDataOffset;
+		uint64_t StringDataOffset;
+		uint64_t FileSize;
+	};
+
+	struct StringRef
+	{
+		uint32_t Offset;
+		uint32_t Length;
+	};
+
+	struct MeshRecord
+	{
+		uint64_t FirstVertex;
+		uint64_t FirstIndex;
+		uint32_t NumVertices;
+		uint32_t NumIndices;
+		uint32_t Flags;
+
+		StringRef Name;
+		StringRef TexturePath;
+		StringRef NormalMapPath;
+		StringRef OpacityMapPath;
+
+		float TextureResolution[2];
+		float AmbientColor[3];
+		float DiffuseColor[3];
+		float SpecularColor[3];
+		float TransmitanceFilter[3];
+		float Shininess;
+		float RefractIndex;
+	};
+
+	static_assert(sizeof(Vertex) == 14 * sizeof(float), "Vertex is expected to be tightly packed");
+	static_assert(sizeof(MeshInstance) == 13 * sizeof(float), "MeshInstance is expected to be tightly packed");
+
+	uint64_t AlignOffset(uint64_t Offset)
+	{
+		return ALIGN(SectionAlignment, Offset);
+	}
+
+	StringRef AppendString(std::string& Strings, const std::string& Str)
+	{
+		StringRef Ref;
+		Ref.Offset = static_cast<uint32_t>(Strings.size());
+		Ref.Length = static_cast<uint32_t>(Str.size());
+		Strings.append(Str);
+		return Ref;
+	}
+
+	void StoreVector(float* Dst, const Vector3f& V)
+	{
+		Dst[0] = V.X;
+		Dst[1] = V.Y;
+		Dst[2] = V.Z;
+	}
+
+	Vector3f LoadVector(const float* Src)
+	{
+		return Vector3f(Src[0], Src[1], Src[2]);
+	}
+
+	void WritePadding(std::ofstream& Stream, uint64_t& Offset)
+	{
+		const char Zeros[SectionAlignment] = {};
+		uint64_t Aligned = AlignOffset(Offset);
+		Stream.write(Zeros, Aligned - Offset);
+		Offset = Aligned;
+	}
+}
+
+namespace MeshCache
+{
+	std::string GetCachePath(const std::string& SourcePath)
+	{
+		return SourcePath + ".meshcache";
+	}
+
+	bool Write(const std::string& CachePath, const CacheKey& Key, Span<const StaticMesh> Meshes, Span<const MeshInstance> Instances)
+	{
+		std::vector<MeshRecord> Records(Meshes.size());
+		std::string Strings;
+
+		uint64_t TotalVertices = 0;
+		uint64_t TotalIndices = 0;
+
+		for (size_t i = 0; i < Meshes.size(); i++)
+		{
+			const StaticMesh& Mesh = Meshes[i];
+			const Material& Mat = Mesh.MeshMaterial;
+			MeshRecord& Record = Records[i];
+
+			Record = {};
+			Record.FirstVertex = TotalVertices;
+			Record.FirstIndex = TotalIndices;
+			Record.NumVertices = static_cast<uint32_t>(Mesh.Vertices.size());
+			Record.NumIndices = static_cast<uint32_t>(Mesh.Indices.size());
+
+			Record.Flags |= Mesh.HasMaterial ? HasMaterialFlag : 0;
+			Record.Flags |= Mesh.HasNormals ? HasNormalsFlag : 0;
+			Record.Flags |= Mesh.HasTexcoords ? HasTexcoordsFlag : 0;
+			Record.Flags |= Mesh.HasTangents ? HasTangentsFlag : 0;
+			Record.Flags |= Mesh.HasBinormals ? HasBinormalsFlag : 0;
+			Record.Flags |= Mesh.HasTransparency ? HasTransparencyFlag : 0;
+
+			Record.Name = AppendString(Strings, Mat.Name);
+			Record.TexturePath = AppendString(Strings, Mat.TexturePath);
+			Record.NormalMapPath = AppendString(Strings, Mat.NormalMapPath);
+			Record.OpacityMapPath = AppendString(Strings, Mat.OpacityMapPath);
+
+			Record.TextureResolution[0] = Mat.TextureResolution.X;
+			Record.TextureResolution[1] = Mat.TextureResolution.Y;
+			StoreVector(Record.AmbientColor, Mat.AmbientColor);
+			StoreVector(Record.DiffuseColor, Mat.DiffuseColor);
+			StoreVector(Record.SpecularColor, Mat.SpecularColor);
+			StoreVector(Record.TransmitanceFilter, Mat.TransmitanceFilter);
+			Record.Shininess = Mat.Shininess;
+			Record.RefractIndex = Mat.RefractIndex;
+
+			TotalVertices += Record.NumVertices;
+			TotalIndices += Record.NumIndices;
+		}
+
+		FileHeader Header = {};
+		Header.Magic = CacheMagic;
+		Header.Version = Version;
+		Header.SourceHash = Key.SourceHash;
+		Header.LoadFlags = Key.LoadFlags;
+		Header.GenVertexNormals = Key.GenVertexNormals;
+		Header.OptimizeMeshes = Key.OptimizeMeshes;
+		Header.VertexSize = sizeof(Vertex);
+		Header.NumMeshes = static_cast<uint32_t>(Meshes.size());
+		Header.NumInstances = static_cast<uint32_t>(Instances.size());
+		Header.MeshTableOffset = AlignOffset(sizeof(FileHeader));
+		Header.InstanceDataOffset = AlignOffset(Header.MeshTableOffset + Records.size() * sizeof(MeshRecord));
+		Header.VertexDataOffset = AlignOffset(Header.InstanceDataOffset + Instances.size() * sizeof(MeshInstance));
+		Header.IndexDataOffset = AlignOffset(Header.VertexDataOffset + TotalVertices * sizeof(Vertex));
+		Header.StringDataOffset = AlignOffset(Header.IndexDataOffset + TotalIndices * sizeof(uint32_t));
+		Header.FileSize = Header.StringDataOffset + Strings.size();
+
+		// Write to a temporary file first so a crash mid-write never leaves a valid looking cache behind
+		std::string TempPath = CachePath + ".tmp";
+		std::ofstream Stream(TempPath, std::ios::binary | std::ios::trunc);
+		if (!Stream)
+		{
+			CORE_WARN("Failed to open mesh cache {0} for writing", TempPath);
+			return false;
+		}
+
+		uint64_t Offset = 0;
+		Stream.write(reinterpret_cast<const char*>(&Header), sizeof(Header));
+		Offset += sizeof(Header);
+		WritePadding(Stream, Offset);
+
+		Stream.write(reinterpret_cast<const char*>(Records.data()), Records.size() * sizeof(MeshRecord));
+		Offset += Records.size() * sizeof(MeshRecord);
+		WritePadding(Stream, Offset);
+
+		Stream.write(reinterpret_cast<const char*>(Instances.data()), Instances.size_bytes());
+		Offset += Instances.size_bytes();
+		WritePadding(Stream, Offset);
+
+		for (const StaticMesh& Mesh : Meshes)
+		{
+			Stream.write(reinterpret_cast<const char*>(Mesh.Vertices.data()), Mesh.Vertices.size() * sizeof(Vertex));
+			Offset += Mesh.Vertices.size() * sizeof(Vertex);
+		}
+		WritePadding(Stream, Offset);
+
+		for (const StaticMesh& Mesh : Meshes)
+		{
+			Stream.write(reinterpret_cast<const char*>(Mesh.Indices.data()), Mesh.Indices.size() * sizeof(uint32_t));
+			Offset += Mesh.Indices.size() * sizeof(uint32_t);
+		}
+		WritePadding(Stream, Offset);
+
+		Stream.write(Strings.data(), Strings.size());
+		Stream.close();
+
+		if (!Stream)
+		{
+			CORE_WARN("Failed to write mesh cache {0}", TempPath);
+			std::remove(TempPath.c_str());
+			return false;
+		}
+
+		std::remove(CachePath.c_str());
+		if (std::rename(TempPath.c_str(), CachePath.c_str()) != 0)
+		{
+			CORE_WARN("Failed to move mesh cache into place at {0}", CachePath);
+			std::remove(TempPath.c_str());
+			return false;
+		}
+
+		CORE_TRACE("Wrote mesh cache {0} ({1} meshes, {2} instances, {3} bytes)", CachePath, Meshes.size(), Instances.size(), Header.FileSize);
+		return true;
+	}
+
+	bool MappedMeshCache::Open(const std::string& CachePath, const CacheKey& Key)
+	{
+		File = std::make_shared<MappedFile>();
+		if (!File->Open(CachePath))
+		{
+			File.reset();
+			return false;
+		}
+
+		bool IsValid = File->Size() >= sizeof(FileHeader);
+		const FileHeader* Header = reinterpret_cast<const FileHeader*>(File->Data());
+
+		IsValid = IsValid &&
+			Header->Magic == CacheMagic &&
+			Header->Version == Version &&
+			Header->VertexSize == sizeof(Vertex) &&
+			Header->FileSize == File->Size();
+
+		IsValid = IsValid &&
+			Header->SourceHash == Key.SourceHash &&
+			Header->LoadFlags == Key.LoadFlags &&
+			Header->GenVertexNormals == Key.GenVertexNormals &&
+			Header->OptimizeMeshes == Key.OptimizeMeshes;
+
+		IsValid = IsValid &&
+			Header->MeshTableOffset + Header->NumMeshes * sizeof(MeshRecord) <= Header->InstanceDataOffset &&
+			Header->InstanceDataOffset + Header->NumInstances * sizeof(MeshInstance) <= Header->VertexDataOffset &&
+			Header->VertexDataOffset <= Header->IndexDataOffset &&
+			Header->IndexDataOffset <= Header->StringDataOffset &&
+			Header->StringDataOffset <= Header->FileSize;
+
+		if (IsValid)
+		{
+			const MeshRecord* Records = reinterpret_cast<const MeshRecord*>(File->Data() + Header->MeshTableOffset);
+			uint64_t StringBytes = Header->FileSize - Header->StringDataOffset;
+
+			for (uint32_t i = 0; i < Header->NumMeshes && IsValid; i++)
+			{
+				const MeshRecord& Record = Records[i];
+				IsValid = Header->VertexDataOffset + (Record.FirstVertex + Record.NumVertices) * sizeof(Vertex) <= Header->IndexDataOffset &&
+					Header->IndexDataOffset + (Record.FirstIndex + Record.NumIndices) * sizeof(uint32_t) <= Header->StringDataOffset;
+
+				for (const StringRef& Ref : { Record.Name, Record.TexturePath, Record.NormalMapPath, Record.OpacityMapPath })
+					IsValid = IsValid && static_cast<uint64_t>(Ref.Offset) + Ref.Length <= StringBytes;
+			}
+
+			const MeshInstance* Instances = reinterpret_cast<const MeshInstance*>(File->Data() + Header->InstanceDataOffset);
+			for (uint32_t i = 0; i < Header->NumInstances && IsValid; i++)
+				IsValid = Instances[i].MeshIndex < Header->NumMeshes;
+		}
+
+		if (!IsValid)
+		{
+			CORE_TRACE("Mesh cache {0} is stale or invalid, ignoring it", CachePath);
+			File.reset();
+		}
+
+		return IsValid;
+	}
+
+	uint32_t MappedMeshCache::GetNumMeshes() const
+	{
+		return File ? reinterpret_cast<const FileHeader*>(File->Data())->NumMeshes : 0;
+	}
+
+	Span<const Vertex> MappedMeshCache::GetVertices(uint32_t MeshIndex) const
+	{
+		const FileHeader* Header = reinterpret_cast<const FileHeader*>(File->Data());
+		const MeshRecord& Record = reinterpret_cast<const MeshRecord*>(File->Data() + Header->MeshTableOffset)[MeshIndex];
+		const Vertex* First = reinterpret_cast<const Vertex*>(File->Data() + Header->VertexDataOffset) + Record.FirstVertex;
+
+		return Span<const Vertex>(First, Record.NumVertices);
+	}
+
+	Span<const uint32_t> MappedMeshCache::GetIndices(uint32_t MeshIndex) const
+	{
+		const FileHeader* Header = reinterpret_cast<const FileHeader*>(File->Data());
+		const MeshRecord& Record = reinterpret_cast<const MeshRecord*>(File->Data() + Header->MeshTableOffset)[MeshIndex];
+		const uint32_t* First = reinterpret_cast<const uint32_t*>(File->Data() + Header->IndexDataOffset) + Record.FirstIndex;
+
+		return Span<const uint32_t>(First, Record.NumIndices);
+	}
+
+	void MappedMeshCache::GetMeshInfo(uint32_t MeshIndex, StaticMesh& OutMesh) const
+	{
+		const FileHeader* Header = reinterpret_cast<const FileHeader*>(File->Data());
+		const MeshRecord& Record = reinterpret_cast<const MeshRecord*>(File->Data() + Header->MeshTableOffset)[MeshIndex];
+
+		OutMesh.HasMaterial = (Record.Flags & HasMaterialFlag) != 0;
+		OutMesh.HasNormals = (Record.Flags & HasNormalsFlag) != 0;
+		OutMesh.HasTexcoords = (Record.Flags & HasTexcoordsFlag) != 0;
+		OutMesh.HasTangents = (Record.Flags & HasTangentsFlag) != 0;
+		OutMesh.HasBinormals = (Record.Flags & HasBinormalsFlag) != 0;
+		OutMesh.HasTransparency = (Record.Flags & HasTransparencyFlag) != 0;
+
+		Material& Mat = OutMesh.MeshMaterial;
+		Mat.Name = GetString(Record.Name.Offset, Record.Name.Length);
+		Mat.TexturePath = GetString(Record.TexturePath.Offset, Record.TexturePath.Length);
+		Mat.NormalMapPath = GetString(Record.NormalMapPath.Offset, Record.NormalMapPath.Length);
+		Mat.OpacityMapPath = GetString(Record.OpacityMapPath.Offset, Record.OpacityMapPath.Length);
+
+		Mat.TextureResolution = Vector2f(Record.TextureResolution[0], Record.TextureResolution[1]);
+		Mat.AmbientColor = LoadVector(Record.AmbientColor);
+		Mat.DiffuseColor = LoadVector(Record.DiffuseColor);
+		Mat.SpecularColor = LoadVector(Record.SpecularColor);
+		Mat.TransmitanceFilter = LoadVector(Record.TransmitanceFilter);
+		Mat.Shininess = Record.Shininess;
+		Mat.RefractIndex = Record.RefractIndex;
+	}
+
+	Span<const MeshInstance> MappedMeshCache::GetInstances() const
+	{
+		if (!File)
+			return Span<const MeshInstance>();
+
+		const FileHeader* Header = reinterpret_cast<const FileHeader*>(File->Data());
+		const MeshInstance* First = reinterpret_cast<const MeshInstance*>(File->Data() + Header->InstanceDataOffset);
+
+		return Span<const MeshInstance>(First, Header->NumInstances);
+	}
+
+	std::string MappedMeshCache::GetString(uint32_t Offset, uint32_t Length) const
+	{
+		const FileHeader* Header = reinterpret_cast<const FileHeader*>(File->Data());
+		const char* Strings = reinterpret_cast<const char*>(File->Data() + Header->StringDataOffset);
+
+		return std::string(Strings + Offset, Length);
+	}
+}
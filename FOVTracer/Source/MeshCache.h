@@ -0,0 +1,80 @@
+#pragma once
+
+#include "StaticMesh.h"
+#include "MappedFile.h"
+#include "Span.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace MeshCache
+{
+	/**
+	* Bump whenever the on-disk layout or the contents of Vertex/Material change.
+	*/
+	constexpr uint32_t Version = 3;
+
+	/**
+	* Everything that influences the imported result. A cache file is only used if its key matches exactly.
+	*/
+	struct CacheKey
+	{
+		uint64_t SourceHash = 0;		// source file, its material libraries and the folder texture paths are resolved against
+		uint32_t LoadFlags = 0;
+		uint32_t GenVertexNormals = 0;
+		uint32_t OptimizeMeshes = 0;
+	};
+
+	/**
+	* Path of the cache file that belongs to a source asset.
+	*/
+	std::string GetCachePath(const std::string& SourcePath);
+
+	/**
+	* Writes the meshes and their instances into a flat cache file. Returns false if the file couldn't be written.
+	* Instance mesh indices are relative to Meshes.
+	*/
+	bool Write(const std::string& CachePath, const CacheKey& Key, Span<const StaticMesh> Meshes, Span<const MeshInstance> Instances);
+
+	/**
+	* A memory mapped cache file. Vertex and index data are handed out as spans directly into the mapping, they stay valid
+	* as long as something holds on to GetFile(). LoadStaticMeshes has its arena adopt the mapping, so a warm load copies
+	* nothing.
+	*/
+	class MappedMeshCache
+	{
+	public:
+		/**
+		* Maps the cache file and validates it against Key. Returns false on a missing, stale or corrupt file.
+		*/
+		bool Open(const std::string& CachePath, const CacheKey& Key);
+
+		uint32_t GetNumMeshes() const;
+
+		Span<const Vertex> GetVertices(uint32_t MeshIndex) const;
+		Span<const uint32_t> GetIndices(uint32_t MeshIndex) const;
+
+		/**
+		* Fills in the material and attribute flags of a mesh. Vertex and index data are left untouched.
+		*/
+		void GetMeshInfo(uint32_t MeshIndex, StaticMesh& OutMesh) const;
+
+		/**
+		* Instances of the cached meshes, mesh indices are relative to the first cached mesh.
+		*/
+		Span<const MeshInstance> GetInstances() const;
+
+		uint64_t GetSizeInBytes() const { return File ? File->Size() : 0; }
+
+		/**
+		* The mapping behind the spans, null unless Open succeeded.
+		*/
+		std::shared_ptr<const MappedFile> GetFile() const { return File; }
+
+	private:
+		std::string GetString(uint32_t Offset, uint32_t Length) const;
+
+		std::shared_ptr<MappedFile> File;
+	};
+}
@@ -0,0 +1,70 @@
+#include "pch.h"
+#include "MeshLOD.h"
+#include "Math.h"
+
+#include <cmath>
+
+namespace MeshLOD
+{
+	static const float PI = 3.14159265f;
+
+	uint32_t SelectLOD(const MeshLODChain& Chain, float MaxError)
+	{
+		uint32_t LOD = 0;
+		for (uint32_t i = 0; i < Chain.Levels.size(); i++)
+		{
+			// Errors grow with every level, the first one over budget ends the search
+			if (Chain.Levels[i].Error > MaxError)
+				break;
+
+			LOD = i + 1;
+		}
+
+		return LOD;
+	}
+
+	float GetErrorForScreenSpaceError(float PixelError, float Distance, float VerticalFOV, float OutputHeight)
+	{
+		float ViewHeight = 2.0f * Distance * std::tan(VerticalFOV * 0.5f * PI / 180.0f);
+		return PixelError * ViewHeight / Math::max(OutputHeight, 1.0f);
+	}
+
+	float GetSampleSpacing(const FoveationInfo& Info, float EccentricityPixels)
+	{
+		float OutputPerLaunchPixel = Info.OutputHeight / Math::max(Info.LaunchHeight, 1.0f);
+		float Radius = EccentricityPixels / OutputPerLaunchPixel;
+
+		if (Radius <= 1.0f)
+			return 1.0f;
+
+		// Same constants as RayGen, L maps the last column to the farthest screen corner and B spreads the rows over a full turn
+		float FovealX = Info.FovealCenterX * Info.LaunchWidth;
+		float FovealY = Info.FovealCenterY * Info.LaunchHeight;
+		float CornerX = Math::max(FovealX, Info.LaunchWidth - FovealX);
+		float CornerY = Math::max(FovealY, Info.LaunchHeight - FovealY);
+		float L = std::log(Math::max(std::sqrt(CornerX * CornerX + CornerY * CornerY), 2.0f));
+		float B = 2.0f * PI / Math::max(Info.LaunchHeight, 1.0f);
+		float Alpha = Math::max(std::fabs(Info.KernelAlpha), 1e-3f);
+
+		// r(x) = exp(L * (x / W)^Alpha), so one column further out covers dr/dx screen pixels
+		float U = std::pow(Math::min(std::log(Radius) / L, 1.0f), 1.0f / Alpha);
+		float RadialSpacing = Radius * L * Alpha * std::pow(U, Alpha - 1.0f) / Math::max(Info.LaunchWidth, 1.0f);
+		float AngularSpacing = Radius * B;
+
+		return Math::max(Math::max(RadialSpacing, AngularSpacing) * OutputPerLaunchPixel, 1.0f);
+	}
+
+	float EccentricityToPixels(const FoveationInfo& Info, float EccentricityDegrees)
+	{
+		// Measured from a gaze through the screen centre, close enough for the off centre gaze points we use
+		float PixelsPerTangent = Info.OutputHeight * 0.5f / std::tan(Info.VerticalFOV * 0.5f * PI / 180.0f);
+		float Angle = Math::min(Math::max(EccentricityDegrees, 0.0f), 89.0f) * PI / 180.0f;
+		return PixelsPerTangent * std::tan(Angle);
+	}
+
+	float GetErrorForEccentricity(const FoveationInfo& Info, float EccentricityDegrees, float Distance, float PixelError)
+	{
+		float Spacing = GetSampleSpacing(Info, EccentricityToPixels(Info, EccentricityDegrees));
+		return GetErrorForScreenSpaceError(PixelError * Spacing, Distance, Info.VerticalFOV, Info.OutputHeight);
+	}
+}
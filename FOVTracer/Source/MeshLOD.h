@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/**
+* One simplified level of a mesh. The indices refer to the vertices of the full resolution mesh, LODs don't add vertices.
+*/
+struct MeshLODLevel
+{
+	std::vector<uint32_t> Indices;
+
+	/**
+	* Largest object space distance between this level and the full resolution surface, as estimated by the quadrics.
+	*/
+	float Error = 0.0f;
+};
+
+/**
+* Simplified levels of a mesh, coarser with every level. LOD 0 is the mesh itself and isn't stored, Levels[0] is LOD 1.
+* Shared between all objects that instance the mesh.
+*/
+struct MeshLODChain
+{
+	std::vector<MeshLODLevel> Levels;
+
+	uint32_t GetNumLODs() const { return static_cast<uint32_t>(Levels.size()) + 1; }
+};
+
+/**
+* Everything needed to tell how coarse the foveated image is at a point of the screen. Mirrors the log-polar mapping in RayGen.hlsl.
+*/
+struct FoveationInfo
+{
+	/**
+	* Size of the log-polar buffer the rays are launched over and of the remapped output image, in pixels.
+	*/
+	float LaunchWidth = 1920.0f;
+	float LaunchHeight = 1080.0f;
+	float OutputWidth = 1920.0f;
+	float OutputHeight = 1080.0f;
+
+	/**
+	* Gaze point in [0, 1] screen coordinates, like TracerParameters::fovealCenter.
+	*/
+	float FovealCenterX = 0.5f;
+	float FovealCenterY = 0.5f;
+
+	float KernelAlpha = 4.0f;
+
+	/**
+	* Vertical field of view of the camera in degrees.
+	*/
+	float VerticalFOV = 75.0f;
+};
+
+namespace MeshLOD
+{
+	/**
+	* Coarsest LOD whose error is at most MaxError. Returns 0, the full mesh, if no simplified level is good enough.
+	*/
+	uint32_t SelectLOD(const MeshLODChain& Chain, float MaxError);
+
+	/**
+	* Object space error that projects to PixelError output pixels at Distance from the camera.
+	*/
+	float GetErrorForScreenSpaceError(float PixelError, float Distance, float VerticalFOV, float OutputHeight);
+
+	/**
+	* Size of one foveated sample in output pixels at EccentricityPixels from the gaze point. 1 inside the fovea, growing with the
+	* radial spacing of the log-polar buffer towards the periphery.
+	*/
+	float GetSampleSpacing(const FoveationInfo& Info, float EccentricityPixels);
+
+	/**
+	* Screen space distance from the gaze point for an angle between the gaze and a view ray, in output pixels.
+	*/
+	float EccentricityToPixels(const FoveationInfo& Info, float EccentricityDegrees);
+
+	/**
+	* Object space error budget for an object at Distance seen at an angular eccentricity. PixelError is the error allowed
+	* inside the fovea and is scaled by the sample spacing, detail the remap blurs away anyway isn't traced.
+	*/
+	float GetErrorForEccentricity(const FoveationInfo& Info, float EccentricityDegrees, float Distance, float PixelError = 1.0f);
+}
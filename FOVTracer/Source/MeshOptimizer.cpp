@@ -0,0 +1,333 @@
+#include "pch.h"
+#include "MeshOptimizer.h"
+
+#include <unordered_map>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace MeshOptimizer
+{
+	static const uint32_t InvalidIndex = ~0u;
+	static const uint32_t NumVertexComponents = 14;
+
+	static void GetComponents(const Vertex& Vtx, float* Out)
+	{
+		Out[0] = Vtx.Position.X;
+		Out[1] = Vtx.Position.Y;
+		Out[2] = Vtx.Position.Z;
+		Out[3] = Vtx.Texcoord.X;
+		Out[4] = Vtx.Texcoord.Y;
+		Out[5] = Vtx.Normal.X;
+		Out[6] = Vtx.Normal.Y;
+		Out[7] = Vtx.Normal.Z;
+		Out[8] = Vtx.Tangent.X;
+		Out[9] = Vtx.Tangent.Y;
+		Out[10] = Vtx.Tangent.Z;
+		Out[11] = Vtx.Binormal.X;
+		Out[12] = Vtx.Binormal.Y;
+		Out[13] = Vtx.Binormal.Z;
+	}
+
+	static uint64_t HashComponents(const float* Components, float InvEpsilon)
+	{
+		const uint64_t Prime = 1099511628211ull;
+		uint64_t Hash = 14695981039346656037ull;
+
+		for (uint32_t i = 0; i < NumVertexComponents; i++)
+		{
+			uint64_t Key;
+			if (InvEpsilon > 0.0f)
+			{
+				int64_t Cell = static_cast<int64_t>(std::floor(static_cast<double>(Components[i]) * InvEpsilon + 0.5));
+				memcpy(&Key, &Cell, sizeof(Key));
+			}
+			else
+			{
+				// -0 and +0 compare equal so they have to hash the same
+				float Value = Components[i] == 0.0f ? 0.0f : Components[i];
+				uint32_t Bits;
+				memcpy(&Bits, &Value, sizeof(Bits));
+				Key = Bits;
+			}
+
+			Hash = (Hash ^ Key) * Prime;
+			Hash ^= Hash >> 32;
+		}
+
+		return Hash;
+	}
+
+	static bool ComponentsEqual(const float* A, const float* B, float Epsilon)
+	{
+		for (uint32_t i = 0; i < NumVertexComponents; i++)
+		{
+			if (std::fabs(A[i] - B[i]) > Epsilon)
+				return false;
+		}
+
+		return true;
+	}
+
+	uint32_t WeldVertices(StaticMesh& Mesh, float Epsilon)
+	{
+		uint32_t NumVertices = static_cast<uint32_t>(Mesh.Vertices.size());
+		float InvEpsilon = Epsilon > 0.0f ? 1.0f / Epsilon : 0.0f;
+
+		std::vector<uint32_t> Remap(NumVertices);
+		std::vector<float> UniqueComponents;
+		std::vector<uint32_t> UniqueSource;
+		std::vector<uint32_t> NextInBucket;
+		std::unordered_map<uint64_t, uint32_t> Buckets;
+
+		UniqueComponents.reserve(static_cast<size_t>(NumVertices) * NumVertexComponents);
+		UniqueSource.reserve(NumVertices);
+		NextInBucket.reserve(NumVertices);
+		Buckets.reserve(NumVertices);
+
+		float Components[NumVertexComponents];
+
+		for (uint32_t i = 0; i < NumVertices; i++)
+		{
+			GetComponents(Mesh.Vertices[i], Components);
+			uint64_t Hash = HashComponents(Components, InvEpsilon);
+
+			uint32_t Match = InvalidIndex;
+			uint32_t BucketHead = InvalidIndex;
+
+			auto It = Buckets.find(Hash);
+			if (It != Buckets.end())
+			{
+				BucketHead = It->second;
+				for (uint32_t u = BucketHead; u != InvalidIndex; u = NextInBucket[u])
+				{
+					if (ComponentsEqual(&UniqueComponents[static_cast<size_t>(u) * NumVertexComponents], Components, Epsilon))
+					{
+						Match = u;
+						break;
+					}
+				}
+			}
+
+			if (Match == InvalidIndex)
+			{
+				Match = static_cast<uint32_t>(UniqueSource.size());
+				UniqueComponents.insert(UniqueComponents.end(), Components, Components + NumVertexComponents);
+				UniqueSource.push_back(i);
+				NextInBucket.push_back(BucketHead);
+				Buckets[Hash] = Match;
+			}
+
+			Remap[i] = Match;
+		}
+
+		uint32_t NumUnique = static_cast<uint32_t>(UniqueSource.size());
+		if (NumUnique == NumVertices)
+			return NumVertices;
+
+		// The first occurrence of a vertex always comes before any of its duplicates, so compacting in place is safe
+		for (uint32_t u = 0; u < NumUnique; u++)
+			Mesh.Vertices[u] = Mesh.Vertices[UniqueSource[u]];
+
+		Mesh.Vertices = Mesh.Vertices.Subspan(0, NumUnique);
+
+		for (uint32_t& Index : Mesh.Indices)
+			Index = Remap[Index];
+
+		return NumUnique;
+	}
+
+	/**
+	* Tipsify helper. Pops the dead-end stack, then falls back to scanning the vertices in input order.
+	*/
+	static uint32_t SkipDeadEnd(const std::vector<uint32_t>& LiveTriangles, std::vector<uint32_t>& DeadEndStack, uint32_t& Cursor)
+	{
+		while (!DeadEndStack.empty())
+		{
+			uint32_t Vtx = DeadEndStack.back();
+			DeadEndStack.pop_back();
+
+			if (LiveTriangles[Vtx] > 0)
+				return Vtx;
+		}
+
+		while (Cursor < LiveTriangles.size())
+		{
+			if (LiveTriangles[Cursor] > 0)
+				return Cursor;
+
+			Cursor++;
+		}
+
+		return InvalidIndex;
+	}
+
+	void OptimizeVertexCache(Span<uint32_t> Indices, uint32_t NumVertices, uint32_t CacheSize)
+	{
+		uint32_t NumTriangles = static_cast<uint32_t>(Indices.size() / 3);
+		if (NumTriangles == 0)
+			return;
+
+		// Vertex to triangle adjacency
+		std::vector<uint32_t> LiveTriangles(NumVertices, 0);
+		for (uint32_t Index : Indices)
+			LiveTriangles[Index]++;
+
+		std::vector<uint32_t> AdjacencyOffsets(static_cast<size_t>(NumVertices) + 1, 0);
+		for (uint32_t v = 0; v < NumVertices; v++)
+			AdjacencyOffsets[v + 1] = AdjacencyOffsets[v] + LiveTriangles[v];
+
+		std::vector<uint32_t> Adjacency(Indices.size());
+		std::vector<uint32_t> FillOffsets(AdjacencyOffsets.begin(), AdjacencyOffsets.end() - 1);
+		for (uint32_t t = 0; t < NumTriangles; t++)
+		{
+			for (uint32_t k = 0; k < 3; k++)
+				Adjacency[FillOffsets[Indices[t * 3 + k]]++] = t;
+		}
+
+		std::vector<uint32_t> CacheTime(NumVertices, 0);
+		std::vector<uint8_t> Emitted(NumTriangles, 0);
+		std::vector<uint32_t> DeadEndStack;
+		std::vector<uint32_t> Candidates;
+		std::vector<uint32_t> Output;
+		Output.reserve(Indices.size());
+
+		uint32_t Time = CacheSize + 1;
+		uint32_t Cursor = 0;
+		uint32_t Fanning = SkipDeadEnd(LiveTriangles, DeadEndStack, Cursor);
+
+		while (Fanning != InvalidIndex)
+		{
+			Candidates.clear();
+
+			for (uint32_t a = AdjacencyOffsets[Fanning]; a < AdjacencyOffsets[Fanning + 1]; a++)
+			{
+				uint32_t t = Adjacency[a];
+				if (Emitted[t])
+					continue;
+
+				for (uint32_t k = 0; k < 3; k++)
+				{
+					uint32_t Vtx = Indices[t * 3 + k];
+
+					Output.push_back(Vtx);
+					DeadEndStack.push_back(Vtx);
+					Candidates.push_back(Vtx);
+					LiveTriangles[Vtx]--;
+
+					if (Time - CacheTime[Vtx] > CacheSize)
+					{
+						CacheTime[Vtx] = Time;
+						Time++;
+					}
+				}
+
+				Emitted[t] = 1;
+			}
+
+			// Pick the candidate that is still in the cache and will stay there while its remaining triangles are emitted
+			uint32_t Next = InvalidIndex;
+			int64_t BestPriority = -1;
+
+			for (uint32_t Vtx : Candidates)
+			{
+				if (LiveTriangles[Vtx] == 0)
+					continue;
+
+				int64_t Priority = 0;
+				int64_t Age = static_cast<int64_t>(Time) - CacheTime[Vtx];
+				if (Age + 2 * static_cast<int64_t>(LiveTriangles[Vtx]) <= CacheSize)
+					Priority = Age;
+
+				if (Priority > BestPriority)
+				{
+					BestPriority = Priority;
+					Next = Vtx;
+				}
+			}
+
+			if (Next == InvalidIndex)
+				Next = SkipDeadEnd(LiveTriangles, DeadEndStack, Cursor);
+
+			Fanning = Next;
+		}
+
+		std::copy(Output.begin(), Output.end(), Indices.begin());
+	}
+
+	void OptimizeVertexFetch(StaticMesh& Mesh)
+	{
+		uint32_t NumVertices = static_cast<uint32_t>(Mesh.Vertices.size());
+
+		std::vector<uint32_t> Remap(NumVertices, InvalidIndex);
+		std::vector<Vertex> Reordered;
+		Reordered.reserve(NumVertices);
+
+		for (uint32_t& Index : Mesh.Indices)
+		{
+			if (Remap[Index] == InvalidIndex)
+			{
+				Remap[Index] = static_cast<uint32_t>(Reordered.size());
+				Reordered.push_back(Mesh.Vertices[Index]);
+			}
+
+			Index = Remap[Index];
+		}
+
+		std::copy(Reordered.begin(), Reordered.end(), Mesh.Vertices.begin());
+		Mesh.Vertices = Mesh.Vertices.Subspan(0, Reordered.size());
+	}
+
+	float ComputeACMR(Span<const uint32_t> Indices, uint32_t NumVertices, uint32_t CacheSize)
+	{
+		size_t NumTriangles = Indices.size() / 3;
+		if (NumTriangles == 0)
+			return 0.0f;
+
+		// FIFO cache, a vertex is only stamped when it is inserted
+		std::vector<uint32_t> InsertTime(NumVertices, 0);
+		uint32_t Time = CacheSize + 1;
+		uint32_t Misses = 0;
+
+		for (uint32_t Index : Indices)
+		{
+			if (Time - InsertTime[Index] > CacheSize)
+			{
+				InsertTime[Index] = Time;
+				Time++;
+				Misses++;
+			}
+		}
+
+		return static_cast<float>(Misses) / static_cast<float>(NumTriangles);
+	}
+
+	OptimizeStats Optimize(StaticMesh& Mesh, const OptimizeSettings& Settings)
+	{
+		OptimizeStats Stats;
+		Stats.VerticesBefore = static_cast<uint32_t>(Mesh.Vertices.size());
+		Stats.VerticesAfter = Stats.VerticesBefore;
+
+		if (Mesh.Indices.empty() || Mesh.Indices.size() % 3 != 0)
+			return Stats;
+
+		for (uint32_t Index : Mesh.Indices)
+		{
+			if (Index >= Stats.VerticesBefore)
+				return Stats;
+		}
+
+		// Left at 0 for untouched meshes, so they don't weigh into averaged ACMRs
+		Stats.NumTriangles = static_cast<uint32_t>(Mesh.Indices.size() / 3);
+		Stats.ACMRBefore = ComputeACMR(Mesh.Indices, Stats.VerticesBefore, Settings.CacheSize);
+
+		uint32_t NumWelded = WeldVertices(Mesh, Settings.WeldEpsilon);
+		OptimizeVertexCache(Mesh.Indices, NumWelded, Settings.CacheSize);
+		OptimizeVertexFetch(Mesh);
+
+		Stats.VerticesAfter = static_cast<uint32_t>(Mesh.Vertices.size());
+		Stats.ACMRAfter = ComputeACMR(Mesh.Indices, Stats.VerticesAfter, Settings.CacheSize);
+
+		return Stats;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "StaticMesh.h"
+#include "Span.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+* Load time geometry optimisation for StaticMesh. Welds duplicate vertices and reorders indices and vertices for locality.
+*/
+namespace MeshOptimizer
+{
+	struct OptimizeSettings
+	{
+		/**
+		* Vertices whose attributes all differ by at most this much are merged. 0 only merges exact duplicates.
+		*/
+		float WeldEpsilon = 1e-5f;
+
+		/**
+		* Size of the simulated FIFO post-transform cache used for reordering and ACMR.
+		*/
+		uint32_t CacheSize = 16;
+	};
+
+	struct OptimizeStats
+	{
+		uint32_t NumTriangles = 0;
+		uint32_t VerticesBefore = 0;
+		uint32_t VerticesAfter = 0;
+		float ACMRBefore = 0.0f;
+		float ACMRAfter = 0.0f;
+	};
+
+	/**
+	* Merges vertices that are equal within Epsilon and remaps the indices. Returns the number of vertices left.
+	* Vertices are bucketed on an Epsilon sized grid, so near duplicates that straddle a grid cell are kept apart.
+	*/
+	uint32_t WeldVertices(StaticMesh& Mesh, float Epsilon);
+
+	/**
+	* Reorders triangles for the post-transform cache using Tipsify (Sander et al. 2007).
+	*/
+	void OptimizeVertexCache(Span<uint32_t> Indices, uint32_t NumVertices, uint32_t CacheSize);
+
+	/**
+	* Reorders vertices in the order they are first referenced by the indices and drops unreferenced ones.
+	* Like welding this only shrinks the vertex span of the mesh, the arena space behind it stays allocated.
+	*/
+	void OptimizeVertexFetch(StaticMesh& Mesh);
+
+	/**
+	* Average cache miss ratio, transformed vertices per triangle for a FIFO cache of CacheSize entries.
+	*/
+	float ComputeACMR(Span<const uint32_t> Indices, uint32_t NumVertices, uint32_t CacheSize);
+
+	/**
+	* Runs all passes on a triangle list mesh in place. The mesh can't tell its primitive type, so the caller has to make sure
+	* it is a triangle list. Meshes whose index count isn't a multiple of three or that index past their vertices are left untouched.
+	*/
+	OptimizeStats Optimize(StaticMesh& Mesh, const OptimizeSettings& Settings = OptimizeSettings());
+}
@@ -0,0 +1,575 @@
+#include "pch.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+
+namespace MeshSimplifier
+{
+	static const uint32_t InvalidIndex = ~0u;
+	static const uint32_t CacheSize = 16;
+
+	enum class VertexKind : uint8_t
+	{
+		Manifold,
+		Border,
+		Locked
+	};
+
+	/**
+	* Symmetric 4x4 plane quadric, only the upper triangle is stored. Weight is the summed plane weight so
+	* Evaluate / Weight is a mean squared distance.
+	*/
+	struct Quadric
+	{
+		double A00 = 0.0, A01 = 0.0, A02 = 0.0, A03 = 0.0;
+		double A11 = 0.0, A12 = 0.0, A13 = 0.0;
+		double A22 = 0.0, A23 = 0.0;
+		double A33 = 0.0;
+		double Weight = 0.0;
+
+		void AddPlane(double NX, double NY, double NZ, double D, double W)
+		{
+			A00 += W * NX * NX; A01 += W * NX * NY; A02 += W * NX * NZ; A03 += W * NX * D;
+			A11 += W * NY * NY; A12 += W * NY * NZ; A13 += W * NY * D;
+			A22 += W * NZ * NZ; A23 += W * NZ * D;
+			A33 += W * D * D;
+			Weight += W;
+		}
+
+		void Add(const Quadric& Other)
+		{
+			A00 += Other.A00; A01 += Other.A01; A02 += Other.A02; A03 += Other.A03;
+			A11 += Other.A11; A12 += Other.A12; A13 += Other.A13;
+			A22 += Other.A22; A23 += Other.A23;
+			A33 += Other.A33;
+			Weight += Other.Weight;
+		}
+
+		double Evaluate(const Vector3f& P) const
+		{
+			double X = P.X, Y = P.Y, Z = P.Z;
+			double Result = A00 * X * X + 2.0 * A01 * X * Y + 2.0 * A02 * X * Z + 2.0 * A03 * X
+				+ A11 * Y * Y + 2.0 * A12 * Y * Z + 2.0 * A13 * Y
+				+ A22 * Z * Z + 2.0 * A23 * Z
+				+ A33;
+
+			return Math::max(Result, 0.0);
+		}
+	};
+
+	struct Collapse
+	{
+		float Cost;
+		float Error;
+		uint32_t From;
+		uint32_t To;
+		uint32_t FromVersion;
+		uint32_t ToVersion;
+
+		bool operator>(const Collapse& Other) const { return Cost > Other.Cost; }
+	};
+
+	static uint64_t HashPosition(const Vector3f& P)
+	{
+		// -0 and +0 are the same position
+		float Components[3] = { P.X == 0.0f ? 0.0f : P.X, P.Y == 0.0f ? 0.0f : P.Y, P.Z == 0.0f ? 0.0f : P.Z };
+		uint32_t Bits[3];
+		memcpy(Bits, Components, sizeof(Bits));
+
+		uint64_t Hash = 14695981039346656037ull;
+		for (uint32_t Value : Bits)
+			Hash = (Hash ^ Value) * 1099511628211ull;
+
+		return Hash;
+	}
+
+	static uint64_t EdgeKey(uint32_t A, uint32_t B)
+	{
+		return A < B ? (static_cast<uint64_t>(A) << 32) | B : (static_cast<uint64_t>(B) << 32) | A;
+	}
+
+	static Vector3f TriangleNormal(const Vector3f& A, const Vector3f& B, const Vector3f& C)
+	{
+		Vector3f Edge1(B.X - A.X, B.Y - A.Y, B.Z - A.Z);
+		Vector3f Edge2(C.X - A.X, C.Y - A.Y, C.Z - A.Z);
+		return Edge1.Cross(Edge2);
+	}
+
+	/**
+	* State of one simplification run. Triangles are rewritten in place as their vertices collapse.
+	*/
+	class Simplifier
+	{
+	public:
+		Simplifier(const StaticMesh& InMesh, const SimplifySettings& InSettings) :
+			Mesh(InMesh),
+			Settings(InSettings)
+		{
+		}
+
+		MeshLODChain Run(SimplifyStats& Stats);
+
+	private:
+		void Classify();
+		void ComputeQuadrics();
+		bool EvaluateCollapse(uint32_t From, uint32_t To, Collapse& OutCollapse) const;
+		void PushEdge(uint32_t A, uint32_t B);
+		void PushVertexEdges(uint32_t Vertex);
+		bool IsBorderEdge(uint32_t A, uint32_t B) const;
+		bool CanCollapse(uint32_t From, uint32_t To);
+		void ApplyCollapse(uint32_t From, uint32_t To);
+		void TakeLevel(MeshLODChain& Chain, float Error);
+
+		const Vector3f& GetPosition(uint32_t Vertex) const { return Mesh.Vertices[Vertex].Position; }
+
+		const StaticMesh& Mesh;
+		SimplifySettings Settings;
+
+		uint32_t NumVertices = 0;
+		uint32_t NumTriangles = 0;
+		uint32_t NumAliveTriangles = 0;
+
+		std::vector<uint32_t> Indices;
+		std::vector<uint8_t> IsTriangleAlive;
+		std::vector<std::vector<uint32_t>> VertexTriangles;
+
+		std::vector<uint32_t> PositionIDs;
+		std::vector<Quadric> PositionQuadrics;
+		std::vector<VertexKind> Kinds;
+		std::vector<uint8_t> IsRemoved;
+		std::vector<uint32_t> Versions;
+
+		std::vector<uint32_t> NeighbourMarks;
+		uint32_t MarkStamp = 0;
+
+		float AttributeScale = 0.0f;
+
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> Queue;
+	};
+
+	void Simplifier::Classify()
+	{
+		// Vertices that share a position, seams in the attributes, can't move without tearing the surface
+		std::unordered_map<uint64_t, uint32_t> PositionMap;
+		std::vector<uint32_t> PositionUsers;
+		std::vector<uint8_t> IsReferenced(NumVertices, 0);
+		for (uint32_t Index : Indices)
+			IsReferenced[Index] = 1;
+
+		PositionIDs.assign(NumVertices, InvalidIndex);
+		for (uint32_t v = 0; v < NumVertices; v++)
+		{
+			if (!IsReferenced[v])
+				continue;
+
+			// Different positions can share a hash, probe on until the stored position matches
+			uint64_t Hash = HashPosition(GetPosition(v));
+			auto Found = PositionMap.find(Hash);
+			while (Found != PositionMap.end())
+			{
+				const Vector3f& Other = GetPosition(Found->second);
+				const Vector3f& Position = GetPosition(v);
+				if (Other.X == Position.X && Other.Y == Position.Y && Other.Z == Position.Z)
+					break;
+
+				Found = PositionMap.find(++Hash);
+			}
+
+			if (Found == PositionMap.end())
+			{
+				PositionMap.emplace(Hash, v);
+				PositionIDs[v] = static_cast<uint32_t>(PositionUsers.size());
+				PositionUsers.push_back(1);
+			}
+			else
+			{
+				PositionIDs[v] = PositionIDs[Found->second];
+				PositionUsers[PositionIDs[v]]++;
+			}
+		}
+
+		Kinds.assign(NumVertices, VertexKind::Manifold);
+		for (uint32_t v = 0; v < NumVertices; v++)
+		{
+			if (!IsReferenced[v] || PositionUsers[PositionIDs[v]] > 1)
+				Kinds[v] = VertexKind::Locked;
+		}
+
+		// Edges are counted between positions so a seam doesn't look like an open border
+		std::unordered_map<uint64_t, uint32_t> EdgeCounts;
+		EdgeCounts.reserve(Indices.size());
+		for (uint32_t t = 0; t < NumTriangles; t++)
+		{
+			for (uint32_t k = 0; k < 3; k++)
+				EdgeCounts[EdgeKey(PositionIDs[Indices[t * 3 + k]], PositionIDs[Indices[t * 3 + (k + 1) % 3]])]++;
+		}
+
+		for (uint32_t t = 0; t < NumTriangles; t++)
+		{
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t A = Indices[t * 3 + k];
+				uint32_t B = Indices[t * 3 + (k + 1) % 3];
+				uint32_t Count = EdgeCounts[EdgeKey(PositionIDs[A], PositionIDs[B])];
+
+				VertexKind Kind = Count == 1 ? VertexKind::Border : (Count > 2 ? VertexKind::Locked : VertexKind::Manifold);
+				if (Kind > Kinds[A])
+					Kinds[A] = Kind;
+				if (Kind > Kinds[B])
+					Kinds[B] = Kind;
+			}
+		}
+
+		PositionQuadrics.assign(PositionUsers.size(), Quadric());
+	}
+
+	void Simplifier::ComputeQuadrics()
+	{
+		for (uint32_t t = 0; t < NumTriangles; t++)
+		{
+			const Vector3f& A = GetPosition(Indices[t * 3 + 0]);
+			const Vector3f& B = GetPosition(Indices[t * 3 + 1]);
+			const Vector3f& C = GetPosition(Indices[t * 3 + 2]);
+
+			Vector3f Normal = TriangleNormal(A, B, C);
+			double DoubleArea = Normal.Length();
+			if (DoubleArea <= 0.0)
+				continue;
+
+			double NX = Normal.X / DoubleArea;
+			double NY = Normal.Y / DoubleArea;
+			double NZ = Normal.Z / DoubleArea;
+			double D = -(NX * A.X + NY * A.Y + NZ * A.Z);
+
+			for (uint32_t k = 0; k < 3; k++)
+				PositionQuadrics[PositionIDs[Indices[t * 3 + k]]].AddPlane(NX, NY, NZ, D, DoubleArea * 0.5);
+
+			// Open borders get a plane through the edge at a right angle to the face
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t I0 = Indices[t * 3 + k];
+				uint32_t I1 = Indices[t * 3 + (k + 1) % 3];
+				if (!IsBorderEdge(I0, I1))
+					continue;
+
+				const Vector3f& P0 = GetPosition(I0);
+				const Vector3f& P1 = GetPosition(I1);
+				double EX = P1.X - P0.X, EY = P1.Y - P0.Y, EZ = P1.Z - P0.Z;
+				double BX = EY * NZ - EZ * NY;
+				double BY = EZ * NX - EX * NZ;
+				double BZ = EX * NY - EY * NX;
+				double Length = std::sqrt(BX * BX + BY * BY + BZ * BZ);
+				if (Length <= 0.0)
+					continue;
+
+				BX /= Length;
+				BY /= Length;
+				BZ /= Length;
+				double BD = -(BX * P0.X + BY * P0.Y + BZ * P0.Z);
+				double W = Settings.BorderWeight * (EX * EX + EY * EY + EZ * EZ);
+
+				PositionQuadrics[PositionIDs[I0]].AddPlane(BX, BY, BZ, BD, W);
+				PositionQuadrics[PositionIDs[I1]].AddPlane(BX, BY, BZ, BD, W);
+			}
+		}
+	}
+
+	bool Simplifier::IsBorderEdge(uint32_t A, uint32_t B) const
+	{
+		uint32_t Shared = 0;
+		for (uint32_t t : VertexTriangles[A])
+		{
+			if (!IsTriangleAlive[t])
+				continue;
+
+			const uint32_t* Tri = &Indices[static_cast<size_t>(t) * 3];
+			if (Tri[0] == B || Tri[1] == B || Tri[2] == B)
+				Shared++;
+		}
+
+		return Shared == 1;
+	}
+
+	bool Simplifier::EvaluateCollapse(uint32_t From, uint32_t To, Collapse& OutCollapse) const
+	{
+		if (Kinds[From] == VertexKind::Locked || IsRemoved[From] || IsRemoved[To])
+			return false;
+
+		Quadric Q = PositionQuadrics[PositionIDs[From]];
+		Q.Add(PositionQuadrics[PositionIDs[To]]);
+
+		float Error = static_cast<float>(std::sqrt(Q.Evaluate(GetPosition(To)) / Math::max(Q.Weight, 1e-30)));
+
+		Vertex A = Mesh.Vertices[From];
+		Vertex B = Mesh.Vertices[To];
+		Vector3f NormalDelta = A.Normal - B.Normal;
+		float UVX = A.Texcoord.X - B.Texcoord.X;
+		float UVY = A.Texcoord.Y - B.Texcoord.Y;
+		float AttributeDelta = NormalDelta.Dot(NormalDelta) + UVX * UVX + UVY * UVY;
+
+		OutCollapse = { Error * Error + AttributeScale * AttributeDelta, Error, From, To, Versions[From], Versions[To] };
+		return true;
+	}
+
+	void Simplifier::PushEdge(uint32_t A, uint32_t B)
+	{
+		// Only the cheaper direction goes into the queue, the edge is pushed again whenever one of its vertices changes
+		Collapse AToB, BToA;
+		bool CanAToB = EvaluateCollapse(A, B, AToB);
+		bool CanBToA = EvaluateCollapse(B, A, BToA);
+
+		if (CanAToB && (!CanBToA || AToB.Cost <= BToA.Cost))
+			Queue.push(AToB);
+		else if (CanBToA)
+			Queue.push(BToA);
+	}
+
+	void Simplifier::PushVertexEdges(uint32_t Vertex)
+	{
+		MarkStamp++;
+		NeighbourMarks[Vertex] = MarkStamp;
+
+		for (uint32_t t : VertexTriangles[Vertex])
+		{
+			if (!IsTriangleAlive[t])
+				continue;
+
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t Other = Indices[static_cast<size_t>(t) * 3 + k];
+				if (NeighbourMarks[Other] == MarkStamp)
+					continue;
+
+				NeighbourMarks[Other] = MarkStamp;
+				PushEdge(Vertex, Other);
+			}
+		}
+	}
+
+	bool Simplifier::CanCollapse(uint32_t From, uint32_t To)
+	{
+		// Border vertices may only slide along the border
+		bool IsBorder = IsBorderEdge(From, To);
+		if (Kinds[From] == VertexKind::Border && !IsBorder)
+			return false;
+
+		// Link condition, the two vertices may only share the neighbours of the triangles that collapse
+		MarkStamp++;
+		uint32_t SharedTriangles = 0;
+		for (uint32_t t : VertexTriangles[To])
+		{
+			if (!IsTriangleAlive[t])
+				continue;
+
+			const uint32_t* Tri = &Indices[static_cast<size_t>(t) * 3];
+			for (uint32_t k = 0; k < 3; k++)
+				NeighbourMarks[Tri[k]] = MarkStamp;
+		}
+
+		MarkStamp++;
+		uint32_t SharedNeighbours = 0;
+		const Vector3f& Target = GetPosition(To);
+		for (uint32_t t : VertexTriangles[From])
+		{
+			if (!IsTriangleAlive[t])
+				continue;
+
+			const uint32_t* Tri = &Indices[static_cast<size_t>(t) * 3];
+			if (Tri[0] == To || Tri[1] == To || Tri[2] == To)
+			{
+				SharedTriangles++;
+				continue;
+			}
+
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t Other = Tri[k];
+				if (Other != From && NeighbourMarks[Other] == MarkStamp - 1)
+				{
+					SharedNeighbours++;
+					NeighbourMarks[Other] = MarkStamp;
+				}
+			}
+
+			// Reject collapses that flip a remaining triangle
+			Vector3f Corners[3];
+			for (uint32_t k = 0; k < 3; k++)
+				Corners[k] = Tri[k] == From ? Target : GetPosition(Tri[k]);
+
+			Vector3f Before = TriangleNormal(GetPosition(Tri[0]), GetPosition(Tri[1]), GetPosition(Tri[2]));
+			Vector3f After = TriangleNormal(Corners[0], Corners[1], Corners[2]);
+			if (Before.Dot(After) <= 0.0f)
+				return false;
+		}
+
+		// Neighbours on the far side of the collapsing triangles are counted once per triangle
+		return SharedTriangles > 0 && SharedNeighbours <= SharedTriangles;
+	}
+
+	void Simplifier::ApplyCollapse(uint32_t From, uint32_t To)
+	{
+		std::vector<uint32_t>& ToTriangles = VertexTriangles[To];
+
+		for (uint32_t t : VertexTriangles[From])
+		{
+			if (!IsTriangleAlive[t])
+				continue;
+
+			uint32_t* Tri = &Indices[static_cast<size_t>(t) * 3];
+			if (Tri[0] == To || Tri[1] == To || Tri[2] == To)
+			{
+				IsTriangleAlive[t] = 0;
+				NumAliveTriangles--;
+				continue;
+			}
+
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				if (Tri[k] == From)
+					Tri[k] = To;
+			}
+
+			ToTriangles.push_back(t);
+		}
+
+		ToTriangles.erase(std::remove_if(ToTriangles.begin(), ToTriangles.end(), [this](uint32_t t) { return !IsTriangleAlive[t]; }), ToTriangles.end());
+		VertexTriangles[From].clear();
+		VertexTriangles[From].shrink_to_fit();
+
+		PositionQuadrics[PositionIDs[To]].Add(PositionQuadrics[PositionIDs[From]]);
+		IsRemoved[From] = 1;
+		Versions[To]++;
+	}
+
+	void Simplifier::TakeLevel(MeshLODChain& Chain, float Error)
+	{
+		MeshLODLevel Level;
+		Level.Indices.reserve(static_cast<size_t>(NumAliveTriangles) * 3);
+		for (uint32_t t = 0; t < NumTriangles; t++)
+		{
+			if (IsTriangleAlive[t])
+				Level.Indices.insert(Level.Indices.end(), &Indices[static_cast<size_t>(t) * 3], &Indices[static_cast<size_t>(t) * 3] + 3);
+		}
+
+		MeshOptimizer::OptimizeVertexCache(Span<uint32_t>(Level.Indices.data(), Level.Indices.size()), NumVertices, CacheSize);
+		Level.Error = Error;
+		Chain.Levels.push_back(std::move(Level));
+	}
+
+	MeshLODChain Simplifier::Run(SimplifyStats& Stats)
+	{
+		MeshLODChain Chain;
+
+		NumVertices = static_cast<uint32_t>(Mesh.Vertices.size());
+		NumTriangles = static_cast<uint32_t>(Mesh.Indices.size() / 3);
+		Stats.NumTriangles = NumTriangles;
+
+		if (NumTriangles < Math::max(Settings.MinTriangles, 1u) || Mesh.Indices.size() % 3 != 0 || Settings.MaxLevels == 0)
+			return Chain;
+
+		Indices.assign(Mesh.Indices.begin(), Mesh.Indices.end());
+		IsTriangleAlive.assign(NumTriangles, 1);
+		NumAliveTriangles = NumTriangles;
+
+		VertexTriangles.resize(NumVertices);
+		for (uint32_t t = 0; t < NumTriangles; t++)
+		{
+			for (uint32_t k = 0; k < 3; k++)
+				VertexTriangles[Indices[t * 3 + k]].push_back(t);
+		}
+
+		IsRemoved.assign(NumVertices, 0);
+		Versions.assign(NumVertices, 0);
+		NeighbourMarks.assign(NumVertices, 0);
+
+		Classify();
+		ComputeQuadrics();
+
+		const float Max = std::numeric_limits<float>::max();
+		Vector3f BoundsMin(Max, Max, Max);
+		Vector3f BoundsMax(-Max, -Max, -Max);
+		for (uint32_t Index : Indices)
+		{
+			const Vector3f& P = GetPosition(Index);
+			BoundsMin = Vector3f(Math::min(BoundsMin.X, P.X), Math::min(BoundsMin.Y, P.Y), Math::min(BoundsMin.Z, P.Z));
+			BoundsMax = Vector3f(Math::max(BoundsMax.X, P.X), Math::max(BoundsMax.Y, P.Y), Math::max(BoundsMax.Z, P.Z));
+		}
+
+		float Diagonal = (BoundsMax - BoundsMin).Length();
+		float MaxError = Settings.MaxRelativeError * Diagonal;
+		AttributeScale = Settings.AttributeWeight * Diagonal * Diagonal;
+
+		for (uint32_t t = 0; t < NumTriangles; t++)
+		{
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				// Interior edges show up in two triangles with opposite winding, border edges only once
+				uint32_t A = Indices[t * 3 + k];
+				uint32_t B = Indices[t * 3 + (k + 1) % 3];
+				if (A < B || IsBorderEdge(A, B))
+					PushEdge(A, B);
+			}
+		}
+
+		float Ratio = Math::min(Math::max(Settings.TriangleRatio, 0.01f), 0.99f);
+		float Target = NumTriangles * Ratio;
+		uint32_t LastLevelTriangles = NumTriangles;
+		float CurrentError = 0.0f;
+
+		while (!Queue.empty() && Chain.Levels.size() < Settings.MaxLevels)
+		{
+			if (NumAliveTriangles <= Target)
+			{
+				TakeLevel(Chain, CurrentError);
+				LastLevelTriangles = NumAliveTriangles;
+				Target = NumAliveTriangles * Ratio;
+				continue;
+			}
+
+			Collapse Next = Queue.top();
+			Queue.pop();
+
+			if (IsRemoved[Next.From] || IsRemoved[Next.To] || Versions[Next.From] != Next.FromVersion || Versions[Next.To] != Next.ToVersion)
+				continue;
+
+			if (Next.Error > MaxError || !CanCollapse(Next.From, Next.To))
+				continue;
+
+			ApplyCollapse(Next.From, Next.To);
+			CurrentError = Math::max(CurrentError, Next.Error);
+			PushVertexEdges(Next.To);
+		}
+
+		// Whatever is left once the error budget runs out is worth a level if it saved a noticeable amount
+		if (Chain.Levels.size() < Settings.MaxLevels && NumAliveTriangles < LastLevelTriangles * 0.9f)
+			TakeLevel(Chain, CurrentError);
+
+		Stats.NumLevels = static_cast<uint32_t>(Chain.Levels.size());
+		if (!Chain.Levels.empty())
+		{
+			Stats.CoarsestTriangles = static_cast<uint32_t>(Chain.Levels.back().Indices.size() / 3);
+			Stats.CoarsestError = Chain.Levels.back().Error;
+		}
+
+		return Chain;
+	}
+
+	MeshLODChain BuildLODChain(const StaticMesh& Mesh, const SimplifySettings& Settings, SimplifyStats* OutStats)
+	{
+		SimplifyStats Stats;
+		Simplifier Simplify(Mesh, Settings);
+		MeshLODChain Chain = Simplify.Run(Stats);
+
+		if (OutStats)
+			*OutStats = Stats;
+
+		return Chain;
+	}
+}
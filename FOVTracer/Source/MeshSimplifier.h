@@ -0,0 +1,61 @@
+#pragma once
+
+#include "StaticMesh.h"
+#include "MeshLOD.h"
+
+#include <cstdint>
+
+/**
+* Quadric error metric simplification (Garland and Heckbert 1997) for building LOD chains of StaticMesh.
+* Edges collapse onto one of their end vertices so every level keeps using the original vertices and attributes.
+* Vertices on texture or normal seams, where one position has several vertices, and on non-manifold edges stay in place.
+*/
+namespace MeshSimplifier
+{
+	struct SimplifySettings
+	{
+		/**
+		* Number of simplified levels to build at most, LOD 0 not included.
+		*/
+		uint32_t MaxLevels = 5;
+
+		/**
+		* Triangle count of each level relative to the previous one.
+		*/
+		float TriangleRatio = 0.5f;
+
+		/**
+		* Simplification stops once the error exceeds this fraction of the mesh bounds diagonal.
+		*/
+		float MaxRelativeError = 0.05f;
+
+		/**
+		* Meshes with fewer triangles aren't simplified.
+		*/
+		uint32_t MinTriangles = 64;
+
+		/**
+		* Weight of the plane quadrics that keep open borders in place, relative to the face quadrics.
+		*/
+		float BorderWeight = 10.0f;
+
+		/**
+		* Penalty for collapsing across a change in normal or texture coordinate, in squared mesh diagonals per unit of attribute change.
+		*/
+		float AttributeWeight = 1e-4f;
+	};
+
+	struct SimplifyStats
+	{
+		uint32_t NumTriangles = 0;
+		uint32_t NumLevels = 0;
+		uint32_t CoarsestTriangles = 0;
+		float CoarsestError = 0.0f;
+	};
+
+	/**
+	* Builds the LOD chain of a triangle list mesh in a single run of edge collapses, taking a level every time the triangle count
+	* drops below the next target. Meshes that aren't triangle lists or are too small get an empty chain.
+	*/
+	MeshLODChain BuildLODChain(const StaticMesh& Mesh, const SimplifySettings& Settings = SimplifySettings(), SimplifyStats* OutStats = nullptr);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Math.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+* A small cluster of connected triangles of a mesh. Triangles index into the meshlet's own vertex list with 8 bit local indices,
+* the vertex list holds indices into the mesh vertices.
+*/
+struct Meshlet
+{
+	/**
+	* First entry in MeshletData::VertexIndices.
+	*/
+	uint32_t VertexOffset = 0;
+
+	/**
+	* First triangle in MeshletData::LocalIndices, the triangle's local indices start at 3 * TriangleOffset.
+	*/
+	uint32_t TriangleOffset = 0;
+
+	uint32_t VertexCount = 0;
+	uint32_t TriangleCount = 0;
+
+	/**
+	* Object space bounds of the meshlet vertices.
+	*/
+	Vector3f BoundsMin;
+	Vector3f BoundsMax;
+
+	/**
+	* Every face normal of the meshlet lies within acos(ConeCutoff) of ConeAxis. A cutoff of 0 or less means the cone
+	* spans a hemisphere or more and can't be used for culling. Face normals follow the winding, cross(B - A, C - A).
+	*/
+	Vector3f ConeAxis;
+	float ConeCutoff = -1.0f;
+};
+
+/**
+* Meshlet decomposition of one mesh. Shared between all objects that instance the mesh.
+*/
+struct MeshletData
+{
+	std::vector<Meshlet> Meshlets;
+	std::vector<uint32_t> VertexIndices;
+	std::vector<uint8_t> LocalIndices;
+
+	uint32_t MaxVertices = 0;
+	uint32_t MaxTriangles = 0;
+};
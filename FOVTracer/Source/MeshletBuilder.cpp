@@ -0,0 +1,282 @@
+#include "pch.h"
+#include "MeshletBuilder.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace MeshletBuilder
+{
+	static const uint32_t InvalidIndex = ~0u;
+	static const uint32_t MaxLocalVertices = 256;
+
+	static uint32_t ExpandBits(uint32_t Value)
+	{
+		Value = (Value * 0x00010001u) & 0xFF0000FFu;
+		Value = (Value * 0x00000101u) & 0x0F00F00Fu;
+		Value = (Value * 0x00000011u) & 0xC30C30C3u;
+		Value = (Value * 0x00000005u) & 0x49249249u;
+		return Value;
+	}
+
+	/**
+	* 30 bit Morton code of a point in [0, 1]^3.
+	*/
+	static uint32_t MortonCode(float X, float Y, float Z)
+	{
+		auto const Quantize = [](float V) { return static_cast<uint32_t>(Math::min(Math::max(V * 1024.0f, 0.0f), 1023.0f)); };
+		return (ExpandBits(Quantize(X)) << 2) | (ExpandBits(Quantize(Y)) << 1) | ExpandBits(Quantize(Z));
+	}
+
+	static void ComputeBounds(const StaticMesh& Mesh, const MeshletData& Data, Meshlet& Cluster)
+	{
+		const float Max = std::numeric_limits<float>::max();
+		Vector3f Min(Max, Max, Max);
+		Vector3f MaxBounds(-Max, -Max, -Max);
+
+		for (uint32_t i = 0; i < Cluster.VertexCount; i++)
+		{
+			const Vector3f& P = Mesh.Vertices[Data.VertexIndices[Cluster.VertexOffset + i]].Position;
+			Min = Vector3f(Math::min(Min.X, P.X), Math::min(Min.Y, P.Y), Math::min(Min.Z, P.Z));
+			MaxBounds = Vector3f(Math::max(MaxBounds.X, P.X), Math::max(MaxBounds.Y, P.Y), Math::max(MaxBounds.Z, P.Z));
+		}
+
+		Cluster.BoundsMin = Min;
+		Cluster.BoundsMax = MaxBounds;
+	}
+
+	static void ComputeNormalCone(const StaticMesh& Mesh, const MeshletData& Data, Meshlet& Cluster)
+	{
+		std::vector<Vector3f> Normals;
+		Normals.reserve(Cluster.TriangleCount);
+
+		Vector3f AxisSum;
+		for (uint32_t t = 0; t < Cluster.TriangleCount; t++)
+		{
+			Vector3f Corners[3];
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t Local = Data.LocalIndices[(static_cast<size_t>(Cluster.TriangleOffset) + t) * 3 + k];
+				Corners[k] = Mesh.Vertices[Data.VertexIndices[Cluster.VertexOffset + Local]].Position;
+			}
+
+			Vector3f Normal = (Corners[1] - Corners[0]).Cross(Corners[2] - Corners[0]);
+			float Length = Normal.Length();
+
+			// Degenerate triangles can't be seen, they don't constrain the cone
+			if (Length <= 0.0f)
+				continue;
+
+			Normal = Normal * (1.0f / Length);
+			Normals.push_back(Normal);
+			AxisSum = AxisSum + Normal;
+		}
+
+		float AxisLength = AxisSum.Length();
+		if (Normals.empty() || AxisLength < 1e-6f)
+		{
+			Cluster.ConeAxis = Vector3f(0.0f, 0.0f, 1.0f);
+			Cluster.ConeCutoff = -1.0f;
+			return;
+		}
+
+		Cluster.ConeAxis = AxisSum * (1.0f / AxisLength);
+
+		float MinDot = 1.0f;
+		for (Vector3f& Normal : Normals)
+			MinDot = Math::min(MinDot, Normal.Dot(Cluster.ConeAxis));
+
+		Cluster.ConeCutoff = MinDot;
+	}
+
+	MeshletData Build(const StaticMesh& Mesh, const BuildSettings& Settings)
+	{
+		MeshletData Data;
+		Data.MaxVertices = Math::min(Math::max(Settings.MaxVertices, 3u), MaxLocalVertices);
+		Data.MaxTriangles = Math::max(Settings.MaxTriangles, 1u);
+
+		if (Data.MaxVertices != Settings.MaxVertices)
+			CORE_WARN("Meshlet vertex limit {0} clamped to {1}", Settings.MaxVertices, Data.MaxVertices);
+
+		uint32_t NumVertices = static_cast<uint32_t>(Mesh.Vertices.size());
+		uint32_t NumTriangles = static_cast<uint32_t>(Mesh.Indices.size() / 3);
+		if (NumTriangles == 0 || Mesh.Indices.size() % 3 != 0)
+			return Data;
+
+		const uint32_t* Indices = Mesh.Indices.data();
+
+		// Centroids and mesh bounds for the seed order
+		std::vector<Vector3f> Centroids(NumTriangles);
+		const float Max = std::numeric_limits<float>::max();
+		Vector3f MeshMin(Max, Max, Max);
+		Vector3f MeshMax(-Max, -Max, -Max);
+
+		for (uint32_t t = 0; t < NumTriangles; t++)
+		{
+			Vector3f Sum;
+			for (uint32_t k = 0; k < 3; k++)
+				Sum = Sum + Mesh.Vertices[Indices[t * 3 + k]].Position;
+
+			Vector3f C = Sum * (1.0f / 3.0f);
+			Centroids[t] = C;
+			MeshMin = Vector3f(Math::min(MeshMin.X, C.X), Math::min(MeshMin.Y, C.Y), Math::min(MeshMin.Z, C.Z));
+			MeshMax = Vector3f(Math::max(MeshMax.X, C.X), Math::max(MeshMax.Y, C.Y), Math::max(MeshMax.Z, C.Z));
+		}
+
+		Vector3f Extent = MeshMax - MeshMin;
+		float InvExtent = 1.0f / Math::max(Math::max(Extent.X, Extent.Y), Math::max(Extent.Z, 1e-20f));
+
+		std::vector<uint32_t> MortonCodes(NumTriangles);
+		std::vector<uint32_t> SeedOrder(NumTriangles);
+		for (uint32_t t = 0; t < NumTriangles; t++)
+		{
+			Vector3f Local = (Centroids[t] - MeshMin) * InvExtent;
+			MortonCodes[t] = MortonCode(Local.X, Local.Y, Local.Z);
+			SeedOrder[t] = t;
+		}
+
+		std::sort(SeedOrder.begin(), SeedOrder.end(), [&](uint32_t A, uint32_t B) { return MortonCodes[A] < MortonCodes[B]; });
+
+		// Vertex to triangle adjacency, same layout as the one Tipsify uses
+		std::vector<uint32_t> AdjacencyOffsets(static_cast<size_t>(NumVertices) + 1, 0);
+		for (size_t i = 0; i < Mesh.Indices.size(); i++)
+			AdjacencyOffsets[Indices[i] + 1]++;
+		for (uint32_t v = 0; v < NumVertices; v++)
+			AdjacencyOffsets[v + 1] += AdjacencyOffsets[v];
+
+		std::vector<uint32_t> Adjacency(Mesh.Indices.size());
+		std::vector<uint32_t> FillOffsets(AdjacencyOffsets.begin(), AdjacencyOffsets.end() - 1);
+		for (uint32_t t = 0; t < NumTriangles; t++)
+		{
+			for (uint32_t k = 0; k < 3; k++)
+				Adjacency[FillOffsets[Indices[t * 3 + k]]++] = t;
+		}
+
+		std::vector<uint8_t> IsEmitted(NumTriangles, 0);
+		std::vector<uint32_t> LocalIndexOf(NumVertices, InvalidIndex);
+		std::vector<uint32_t> Candidates;
+
+		Data.Meshlets.reserve(NumTriangles / Data.MaxTriangles + 1);
+		Data.LocalIndices.reserve(Mesh.Indices.size());
+
+		Meshlet Current;
+		Vector3f CentroidSum;
+		uint32_t SeedCursor = 0;
+
+		auto const FinishMeshlet = [&]()
+		{
+			ComputeBounds(Mesh, Data, Current);
+			ComputeNormalCone(Mesh, Data, Current);
+
+			for (uint32_t i = 0; i < Current.VertexCount; i++)
+				LocalIndexOf[Data.VertexIndices[Current.VertexOffset + i]] = InvalidIndex;
+
+			Data.Meshlets.push_back(Current);
+
+			Current = Meshlet();
+			Current.VertexOffset = static_cast<uint32_t>(Data.VertexIndices.size());
+			Current.TriangleOffset = static_cast<uint32_t>(Data.LocalIndices.size() / 3);
+			CentroidSum = Vector3f();
+			Candidates.clear();
+		};
+
+		uint32_t NumEmitted = 0;
+		while (NumEmitted < NumTriangles)
+		{
+			uint32_t Best = InvalidIndex;
+			uint32_t BestNewVertices = InvalidIndex;
+			float BestDistance = Max;
+
+			if (Current.TriangleCount > 0)
+			{
+				Vector3f Centre = CentroidSum * (1.0f / static_cast<float>(Current.TriangleCount));
+
+				// Compact the candidate list while scoring it, emitted triangles drop out
+				size_t NumLive = 0;
+				for (size_t c = 0; c < Candidates.size(); c++)
+				{
+					uint32_t t = Candidates[c];
+					if (IsEmitted[t])
+						continue;
+
+					Candidates[NumLive++] = t;
+
+					uint32_t NewVertices = 0;
+					for (uint32_t k = 0; k < 3; k++)
+						NewVertices += LocalIndexOf[Indices[t * 3 + k]] == InvalidIndex ? 1 : 0;
+
+					if (Current.VertexCount + NewVertices > Data.MaxVertices)
+						continue;
+
+					Vector3f Offset = Centroids[t] - Centre;
+					float Distance = Offset.Dot(Offset);
+
+					if (NewVertices < BestNewVertices || (NewVertices == BestNewVertices && Distance < BestDistance))
+					{
+						Best = t;
+						BestNewVertices = NewVertices;
+						BestDistance = Distance;
+					}
+				}
+				Candidates.resize(NumLive);
+
+				// Nothing connected fits anymore, start a new meshlet from the next seed
+				if (Best == InvalidIndex)
+				{
+					FinishMeshlet();
+					continue;
+				}
+			}
+			else
+			{
+				while (IsEmitted[SeedOrder[SeedCursor]])
+					SeedCursor++;
+
+				Best = SeedOrder[SeedCursor];
+			}
+
+			for (uint32_t k = 0; k < 3; k++)
+			{
+				uint32_t Index = Indices[Best * 3 + k];
+				if (LocalIndexOf[Index] == InvalidIndex)
+				{
+					LocalIndexOf[Index] = Current.VertexCount++;
+					Data.VertexIndices.push_back(Index);
+				}
+
+				Data.LocalIndices.push_back(static_cast<uint8_t>(LocalIndexOf[Index]));
+
+				for (uint32_t a = AdjacencyOffsets[Index]; a < AdjacencyOffsets[Index + 1]; a++)
+				{
+					if (!IsEmitted[Adjacency[a]] && Adjacency[a] != Best)
+						Candidates.push_back(Adjacency[a]);
+				}
+			}
+
+			IsEmitted[Best] = 1;
+			NumEmitted++;
+			Current.TriangleCount++;
+			CentroidSum = CentroidSum + Centroids[Best];
+
+			if (Current.TriangleCount == Data.MaxTriangles)
+				FinishMeshlet();
+		}
+
+		if (Current.TriangleCount > 0)
+			FinishMeshlet();
+
+		return Data;
+	}
+
+	bool IsBackfacing(const Meshlet& Cluster, const Vector3f& ViewDirection)
+	{
+		if (Cluster.ConeCutoff <= 0.0f)
+			return false;
+
+		// Backfacing for every normal in the cone if the view direction is within 90 degrees minus the cone angle of the axis
+		float SinCone = std::sqrt(Math::max(1.0f - Cluster.ConeCutoff * Cluster.ConeCutoff, 0.0f));
+		Vector3f Axis = Cluster.ConeAxis;
+		return Axis.Dot(ViewDirection) > SinCone;
+	}
+}
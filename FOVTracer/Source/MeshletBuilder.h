@@ -0,0 +1,33 @@
+#pragma once
+
+#include "StaticMesh.h"
+#include "Meshlet.h"
+
+#include <cstdint>
+
+/**
+* Splits meshes into meshlets, spatially coherent clusters of connected triangles with bounds and normal cones.
+*/
+namespace MeshletBuilder
+{
+	struct BuildSettings
+	{
+		/**
+		* Limits per meshlet. Local indices are 8 bit so MaxVertices is clamped to 256.
+		*/
+		uint32_t MaxVertices = 64;
+		uint32_t MaxTriangles = 124;
+	};
+
+	/**
+	* Clusters the triangles of a triangle list mesh. Seed triangles are taken in Morton order of their centroids and each meshlet
+	* grows greedily over shared vertices, preferring triangles that add the fewest new vertices and then the ones closest to its centre.
+	*/
+	MeshletData Build(const StaticMesh& Mesh, const BuildSettings& Settings = BuildSettings());
+
+	/**
+	* True if no triangle of the meshlet can be front facing for a view direction pointing from the eye towards the meshlet.
+	* ViewDirection has to be normalized.
+	*/
+	bool IsBackfacing(const Meshlet& Cluster, const Vector3f& ViewDirection);
+}
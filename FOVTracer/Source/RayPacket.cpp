@@ -0,0 +1,71 @@
+#include "pch.h"
+#include "RayPacket.h"
+
+#include <cmath>
+#include <limits>
+
+uint32_t RayPacket::AddRay(const Vector3f& Origin, const Vector3f& Direction, float MaxT)
+{
+	// Same stand-in for a zero direction as the single ray traversal
+	const float Huge = 1e30f;
+
+	uint32_t Index = NumRays++;
+	OriginX[Index] = Origin.X;
+	OriginY[Index] = Origin.Y;
+	OriginZ[Index] = Origin.Z;
+	DirectionX[Index] = Direction.X;
+	DirectionY[Index] = Direction.Y;
+	DirectionZ[Index] = Direction.Z;
+	InvDirectionX[Index] = Direction.X != 0.0f ? 1.0f / Direction.X : Huge;
+	InvDirectionY[Index] = Direction.Y != 0.0f ? 1.0f / Direction.Y : Huge;
+	InvDirectionZ[Index] = Direction.Z != 0.0f ? 1.0f / Direction.Z : Huge;
+	TMax[Index] = MaxT;
+	IsCoherent = false;
+
+	return Index;
+}
+
+bool RayPacket::Prepare(float MinDirectionCos)
+{
+	IsCoherent = false;
+	if (NumRays == 0)
+		return false;
+
+	const float* Origins[3] = { OriginX, OriginY, OriginZ };
+	const float* Directions[3] = { DirectionX, DirectionY, DirectionZ };
+	const float* InvDirections[3] = { InvDirectionX, InvDirectionY, InvDirectionZ };
+
+	for (uint32_t Axis = 0; Axis < 3; Axis++)
+	{
+		IsNegative[Axis] = InvDirections[Axis][0] < 0.0f ? 1 : 0;
+		OriginMin[Axis] = std::numeric_limits<float>::max();
+		OriginMax[Axis] = -std::numeric_limits<float>::max();
+		InvDirectionMin[Axis] = std::numeric_limits<float>::max();
+		InvDirectionMax[Axis] = 0.0f;
+
+		for (uint32_t r = 0; r < NumRays; r++)
+		{
+			if ((InvDirections[Axis][r] < 0.0f ? 1u : 0u) != IsNegative[Axis])
+				return false;
+
+			float Magnitude = std::fabs(InvDirections[Axis][r]);
+			OriginMin[Axis] = Math::min(OriginMin[Axis], Origins[Axis][r]);
+			OriginMax[Axis] = Math::max(OriginMax[Axis], Origins[Axis][r]);
+			InvDirectionMin[Axis] = Math::min(InvDirectionMin[Axis], Magnitude);
+			InvDirectionMax[Axis] = Math::max(InvDirectionMax[Axis], Magnitude);
+		}
+	}
+
+	for (uint32_t r = 1; r < NumRays; r++)
+	{
+		float Cos = 0.0f;
+		for (uint32_t Axis = 0; Axis < 3; Axis++)
+			Cos += Directions[Axis][0] * Directions[Axis][r];
+
+		if (Cos < MinDirectionCos)
+			return false;
+	}
+
+	IsCoherent = true;
+	return true;
+}
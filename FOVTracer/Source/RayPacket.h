@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Math.h"
+
+#include <cstdint>
+
+/**
+* Up to MaxRays rays traced through the BVH together, stored per component. Prepare bounds the packet with intervals of its
+* origins and inverse directions, nodes outside that frustum are culled for the whole packet with one test.
+*/
+struct RayPacket
+{
+	static constexpr uint32_t MaxRays = 16;
+
+	void Clear() { NumRays = 0; IsCoherent = false; }
+
+	/**
+	* Returns the index of the ray in the packet. Direction has to be normalized. The packet has to be prepared again before
+	* it is traced.
+	*/
+	uint32_t AddRay(const Vector3f& Origin, const Vector3f& Direction, float MaxT);
+
+	/**
+	* Computes the culling intervals. The packet is coherent if every ray points into the same octant and no direction is
+	* more than acos(MinDirectionCos) away from the first one, otherwise its rays have to be traced one by one.
+	*/
+	bool Prepare(float MinDirectionCos);
+
+	uint32_t NumRays = 0;
+	bool IsCoherent = false;
+
+	float OriginX[MaxRays];
+	float OriginY[MaxRays];
+	float OriginZ[MaxRays];
+	float DirectionX[MaxRays];
+	float DirectionY[MaxRays];
+	float DirectionZ[MaxRays];
+	float InvDirectionX[MaxRays];
+	float InvDirectionY[MaxRays];
+	float InvDirectionZ[MaxRays];
+
+	/**
+	* Shortened as the rays hit.
+	*/
+	float TMax[MaxRays];
+
+	/**
+	* Bounds of the packet per axis. Inverse directions are taken by magnitude, IsNegative holds the shared sign.
+	*/
+	float OriginMin[3];
+	float OriginMax[3];
+	float InvDirectionMin[3];
+	float InvDirectionMax[3];
+	uint32_t IsNegative[3];
+};
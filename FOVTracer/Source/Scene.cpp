@@ -2,10 +2,25 @@
 #include "Scene.h"
 #include "Utils.h"
 #include "Log.h"
+#include "ThreadPool.h"
+#include "HostResidency.h"
+
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+#include <atomic>
+#include <string>
+#include <cassert>
+
+Scene::~Scene()
+{
+	Clear();
+}
 
 void Scene::AddSceneObject(const SceneObject& SObject)
 {
 	SceneObjects.push_back(SObject);
+	Generation++;
 }
 
 uint32_t Scene::GetNumSceneObjects()
@@ -15,23 +30,368 @@ uint32_t Scene::GetNumSceneObjects()
 
 void Scene::Clear()
 {
+	WaitForStreamTask();
+	StreamedObjects.clear();
+
+	// The residency mustn't call back into arenas that are gone
+	for (const ArenaSource& Source : ArenaSources)
+	{
+		if (!Source.ResidencyKey.empty())
+			HostResidency::GetGlobal().Remove(Source.ResidencyKey);
+	}
+
 	SceneObjects.clear();
+	Geometry.Clear();
+	Arenas.clear();
+	ArenaSources.clear();
+	Generation++;
+}
+
+void Scene::BuildGeometry()
+{
+	if (!LockHostMeshes())
+	{
+		CORE_ERROR("Scene meshes couldn't be reloaded, scene geometry is left empty");
+		Geometry.Clear();
+		return;
+	}
+
+	Geometry.Build(Span<const SceneObject>(SceneObjects.data(), SceneObjects.size()));
+	UnlockHostMeshes();
+}
+
+void Scene::GetUniqueMeshes(std::vector<const StaticMesh*>& OutMeshes, std::vector<uint32_t>& OutObjectMeshIDs) const
+{
+	// Instances point at the same arena spans, so the vertex pointer identifies the mesh
+	std::unordered_map<const Vertex*, uint32_t> UniqueMeshIDs;
+	OutMeshes.clear();
+	OutObjectMeshIDs.resize(SceneObjects.size());
+
+	for (size_t i = 0; i < SceneObjects.size(); i++)
+	{
+		const StaticMesh& Mesh = SceneObjects[i].Mesh;
+		auto const Inserted = UniqueMeshIDs.emplace(Mesh.Vertices.data(), static_cast<uint32_t>(OutMeshes.size()));
+		if (Inserted.second)
+			OutMeshes.push_back(&Mesh);
+
+		OutObjectMeshIDs[i] = Inserted.first->second;
+	}
+}
+
+void Scene::BuildMeshlets(const MeshletBuilder::BuildSettings& Settings)
+{
+	auto const Start = std::chrono::high_resolution_clock::now();
+
+	std::vector<const StaticMesh*> UniqueMeshes;
+	std::vector<uint32_t> ObjectMeshIDs;
+	if (!LockHostMeshes())
+	{
+		CORE_ERROR("Scene meshes couldn't be reloaded, no meshlets were built");
+		return;
+	}
+
+	GetUniqueMeshes(UniqueMeshes, ObjectMeshIDs);
+
+	std::vector<std::shared_ptr<const MeshletData>> Meshlets(UniqueMeshes.size());
+	ThreadPool::GetGlobal().ParallelFor(static_cast<uint32_t>(UniqueMeshes.size()), [&](uint32_t i)
+	{
+		Meshlets[i] = std::make_shared<const MeshletData>(MeshletBuilder::Build(*UniqueMeshes[i], Settings));
+	});
+
+	size_t NumMeshlets = 0;
+	for (const std::shared_ptr<const MeshletData>& Data : Meshlets)
+		NumMeshlets += Data->Meshlets.size();
+
+	for (size_t i = 0; i < SceneObjects.size(); i++)
+		SceneObjects[i].Mesh.Meshlets = Meshlets[ObjectMeshIDs[i]];
+
+	UnlockHostMeshes();
+
+	auto const End = std::chrono::high_resolution_clock::now();
+	CORE_TRACE("Built {0} meshlets for {1} meshes in {2:.1f} ms", NumMeshlets, UniqueMeshes.size(),
+		std::chrono::duration<double, std::milli>(End - Start).count());
+}
+
+void Scene::BuildLODs(const MeshSimplifier::SimplifySettings& Settings)
+{
+	auto const Start = std::chrono::high_resolution_clock::now();
+
+	std::vector<const StaticMesh*> UniqueMeshes;
+	std::vector<uint32_t> ObjectMeshIDs;
+	if (!LockHostMeshes())
+	{
+		CORE_ERROR("Scene meshes couldn't be reloaded, no LODs were built");
+		return;
+	}
+
+	GetUniqueMeshes(UniqueMeshes, ObjectMeshIDs);
+
+	std::vector<std::shared_ptr<const MeshLODChain>> Chains(UniqueMeshes.size());
+	ThreadPool::GetGlobal().ParallelFor(static_cast<uint32_t>(UniqueMeshes.size()), [&](uint32_t i)
+	{
+		Chains[i] = std::make_shared<const MeshLODChain>(MeshSimplifier::BuildLODChain(*UniqueMeshes[i], Settings));
+	});
+
+	size_t NumLevels = 0;
+	for (const std::shared_ptr<const MeshLODChain>& Chain : Chains)
+		NumLevels += Chain->Levels.size();
+
+	for (size_t i = 0; i < SceneObjects.size(); i++)
+		SceneObjects[i].Mesh.LODs = Chains[ObjectMeshIDs[i]];
+
+	UnlockHostMeshes();
+
+	auto const End = std::chrono::high_resolution_clock::now();
+	CORE_TRACE("Built {0} LOD levels for {1} meshes in {2:.1f} ms", NumLevels, UniqueMeshes.size(),
+		std::chrono::duration<double, std::milli>(End - Start).count());
+}
+
+Vertex Scene::GetHitAttributes(uint32_t TriangleIndex, float U, float V) const
+{
+	return Geometry.InterpolateAttributes(Span<const SceneObject>(SceneObjects.data(), SceneObjects.size()), TriangleIndex, U, V);
+}
+
+void Scene::ReleaseHostMeshes()
+{
+	static std::atomic<uint64_t> NextArenaID{ 0 };
+
+	// A world space copy of every instance, the biggest host mesh allocation of all and of no use to the GPU
+	Geometry.Clear();
+
+	// The last arena of a streaming load still has objects waiting to be published
+	const size_t NumPublished = IsStreaming() ? Arenas.size() - 1 : Arenas.size();
+
+	for (uint32_t i = 0; i < NumPublished; i++)
+	{
+		ArenaSource& Source = ArenaSources[i];
+		if (!Source.ResidencyKey.empty())
+		{
+			HostResidency::GetGlobal().Release(Source.ResidencyKey);
+			continue;
+		}
+
+		// Failed loads never got any data
+		if (Arenas[i]->GetSizeInBytes() == 0)
+			continue;
+
+		Source.ResidencyKey = Source.Path + "#meshes" + std::to_string(NextArenaID++);
+		HostResidency::GetGlobal().Add(Source.ResidencyKey, HostMemoryCategory::Meshes, Arenas[i]->GetSizeInBytes(),
+			[this, i]() { ReleaseArena(i); }, [this, i]() { return ReloadArena(i); });
+		HostResidency::GetGlobal().Release(Source.ResidencyKey);
+	}
+}
+
+bool Scene::LockHostMeshes()
+{
+	for (size_t i = 0; i < ArenaSources.size(); i++)
+	{
+		if (ArenaSources[i].ResidencyKey.empty() || HostResidency::GetGlobal().Lock(ArenaSources[i].ResidencyKey))
+			continue;
+
+		// All or nothing, so a failed lock never needs a matching UnlockHostMeshes
+		for (size_t j = 0; j < i; j++)
+		{
+			if (!ArenaSources[j].ResidencyKey.empty())
+				HostResidency::GetGlobal().Unlock(ArenaSources[j].ResidencyKey);
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+void Scene::UnlockHostMeshes()
+{
+	for (const ArenaSource& Source : ArenaSources)
+	{
+		if (!Source.ResidencyKey.empty())
+			HostResidency::GetGlobal().Unlock(Source.ResidencyKey);
+	}
+}
+
+void Scene::ReleaseArena(uint32_t ArenaIndex)
+{
+	assert(std::this_thread::get_id() == OwnerThread && "Scene meshes may only be released on the thread that owns the scene");
+
+	// Spans are emptied, not just nulled, so nothing can walk a dropped mesh. The sizes are kept aside to check the reload against.
+	std::vector<MeshSize>& MeshSizes = ArenaSources[ArenaIndex].MeshSizes;
+	for (SceneObject& Object : SceneObjects)
+	{
+		if (Object.ArenaIndex != ArenaIndex)
+			continue;
+
+		if (Object.MeshIndex >= MeshSizes.size())
+			MeshSizes.resize(Object.MeshIndex + 1);
+
+		MeshSizes[Object.MeshIndex] = { Object.Mesh.Vertices.size(), Object.Mesh.Indices.size() };
+		Object.Mesh.Vertices = Span<Vertex>();
+		Object.Mesh.Indices = Span<uint32_t>();
+	}
+
+	Arenas[ArenaIndex]->Clear();
+}
+
+uint64_t Scene::ReloadArena(uint32_t ArenaIndex)
+{
+	assert(std::this_thread::get_id() == OwnerThread && "Scene meshes may only be reloaded on the thread that owns the scene");
+
+	const ArenaSource& Source = ArenaSources[ArenaIndex];
+
+	// Comes straight from the mesh cache unless the file changed, in which case the counts below won't match
+	std::unique_ptr<GeometryArena> Arena = std::make_unique<GeometryArena>();
+	std::vector<StaticMesh> Meshes;
+	std::vector<MeshInstance> Instances;
+	if (!Utils::LoadStaticMeshes(Source.Path, *Arena, Meshes, Instances, Source.GenNormals, Source.Optimize))
+		return 0;
+
+	for (const SceneObject& Object : SceneObjects)
+	{
+		if (Object.ArenaIndex != ArenaIndex)
+			continue;
+
+		if (Object.MeshIndex >= Meshes.size() || Object.MeshIndex >= Source.MeshSizes.size() ||
+			Meshes[Object.MeshIndex].Vertices.size() != Source.MeshSizes[Object.MeshIndex].NumVertices ||
+			Meshes[Object.MeshIndex].Indices.size() != Source.MeshSizes[Object.MeshIndex].NumIndices)
+		{
+			CORE_ERROR("{0} changed since it was loaded, its meshes can't be reloaded", Source.Path);
+			return 0;
+		}
+	}
+
+	for (SceneObject& Object : SceneObjects)
+	{
+		if (Object.ArenaIndex != ArenaIndex)
+			continue;
+
+		Object.Mesh.Vertices = Meshes[Object.MeshIndex].Vertices;
+		Object.Mesh.Indices = Meshes[Object.MeshIndex].Indices;
+	}
+
+	Arenas[ArenaIndex] = std::move(Arena);
+	CORE_TRACE("Reloaded {0} meshes from {1}", Meshes.size(), Source.Path);
+
+	return Arenas[ArenaIndex]->GetSizeInBytes();
 }
 
-void Scene::LoadFromPath(std::string Path, bool ShouldGenNormals)
+void Scene::LoadFromPath(std::string Path, bool ShouldGenNormals, bool ShouldOptimize, bool ShouldBuildLODs)
 {
+	std::unique_ptr<GeometryArena> Arena = std::make_unique<GeometryArena>();
 	std::vector<StaticMesh> Meshes;
+	std::vector<MeshInstance> Instances;
 
-	bool Success = Utils::LoadStaticMeshes(Path, Meshes, ShouldGenNormals);
+	bool Success = Utils::LoadStaticMeshes(Path, *Arena, Meshes, Instances, ShouldGenNormals, ShouldOptimize);
 
 	if (Success)
 	{
-		for (int i = 0; i < Meshes.size(); i++)
-		{
-			SceneObject ScnObj;
-			ScnObj.Mesh = Meshes[i];
+		SceneObjects.reserve(SceneObjects.size() + Instances.size());
+		const uint32_t ArenaIndex = static_cast<uint32_t>(Arenas.size());
 
-			SceneObjects.push_back(ScnObj);
+		// Every instance gets its own object, the mesh spans all point at the same data in the arena
+		for (const MeshInstance& Instance : Instances)
+		{
+			SceneObjects.emplace_back();
+			SceneObjects.back().Mesh = Meshes[Instance.MeshIndex];
+			SceneObjects.back().ObjectToWorld = Instance.ObjectToWorld;
+			SceneObjects.back().ArenaIndex = ArenaIndex;
+			SceneObjects.back().MeshIndex = Instance.MeshIndex;
 		}
+
+		CORE_TRACE("{0} meshes in {1} objects from {2} share one {3} byte geometry arena", Meshes.size(), Instances.size(), Path, Arena->GetSizeInBytes());
+		Arenas.push_back(std::move(Arena));
+		ArenaSources.push_back({ Path, ShouldGenNormals, ShouldOptimize, std::string() });
+
+		Generation++;
+
+		if (ShouldBuildLODs)
+			BuildLODs();
+	}
+}
+
+void Scene::LoadFromPathStreamed(std::string Path, bool ShouldGenNormals, bool ShouldOptimize)
+{
+	// One streaming load at a time, the previous one keeps publishing from the queue
+	WaitForStreamTask();
+
+	const uint32_t ArenaIndex = static_cast<uint32_t>(Arenas.size());
+	Arenas.push_back(std::make_unique<GeometryArena>());
+	ArenaSources.push_back({ Path, ShouldGenNormals, ShouldOptimize, std::string() });
+	GeometryArena* Arena = Arenas.back().get();
+
+	{
+		std::lock_guard<std::mutex> Lock(StreamMutex);
+		IsStreamDone = false;
 	}
+
+	StreamTask = ThreadPool::GetGlobal().Submit([this, Path, ShouldGenNormals, ShouldOptimize, Arena, ArenaIndex]()
+	{
+		std::vector<StaticMesh> Meshes;
+		std::vector<MeshInstance> Instances;
+
+		// Each batch of meshes goes into the queue as soon as the loader is done with it
+		auto const QueueBatch = [this, ArenaIndex](const std::vector<StaticMesh>& LoadedMeshes, Span<const MeshInstance> NewInstances)
+		{
+			std::vector<SceneObject> Objects(NewInstances.size());
+			for (size_t i = 0; i < NewInstances.size(); i++)
+			{
+				Objects[i].Mesh = LoadedMeshes[NewInstances[i].MeshIndex];
+				Objects[i].ObjectToWorld = NewInstances[i].ObjectToWorld;
+				Objects[i].ArenaIndex = ArenaIndex;
+				Objects[i].MeshIndex = NewInstances[i].MeshIndex;
+			}
+
+			std::lock_guard<std::mutex> Lock(StreamMutex);
+			StreamedObjects.insert(StreamedObjects.end(), std::make_move_iterator(Objects.begin()), std::make_move_iterator(Objects.end()));
+			StreamCondition.notify_all();
+		};
+
+		if (Utils::LoadStaticMeshes(Path, *Arena, Meshes, Instances, ShouldGenNormals, ShouldOptimize, true, QueueBatch))
+			CORE_TRACE("Streamed {0} meshes in {1} objects from {2}", Meshes.size(), Instances.size(), Path);
+		else
+			CORE_ERROR("Streaming load of {0} failed", Path);
+
+		std::lock_guard<std::mutex> Lock(StreamMutex);
+		IsStreamDone = true;
+		StreamCondition.notify_all();
+	});
+}
+
+uint32_t Scene::PublishStreamedObjects(uint32_t MaxObjects)
+{
+	uint32_t NumPublished = 0;
+
+	{
+		std::lock_guard<std::mutex> Lock(StreamMutex);
+
+		NumPublished = static_cast<uint32_t>(std::min<size_t>(MaxObjects, StreamedObjects.size()));
+		if (NumPublished == 0)
+			return 0;
+
+		auto const First = StreamedObjects.begin();
+		SceneObjects.insert(SceneObjects.end(), std::make_move_iterator(First), std::make_move_iterator(First + NumPublished));
+		StreamedObjects.erase(First, First + NumPublished);
+	}
+
+	Generation++;
+
+	CORE_TRACE("Published {0} streamed objects, {1} in scene", NumPublished, SceneObjects.size());
+	return NumPublished;
+}
+
+void Scene::WaitForStreamedObjects()
+{
+	std::unique_lock<std::mutex> Lock(StreamMutex);
+	StreamCondition.wait(Lock, [this]() { return IsStreamDone || !StreamedObjects.empty(); });
+}
+
+bool Scene::IsStreaming()
+{
+	std::lock_guard<std::mutex> Lock(StreamMutex);
+	return !IsStreamDone || !StreamedObjects.empty();
+}
+
+void Scene::WaitForStreamTask()
+{
+	if (StreamTask.valid())
+		StreamTask.wait();
 }
@@ -2,21 +2,153 @@
 
 #include "SceneObject.h"
 #include "Camera.h"
+#include "SceneGeometry.h"
+#include "GeometryArena.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <thread>
 
 class Scene
 {
 public:
+	~Scene();
+
 	void AddSceneObject(const SceneObject& SObject);
 	uint32_t GetNumSceneObjects();
 
-	void LoadFromPath(std::string Path, bool ShouldGenNormals);
+	/**
+	* Loads Path into new scene objects. ShouldBuildLODs runs BuildLODs over the scene afterwards. Geometry isn't touched.
+	*/
+	void LoadFromPath(std::string Path, bool ShouldGenNormals, bool ShouldOptimize = false, bool ShouldBuildLODs = false);
+
+	/**
+	* Starts loading Path on the thread pool and returns right away. Objects are queued a batch at a time as the loader
+	* finishes their meshes, and wait there until PublishStreamedObjects moves them into SceneObjects.
+	*/
+	void LoadFromPathStreamed(std::string Path, bool ShouldGenNormals, bool ShouldOptimize = false);
+
+	/**
+	* Moves up to MaxObjects streamed objects into SceneObjects. Returns the number of objects added. Geometry is left as it
+	* is, CPU side users call BuildGeometry once IsStreaming turns false. Only call from the thread that reads SceneObjects.
+	*/
+	uint32_t PublishStreamedObjects(uint32_t MaxObjects = ~0u);
+
+	/**
+	* Blocks until a streamed object is ready to publish or the streaming load is done.
+	*/
+	void WaitForStreamedObjects();
+
+	/**
+	* True while a streaming load is running or has objects left to publish.
+	*/
+	bool IsStreaming();
+
+	/**
+	* Bumped whenever SceneObjects changes. Consumers compare it with the generation they last saw to pick up new objects.
+	*/
+	uint64_t GetGeneration() const { return Generation; }
 
 	void Clear();
 
+	/**
+	* Rebuilds Geometry from SceneObjects. Nothing builds it on its own, the GPU path never reads it, so the CPU acceleration
+	* structures and benchmarks call this after loading and again whenever SceneObjects changed. ReleaseHostMeshes clears it.
+	*/
+	void BuildGeometry();
+
+	/**
+	* Clusters every mesh of SceneObjects into meshlets. Objects that instance the same mesh data share one decomposition.
+	* Nothing in the tracer reads them yet, RunMeshletBenchmark is the only caller.
+	*/
+	void BuildMeshlets(const MeshletBuilder::BuildSettings& Settings = MeshletBuilder::BuildSettings());
+
+	/**
+	* Builds a LOD chain for every mesh of SceneObjects, shared between objects like the meshlets.
+	*/
+	void BuildLODs(const MeshSimplifier::SimplifySettings& Settings = MeshSimplifier::SimplifySettings());
+
+	/**
+	* Host mesh residency belongs to the thread that created the scene. HostResidency runs the release and reload of an
+	* arena on whichever thread triggered them, and both rewrite SceneObjects, so ReleaseHostMeshes, LockHostMeshes and
+	* anything that evicts from HostResidency while meshes are registered must be called from there. Asserted in debug builds.
+	*
+	* Hands the vertex and index data of every fully published arena to HostResidency and drops it. The mesh spans of the
+	* objects are empty until the data is locked again, the GPU side takes its counts from the buffer views. Call once the
+	* objects are uploaded.
+	*/
+	void ReleaseHostMeshes();
+
+	/**
+	* Reloads dropped arenas from the mesh cache and keeps them resident until UnlockHostMeshes. Mesh data may only be
+	* read in between once ReleaseHostMeshes was called. Returns false if an arena couldn't be reloaded, nothing is locked
+	* then and UnlockHostMeshes mustn't be called.
+	*/
+	bool LockHostMeshes();
+	void UnlockHostMeshes();
+
+	/**
+	* Shading attributes at a hit on a triangle of Geometry, which has to be built.
+	*/
+	Vertex GetHitAttributes(uint32_t TriangleIndex, float U, float V) const;
+
+	/**
+	* Meshes of SceneObjects without duplicates, instances share their arena spans. OutObjectMeshIDs maps each object to its unique mesh.
+	*/
+	void GetUniqueMeshes(std::vector<const StaticMesh*>& OutMeshes, std::vector<uint32_t>& OutObjectMeshIDs) const;
+
 	std::vector<SceneObject> SceneObjects;
+	SceneGeometry Geometry;
+
+	/**
+	* Vertex and index storage of the scene objects, one arena per LoadFromPath call.
+	*/
+	std::vector<std::unique_ptr<GeometryArena>> Arenas;
 	Camera SceneCamera;
+
+private:
+	void WaitForStreamTask();
+
+	struct MeshSize
+	{
+		size_t NumVertices = 0;
+		size_t NumIndices = 0;
+	};
+
+	/**
+	* What an arena was loaded with, so it can be loaded again. ResidencyKey is empty until the arena is released the first time.
+	* MeshSizes holds the sizes the objects had when the arena was released, by mesh index.
+	*/
+	struct ArenaSource
+	{
+		std::string Path;
+		bool GenNormals = false;
+		bool Optimize = false;
+		std::string ResidencyKey;
+		std::vector<MeshSize> MeshSizes;
+	};
+
+	void ReleaseArena(uint32_t ArenaIndex);
+	uint64_t ReloadArena(uint32_t ArenaIndex);
+
+	// Parallel to Arenas
+	std::vector<ArenaSource> ArenaSources;
+
+	uint64_t Generation = 0;
+
+	// See ReleaseHostMeshes
+	const std::thread::id OwnerThread = std::this_thread::get_id();
+
+	std::future<void> StreamTask;
+	std::mutex StreamMutex;
+	std::condition_variable StreamCondition;
+	std::vector<SceneObject> StreamedObjects;
+	bool IsStreamDone = true;
 };
 
@@ -0,0 +1,105 @@
+#include "pch.h"
+#include "SceneGeometry.h"
+#include "SceneObject.h"
+#include "ThreadPool.h"
+
+void SceneGeometry::Build(Span<const SceneObject> Objects)
+{
+	Clear();
+
+	uint32_t NumMeshes = static_cast<uint32_t>(Objects.size());
+	MeshFirstVertex.resize(NumMeshes);
+	MeshFirstTriangle.resize(NumMeshes);
+
+	// Offsets first so every stream is allocated exactly once
+	uint32_t NumVertices = 0;
+	uint32_t NumTriangles = 0;
+	for (uint32_t i = 0; i < NumMeshes; i++)
+	{
+		const StaticMesh& Mesh = Objects[i].Mesh;
+
+		MeshFirstVertex[i] = NumVertices;
+		MeshFirstTriangle[i] = NumTriangles;
+
+		NumVertices += static_cast<uint32_t>(Mesh.Vertices.size());
+		NumTriangles += static_cast<uint32_t>(Mesh.Indices.size() / 3);
+	}
+
+	Positions.resize(NumVertices);
+	Indices.resize(static_cast<size_t>(NumTriangles) * 3);
+	TriangleMeshIDs.resize(NumTriangles);
+
+	ThreadPool::GetGlobal().ParallelFor(NumMeshes, [&](uint32_t i)
+	{
+		const StaticMesh& Mesh = Objects[i].Mesh;
+		const Transform3x4& ObjectToWorld = Objects[i].ObjectToWorld;
+		uint32_t FirstVertex = MeshFirstVertex[i];
+		uint32_t FirstTriangle = MeshFirstTriangle[i];
+		uint32_t MeshTriangles = static_cast<uint32_t>(Mesh.Indices.size() / 3);
+
+		Vector3f* pPositions = Positions.data() + FirstVertex;
+		for (size_t j = 0; j < Mesh.Vertices.size(); j++)
+			pPositions[j] = ObjectToWorld.TransformPoint(Mesh.Vertices[j].Position);
+
+		uint32_t* pIndices = Indices.data() + static_cast<size_t>(FirstTriangle) * 3;
+		for (size_t j = 0; j < static_cast<size_t>(MeshTriangles) * 3; j++)
+			pIndices[j] = Mesh.Indices[j] + FirstVertex;
+
+		uint32_t* pMeshIDs = TriangleMeshIDs.data() + FirstTriangle;
+		for (uint32_t j = 0; j < MeshTriangles; j++)
+			pMeshIDs[j] = i;
+	});
+}
+
+void SceneGeometry::Clear()
+{
+	Positions.clear();
+	Indices.clear();
+	TriangleMeshIDs.clear();
+	MeshFirstVertex.clear();
+	MeshFirstTriangle.clear();
+}
+
+void SceneGeometry::GetLocalTriangle(uint32_t TriangleIndex, uint32_t& OutMeshID, uint32_t OutLocalIndices[3]) const
+{
+	OutMeshID = TriangleMeshIDs[TriangleIndex];
+	uint32_t FirstVertex = MeshFirstVertex[OutMeshID];
+
+	for (uint32_t k = 0; k < 3; k++)
+		OutLocalIndices[k] = Indices[static_cast<size_t>(TriangleIndex) * 3 + k] - FirstVertex;
+}
+
+Vertex SceneGeometry::InterpolateAttributes(Span<const SceneObject> Objects, uint32_t TriangleIndex, float U, float V) const
+{
+	uint32_t MeshID;
+	uint32_t LocalIndices[3];
+	GetLocalTriangle(TriangleIndex, MeshID, LocalIndices);
+
+	Span<const Vertex> Vertices = Objects[MeshID].Mesh.Vertices;
+	const float Weights[3] = { 1.0f - U - V, U, V };
+
+	Vertex Result;
+	for (uint32_t k = 0; k < 3; k++)
+	{
+		Vertex Vtx = Vertices[LocalIndices[k]];
+		float W = Weights[k];
+
+		Result.Position = Result.Position + Vtx.Position * W;
+		Result.Texcoord.X += Vtx.Texcoord.X * W;
+		Result.Texcoord.Y += Vtx.Texcoord.Y * W;
+		Result.Normal = Result.Normal + Vtx.Normal * W;
+		Result.Tangent = Result.Tangent + Vtx.Tangent * W;
+		Result.Binormal = Result.Binormal + Vtx.Binormal * W;
+	}
+
+	const Transform3x4& ObjectToWorld = Objects[MeshID].ObjectToWorld;
+	if (!ObjectToWorld.IsIdentity())
+	{
+		Result.Position = ObjectToWorld.TransformPoint(Result.Position);
+		Result.Normal = ObjectToWorld.GetNormalTransform().TransformVector(Result.Normal);
+		Result.Tangent = ObjectToWorld.TransformVector(Result.Tangent);
+		Result.Binormal = ObjectToWorld.TransformVector(Result.Binormal);
+	}
+
+	return Result;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "StaticMesh.h"
+#include "Span.h"
+
+#include <cstdint>
+#include <vector>
+
+class SceneObject;
+
+/**
+* Structure-of-arrays copy of the scene triangles for acceleration structure builds and traversal.
+* Positions are in world space and indices of all meshes are concatenated, indices are global into the position stream.
+* Shading attributes stay in the meshes and are fetched per hit.
+*/
+class SceneGeometry
+{
+public:
+	/**
+	* Rebuilds the streams from the scene objects. Mesh IDs are indices into Objects.
+	*/
+	void Build(Span<const SceneObject> Objects);
+
+	void Clear();
+
+	Span<const Vector3f> GetPositions() const { return Span<const Vector3f>(Positions.data(), Positions.size()); }
+	Span<const uint32_t> GetIndices() const { return Span<const uint32_t>(Indices.data(), Indices.size()); }
+	Span<const uint32_t> GetTriangleMeshIDs() const { return Span<const uint32_t>(TriangleMeshIDs.data(), TriangleMeshIDs.size()); }
+
+	uint32_t GetNumTriangles() const { return static_cast<uint32_t>(TriangleMeshIDs.size()); }
+	uint32_t GetNumMeshes() const { return static_cast<uint32_t>(MeshFirstVertex.size()); }
+
+	/**
+	* Index of the first position of a mesh, mesh local vertex indices are relative to it.
+	*/
+	uint32_t GetMeshFirstVertex(uint32_t MeshID) const { return MeshFirstVertex[MeshID]; }
+
+	/**
+	* Vertex indices of a triangle, local to the mesh the triangle belongs to.
+	*/
+	void GetLocalTriangle(uint32_t TriangleIndex, uint32_t& OutMeshID, uint32_t OutLocalIndices[3]) const;
+
+	/**
+	* Fetches and interpolates the shading attributes of a hit. U and V weight the second and third vertex like DXR barycentrics.
+	*/
+	Vertex InterpolateAttributes(Span<const SceneObject> Objects, uint32_t TriangleIndex, float U, float V) const;
+
+private:
+	std::vector<Vector3f> Positions;
+	std::vector<uint32_t> Indices;
+	std::vector<uint32_t> TriangleMeshIDs;
+
+	std::vector<uint32_t> MeshFirstVertex;
+	std::vector<uint32_t> MeshFirstTriangle;
+};
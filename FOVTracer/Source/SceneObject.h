@@ -11,6 +11,18 @@ public:
 	Transform Transform;
 	StaticMesh Mesh;
 
+	/**
+	* Placement of Mesh in the scene. Instances of the same mesh share its vertex and index data.
+	*/
+	Transform3x4 ObjectToWorld;
+
+	/**
+	* Where the mesh data came from, the index in Scene::Arenas and the mesh index within that load. ~0u for meshes the scene
+	* doesn't own.
+	*/
+	uint32_t ArenaIndex = ~0u;
+	uint32_t MeshIndex = 0;
+
 	~SceneObject();
 
 	bool LoadFromPath(const std::string& Path, bool GenNormals);
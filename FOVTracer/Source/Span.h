@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+/**
+* Non-owning view of a contiguous range of elements.
+*/
+template<class Type>
+class Span
+{
+public:
+	Span() : DataPtr(nullptr), Count(0) {}
+	Span(Type* Data, size_t Size) : DataPtr(Data), Count(Size) {}
+
+	// Allows Span<T> to be passed where a Span<const T> is expected
+	template<class OtherType, class = typename std::enable_if<std::is_convertible<OtherType(*)[], Type(*)[]>::value>::type>
+	Span(const Span<OtherType>& Other) : DataPtr(Other.data()), Count(Other.size()) {}
+
+	Type* data() const { return DataPtr; }
+	size_t size() const { return Count; }
+	size_t size_bytes() const { return Count * sizeof(Type); }
+	bool empty() const { return Count == 0; }
+
+	Type* begin() const { return DataPtr; }
+	Type* end() const { return DataPtr + Count; }
+
+	Type& operator[](size_t Index) const { return DataPtr[Index]; }
+
+	Span<Type> Subspan(size_t Offset, size_t Size) const { return Span<Type>(DataPtr + Offset, Size); }
+
+private:
+	Type* DataPtr;
+	size_t Count;
+};
@@ -2,17 +2,16 @@
 #include "StaticMesh.h"
 
 
-void StaticMesh::ReserveNumVertices(uint32_t Num)
-{
-	Vertices.reserve(Num);
-}
-
 void StaticMesh::Clear()
 {
-	Vertices.clear();
+	Vertices = Span<Vertex>();
+	Indices = Span<uint32_t>();
 	MeshMaterial = {};
 
 	HasMaterial = false;
 	HasNormals = false;
 	HasTexcoords = false;
+
+	Meshlets.reset();
+	LODs.reset();
 }
\ No newline at end of file
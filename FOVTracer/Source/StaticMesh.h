@@ -1,9 +1,14 @@
 #pragma once
 
 #include "Math.h"
+#include "Span.h"
+#include "Transform.h"
+#include "Meshlet.h"
+#include "MeshLOD.h"
 
 #include <string>
 #include <vector>
+#include <memory>
 
 struct Material
 {
@@ -30,15 +35,16 @@ struct Vertex
 	Vector3f Binormal;
 };
 
+/**
+* Vertex and index data are views into a GeometryArena, which has to outlive the mesh.
+*/
 class StaticMesh
 {
 public:
-	void ReserveNumVertices(uint32_t Num);
-
 	void Clear();
 
-	std::vector<Vertex> Vertices;
-	std::vector<uint32_t> Indices;
+	Span<Vertex> Vertices;
+	Span<uint32_t> Indices;
 
 	Material MeshMaterial;
 
@@ -49,7 +55,26 @@ public:
 	bool HasBinormals = false;
 	bool HasTransparency = false;
 
+	/**
+	* Optional cluster decomposition, see MeshletBuilder. Null unless built, copies of the mesh share it. Not uploaded or
+	* traced, only measured by RunMeshletBenchmark so far.
+	*/
+	std::shared_ptr<const MeshletData> Meshlets;
+
+	/**
+	* Optional simplified levels, see MeshSimplifier. Null unless built, copies of the mesh share it.
+	*/
+	std::shared_ptr<const MeshLODChain> LODs;
+
 private:
 
 };
 
+/**
+* One placement of a mesh. MeshIndex refers to the mesh list the instance was loaded together with.
+*/
+struct MeshInstance
+{
+	uint32_t MeshIndex = 0;
+	Transform3x4 ObjectToWorld;
+};
@@ -0,0 +1,211 @@
+#include "pch.h"
+#include "TextureCache.h"
+#include "TextureCompression.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+/**
+* Drops the channels Usage doesn't need from an RGBA8 texture. Block compressed textures are already smaller and stay as they are.
+*/
+static void PackForUsage(TextureInfo& Info, TextureFormat::TextureUsage Usage)
+{
+	const DXGI_FORMAT Format = TextureFormat::GetUsageFormat(Usage);
+	if (Info.format != DXGI_FORMAT_R8G8B8A8_UNORM || Info.stride != 4 || Format == Info.format)
+		return;
+
+	const uint32_t Channels = TextureFormat::GetElementBytes(Format);
+	const size_t NumPixels = Info.pixels.Size() / 4;
+
+	// Levels are back to back, so the whole chain packs as one run and every offset shrinks by the same ratio.
+	// Packing straight into a smaller buffer frees the RGBA8 chain without copying it first
+	ImageBuffer Packed(NumPixels * Channels);
+	TextureFormat::PackChannels(Info.pixels.Data(), Packed.MutableData(), NumPixels, Channels);
+	Info.pixels = std::move(Packed);
+
+	for (TextureMip& Mip : Info.mips)
+		Mip.offset = Mip.offset / 4 * Channels;
+
+	Info.stride = Channels;
+	Info.format = Format;
+}
+
+bool TextureHandle::IsReady() const
+{
+	return Decode.valid() && Decode.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+const TextureInfo& TextureHandle::Get() const
+{
+	return *Decode.get();
+}
+
+TextureCache::TextureCache(const TextureCacheSettings& InSettings) : Settings(InSettings)
+{
+	if (Settings.UseDiskCache)
+	{
+		std::string Directory = Settings.DiskCacheDirectory.empty() ? TextureDiskCache::GetDefaultDirectory() : Settings.DiskCacheDirectory;
+		DiskCache = std::make_shared<TextureDiskCache>(Directory, Settings.DiskCacheMaxBytes);
+	}
+}
+
+TextureCache::~TextureCache()
+{
+	WaitForAll();
+}
+
+TextureHandle TextureCache::Request(const std::string& Path, TextureFormat::TextureUsage Usage)
+{
+	std::string Key = GetKey(NormalizePath(Path), Usage);
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+	NumRequests++;
+
+	auto const Found = Entries.find(Key);
+	if (Found != Entries.end())
+		return TextureHandle(Found->second);
+
+	NumDecodes++;
+	TextureCacheSettings DecodeSettings = Settings;
+	std::shared_ptr<TextureDiskCache> DecodeDiskCache = DiskCache;
+	std::shared_future<std::shared_ptr<const TextureInfo>> Decode = ThreadPool::GetGlobal().Submit([Path, Usage, DecodeSettings, DecodeDiskCache]()
+	{
+		return std::shared_ptr<const TextureInfo>(std::make_shared<TextureInfo>(LoadTexture(Path, Usage, DecodeSettings, DecodeDiskCache.get())));
+	}).share();
+
+	Entries.emplace(std::move(Key), Decode);
+	return TextureHandle(std::move(Decode));
+}
+
+void TextureCache::Release(const std::string& Path, TextureFormat::TextureUsage Usage)
+{
+	std::lock_guard<std::mutex> Lock(Mutex);
+	Entries.erase(GetKey(NormalizePath(Path), Usage));
+}
+
+void TextureCache::WaitForAll()
+{
+	std::vector<std::shared_future<std::shared_ptr<const TextureInfo>>> Decodes;
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		for (auto const& Entry : Entries)
+			Decodes.push_back(Entry.second);
+	}
+
+	for (auto const& Decode : Decodes)
+		Decode.wait();
+}
+
+void TextureCache::Clear()
+{
+	WaitForAll();
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+	Entries.clear();
+}
+
+TextureInfo TextureCache::LoadTexture(const std::string& Path, TextureFormat::TextureUsage Usage, const TextureCacheSettings& Settings, TextureDiskCache* DiskCache)
+{
+	TextureDiskCacheKey Key;
+	Key.Usage = static_cast<uint32_t>(Usage);
+	Key.GenerateMips = Settings.GenerateMips ? 1 : 0;
+	Key.KeepBlockCompressed = Settings.KeepBlockCompressed ? 1 : 0;
+	Key.Compression = Settings.Compress ? (Settings.UseBC7 ? 2 : 1) : 0;
+	Key.Mips = Settings.Mips;
+
+	// Only colour is stored in sRGB, normals and masks are filtered as the plain values they are
+	if (Usage != TextureFormat::TextureUsage::Albedo)
+		Key.Mips.SRGB = false;
+
+	// Missing files end up as the fallback texture, which must never be cached under their name
+	bool UseDiskCache = DiskCache && Utils::HashFile(Path, Key.SourceHash);
+
+	TextureInfo Info;
+	if (UseDiskCache && DiskCache->Read(Key, Info))
+	{
+		Info.usage = Usage;
+		return Info;
+	}
+
+	if (!Settings.KeepBlockCompressed || !Utils::LoadNativeDDS(Path, Settings.GenerateMips, Info))
+	{
+		Info = Utils::LoadTexture(Path, 4);
+		if (Settings.GenerateMips)
+			TextureMips::GenerateMipChain(Info, Key.Mips);
+	}
+
+	PackForUsage(Info, Usage);
+	Info.usage = Usage;
+
+	const DXGI_FORMAT CompressedFormat = Settings.Compress ? TextureCompression::ChooseFormat(Info, Usage, Settings.UseBC7) : DXGI_FORMAT_UNKNOWN;
+	TextureCompression::CompressionStats Stats;
+	if (CompressedFormat != DXGI_FORMAT_UNKNOWN && TextureCompression::CompressTexture(Info, CompressedFormat, &Stats))
+	{
+		CORE_TRACE("Encoded {0} to {1} in {2:.1f} ms, {3:.1f} MPixel/s, PSNR {4:.2f} dB", Path, TextureCompression::GetFormatName(CompressedFormat),
+			Stats.EncodeMS, Stats.NumPixels / (Math::max(Stats.EncodeMS, 0.001) * 1000.0), Stats.PSNR);
+	}
+
+	if (UseDiskCache)
+		DiskCache->Write(Key, Info);
+
+	return Info;
+}
+
+std::string TextureCache::NormalizePath(const std::string& Path)
+{
+	std::string Unified = Path;
+	std::replace(Unified.begin(), Unified.end(), '\\', '/');
+
+#ifdef _WIN32
+	std::transform(Unified.begin(), Unified.end(), Unified.begin(), [](char C) { return static_cast<char>(std::tolower(static_cast<unsigned char>(C))); });
+#endif
+
+	bool IsAbsolute = !Unified.empty() && Unified[0] == '/';
+
+	std::vector<std::string> Segments;
+	size_t Start = 0;
+	while (Start <= Unified.size())
+	{
+		size_t End = Unified.find('/', Start);
+		if (End == std::string::npos)
+			End = Unified.size();
+
+		std::string Segment = Unified.substr(Start, End - Start);
+		if (Segment == "..")
+		{
+			// Leading ".." of a relative path can't be resolved and stay
+			if (!Segments.empty() && Segments.back() != "..")
+				Segments.pop_back();
+			else if (!IsAbsolute)
+				Segments.push_back(Segment);
+		}
+		else if (!Segment.empty() && Segment != ".")
+		{
+			Segments.push_back(Segment);
+		}
+
+		Start = End + 1;
+	}
+
+	std::string Normalized = IsAbsolute ? "/" : "";
+	for (size_t i = 0; i < Segments.size(); i++)
+	{
+		if (i > 0)
+			Normalized += '/';
+		Normalized += Segments[i];
+	}
+
+	return Normalized;
+}
+
+std::string TextureCache::GetKey(const std::string& Path, TextureFormat::TextureUsage Usage)
+{
+	if (Path.empty())
+		return Path;
+
+	return Path + "#" + TextureFormat::GetUsageName(Usage);
+}
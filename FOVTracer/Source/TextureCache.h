@@ -0,0 +1,145 @@
+#pragma once
+
+#include "DX.h"
+#include "TextureMips.h"
+#include "TextureDiskCache.h"
+#include "TextureFormat.h"
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <unordered_map>
+
+/**
+* A texture decode requested from a TextureCache. Copies refer to the same decode.
+*/
+class TextureHandle
+{
+public:
+	TextureHandle() = default;
+
+	bool IsValid() const { return Decode.valid(); }
+
+	/**
+	* True once the pixels are decoded, never blocks.
+	*/
+	bool IsReady() const;
+
+	/**
+	* Blocks until the pixels are decoded. Failed decodes hold the fallback texture.
+	*/
+	const TextureInfo& Get() const;
+
+private:
+	friend class TextureCache;
+
+	explicit TextureHandle(std::shared_future<std::shared_ptr<const TextureInfo>> InDecode) : Decode(std::move(InDecode)) {}
+
+	std::shared_future<std::shared_ptr<const TextureInfo>> Decode;
+};
+
+struct TextureCacheSettings
+{
+	/**
+	* Build the mip chain on the CPU right after the decode, on the same pool task.
+	*/
+	bool GenerateMips = true;
+
+	/**
+	* Upload DDS files in their block compressed format with their authored mips. Files that can't be used like that, for
+	* example without mips while GenerateMips is set, are still decompressed to RGBA8.
+	*/
+	bool KeepBlockCompressed = true;
+
+	/**
+	* Encode uncompressed albedo, normal and opacity chains to BC formats on the CPU, see TextureCompression::ChooseFormat.
+	*/
+	bool Compress = true;
+
+	/**
+	* Albedo goes to BC7 instead of BC1 or BC3. Same size as BC3, better colour than both, but a slower encode.
+	*/
+	bool UseBC7 = false;
+
+	/**
+	* Keep processed textures in a TextureDiskCache and map them back in while the source and settings don't change.
+	*/
+	bool UseDiskCache = true;
+
+	/**
+	* Empty uses TextureDiskCache::GetDefaultDirectory().
+	*/
+	std::string DiskCacheDirectory;
+	uint64_t DiskCacheMaxBytes = TextureDiskCache::DefaultMaxBytes;
+
+	TextureMips::MipSettings Mips;
+};
+
+/**
+* Decodes textures on the global thread pool into the layout of their usage or, for DDS files, their block compressed format.
+* Requests are deduplicated by normalised path and usage, so a file is decoded once per usage no matter how many materials
+* use it, and the result stays cached until released.
+*/
+class TextureCache
+{
+public:
+	explicit TextureCache(const TextureCacheSettings& InSettings = TextureCacheSettings());
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+	~TextureCache();
+
+	/**
+	* Returns the decode of Path for Usage, starting it if nobody asked for the file with that usage before.
+	*/
+	TextureHandle Request(const std::string& Path, TextureFormat::TextureUsage Usage = TextureFormat::TextureUsage::Albedo);
+
+	/**
+	* Drops the cache's reference to a texture. Handles that are still around keep the pixels alive.
+	*/
+	void Release(const std::string& Path, TextureFormat::TextureUsage Usage = TextureFormat::TextureUsage::Albedo);
+
+	/**
+	* Blocks until every cached decode has finished.
+	*/
+	void WaitForAll();
+
+	void Clear();
+
+	uint32_t GetNumRequests() const { return NumRequests; }
+	uint32_t GetNumDecodes() const { return NumDecodes; }
+
+	/**
+	* nullptr if the disk cache is disabled.
+	*/
+	const TextureDiskCache* GetDiskCache() const { return DiskCache.get(); }
+
+	/**
+	* Forward slashes, no "." or ".." segments and, on Windows, lower case. Different spellings of a file map to the same key.
+	*/
+	static std::string NormalizePath(const std::string& Path);
+
+	/**
+	* Key of Path loaded for Usage, the same file can be resident once per usage. Empty paths stay empty, they all load the fallback.
+	*/
+	static std::string GetKey(const std::string& Path, TextureFormat::TextureUsage Usage);
+
+	/**
+	* Disk cache lookup, decode, mip generation, channel packing and block compression of a single texture, what every request
+	* runs on the pool.
+	* DiskCache may be nullptr.
+	*/
+	static TextureInfo LoadTexture(const std::string& Path, TextureFormat::TextureUsage Usage, const TextureCacheSettings& Settings, TextureDiskCache* DiskCache);
+
+private:
+	const TextureCacheSettings Settings;
+
+	// Shared with the decode tasks, released textures can still be decoding after the cache is gone
+	std::shared_ptr<TextureDiskCache> DiskCache;
+
+	std::mutex Mutex;
+	std::unordered_map<std::string, std::shared_future<std::shared_ptr<const TextureInfo>>> Entries;
+
+	uint32_t NumRequests = 0;
+	uint32_t NumDecodes = 0;
+};
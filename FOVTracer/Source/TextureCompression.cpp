@@ -0,0 +1,863 @@
+#include "pch.h"
+#include "TextureCompression.h"
+#include "ThreadPool.h"
+#include "Math.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+	// Below this many level pixels the encode isn't worth splitting over the pool
+	constexpr uint32_t MinParallelPixels = 128 * 128;
+	constexpr uint32_t BlockRowsPerTask = 4;
+
+	// Least squares passes after the principal axis fit, a second one only gains about 0.2 dB for half again the time
+	constexpr uint32_t NumRefinements = 1;
+
+	// Interpolation weights of the second endpoint for every BC7 4 bit index, out of 64
+	constexpr int BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	/**
+	* Nearest BC7 index of every weight out of 64.
+	*/
+	struct BC7IndexTable
+	{
+		uint8_t Indices[65];
+
+		BC7IndexTable()
+		{
+			for (int Weight = 0; Weight <= 64; Weight++)
+			{
+				Indices[Weight] = 0;
+				for (uint8_t Index = 1; Index < 16; Index++)
+				{
+					if (std::abs(BC7Weights[Index] - Weight) < std::abs(BC7Weights[Indices[Weight]] - Weight))
+						Indices[Weight] = Index;
+				}
+			}
+		}
+
+		uint8_t operator[](int Weight) const { return Indices[Weight]; }
+	};
+
+	const BC7IndexTable BC7IndexOfWeight;
+
+	// Weight of the second endpoint for every BC1 index in four colour mode
+	constexpr float BC1Weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+	int Clamp(int Value, int Low, int High)
+	{
+		return Value < Low ? Low : (Value > High ? High : Value);
+	}
+
+	uint32_t GetNumChannels(DXGI_FORMAT Format)
+	{
+		switch (Format)
+		{
+		case DXGI_FORMAT_BC1_UNORM: return 3;
+		case DXGI_FORMAT_BC4_UNORM: return 1;
+		case DXGI_FORMAT_BC5_UNORM: return 2;
+		default: return 4;
+		}
+	}
+
+	/**
+	* Principal axis of Count points with NumChannels channels, by power iteration on the covariance. Returns false for a
+	* block where every point is the same.
+	*/
+	bool FindPrincipalAxis(const float (*Points)[4], uint32_t Count, uint32_t NumChannels, float* Mean, float* Axis)
+	{
+		float Min[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+		float Max[4] = {};
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			Mean[c] = 0.0f;
+			Axis[c] = 0.0f;
+		}
+
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			for (uint32_t c = 0; c < NumChannels; c++)
+			{
+				Mean[c] += Points[i][c];
+				Min[c] = Math::min(Min[c], Points[i][c]);
+				Max[c] = Math::max(Max[c], Points[i][c]);
+			}
+		}
+
+		bool IsFlat = true;
+		for (uint32_t c = 0; c < NumChannels; c++)
+		{
+			Mean[c] /= Count;
+			Axis[c] = Max[c] - Min[c];
+			IsFlat = IsFlat && Axis[c] == 0.0f;
+		}
+
+		if (IsFlat)
+			return false;
+
+		float Covariance[4][4] = {};
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			for (uint32_t a = 0; a < NumChannels; a++)
+			{
+				for (uint32_t b = a; b < NumChannels; b++)
+					Covariance[a][b] += (Points[i][a] - Mean[a]) * (Points[i][b] - Mean[b]);
+			}
+		}
+
+		for (uint32_t a = 0; a < NumChannels; a++)
+		{
+			for (uint32_t b = 0; b < a; b++)
+				Covariance[a][b] = Covariance[b][a];
+		}
+
+		// Starting from the bounding box diagonal converges in a handful of steps for anything but degenerate blocks
+		for (uint32_t Iteration = 0; Iteration < 8; Iteration++)
+		{
+			float Next[4] = {};
+			float Largest = 0.0f;
+			for (uint32_t a = 0; a < NumChannels; a++)
+			{
+				for (uint32_t b = 0; b < NumChannels; b++)
+					Next[a] += Covariance[a][b] * Axis[b];
+
+				Largest = Math::max(Largest, std::fabs(Next[a]));
+			}
+
+			if (Largest == 0.0f)
+				break;
+
+			for (uint32_t c = 0; c < NumChannels; c++)
+				Axis[c] = Next[c] / Largest;
+		}
+
+		return true;
+	}
+
+	/**
+	* Points with the lowest and highest projection on the principal axis, the starting endpoints of every fit.
+	*/
+	void FindEndpoints(const float (*Points)[4], uint32_t Count, uint32_t NumChannels, float* E0, float* E1)
+	{
+		float Mean[4];
+		float Axis[4];
+		if (!FindPrincipalAxis(Points, Count, NumChannels, Mean, Axis))
+		{
+			memcpy(E0, Points[0], sizeof(float) * 4);
+			memcpy(E1, Points[0], sizeof(float) * 4);
+			return;
+		}
+
+		uint32_t MinIndex = 0;
+		uint32_t MaxIndex = 0;
+		float MinProjection = 0.0f;
+		float MaxProjection = 0.0f;
+		for (uint32_t i = 0; i < Count; i++)
+		{
+			float Projection = 0.0f;
+			for (uint32_t c = 0; c < NumChannels; c++)
+				Projection += (Points[i][c] - Mean[c]) * Axis[c];
+
+			if (i == 0 || Projection < MinProjection)
+			{
+				MinProjection = Projection;
+				MinIndex = i;
+			}
+
+			if (i == 0 || Projection > MaxProjection)
+			{
+				MaxProjection = Projection;
+				MaxIndex = i;
+			}
+		}
+
+		memcpy(E0, Points[MinIndex], sizeof(float) * 4);
+		memcpy(E1, Points[MaxIndex], sizeof(float) * 4);
+	}
+
+	/**
+	* Least squares endpoints for fixed indices, Weights[Index] being the share of E1. Leaves the endpoints alone when the
+	* indices don't constrain them, for example when every texel uses the same one.
+	*/
+	void RefitEndpoints(const float (*Points)[4], const uint8_t* Indices, const float* Weights, uint32_t NumChannels, float* E0, float* E1)
+	{
+		float AA = 0.0f, AB = 0.0f, BB = 0.0f;
+		float AX[4] = {};
+		float BX[4] = {};
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			float Beta = Weights[Indices[i]];
+			float Alpha = 1.0f - Beta;
+
+			AA += Alpha * Alpha;
+			AB += Alpha * Beta;
+			BB += Beta * Beta;
+			for (uint32_t c = 0; c < NumChannels; c++)
+			{
+				AX[c] += Alpha * Points[i][c];
+				BX[c] += Beta * Points[i][c];
+			}
+		}
+
+		float Determinant = AA * BB - AB * AB;
+		if (std::fabs(Determinant) < 1e-6f)
+			return;
+
+		for (uint32_t c = 0; c < NumChannels; c++)
+		{
+			E0[c] = Math::min(Math::max((AX[c] * BB - BX[c] * AB) / Determinant, 0.0f), 255.0f);
+			E1[c] = Math::min(Math::max((BX[c] * AA - AX[c] * AB) / Determinant, 0.0f), 255.0f);
+		}
+	}
+
+	void ToPoints(const uint8_t* Texels, float (*Points)[4])
+	{
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			for (uint32_t c = 0; c < 4; c++)
+				Points[i][c] = Texels[i * 4 + c];
+		}
+	}
+
+	uint16_t PackRGB565(const float* Color)
+	{
+		int R = Clamp(static_cast<int>(Color[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+		int G = Clamp(static_cast<int>(Color[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+		int B = Clamp(static_cast<int>(Color[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+
+		return static_cast<uint16_t>((R << 11) | (G << 5) | B);
+	}
+
+	void UnpackRGB565(uint16_t Packed, int* Color)
+	{
+		int R = (Packed >> 11) & 31;
+		int G = (Packed >> 5) & 63;
+		int B = Packed & 31;
+
+		Color[0] = (R << 3) | (R >> 2);
+		Color[1] = (G << 2) | (G >> 4);
+		Color[2] = (B << 3) | (B >> 2);
+	}
+
+	/**
+	* Colour palette of a BC1 block. Without FourColors the third entry is the midpoint and the fourth transparent black.
+	*/
+	void GetBC1Palette(uint16_t C0, uint16_t C1, bool FourColors, int (*Palette)[3])
+	{
+		UnpackRGB565(C0, Palette[0]);
+		UnpackRGB565(C1, Palette[1]);
+
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			if (FourColors)
+			{
+				Palette[2][c] = (2 * Palette[0][c] + Palette[1][c] + 1) / 3;
+				Palette[3][c] = (Palette[0][c] + 2 * Palette[1][c] + 1) / 3;
+			}
+			else
+			{
+				Palette[2][c] = (Palette[0][c] + Palette[1][c]) / 2;
+				Palette[3][c] = 0;
+			}
+		}
+	}
+
+	uint32_t FindBC1Indices(const float (*Points)[4], const int (*Palette)[3], uint32_t NumEntries, uint8_t* Indices)
+	{
+		uint32_t TotalError = 0;
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			uint32_t BestError = UINT32_MAX;
+			for (uint32_t Entry = 0; Entry < NumEntries; Entry++)
+			{
+				uint32_t Error = 0;
+				for (uint32_t c = 0; c < 3; c++)
+				{
+					int Delta = static_cast<int>(Points[i][c]) - Palette[Entry][c];
+					Error += Delta * Delta;
+				}
+
+				if (Error < BestError)
+				{
+					BestError = Error;
+					Indices[i] = static_cast<uint8_t>(Entry);
+				}
+			}
+
+			TotalError += BestError;
+		}
+
+		return TotalError;
+	}
+
+	/**
+	* Four colour BC1 block, also the colour half of BC3. Endpoints are ordered so the block never decodes in three colour mode.
+	*/
+	void EncodeColorBlock(const float (*Points)[4], uint8_t* Block)
+	{
+		float E0[4];
+		float E1[4];
+		FindEndpoints(Points, 16, 3, E0, E1);
+
+		uint16_t BestC0 = 0, BestC1 = 0;
+		uint8_t BestIndices[16] = {};
+		uint32_t BestError = UINT32_MAX;
+
+		for (uint32_t Pass = 0; Pass <= NumRefinements; Pass++)
+		{
+			uint16_t C0 = PackRGB565(E0);
+			uint16_t C1 = PackRGB565(E1);
+			if (C0 < C1)
+			{
+				std::swap(C0, C1);
+				std::swap(E0, E1);
+			}
+
+			// Equal endpoints decode in three colour mode, only the first entry is safe to use
+			int Palette[4][3];
+			GetBC1Palette(C0, C1, true, Palette);
+
+			uint8_t Indices[16];
+			uint32_t Error = FindBC1Indices(Points, Palette, C0 == C1 ? 1 : 4, Indices);
+			// A refit that doesn't help won't help on the next pass either
+			if (Error >= BestError)
+				break;
+
+			BestError = Error;
+			BestC0 = C0;
+			BestC1 = C1;
+			memcpy(BestIndices, Indices, sizeof(Indices));
+
+			if (Error == 0 || C0 == C1)
+				break;
+
+			RefitEndpoints(Points, Indices, BC1Weights, 3, E0, E1);
+		}
+
+		uint32_t PackedIndices = 0;
+		for (uint32_t i = 0; i < 16; i++)
+			PackedIndices |= static_cast<uint32_t>(BestIndices[i]) << (i * 2);
+
+		memcpy(Block, &BestC0, 2);
+		memcpy(Block + 2, &BestC1, 2);
+		memcpy(Block + 4, &PackedIndices, 4);
+	}
+
+	void DecodeColorBlock(const uint8_t* Block, bool AllowThreeColors, uint8_t* Texels)
+	{
+		uint16_t C0, C1;
+		uint32_t PackedIndices;
+		memcpy(&C0, Block, 2);
+		memcpy(&C1, Block + 2, 2);
+		memcpy(&PackedIndices, Block + 4, 4);
+
+		const bool FourColors = !AllowThreeColors || C0 > C1;
+
+		int Palette[4][3];
+		GetBC1Palette(C0, C1, FourColors, Palette);
+
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			uint32_t Index = (PackedIndices >> (i * 2)) & 3;
+			for (uint32_t c = 0; c < 3; c++)
+				Texels[i * 4 + c] = static_cast<uint8_t>(Palette[Index][c]);
+
+			Texels[i * 4 + 3] = (!FourColors && Index == 3) ? 0 : 255;
+		}
+	}
+
+	void GetBC4Palette(int A0, int A1, int* Palette)
+	{
+		Palette[0] = A0;
+		Palette[1] = A1;
+
+		if (A0 > A1)
+		{
+			for (int i = 1; i < 7; i++)
+				Palette[i + 1] = ((7 - i) * A0 + i * A1 + 3) / 7;
+		}
+		else
+		{
+			for (int i = 1; i < 5; i++)
+				Palette[i + 1] = ((5 - i) * A0 + i * A1 + 2) / 5;
+
+			Palette[6] = 0;
+			Palette[7] = 255;
+		}
+	}
+
+	/**
+	* One channel of the texels as a BC4 block, also the alpha half of BC3 and both halves of BC5. The full range of the
+	* block is spanned with the eight value mode, which leaves at most 1/14 of the range as error per texel.
+	*/
+	void EncodeSingleChannelBlock(const uint8_t* Texels, uint32_t Channel, uint8_t* Block)
+	{
+		int Min = 255;
+		int Max = 0;
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			Min = Math::min(Min, static_cast<int>(Texels[i * 4 + Channel]));
+			Max = Math::max(Max, static_cast<int>(Texels[i * 4 + Channel]));
+		}
+
+		Block[0] = static_cast<uint8_t>(Max);
+		Block[1] = static_cast<uint8_t>(Min);
+
+		// The eight values are evenly spaced from Max down to Min, the nearest one follows from the position in the range
+		uint64_t PackedIndices = 0;
+		if (Max > Min)
+		{
+			const int Range = Max - Min;
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				int Step = ((Max - Texels[i * 4 + Channel]) * 7 + Range / 2) / Range;
+				uint64_t Index = Step == 0 ? 0 : (Step == 7 ? 1 : Step + 1);
+
+				PackedIndices |= Index << (i * 3);
+			}
+		}
+
+		for (uint32_t b = 0; b < 6; b++)
+			Block[2 + b] = static_cast<uint8_t>(PackedIndices >> (b * 8));
+	}
+
+	void DecodeSingleChannelBlock(const uint8_t* Block, uint32_t Channel, uint8_t* Texels)
+	{
+		int Palette[8];
+		GetBC4Palette(Block[0], Block[1], Palette);
+
+		uint64_t PackedIndices = 0;
+		for (uint32_t b = 0; b < 6; b++)
+			PackedIndices |= static_cast<uint64_t>(Block[2 + b]) << (b * 8);
+
+		for (uint32_t i = 0; i < 16; i++)
+			Texels[i * 4 + Channel] = static_cast<uint8_t>(Palette[(PackedIndices >> (i * 3)) & 7]);
+	}
+
+	void WriteBits(uint8_t* Block, uint32_t& Position, uint32_t Value, uint32_t NumBits)
+	{
+		for (uint32_t b = 0; b < NumBits; b++, Position++)
+		{
+			if ((Value >> b) & 1)
+				Block[Position >> 3] |= static_cast<uint8_t>(1 << (Position & 7));
+		}
+	}
+
+	uint32_t ReadBits(const uint8_t* Block, uint32_t& Position, uint32_t NumBits)
+	{
+		uint32_t Value = 0;
+		for (uint32_t b = 0; b < NumBits; b++, Position++)
+			Value |= static_cast<uint32_t>((Block[Position >> 3] >> (Position & 7)) & 1) << b;
+
+		return Value;
+	}
+
+	/**
+	* Mode 6 endpoints are 7 bits per channel plus one p-bit shared by the channels, the p-bit that fits better is kept.
+	*/
+	void QuantizeBC7Endpoint(const float* Endpoint, uint8_t* Quantized, uint8_t& PBit)
+	{
+		float BestError = 0.0f;
+		for (uint8_t P = 0; P < 2; P++)
+		{
+			uint8_t Candidate[4];
+			float Error = 0.0f;
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				Candidate[c] = static_cast<uint8_t>(Clamp(static_cast<int>((Endpoint[c] - P) * 0.5f + 0.5f), 0, 127));
+				float Delta = (Candidate[c] * 2 + P) - Endpoint[c];
+				Error += Delta * Delta;
+			}
+
+			if (P == 0 || Error < BestError)
+			{
+				BestError = Error;
+				PBit = P;
+				memcpy(Quantized, Candidate, sizeof(Candidate));
+			}
+		}
+	}
+
+	void GetBC7Palette(const uint8_t* Q0, uint8_t P0, const uint8_t* Q1, uint8_t P1, int (*Palette)[4])
+	{
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			int E0 = Q0[c] * 2 + P0;
+			int E1 = Q1[c] * 2 + P1;
+			for (uint32_t Entry = 0; Entry < 16; Entry++)
+				Palette[Entry][c] = ((64 - BC7Weights[Entry]) * E0 + BC7Weights[Entry] * E1 + 32) >> 6;
+		}
+	}
+
+	void EncodeBC7Block(const float (*Points)[4], uint8_t* Block)
+	{
+		float E0[4];
+		float E1[4];
+		FindEndpoints(Points, 16, 4, E0, E1);
+
+		float Weights[16];
+		for (uint32_t Entry = 0; Entry < 16; Entry++)
+			Weights[Entry] = BC7Weights[Entry] / 64.0f;
+
+		uint8_t BestQ0[4] = {}, BestQ1[4] = {};
+		uint8_t BestP0 = 0, BestP1 = 0;
+		uint8_t BestIndices[16] = {};
+		uint32_t BestError = UINT32_MAX;
+
+		for (uint32_t Pass = 0; Pass <= NumRefinements; Pass++)
+		{
+			uint8_t Q0[4], Q1[4];
+			uint8_t P0, P1;
+			QuantizeBC7Endpoint(E0, Q0, P0);
+			QuantizeBC7Endpoint(E1, Q1, P1);
+
+			int Palette[16][4];
+			GetBC7Palette(Q0, P0, Q1, P1, Palette);
+
+			// Fast tier, texels are projected on the quantized segment instead of trying all 16 entries
+			float Direction[4];
+			float LengthSquared = 0.0f;
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				Direction[c] = static_cast<float>(Palette[15][c] - Palette[0][c]);
+				LengthSquared += Direction[c] * Direction[c];
+			}
+
+			uint8_t Indices[16];
+			uint32_t Error = 0;
+			for (uint32_t i = 0; i < 16; i++)
+			{
+				float Projection = 0.0f;
+				for (uint32_t c = 0; c < 4; c++)
+					Projection += (Points[i][c] - Palette[0][c]) * Direction[c];
+
+				int Weight = LengthSquared > 0.0f ? static_cast<int>(Projection / LengthSquared * 64.0f + 0.5f) : 0;
+				Indices[i] = BC7IndexOfWeight[Clamp(Weight, 0, 64)];
+
+				for (uint32_t c = 0; c < 4; c++)
+				{
+					int Delta = static_cast<int>(Points[i][c]) - Palette[Indices[i]][c];
+					Error += Delta * Delta;
+				}
+			}
+
+			if (Error >= BestError)
+				break;
+
+			BestError = Error;
+			memcpy(BestQ0, Q0, 4);
+			memcpy(BestQ1, Q1, 4);
+			BestP0 = P0;
+			BestP1 = P1;
+			memcpy(BestIndices, Indices, sizeof(Indices));
+
+			if (Error == 0)
+				break;
+
+			RefitEndpoints(Points, Indices, Weights, 4, E0, E1);
+		}
+
+		// The top bit of the first index is implied zero, swapping the endpoints flips every index
+		if (BestIndices[0] & 8)
+		{
+			std::swap(BestQ0, BestQ1);
+			std::swap(BestP0, BestP1);
+			for (uint8_t& Index : BestIndices)
+				Index = 15 - Index;
+		}
+
+		memset(Block, 0, 16);
+		uint32_t Position = 0;
+		WriteBits(Block, Position, 1 << 6, 7);
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			WriteBits(Block, Position, BestQ0[c], 7);
+			WriteBits(Block, Position, BestQ1[c], 7);
+		}
+
+		WriteBits(Block, Position, BestP0, 1);
+		WriteBits(Block, Position, BestP1, 1);
+
+		WriteBits(Block, Position, BestIndices[0], 3);
+		for (uint32_t i = 1; i < 16; i++)
+			WriteBits(Block, Position, BestIndices[i], 4);
+	}
+
+	bool DecodeBC7Block(const uint8_t* Block, uint8_t* Texels)
+	{
+		uint32_t Position = 0;
+		if (ReadBits(Block, Position, 7) != (1 << 6))
+			return false;
+
+		uint8_t Q0[4], Q1[4];
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			Q0[c] = static_cast<uint8_t>(ReadBits(Block, Position, 7));
+			Q1[c] = static_cast<uint8_t>(ReadBits(Block, Position, 7));
+		}
+
+		uint8_t P0 = static_cast<uint8_t>(ReadBits(Block, Position, 1));
+		uint8_t P1 = static_cast<uint8_t>(ReadBits(Block, Position, 1));
+
+		int Palette[16][4];
+		GetBC7Palette(Q0, P0, Q1, P1, Palette);
+
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			uint32_t Index = ReadBits(Block, Position, i == 0 ? 3 : 4);
+			for (uint32_t c = 0; c < 4; c++)
+				Texels[i * 4 + c] = static_cast<uint8_t>(Palette[Index][c]);
+		}
+
+		return true;
+	}
+
+	/**
+	* 4x4 texels of a level as RGBA8, clamped at the edges. Missing channels read as 0 and a missing alpha as 255.
+	*/
+	void LoadBlock(const uint8_t* Src, uint32_t Width, uint32_t Height, uint32_t Stride, uint32_t BlockX, uint32_t BlockY, uint8_t* Texels)
+	{
+		for (uint32_t y = 0; y < 4; y++)
+		{
+			uint32_t SrcY = Math::min(BlockY * 4 + y, Height - 1);
+			for (uint32_t x = 0; x < 4; x++)
+			{
+				uint32_t SrcX = Math::min(BlockX * 4 + x, Width - 1);
+				const uint8_t* Pixel = Src + (static_cast<size_t>(SrcY) * Width + SrcX) * Stride;
+				uint8_t* Texel = Texels + (y * 4 + x) * 4;
+
+				Texel[0] = Pixel[0];
+				Texel[1] = Stride > 1 ? Pixel[1] : 0;
+				Texel[2] = Stride > 2 ? Pixel[2] : 0;
+				Texel[3] = Stride > 3 ? Pixel[3] : 255;
+			}
+		}
+	}
+}
+
+namespace TextureCompression
+{
+	const char* GetFormatName(DXGI_FORMAT Format)
+	{
+		switch (Format)
+		{
+		case DXGI_FORMAT_BC1_UNORM: return "BC1";
+		case DXGI_FORMAT_BC3_UNORM: return "BC3";
+		case DXGI_FORMAT_BC4_UNORM: return "BC4";
+		case DXGI_FORMAT_BC5_UNORM: return "BC5";
+		case DXGI_FORMAT_BC7_UNORM: return "BC7";
+		case DXGI_FORMAT_R8G8B8A8_UNORM: return "RGBA8";
+		case DXGI_FORMAT_R8G8_UNORM: return "RG8";
+		case DXGI_FORMAT_R8_UNORM: return "R8";
+		default: return "unknown";
+		}
+	}
+
+	void EncodeBlock(DXGI_FORMAT Format, const uint8_t* Texels, uint8_t* Block)
+	{
+		float Points[16][4];
+
+		switch (Format)
+		{
+		case DXGI_FORMAT_BC1_UNORM:
+			ToPoints(Texels, Points);
+			EncodeColorBlock(Points, Block);
+			break;
+		case DXGI_FORMAT_BC3_UNORM:
+			ToPoints(Texels, Points);
+			EncodeSingleChannelBlock(Texels, 3, Block);
+			EncodeColorBlock(Points, Block + 8);
+			break;
+		case DXGI_FORMAT_BC4_UNORM:
+			EncodeSingleChannelBlock(Texels, 0, Block);
+			break;
+		case DXGI_FORMAT_BC5_UNORM:
+			EncodeSingleChannelBlock(Texels, 0, Block);
+			EncodeSingleChannelBlock(Texels, 1, Block + 8);
+			break;
+		case DXGI_FORMAT_BC7_UNORM:
+			ToPoints(Texels, Points);
+			EncodeBC7Block(Points, Block);
+			break;
+		default:
+			break;
+		}
+	}
+
+	bool DecodeBlock(DXGI_FORMAT Format, const uint8_t* Block, uint8_t* Texels)
+	{
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			Texels[i * 4 + 0] = 0;
+			Texels[i * 4 + 1] = 0;
+			Texels[i * 4 + 2] = 0;
+			Texels[i * 4 + 3] = 255;
+		}
+
+		switch (Format)
+		{
+		case DXGI_FORMAT_BC1_UNORM:
+			DecodeColorBlock(Block, true, Texels);
+			return true;
+		case DXGI_FORMAT_BC3_UNORM:
+			DecodeColorBlock(Block + 8, false, Texels);
+			DecodeSingleChannelBlock(Block, 3, Texels);
+			return true;
+		case DXGI_FORMAT_BC4_UNORM:
+			DecodeSingleChannelBlock(Block, 0, Texels);
+			return true;
+		case DXGI_FORMAT_BC5_UNORM:
+			DecodeSingleChannelBlock(Block, 0, Texels);
+			DecodeSingleChannelBlock(Block + 8, 1, Texels);
+			return true;
+		case DXGI_FORMAT_BC7_UNORM:
+			return DecodeBC7Block(Block, Texels);
+		default:
+			return false;
+		}
+	}
+
+	DXGI_FORMAT ChooseFormat(const TextureInfo& Info, TextureFormat::TextureUsage Usage, bool UseBC7)
+	{
+		// Without a CPU chain the mips come from Generate_Mips, which can't write to block compressed textures
+		if (Info.mips.empty() || Info.width % 4 != 0 || Info.height % 4 != 0 || Info.pixels.Empty())
+			return DXGI_FORMAT_UNKNOWN;
+
+		switch (Usage)
+		{
+		case TextureFormat::TextureUsage::Albedo:
+		{
+			if (Info.format != DXGI_FORMAT_R8G8B8A8_UNORM)
+				return DXGI_FORMAT_UNKNOWN;
+
+			if (UseBC7)
+				return DXGI_FORMAT_BC7_UNORM;
+
+			const size_t NumPixels = static_cast<size_t>(Info.width) * Info.height;
+			const uint8_t* Pixels = Info.pixels.Data() + Info.mips[0].offset;
+			for (size_t i = 0; i < NumPixels; i++)
+			{
+				if (Pixels[i * 4 + 3] != 255)
+					return DXGI_FORMAT_BC3_UNORM;
+			}
+
+			return DXGI_FORMAT_BC1_UNORM;
+		}
+		case TextureFormat::TextureUsage::Normal:
+			return Info.format == DXGI_FORMAT_R8G8_UNORM ? DXGI_FORMAT_BC5_UNORM : DXGI_FORMAT_UNKNOWN;
+		case TextureFormat::TextureUsage::Opacity:
+			return Info.format == DXGI_FORMAT_R8_UNORM ? DXGI_FORMAT_BC4_UNORM : DXGI_FORMAT_UNKNOWN;
+		default:
+			return DXGI_FORMAT_UNKNOWN;
+		}
+	}
+
+	bool CompressTexture(TextureInfo& Info, DXGI_FORMAT Format, CompressionStats* OutStats)
+	{
+		const uint32_t BlockBytes = TextureFormat::GetElementBytes(Format);
+		const uint32_t SrcStride = static_cast<uint32_t>(Info.stride);
+		const bool IsSupportedSource = Info.format == DXGI_FORMAT_R8G8B8A8_UNORM || Info.format == DXGI_FORMAT_R8G8_UNORM || Info.format == DXGI_FORMAT_R8_UNORM;
+
+		if (!TextureFormat::IsBlockCompressed(Format) || !IsSupportedSource || Info.mips.empty() || Info.width % 4 != 0 || Info.height % 4 != 0)
+			return false;
+
+		auto const Start = std::chrono::high_resolution_clock::now();
+
+		std::vector<TextureMip> Mips(Info.mips.size());
+		size_t Size = 0;
+		uint64_t NumPixels = 0;
+		for (size_t m = 0; m < Info.mips.size(); m++)
+		{
+			Mips[m].width = Info.mips[m].width;
+			Mips[m].height = Info.mips[m].height;
+			Mips[m].offset = Size;
+
+			Size += TextureFormat::GetSurfaceSize(Format, Mips[m].width, Mips[m].height);
+			NumPixels += static_cast<uint64_t>(Mips[m].width) * Mips[m].height;
+		}
+
+		ImageBuffer Blocks(Size);
+		uint8_t* BlockData = Blocks.MutableData();
+
+		// Level 0 is decoded again right after encoding, one squared error sum per block row keeps the tasks independent
+		const uint32_t NumChannels = GetNumChannels(Format);
+		std::vector<double> RowErrors((Info.height + 3) / 4, 0.0);
+
+		for (size_t m = 0; m < Mips.size(); m++)
+		{
+			const uint32_t Width = Mips[m].width;
+			const uint32_t Height = Mips[m].height;
+			const uint32_t BlocksX = (Width + 3) / 4;
+			const uint32_t BlocksY = (Height + 3) / 4;
+			const uint8_t* Src = Info.pixels.Data() + Info.mips[m].offset;
+			uint8_t* Dst = BlockData + Mips[m].offset;
+
+			auto EncodeRows = [&](uint32_t FirstRow, uint32_t EndRow)
+			{
+				uint8_t Texels[64];
+				uint8_t Decoded[64];
+				for (uint32_t BlockY = FirstRow; BlockY < EndRow; BlockY++)
+				{
+					for (uint32_t BlockX = 0; BlockX < BlocksX; BlockX++)
+					{
+						uint8_t* Block = Dst + (static_cast<size_t>(BlockY) * BlocksX + BlockX) * BlockBytes;
+
+						LoadBlock(Src, Width, Height, SrcStride, BlockX, BlockY, Texels);
+						EncodeBlock(Format, Texels, Block);
+
+						if (m != 0 || !DecodeBlock(Format, Block, Decoded))
+							continue;
+
+						for (uint32_t i = 0; i < 16; i++)
+						{
+							for (uint32_t c = 0; c < NumChannels; c++)
+							{
+								double Delta = static_cast<double>(Texels[i * 4 + c]) - Decoded[i * 4 + c];
+								RowErrors[BlockY] += Delta * Delta;
+							}
+						}
+					}
+				}
+			};
+
+			if (Width * Height < MinParallelPixels)
+			{
+				EncodeRows(0, BlocksY);
+				continue;
+			}
+
+			uint32_t NumTasks = (BlocksY + BlockRowsPerTask - 1) / BlockRowsPerTask;
+			ThreadPool::GetGlobal().ParallelFor(NumTasks, [&](uint32_t Task)
+			{
+				uint32_t FirstRow = Task * BlockRowsPerTask;
+				EncodeRows(FirstRow, Math::min(FirstRow + BlockRowsPerTask, BlocksY));
+			});
+		}
+
+		if (OutStats)
+		{
+			double SquaredError = 0.0;
+			for (double RowError : RowErrors)
+				SquaredError += RowError;
+
+			double MSE = SquaredError / (static_cast<double>(Info.width) * Info.height * NumChannels);
+
+			OutStats->EncodeMS = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - Start).count();
+			OutStats->NumPixels = NumPixels;
+			OutStats->PSNR = MSE > 0.0 ? Math::min(10.0 * std::log10(255.0 * 255.0 / MSE), MaxPSNR) : MaxPSNR;
+		}
+
+		Info.pixels = std::move(Blocks);
+		Info.mips = std::move(Mips);
+		Info.stride = static_cast<int>(BlockBytes);
+		Info.format = Format;
+
+		return true;
+	}
+}
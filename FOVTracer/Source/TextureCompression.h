@@ -0,0 +1,56 @@
+#pragma once
+
+#include "DX.h"
+#include "TextureFormat.h"
+
+#include <cstdint>
+
+/**
+* CPU block compression of decoded textures. BC1, BC3, BC4 and BC5 blocks are fitted along the principal axis of the block
+* and refined with a least squares pass, BC7 is the fast tier that only writes mode 6 (one RGBA subset, 4 bit indices).
+*/
+namespace TextureCompression
+{
+	/**
+	* Bump whenever an encoder changes, cached textures encoded with an older version are ignored.
+	*/
+	constexpr uint32_t Version = 1;
+
+	struct CompressionStats
+	{
+		double EncodeMS = 0.0;
+		uint64_t NumPixels = 0;		// all mip levels
+
+		/**
+		* Level 0 against the uncompressed source, over the channels the format keeps. Lossless blocks report MaxPSNR.
+		*/
+		double PSNR = 0.0;
+	};
+
+	constexpr double MaxPSNR = 100.0;
+
+	const char* GetFormatName(DXGI_FORMAT Format);
+
+	/**
+	* Encodes 16 RGBA8 texels, row by row, into one block of Format. Only BC1, BC3, BC4, BC5 and BC7 are supported.
+	*/
+	void EncodeBlock(DXGI_FORMAT Format, const uint8_t* Texels, uint8_t* Block);
+
+	/**
+	* Decodes a block written by EncodeBlock into 16 RGBA8 texels. For BC7 only mode 6 is understood, returns false otherwise.
+	*/
+	bool DecodeBlock(DXGI_FORMAT Format, const uint8_t* Block, uint8_t* Texels);
+
+	/**
+	* BC1 for opaque albedo and BC3 for albedo with alpha, or BC7 for both if UseBC7 is set. BC5 for RG8 normals and BC4 for
+	* opacity. DXGI_FORMAT_UNKNOWN if Info should stay as it is: noise, block compressed already, no CPU mip chain, or a
+	* level 0 size that isn't a multiple of 4.
+	*/
+	DXGI_FORMAT ChooseFormat(const TextureInfo& Info, TextureFormat::TextureUsage Usage, bool UseBC7);
+
+	/**
+	* Replaces every mip level of Info, 1, 2 or 4 bytes per pixel, with Format blocks. Block rows are split over the global
+	* thread pool. Returns false and leaves Info alone if it can't be compressed.
+	*/
+	bool CompressTexture(TextureInfo& Info, DXGI_FORMAT Format, CompressionStats* OutStats = nullptr);
+}
@@ -0,0 +1,313 @@
+#include "pch.h"
+#include "TextureDiskCache.h"
+#include "MappedFile.h"
+#include "Utils.h"
+#include "TextureFormat.h"
+#include "TextureCompression.h"
+#include "Log.h"
+#include "ResourceManagement.h"
+
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+/*
+* Entry layout:
+*	EntryHeader
+*	EntryMip[NumMips]
+*	texel data at DataOffset, aligned to DataAlignment
+*/
+
+namespace
+{
+	constexpr uint32_t EntryMagic = 0x43564F46; // "FOVC"
+	constexpr uint64_t DataAlignment = 64;
+	constexpr const char* EntryExtension = ".texcache";
+
+	// More levels than any 32 bit wide texture has, anything above is a corrupt header
+	constexpr uint32_t MaxMips = 32;
+
+	struct EntryHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t MipVersion;
+		uint32_t Format;
+		uint64_t SourceHash;
+		uint32_t Usage;
+		uint32_t GenerateMips;
+		uint32_t KeepBlockCompressed;
+		uint32_t Compression;
+		uint32_t Filter;
+		uint32_t SRGB;
+		uint32_t MaxLevels;
+		int32_t Width;
+		int32_t Height;
+		int32_t Stride;
+		int32_t Offset;
+		uint32_t NumMips;
+		uint64_t DataOffset;
+		uint64_t DataSize;
+		uint64_t FileSize;
+	};
+
+	struct EntryMip
+	{
+		int32_t Width;
+		int32_t Height;
+		uint64_t Offset;
+	};
+
+	bool MatchesKey(const EntryHeader& Header, const TextureDiskCacheKey& Key)
+	{
+		return Header.SourceHash == Key.SourceHash &&
+			Header.Usage == Key.Usage &&
+			Header.GenerateMips == Key.GenerateMips &&
+			Header.KeepBlockCompressed == Key.KeepBlockCompressed &&
+			Header.Compression == Key.Compression &&
+			Header.Filter == static_cast<uint32_t>(Key.Mips.Filter) &&
+			Header.SRGB == static_cast<uint32_t>(Key.Mips.SRGB) &&
+			Header.MaxLevels == Key.Mips.MaxLevels;
+	}
+}
+
+uint64_t TextureDiskCacheKey::Hash() const
+{
+	// Hashed field by field, padding in the struct would make the key unstable
+	const uint64_t Fields[] = {
+		SourceHash,
+		Usage,
+		GenerateMips,
+		KeepBlockCompressed,
+		Compression,
+		static_cast<uint64_t>(Mips.Filter),
+		Mips.SRGB ? 1ull : 0ull,
+		Mips.MaxLevels,
+		TextureMips::Version,
+		TextureCompression::Version,
+		TextureDiskCache::Version
+	};
+
+	return Utils::HashBytes(Fields, sizeof(Fields));
+}
+
+TextureDiskCache::TextureDiskCache(const std::string& InDirectory, uint64_t InMaxBytes) : Directory(InDirectory), MaxBytes(InMaxBytes)
+{
+	std::error_code Error;
+	std::filesystem::create_directories(Directory, Error);
+	if (Error)
+		CORE_WARN("Failed to create texture cache directory {0}: {1}", Directory, Error.message());
+
+	Prune();
+}
+
+bool TextureDiskCache::Read(const TextureDiskCacheKey& Key, TextureInfo& OutInfo)
+{
+	std::string Path = GetEntryPath(Key);
+
+	// The last write time doubles as the last use for pruning, it has to be refreshed before the mapping locks the file
+	std::error_code Error;
+	std::filesystem::last_write_time(Path, std::filesystem::file_time_type::clock::now(), Error);
+
+	std::shared_ptr<MappedFile> File = std::make_shared<MappedFile>();
+	if (Error || !File->Open(Path))
+	{
+		NumMisses++;
+		return false;
+	}
+
+	bool IsValid = File->Size() >= sizeof(EntryHeader);
+	const EntryHeader* Header = reinterpret_cast<const EntryHeader*>(File->Data());
+
+	IsValid = IsValid &&
+		Header->Magic == EntryMagic &&
+		Header->Version == Version &&
+		Header->MipVersion == TextureMips::Version &&
+		TextureFormat::GetElementBytes(static_cast<DXGI_FORMAT>(Header->Format)) == static_cast<uint32_t>(Header->Stride) &&
+		Header->FileSize == File->Size() &&
+		MatchesKey(*Header, Key);
+
+	const DXGI_FORMAT Format = IsValid ? static_cast<DXGI_FORMAT>(Header->Format) : DXGI_FORMAT_UNKNOWN;
+
+	IsValid = IsValid &&
+		Header->Width > 0 && Header->Height > 0 && Header->Stride > 0 &&
+		Header->NumMips <= MaxMips &&
+		sizeof(EntryHeader) + Header->NumMips * sizeof(EntryMip) <= Header->DataOffset &&
+		Header->DataOffset + Header->DataSize <= Header->FileSize &&
+		TextureFormat::GetSurfaceSize(Format, Header->Width, Header->Height) <= Header->DataSize;
+
+	// Only looked at once the header is known to be inside the file and the mip table inside the header's DataOffset
+	const EntryMip* Mips = IsValid ? reinterpret_cast<const EntryMip*>(File->Data() + sizeof(EntryHeader)) : nullptr;
+	for (uint32_t i = 0; IsValid && i < Header->NumMips; i++)
+		IsValid = Mips[i].Width > 0 && Mips[i].Height > 0 && Mips[i].Offset + TextureFormat::GetSurfaceSize(Format, Mips[i].Width, Mips[i].Height) <= Header->DataSize;
+
+	if (!IsValid)
+	{
+		CORE_TRACE("Texture cache entry {0} is stale or invalid, ignoring it", Path);
+		NumMisses++;
+		return false;
+	}
+
+	OutInfo = TextureInfo();
+	OutInfo.width = Header->Width;
+	OutInfo.height = Header->Height;
+	OutInfo.stride = Header->Stride;
+	OutInfo.offset = Header->Offset;
+	OutInfo.format = Format;
+
+	OutInfo.mips.resize(Header->NumMips);
+	for (uint32_t i = 0; i < Header->NumMips; i++)
+	{
+		OutInfo.mips[i].width = Mips[i].Width;
+		OutInfo.mips[i].height = Mips[i].Height;
+		OutInfo.mips[i].offset = static_cast<size_t>(Mips[i].Offset);
+	}
+
+	// Texels stay in the mapping, the upload reads them straight from there
+	OutInfo.pixels = ImageBuffer(File, File->Data() + Header->DataOffset, static_cast<size_t>(Header->DataSize));
+
+	NumHits++;
+	return true;
+}
+
+bool TextureDiskCache::Write(const TextureDiskCacheKey& Key, const TextureInfo& Info)
+{
+	EntryHeader Header = {};
+	Header.Magic = EntryMagic;
+	Header.Version = Version;
+	Header.MipVersion = TextureMips::Version;
+	Header.Format = Info.format;
+	Header.SourceHash = Key.SourceHash;
+	Header.Usage = Key.Usage;
+	Header.GenerateMips = Key.GenerateMips;
+	Header.KeepBlockCompressed = Key.KeepBlockCompressed;
+	Header.Compression = Key.Compression;
+	Header.Filter = static_cast<uint32_t>(Key.Mips.Filter);
+	Header.SRGB = static_cast<uint32_t>(Key.Mips.SRGB);
+	Header.MaxLevels = Key.Mips.MaxLevels;
+	Header.Width = Info.width;
+	Header.Height = Info.height;
+	Header.Stride = Info.stride;
+	Header.Offset = Info.offset;
+	Header.NumMips = static_cast<uint32_t>(Info.mips.size());
+	Header.DataOffset = ALIGN(DataAlignment, sizeof(EntryHeader) + Header.NumMips * sizeof(EntryMip));
+	Header.DataSize = Info.pixels.Size();
+	Header.FileSize = Header.DataOffset + Header.DataSize;
+
+	std::vector<EntryMip> Mips(Info.mips.size());
+	for (size_t i = 0; i < Info.mips.size(); i++)
+	{
+		Mips[i].Width = Info.mips[i].width;
+		Mips[i].Height = Info.mips[i].height;
+		Mips[i].Offset = Info.mips[i].offset;
+	}
+
+	std::string Path = GetEntryPath(Key);
+
+	// Same as the mesh cache, a crash mid-write must never leave a valid looking entry behind
+	std::string TempPath = Path + ".tmp";
+	std::ofstream Stream(TempPath, std::ios::binary | std::ios::trunc);
+	if (!Stream)
+	{
+		CORE_WARN("Failed to open texture cache entry {0} for writing", TempPath);
+		return false;
+	}
+
+	const char Zeros[DataAlignment] = {};
+	Stream.write(reinterpret_cast<const char*>(&Header), sizeof(Header));
+	Stream.write(reinterpret_cast<const char*>(Mips.data()), Mips.size() * sizeof(EntryMip));
+	Stream.write(Zeros, Header.DataOffset - sizeof(Header) - Mips.size() * sizeof(EntryMip));
+	Stream.write(reinterpret_cast<const char*>(Info.pixels.Data()), Info.pixels.Size());
+	Stream.close();
+
+	if (!Stream)
+	{
+		CORE_WARN("Failed to write texture cache entry {0}", TempPath);
+		std::remove(TempPath.c_str());
+		return false;
+	}
+
+	std::remove(Path.c_str());
+	if (std::rename(TempPath.c_str(), Path.c_str()) != 0)
+	{
+		CORE_WARN("Failed to move texture cache entry into place at {0}", Path);
+		std::remove(TempPath.c_str());
+		return false;
+	}
+
+	if ((TotalBytes += Header.FileSize) > MaxBytes)
+		Prune();
+
+	return true;
+}
+
+void TextureDiskCache::Prune()
+{
+	struct Entry
+	{
+		std::filesystem::path Path;
+		uint64_t Size;
+		std::filesystem::file_time_type LastUse;
+	};
+
+	std::lock_guard<std::mutex> Lock(Mutex);
+
+	std::vector<Entry> Entries;
+	uint64_t Size = 0;
+
+	std::error_code Error;
+	for (std::filesystem::directory_iterator It(Directory, Error), End; !Error && It != End; It.increment(Error))
+	{
+		if (!It->is_regular_file(Error) || It->path().extension() != EntryExtension)
+			continue;
+
+		Entry NewEntry;
+		NewEntry.Path = It->path();
+		NewEntry.Size = It->file_size(Error);
+		NewEntry.LastUse = It->last_write_time(Error);
+
+		if (!Error)
+		{
+			Size += NewEntry.Size;
+			Entries.push_back(NewEntry);
+		}
+	}
+
+	uint32_t NumPruned = 0;
+	if (Size > MaxBytes)
+	{
+		std::sort(Entries.begin(), Entries.end(), [](const Entry& A, const Entry& B) { return A.LastUse < B.LastUse; });
+
+		for (const Entry& OldEntry : Entries)
+		{
+			if (Size <= MaxBytes)
+				break;
+
+			if (std::filesystem::remove(OldEntry.Path, Error))
+			{
+				Size -= OldEntry.Size;
+				NumPruned++;
+			}
+		}
+	}
+
+	TotalBytes = Size;
+
+	if (NumPruned > 0)
+		CORE_TRACE("Pruned {0} texture cache entries, {1:.1f} MB left in {2}", NumPruned, Size / (1024.0 * 1024.0), Directory);
+}
+
+std::string TextureDiskCache::GetDefaultDirectory()
+{
+	return Utils::GetResourcePath("TextureCache");
+}
+
+std::string TextureDiskCache::GetEntryPath(const TextureDiskCacheKey& Key) const
+{
+	char Name[17];
+	snprintf(Name, sizeof(Name), "%016llx", static_cast<unsigned long long>(Key.Hash()));
+
+	return Directory + "/" + Name + EntryExtension;
+}
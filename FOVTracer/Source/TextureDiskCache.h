@@ -0,0 +1,87 @@
+#pragma once
+
+#include "DX.h"
+#include "TextureMips.h"
+
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+/**
+* Everything that influences a processed texture. Entries are stored under a hash of the whole key, so a changed source file or
+* different settings simply map to another entry and the stale one ages out.
+*/
+struct TextureDiskCacheKey
+{
+	uint64_t SourceHash = 0;
+	uint32_t Usage = 0;			// TextureFormat::TextureUsage
+	uint32_t GenerateMips = 1;
+	uint32_t KeepBlockCompressed = 1;
+	uint32_t Compression = 0;	// 0 none, 1 BC1 to BC5, 2 BC7 for albedo
+	TextureMips::MipSettings Mips;
+
+	uint64_t Hash() const;
+};
+
+/**
+* On-disk cache of final texture payloads, all mip levels included, in one directory shared by every scene. Entries are read
+* back through a memory mapping and handed out without copying the texels. The directory is kept below a size limit by
+* deleting the least recently used entries.
+*/
+class TextureDiskCache
+{
+public:
+	/**
+	* Bump whenever the entry layout changes.
+	*/
+	static constexpr uint32_t Version = 4;
+
+	static constexpr uint64_t DefaultMaxBytes = 4ull * 1024 * 1024 * 1024;
+
+	/**
+	* Creates Directory if needed and prunes it down to MaxBytes.
+	*/
+	TextureDiskCache(const std::string& InDirectory, uint64_t InMaxBytes = DefaultMaxBytes);
+	TextureDiskCache(const TextureDiskCache&) = delete;
+	TextureDiskCache& operator=(const TextureDiskCache&) = delete;
+
+	/**
+	* Maps the entry of Key. OutInfo.pixels adopts the mapping, the texels aren't copied.
+	* Returns false on a missing or invalid entry.
+	*/
+	bool Read(const TextureDiskCacheKey& Key, TextureInfo& OutInfo);
+
+	/**
+	* Stores Info under Key, then prunes if the directory went over the limit.
+	*/
+	bool Write(const TextureDiskCacheKey& Key, const TextureInfo& Info);
+
+	/**
+	* Deletes least recently used entries until the directory fits in the size limit. Entries that are mapped right now
+	* can't be deleted on Windows and are skipped.
+	*/
+	void Prune();
+
+	uint64_t GetSizeInBytes() const { return TotalBytes; }
+	uint32_t GetNumHits() const { return NumHits; }
+	uint32_t GetNumMisses() const { return NumMisses; }
+
+	const std::string& GetDirectory() const { return Directory; }
+
+	/**
+	* Default location, next to the other resources.
+	*/
+	static std::string GetDefaultDirectory();
+
+private:
+	std::string GetEntryPath(const TextureDiskCacheKey& Key) const;
+
+	const std::string Directory;
+	const uint64_t MaxBytes;
+
+	std::mutex Mutex;
+	std::atomic<uint64_t> TotalBytes{ 0 };
+	std::atomic<uint32_t> NumHits{ 0 };
+	std::atomic<uint32_t> NumMisses{ 0 };
+};
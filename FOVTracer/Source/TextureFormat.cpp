@@ -0,0 +1,375 @@
+#include "pch.h"
+#include "TextureFormat.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TEXTURE_FORMAT_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define TEXTURE_FORMAT_X86 0
+#endif
+
+// MSVC compiles intrinsics for any instruction set, GCC and Clang need the functions that use them marked
+#if defined(_MSC_VER)
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#else
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace TextureFormat
+{
+	static void ExpandGreyScalar(const uint8_t* Src, uint8_t* Dst, size_t NumPixels)
+	{
+		for (size_t i = 0; i < NumPixels; i++)
+		{
+			uint8_t Grey = Src[i];
+			Dst[i * 4] = Grey;
+			Dst[i * 4 + 1] = Grey;
+			Dst[i * 4 + 2] = Grey;
+			Dst[i * 4 + 3] = 0xFF;
+		}
+	}
+
+	static void ExpandGreyAlphaScalar(const uint8_t* Src, uint8_t* Dst, size_t NumPixels)
+	{
+		for (size_t i = 0; i < NumPixels; i++)
+		{
+			uint8_t Grey = Src[i * 2];
+			Dst[i * 4] = Grey;
+			Dst[i * 4 + 1] = Grey;
+			Dst[i * 4 + 2] = Grey;
+			Dst[i * 4 + 3] = Src[i * 2 + 1];
+		}
+	}
+
+	static void ExpandRGBScalar(const uint8_t* Src, uint8_t* Dst, size_t NumPixels)
+	{
+		for (size_t i = 0; i < NumPixels; i++)
+		{
+			Dst[i * 4] = Src[i * 3];
+			Dst[i * 4 + 1] = Src[i * 3 + 1];
+			Dst[i * 4 + 2] = Src[i * 3 + 2];
+			Dst[i * 4 + 3] = 0xFF;
+		}
+	}
+
+	static void CopyRGBA(const uint8_t* Src, uint8_t* Dst, size_t NumPixels)
+	{
+		memcpy(Dst, Src, NumPixels * 4);
+	}
+
+#if TEXTURE_FORMAT_X86
+	TARGET_SSSE3 static void ExpandGreySSSE3(const uint8_t* Src, uint8_t* Dst, size_t NumPixels)
+	{
+		const __m128i Alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+		const __m128i Mask0 = _mm_setr_epi8(0, 0, 0, -1, 1, 1, 1, -1, 2, 2, 2, -1, 3, 3, 3, -1);
+		const __m128i Mask1 = _mm_setr_epi8(4, 4, 4, -1, 5, 5, 5, -1, 6, 6, 6, -1, 7, 7, 7, -1);
+		const __m128i Mask2 = _mm_setr_epi8(8, 8, 8, -1, 9, 9, 9, -1, 10, 10, 10, -1, 11, 11, 11, -1);
+		const __m128i Mask3 = _mm_setr_epi8(12, 12, 12, -1, 13, 13, 13, -1, 14, 14, 14, -1, 15, 15, 15, -1);
+
+		size_t i = 0;
+		for (; i + 16 <= NumPixels; i += 16)
+		{
+			__m128i Grey = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i));
+			__m128i* Out = reinterpret_cast<__m128i*>(Dst + i * 4);
+
+			_mm_storeu_si128(Out, _mm_or_si128(_mm_shuffle_epi8(Grey, Mask0), Alpha));
+			_mm_storeu_si128(Out + 1, _mm_or_si128(_mm_shuffle_epi8(Grey, Mask1), Alpha));
+			_mm_storeu_si128(Out + 2, _mm_or_si128(_mm_shuffle_epi8(Grey, Mask2), Alpha));
+			_mm_storeu_si128(Out + 3, _mm_or_si128(_mm_shuffle_epi8(Grey, Mask3), Alpha));
+		}
+
+		ExpandGreyScalar(Src + i, Dst + i * 4, NumPixels - i);
+	}
+
+	TARGET_SSSE3 static void ExpandGreyAlphaSSSE3(const uint8_t* Src, uint8_t* Dst, size_t NumPixels)
+	{
+		const __m128i Mask0 = _mm_setr_epi8(0, 0, 0, 1, 2, 2, 2, 3, 4, 4, 4, 5, 6, 6, 6, 7);
+		const __m128i Mask1 = _mm_setr_epi8(8, 8, 8, 9, 10, 10, 10, 11, 12, 12, 12, 13, 14, 14, 14, 15);
+
+		size_t i = 0;
+		for (; i + 8 <= NumPixels; i += 8)
+		{
+			__m128i GreyAlpha = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i * 2));
+			__m128i* Out = reinterpret_cast<__m128i*>(Dst + i * 4);
+
+			_mm_storeu_si128(Out, _mm_shuffle_epi8(GreyAlpha, Mask0));
+			_mm_storeu_si128(Out + 1, _mm_shuffle_epi8(GreyAlpha, Mask1));
+		}
+
+		ExpandGreyAlphaScalar(Src + i * 2, Dst + i * 4, NumPixels - i);
+	}
+
+	TARGET_SSSE3 static void ExpandRGBSSSE3(const uint8_t* Src, uint8_t* Dst, size_t NumPixels)
+	{
+		const __m128i Alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+		const __m128i Mask = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+		// Every load reads 16 bytes for 4 pixels, stop while the last one is still inside the source
+		size_t i = 0;
+		for (; (i + 4) * 3 + 4 <= NumPixels * 3; i += 4)
+		{
+			__m128i RGB = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i * 3));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(Dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(RGB, Mask), Alpha));
+		}
+
+		ExpandRGBScalar(Src + i * 3, Dst + i * 4, NumPixels - i);
+	}
+
+	TARGET_AVX2 static void ExpandGreyAVX2(const uint8_t* Src, uint8_t* Dst, size_t NumPixels)
+	{
+		const __m256i Alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+		const __m256i Mask0 = _mm256_setr_epi8(
+			0, 0, 0, -1, 1, 1, 1, -1, 2, 2, 2, -1, 3, 3, 3, -1,
+			4, 4, 4, -1, 5, 5, 5, -1, 6, 6, 6, -1, 7, 7, 7, -1);
+		const __m256i Mask1 = _mm256_setr_epi8(
+			8, 8, 8, -1, 9, 9, 9, -1, 10, 10, 10, -1, 11, 11, 11, -1,
+			12, 12, 12, -1, 13, 13, 13, -1, 14, 14, 14, -1, 15, 15, 15, -1);
+
+		// Shuffles stay within 128 bit lanes, so both lanes get the same 16 source pixels
+		size_t i = 0;
+		for (; i + 16 <= NumPixels; i += 16)
+		{
+			__m256i Grey = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i)));
+			__m256i* Out = reinterpret_cast<__m256i*>(Dst + i * 4);
+
+			_mm256_storeu_si256(Out, _mm256_or_si256(_mm256_shuffle_epi8(Grey, Mask0), Alpha));
+			_mm256_storeu_si256(Out + 1, _mm256_or_si256(_mm256_shuffle_epi8(Grey, Mask1), Alpha));
+		}
+
+		ExpandGreyScalar(Src + i, Dst + i * 4, NumPixels - i);
+	}
+
+	TARGET_AVX2 static void ExpandGreyAlphaAVX2(const uint8_t* Src, uint8_t* Dst, size_t NumPixels)
+	{
+		const __m256i Mask = _mm256_setr_epi8(
+			0, 0, 0, 1, 2, 2, 2, 3, 4, 4, 4, 5, 6, 6, 6, 7,
+			8, 8, 8, 9, 10, 10, 10, 11, 12, 12, 12, 13, 14, 14, 14, 15);
+
+		size_t i = 0;
+		for (; i + 16 <= NumPixels; i += 16)
+		{
+			__m256i Low = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i * 2)));
+			__m256i High = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i * 2 + 16)));
+			__m256i* Out = reinterpret_cast<__m256i*>(Dst + i * 4);
+
+			_mm256_storeu_si256(Out, _mm256_shuffle_epi8(Low, Mask));
+			_mm256_storeu_si256(Out + 1, _mm256_shuffle_epi8(High, Mask));
+		}
+
+		ExpandGreyAlphaScalar(Src + i * 2, Dst + i * 4, NumPixels - i);
+	}
+
+	TARGET_AVX2 static void ExpandRGBAVX2(const uint8_t* Src, uint8_t* Dst, size_t NumPixels)
+	{
+		const __m256i Alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+		const __m256i Mask = _mm256_setr_epi8(
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+		// 4 pixels per lane, the upper lane loads 12 bytes further on and reads 4 bytes past its 8th pixel
+		size_t i = 0;
+		for (; (i + 8) * 3 + 4 <= NumPixels * 3; i += 8)
+		{
+			__m128i Low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i * 3));
+			__m128i High = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Src + i * 3 + 12));
+			__m256i RGB = _mm256_inserti128_si256(_mm256_castsi128_si256(Low), High, 1);
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(Dst + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(RGB, Mask), Alpha));
+		}
+
+		ExpandRGBScalar(Src + i * 3, Dst + i * 4, NumPixels - i);
+	}
+
+	static SimdLevel DetectSimdLevel()
+	{
+#if defined(_MSC_VER)
+		int Info[4];
+		__cpuid(Info, 0);
+		int MaxLeaf = Info[0];
+
+		__cpuid(Info, 1);
+		bool HasSSSE3 = (Info[2] & (1 << 9)) != 0;
+		bool HasOSXSAVE = (Info[2] & (1 << 27)) != 0;
+		bool HasAVX = (Info[2] & (1 << 28)) != 0;
+
+		bool HasAVX2 = false;
+		if (MaxLeaf >= 7)
+		{
+			__cpuidex(Info, 7, 0);
+			HasAVX2 = (Info[1] & (1 << 5)) != 0;
+		}
+
+		// The OS also has to save the upper halves of the YMM registers
+		HasAVX2 = HasAVX2 && HasAVX && HasOSXSAVE && (_xgetbv(0) & 6) == 6;
+#else
+		__builtin_cpu_init();
+		bool HasSSSE3 = __builtin_cpu_supports("ssse3");
+		bool HasAVX2 = __builtin_cpu_supports("avx2");
+#endif
+
+		if (HasAVX2)
+			return SimdLevel::AVX2;
+
+		return HasSSSE3 ? SimdLevel::SSSE3 : SimdLevel::Scalar;
+	}
+#else
+	static SimdLevel DetectSimdLevel()
+	{
+		return SimdLevel::Scalar;
+	}
+#endif
+
+	SimdLevel GetSupportedSimdLevel()
+	{
+		static const SimdLevel Supported = DetectSimdLevel();
+		return Supported;
+	}
+
+	const char* GetSimdLevelName(SimdLevel Level)
+	{
+		switch (Level)
+		{
+		case SimdLevel::AVX2: return "AVX2";
+		case SimdLevel::SSSE3: return "SSSE3";
+		default: return "Scalar";
+		}
+	}
+
+	ExpandFunc GetExpander(uint32_t SrcChannels, SimdLevel Level)
+	{
+		if (Level > GetSupportedSimdLevel())
+			Level = GetSupportedSimdLevel();
+
+		// A straight copy is already as fast as memcpy gets
+		if (SrcChannels == 4)
+			return CopyRGBA;
+
+#if TEXTURE_FORMAT_X86
+		if (Level == SimdLevel::AVX2)
+		{
+			switch (SrcChannels)
+			{
+			case 1: return ExpandGreyAVX2;
+			case 2: return ExpandGreyAlphaAVX2;
+			case 3: return ExpandRGBAVX2;
+			default: return nullptr;
+			}
+		}
+
+		if (Level == SimdLevel::SSSE3)
+		{
+			switch (SrcChannels)
+			{
+			case 1: return ExpandGreySSSE3;
+			case 2: return ExpandGreyAlphaSSSE3;
+			case 3: return ExpandRGBSSSE3;
+			default: return nullptr;
+			}
+		}
+#endif
+
+		switch (SrcChannels)
+		{
+		case 1: return ExpandGreyScalar;
+		case 2: return ExpandGreyAlphaScalar;
+		case 3: return ExpandRGBScalar;
+		default: return nullptr;
+		}
+	}
+
+	bool IsBlockCompressed(DXGI_FORMAT Format)
+	{
+		return (Format >= DXGI_FORMAT_BC1_TYPELESS && Format <= DXGI_FORMAT_BC5_SNORM) ||
+			(Format >= DXGI_FORMAT_BC6H_TYPELESS && Format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+	}
+
+	uint32_t GetElementBytes(DXGI_FORMAT Format)
+	{
+		switch (Format)
+		{
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+			return 4;
+		case DXGI_FORMAT_R8G8_UNORM:
+			return 2;
+		case DXGI_FORMAT_R8_UNORM:
+			return 1;
+		case DXGI_FORMAT_BC1_TYPELESS:
+		case DXGI_FORMAT_BC1_UNORM:
+		case DXGI_FORMAT_BC1_UNORM_SRGB:
+		case DXGI_FORMAT_BC4_TYPELESS:
+		case DXGI_FORMAT_BC4_UNORM:
+		case DXGI_FORMAT_BC4_SNORM:
+			return 8;
+		default:
+			return IsBlockCompressed(Format) ? 16 : 0;
+		}
+	}
+
+	size_t GetSurfaceSize(DXGI_FORMAT Format, uint32_t Width, uint32_t Height)
+	{
+		if (IsBlockCompressed(Format))
+			return static_cast<size_t>((Width + 3) / 4) * ((Height + 3) / 4) * GetElementBytes(Format);
+
+		return static_cast<size_t>(Width) * Height * GetElementBytes(Format);
+	}
+
+	const char* GetUsageName(TextureUsage Usage)
+	{
+		switch (Usage)
+		{
+		case TextureUsage::Albedo: return "albedo";
+		case TextureUsage::Normal: return "normal";
+		case TextureUsage::Opacity: return "opacity";
+		case TextureUsage::Noise: return "noise";
+		default: return "unknown";
+		}
+	}
+
+	DXGI_FORMAT GetUsageFormat(TextureUsage Usage)
+	{
+		switch (Usage)
+		{
+		case TextureUsage::Normal: return DXGI_FORMAT_R8G8_UNORM;
+		case TextureUsage::Opacity:
+		case TextureUsage::Noise: return DXGI_FORMAT_R8_UNORM;
+		default: return DXGI_FORMAT_R8G8B8A8_UNORM;
+		}
+	}
+
+	void PackChannels(const uint8_t* Src, uint8_t* Dst, size_t NumPixels, uint32_t DstChannels)
+	{
+		switch (DstChannels)
+		{
+		case 1:
+			for (size_t i = 0; i < NumPixels; i++)
+				Dst[i] = Src[i * 4];
+			break;
+		case 2:
+			for (size_t i = 0; i < NumPixels; i++)
+			{
+				Dst[i * 2 + 0] = Src[i * 4 + 0];
+				Dst[i * 2 + 1] = Src[i * 4 + 1];
+			}
+			break;
+		case 3:
+			for (size_t i = 0; i < NumPixels; i++)
+			{
+				Dst[i * 3 + 0] = Src[i * 4 + 0];
+				Dst[i * 3 + 1] = Src[i * 4 + 1];
+				Dst[i * 3 + 2] = Src[i * 4 + 2];
+			}
+			break;
+		case 4:
+			memmove(Dst, Src, NumPixels * 4);
+			break;
+		}
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <dxgiformat.h>
+
+/**
+* Pixel format conversion for decoded textures. Decodes are expanded to RGBA8, then packed down to what their usage needs.
+*/
+namespace TextureFormat
+{
+	/**
+	* What a texture is sampled for, decides the smallest layout that still has every channel the shaders read.
+	*/
+	enum class TextureUsage : uint32_t
+	{
+		Albedo,
+		Normal,
+		Opacity,
+		Noise,
+		Count
+	};
+
+	enum class SimdLevel : uint32_t
+	{
+		Scalar,
+		SSSE3,
+		AVX2
+	};
+
+	/**
+	* Expands NumPixels pixels from Src to 4 byte pixels in Dst. Src and Dst must not overlap.
+	*/
+	typedef void (*ExpandFunc)(const uint8_t* Src, uint8_t* Dst, size_t NumPixels);
+
+	/**
+	* Best level the CPU and OS support, detected once.
+	*/
+	SimdLevel GetSupportedSimdLevel();
+
+	const char* GetSimdLevelName(SimdLevel Level);
+
+	/**
+	* Converter from SrcChannels (1 to 4) bytes per pixel to RGBA8, using at most Level. Returns nullptr for other channel counts.
+	* Grey is replicated into RGB, grey-alpha keeps its alpha and missing alpha is filled with 255, like stb_image does it.
+	*/
+	ExpandFunc GetExpander(uint32_t SrcChannels, SimdLevel Level);
+
+	inline ExpandFunc GetExpander(uint32_t SrcChannels) { return GetExpander(SrcChannels, GetSupportedSimdLevel()); }
+
+	bool IsBlockCompressed(DXGI_FORMAT Format);
+
+	/**
+	* Bytes per pixel, or per 4x4 block for block compressed formats. 0 for formats the texture pipeline doesn't handle.
+	*/
+	uint32_t GetElementBytes(DXGI_FORMAT Format);
+
+	/**
+	* Bytes of one tightly packed Width x Height surface, partial blocks at the edges included.
+	*/
+	size_t GetSurfaceSize(DXGI_FORMAT Format, uint32_t Width, uint32_t Height);
+
+	const char* GetUsageName(TextureUsage Usage);
+
+	/**
+	* RGBA8 for albedo, RG8 for tangent space normals whose Z is reconstructed in the shader, R8 for opacity and noise.
+	*/
+	DXGI_FORMAT GetUsageFormat(TextureUsage Usage);
+
+	/**
+	* Keeps the first DstChannels (1 to 4) bytes of each of the NumPixels RGBA8 pixels in Src. Dst may be Src, pixels are
+	* packed front to back so nothing is overwritten before it is read.
+	*/
+	void PackChannels(const uint8_t* Src, uint8_t* Dst, size_t NumPixels, uint32_t DstChannels);
+}
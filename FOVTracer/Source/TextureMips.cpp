@@ -0,0 +1,383 @@
+#include "pch.h"
+#include "TextureMips.h"
+#include "ThreadPool.h"
+#include "Math.h"
+#include "Log.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TEXTURE_MIPS_SSE 1
+#include <emmintrin.h>
+#else
+#define TEXTURE_MIPS_SSE 0
+#endif
+
+namespace
+{
+	constexpr float KaiserAlpha = 4.0f;
+	constexpr float KaiserRadius = 3.0f;	// in destination texels
+
+	// Below this many destination pixels a level isn't worth splitting over the pool
+	constexpr uint32_t MinParallelPixels = 128 * 128;
+	constexpr uint32_t RowsPerTask = 8;
+
+	/**
+	* Source texels and weights of every destination texel along one axis, NumTaps per texel. Taps past the edge are clamped.
+	*/
+	struct FilterTaps
+	{
+		uint32_t NumTaps = 0;
+		std::vector<uint32_t> Indices;
+		std::vector<float> Weights;
+	};
+
+	float Sinc(float X)
+	{
+		if (fabsf(X) < 1e-5f)
+			return 1.0f;
+
+		float PiX = 3.14159265f * X;
+		return sinf(PiX) / PiX;
+	}
+
+	// Modified Bessel function of the first kind, order 0
+	float BesselI0(float X)
+	{
+		float Sum = 1.0f;
+		float Term = 1.0f;
+		for (int k = 1; k < 32; k++)
+		{
+			float Half = X / (2.0f * k);
+			Term *= Half * Half;
+			Sum += Term;
+			if (Term < Sum * 1e-7f)
+				break;
+		}
+		return Sum;
+	}
+
+	float Kaiser(float X)
+	{
+		float T = X / KaiserRadius;
+		if (T * T >= 1.0f)
+			return 0.0f;
+
+		return Sinc(X) * BesselI0(KaiserAlpha * sqrtf(1.0f - T * T)) / BesselI0(KaiserAlpha);
+	}
+
+	FilterTaps BuildTaps(uint32_t SrcSize, uint32_t DstSize, TextureMips::MipFilter Filter)
+	{
+		FilterTaps Taps;
+		float Scale = static_cast<float>(SrcSize) / DstSize;
+		float Radius = Filter == TextureMips::MipFilter::Box ? Scale * 0.5f : KaiserRadius * Math::max(Scale, 1.0f);
+
+		Taps.NumTaps = static_cast<uint32_t>(ceilf(Radius * 2.0f)) + 1;
+		Taps.Indices.resize(static_cast<size_t>(DstSize) * Taps.NumTaps, 0);
+		Taps.Weights.resize(static_cast<size_t>(DstSize) * Taps.NumTaps, 0.0f);
+
+		for (uint32_t i = 0; i < DstSize; i++)
+		{
+			float Center = (i + 0.5f) * Scale;
+			int First = static_cast<int>(floorf(Center - Radius));
+
+			uint32_t* Indices = &Taps.Indices[static_cast<size_t>(i) * Taps.NumTaps];
+			float* Weights = &Taps.Weights[static_cast<size_t>(i) * Taps.NumTaps];
+
+			float Total = 0.0f;
+			for (uint32_t k = 0; k < Taps.NumTaps; k++)
+			{
+				int Texel = First + static_cast<int>(k);
+				float Weight = 0.0f;
+
+				if (Filter == TextureMips::MipFilter::Box)
+				{
+					// Coverage of the texel by the footprint, odd sizes get a third texel at partial weight
+					float Low = Math::max(static_cast<float>(Texel), Center - Radius);
+					float High = Math::min(static_cast<float>(Texel + 1), Center + Radius);
+					Weight = Math::max(High - Low, 0.0f);
+				}
+				else
+				{
+					Weight = Kaiser((Texel + 0.5f - Center) / Math::max(Scale, 1.0f));
+				}
+
+				Indices[k] = static_cast<uint32_t>(Math::min(Math::max(Texel, 0), static_cast<int>(SrcSize) - 1));
+				Weights[k] = Weight;
+				Total += Weight;
+			}
+
+			for (uint32_t k = 0; k < Taps.NumTaps; k++)
+				Weights[k] /= Total;
+		}
+
+		return Taps;
+	}
+
+	struct ColorTables
+	{
+		float ToLinear[256];
+		uint8_t ToSRGB[65536];
+
+		ColorTables()
+		{
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				float C = i / 255.0f;
+				ToLinear[i] = C <= 0.04045f ? C / 12.92f : powf((C + 0.055f) / 1.055f, 2.4f);
+			}
+
+			for (uint32_t i = 0; i < 65536; i++)
+			{
+				float L = i / 65535.0f;
+				float C = L <= 0.0031308f ? L * 12.92f : 1.055f * powf(L, 1.0f / 2.4f) - 0.055f;
+				ToSRGB[i] = static_cast<uint8_t>(Math::min(Math::max(C * 255.0f + 0.5f, 0.0f), 255.0f));
+			}
+		}
+	};
+
+	const ColorTables& GetColorTables()
+	{
+		static const ColorTables Tables;
+		return Tables;
+	}
+
+#if TEXTURE_MIPS_SSE
+	typedef __m128 Float4;
+
+	inline Float4 Zero4() { return _mm_setzero_ps(); }
+	inline Float4 MulAdd4(Float4 Acc, Float4 V, float W) { return _mm_add_ps(Acc, _mm_mul_ps(V, _mm_set1_ps(W))); }
+
+	inline Float4 LoadUNorm(const uint8_t* Pixel)
+	{
+		int Packed;
+		memcpy(&Packed, Pixel, 4);
+
+		__m128i Zero = _mm_setzero_si128();
+		__m128i Words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(Packed), Zero);
+		return _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(Words, Zero)), _mm_set1_ps(1.0f / 255.0f));
+	}
+
+	inline Float4 LoadSRGB(const uint8_t* Pixel, const ColorTables& Tables)
+	{
+		return _mm_setr_ps(Tables.ToLinear[Pixel[0]], Tables.ToLinear[Pixel[1]], Tables.ToLinear[Pixel[2]], Pixel[3] / 255.0f);
+	}
+
+	inline void StoreUNorm(Float4 V, uint8_t* Pixel)
+	{
+		__m128 Scaled = _mm_add_ps(_mm_mul_ps(V, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f));
+		__m128i Ints = _mm_cvttps_epi32(_mm_max_ps(Scaled, _mm_setzero_ps()));
+		__m128i Bytes = _mm_packus_epi16(_mm_packs_epi32(Ints, Ints), _mm_setzero_si128());
+
+		int Packed = _mm_cvtsi128_si32(Bytes);
+		memcpy(Pixel, &Packed, 4);
+	}
+
+	inline void StoreSRGB(Float4 V, uint8_t* Pixel, const ColorTables& Tables)
+	{
+		__m128 Clamped = _mm_min_ps(_mm_max_ps(V, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		__m128 Scaled = _mm_add_ps(_mm_mul_ps(Clamped, _mm_setr_ps(65535.0f, 65535.0f, 65535.0f, 255.0f)), _mm_set1_ps(0.5f));
+
+		alignas(16) int32_t Ints[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(Ints), _mm_cvttps_epi32(Scaled));
+
+		Pixel[0] = Tables.ToSRGB[Ints[0]];
+		Pixel[1] = Tables.ToSRGB[Ints[1]];
+		Pixel[2] = Tables.ToSRGB[Ints[2]];
+		Pixel[3] = static_cast<uint8_t>(Ints[3]);
+	}
+#else
+	struct Float4
+	{
+		float V[4];
+	};
+
+	inline Float4 Zero4() { return Float4{ { 0.0f, 0.0f, 0.0f, 0.0f } }; }
+
+	inline Float4 MulAdd4(Float4 Acc, Float4 V, float W)
+	{
+		for (int c = 0; c < 4; c++)
+			Acc.V[c] += V.V[c] * W;
+		return Acc;
+	}
+
+	inline Float4 LoadUNorm(const uint8_t* Pixel)
+	{
+		return Float4{ { Pixel[0] / 255.0f, Pixel[1] / 255.0f, Pixel[2] / 255.0f, Pixel[3] / 255.0f } };
+	}
+
+	inline Float4 LoadSRGB(const uint8_t* Pixel, const ColorTables& Tables)
+	{
+		return Float4{ { Tables.ToLinear[Pixel[0]], Tables.ToLinear[Pixel[1]], Tables.ToLinear[Pixel[2]], Pixel[3] / 255.0f } };
+	}
+
+	inline void StoreUNorm(Float4 V, uint8_t* Pixel)
+	{
+		for (int c = 0; c < 4; c++)
+			Pixel[c] = static_cast<uint8_t>(Math::min(Math::max(V.V[c] * 255.0f + 0.5f, 0.0f), 255.0f));
+	}
+
+	inline void StoreSRGB(Float4 V, uint8_t* Pixel, const ColorTables& Tables)
+	{
+		for (int c = 0; c < 3; c++)
+			Pixel[c] = Tables.ToSRGB[static_cast<uint32_t>(Math::min(Math::max(V.V[c], 0.0f), 1.0f) * 65535.0f + 0.5f)];
+		Pixel[3] = static_cast<uint8_t>(Math::min(Math::max(V.V[3] * 255.0f + 0.5f, 0.0f), 255.0f));
+	}
+#endif
+
+	/**
+	* Filters destination rows [FirstRow, EndRow). Columns are filtered first into a float row, then that row is filtered across.
+	*/
+	void FilterRows(const uint8_t* Src, uint32_t SrcWidth, uint8_t* Dst, uint32_t DstWidth, const FilterTaps& Horizontal, const FilterTaps& Vertical,
+		bool SRGB, uint32_t FirstRow, uint32_t EndRow)
+	{
+		const ColorTables& Tables = GetColorTables();
+		std::vector<Float4> Row(SrcWidth);
+
+		for (uint32_t y = FirstRow; y < EndRow; y++)
+		{
+			std::fill(Row.begin(), Row.end(), Zero4());
+
+			for (uint32_t k = 0; k < Vertical.NumTaps; k++)
+			{
+				float Weight = Vertical.Weights[static_cast<size_t>(y) * Vertical.NumTaps + k];
+				if (Weight == 0.0f)
+					continue;
+
+				const uint8_t* SrcRow = Src + static_cast<size_t>(Vertical.Indices[static_cast<size_t>(y) * Vertical.NumTaps + k]) * SrcWidth * 4;
+				if (SRGB)
+				{
+					for (uint32_t x = 0; x < SrcWidth; x++)
+						Row[x] = MulAdd4(Row[x], LoadSRGB(SrcRow + x * 4, Tables), Weight);
+				}
+				else
+				{
+					for (uint32_t x = 0; x < SrcWidth; x++)
+						Row[x] = MulAdd4(Row[x], LoadUNorm(SrcRow + x * 4), Weight);
+				}
+			}
+
+			uint8_t* DstRow = Dst + static_cast<size_t>(y) * DstWidth * 4;
+			for (uint32_t x = 0; x < DstWidth; x++)
+			{
+				const uint32_t* Indices = &Horizontal.Indices[static_cast<size_t>(x) * Horizontal.NumTaps];
+				const float* Weights = &Horizontal.Weights[static_cast<size_t>(x) * Horizontal.NumTaps];
+
+				Float4 Sum = Zero4();
+				for (uint32_t k = 0; k < Horizontal.NumTaps; k++)
+					Sum = MulAdd4(Sum, Row[Indices[k]], Weights[k]);
+
+				if (SRGB)
+					StoreSRGB(Sum, DstRow + x * 4, Tables);
+				else
+					StoreUNorm(Sum, DstRow + x * 4);
+			}
+		}
+	}
+
+	void FillMipLayout(TextureInfo& Info, uint32_t NumLevels)
+	{
+		Info.mips.resize(NumLevels);
+
+		size_t Offset = 0;
+		for (uint32_t Level = 0; Level < NumLevels; Level++)
+		{
+			TextureMip& Mip = Info.mips[Level];
+			Mip.width = Math::max(Info.width >> Level, 1);
+			Mip.height = Math::max(Info.height >> Level, 1);
+			Mip.offset = Offset;
+
+			Offset += static_cast<size_t>(Mip.width) * Mip.height * 4;
+		}
+	}
+}
+
+namespace TextureMips
+{
+	uint32_t GetNumMipLevels(uint32_t Width, uint32_t Height)
+	{
+		uint32_t Size = Math::max(Math::max(Width, Height), 1u);
+
+		uint32_t NumLevels = 1;
+		while (Size > 1)
+		{
+			Size >>= 1;
+			NumLevels++;
+		}
+		return NumLevels;
+	}
+
+	size_t GetMipChainSize(uint32_t Width, uint32_t Height, uint32_t NumLevels)
+	{
+		size_t Size = 0;
+		for (uint32_t Level = 0; Level < NumLevels; Level++)
+			Size += static_cast<size_t>(Math::max(Width >> Level, 1u)) * Math::max(Height >> Level, 1u) * 4;
+		return Size;
+	}
+
+	void Downsample(const uint8_t* Src, uint32_t SrcWidth, uint32_t SrcHeight, uint8_t* Dst, uint32_t DstWidth, uint32_t DstHeight, const MipSettings& Settings)
+	{
+		FilterTaps Horizontal = BuildTaps(SrcWidth, DstWidth, Settings.Filter);
+		FilterTaps Vertical = BuildTaps(SrcHeight, DstHeight, Settings.Filter);
+
+		if (DstWidth * DstHeight < MinParallelPixels)
+		{
+			FilterRows(Src, SrcWidth, Dst, DstWidth, Horizontal, Vertical, Settings.SRGB, 0, DstHeight);
+			return;
+		}
+
+		uint32_t NumTasks = (DstHeight + RowsPerTask - 1) / RowsPerTask;
+		ThreadPool::GetGlobal().ParallelFor(NumTasks, [&](uint32_t Task)
+		{
+			uint32_t FirstRow = Task * RowsPerTask;
+			FilterRows(Src, SrcWidth, Dst, DstWidth, Horizontal, Vertical, Settings.SRGB, FirstRow, Math::min(FirstRow + RowsPerTask, DstHeight));
+		});
+	}
+
+	bool GenerateMipChain(TextureInfo& Info, const MipSettings& Settings)
+	{
+		if (!Info.mips.empty())
+			return true;
+
+		if (Info.stride != 4 || Info.width <= 0 || Info.height <= 0 || Info.pixels.Size() < static_cast<size_t>(Info.width) * Info.height * 4)
+		{
+			CORE_WARN("Can't generate mips for a {0}x{1} texture with {2} bytes per pixel", Info.width, Info.height, Info.stride);
+			return false;
+		}
+
+		uint32_t NumLevels = GetNumMipLevels(Info.width, Info.height);
+		if (Settings.MaxLevels > 0)
+			NumLevels = Math::min(NumLevels, Settings.MaxLevels);
+
+		// Level 0 stays where it is, the rest of the chain goes right behind it in the same buffer
+		Info.pixels.Resize(GetMipChainSize(Info.width, Info.height, NumLevels));
+		FillMipLayout(Info, NumLevels);
+
+		UINT8* Pixels = Info.pixels.MutableData();
+		for (uint32_t Level = 1; Level < NumLevels; Level++)
+		{
+			const TextureMip& Parent = Info.mips[Level - 1];
+			const TextureMip& Mip = Info.mips[Level];
+
+			Downsample(Pixels + Parent.offset, Parent.width, Parent.height, Pixels + Mip.offset, Mip.width, Mip.height, Settings);
+		}
+
+		return true;
+	}
+
+	TextureInfo GetMipTail(const TextureInfo& Info, uint32_t FirstLevel)
+	{
+		TextureInfo Tail = Info;
+		if (FirstLevel == 0 || FirstLevel >= Info.mips.size())
+			return Tail;
+
+		Tail.width = Info.mips[FirstLevel].width;
+		Tail.height = Info.mips[FirstLevel].height;
+		Tail.mips.erase(Tail.mips.begin(), Tail.mips.begin() + FirstLevel);
+
+		return Tail;
+	}
+}
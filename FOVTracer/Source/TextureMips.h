@@ -0,0 +1,63 @@
+#pragma once
+
+#include "DX.h"
+
+#include <cstdint>
+
+/**
+* CPU mip chain generation for RGBA8 textures. Levels are filtered straight from the level above with a separable filter
+* whose footprint follows the real size ratio, so odd and non-square sizes are handled without dropping texels.
+*/
+namespace TextureMips
+{
+	/**
+	* Bump whenever the filters change, cached chains built with an older version are ignored.
+	*/
+	constexpr uint32_t Version = 1;
+
+	enum class MipFilter : uint32_t
+	{
+		Box,
+		Kaiser
+	};
+
+	struct MipSettings
+	{
+		MipFilter Filter = MipFilter::Box;
+
+		/**
+		* Filter colour in linear space and convert back, alpha is always filtered as is.
+		*/
+		bool SRGB = false;
+
+		/**
+		* 0 builds the full chain down to 1x1.
+		*/
+		uint32_t MaxLevels = 0;
+	};
+
+	/**
+	* Levels of a full chain down to 1x1, floor(log2(max(Width, Height))) + 1.
+	*/
+	uint32_t GetNumMipLevels(uint32_t Width, uint32_t Height);
+
+	/**
+	* Bytes of a full RGBA8 chain, level 0 included.
+	*/
+	size_t GetMipChainSize(uint32_t Width, uint32_t Height, uint32_t NumLevels);
+
+	/**
+	* Filters a Src level of 4 byte pixels into Dst. Rows are split over the global thread pool.
+	*/
+	void Downsample(const uint8_t* Src, uint32_t SrcWidth, uint32_t SrcHeight, uint8_t* Dst, uint32_t DstWidth, uint32_t DstHeight, const MipSettings& Settings);
+
+	/**
+	* Appends every mip level to Info.pixels in one allocation and fills in Info.mips. Info has to be RGBA8 with only level 0.
+	*/
+	bool GenerateMipChain(TextureInfo& Info, const MipSettings& Settings);
+
+	/**
+	* The chain of Info from FirstLevel down, sharing its pixels. The mip offsets still point into the full chain.
+	*/
+	TextureInfo GetMipTail(const TextureInfo& Info, uint32_t FirstLevel);
+}
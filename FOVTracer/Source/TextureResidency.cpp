@@ -0,0 +1,336 @@
+#include "pch.h"
+#include "TextureResidency.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	const float PI = 3.14159265f;
+
+	// Same constants as ClosestHit.hlsl
+	const float BaseLODBias = 0.35f;
+	const float FoveatedLODBias = 3.0f;
+	const float ConeDistanceOffset = 100.0f;
+
+	/**
+	* Width of the ray cone ClosestHit starts for a ray along Dir, twice the chord to the ray one pixel to the right.
+	*/
+	float GetConeSpread(Vector3f Dir, Vector3f Right, float PixelSize)
+	{
+		Vector3f Neighbour = (Dir + Right * PixelSize).Normalized();
+		return 2.0f * std::sqrt(Math::max(2.0f * (1.0f - Dir.Dot(Neighbour)), 0.0f));
+	}
+
+	/**
+	* Extra LOD the foveated path adds at RadiusPixels from the gaze point, in launch pixels.
+	*/
+	float GetFoveationBias(const FoveationInfo& Info, float RadiusPixels)
+	{
+		if (RadiusPixels <= 1.0f)
+			return 0.0f;
+
+		// L maps the last column of the log-polar buffer to the farthest screen corner, see RayGen
+		float FovealX = Info.FovealCenterX * Info.LaunchWidth;
+		float FovealY = Info.FovealCenterY * Info.LaunchHeight;
+		float CornerX = Math::max(FovealX, Info.LaunchWidth - FovealX);
+		float CornerY = Math::max(FovealY, Info.LaunchHeight - FovealY);
+		float L = std::log(Math::max(std::sqrt(CornerX * CornerX + CornerY * CornerY), 2.0f));
+
+		// kernelFunc of the column a screen radius ends up in is log(r) / L
+		float X = Math::min(std::log(RadiusPixels) / L, 1.0f);
+		float Smooth = X * X * (3.0f - 2.0f * X);
+
+		return FoveatedLODBias * Smooth * Smooth * Smooth;
+	}
+
+	float GetDistance(const Vector3f& Point, const BoundingBox& Bounds)
+	{
+		float DX = Math::max(Math::max(Bounds.Min.X - Point.X, Point.X - Bounds.Max.X), 0.0f);
+		float DY = Math::max(Math::max(Bounds.Min.Y - Point.Y, Point.Y - Bounds.Max.Y), 0.0f);
+		float DZ = Math::max(Math::max(Bounds.Min.Z - Point.Z, Point.Z - Bounds.Max.Z), 0.0f);
+		return std::sqrt(DX * DX + DY * DY + DZ * DZ);
+	}
+
+	uint64_t SumMipBytes(const std::vector<uint64_t>& MipBytes, uint32_t FirstMip)
+	{
+		uint64_t Bytes = 0;
+		for (size_t Mip = FirstMip; Mip < MipBytes.size(); Mip++)
+			Bytes += MipBytes[Mip];
+
+		return Bytes;
+	}
+}
+
+void TextureResidency::AddTexture(const std::string& Key, std::vector<uint64_t> MipBytes, uint32_t MaxTopMip, uint32_t ResidentMip)
+{
+	TextureState& State = Textures[Key];
+	State.MipBytes = std::move(MipBytes);
+	State.MaxTopMip = MaxTopMip;
+	State.ResidentMip = Math::min(ResidentMip, MaxTopMip);
+	State.FramesOverResident = 0;
+}
+
+void TextureResidency::AddObject(const std::string& Key, const BoundingBox& WorldBounds, bool NeedsTopLevel)
+{
+	Objects.push_back({ Key, WorldBounds, NeedsTopLevel });
+
+	// Uploads before the next Update already have to start at level 0
+	if (NeedsTopLevel)
+		NeededMips[Key] = 0;
+}
+
+void TextureResidency::Clear()
+{
+	Textures.clear();
+	NeededMips.clear();
+	Objects.clear();
+	PendingFrames = 0;
+}
+
+std::vector<TextureResidency::ResidencyChange> TextureResidency::Update(const TextureLODView& View)
+{
+	NeededMips.clear();
+	for (const ObjectBounds& Object : Objects)
+	{
+		uint32_t Mip = MaxLOD;
+		if (Object.NeedsTopLevel)
+		{
+			Mip = 0;
+		}
+		else
+		{
+			float LOD = GetMinLOD(View, Object.WorldBounds);
+			if (LOD < static_cast<float>(MaxLOD))
+				Mip = static_cast<uint32_t>(std::floor(Math::max(LOD, 0.0f)));
+		}
+
+		auto Needed = NeededMips.emplace(Object.Key, Mip);
+		if (!Needed.second)
+			Needed.first->second = Math::min(Needed.first->second, Mip);
+	}
+
+	struct Candidate
+	{
+		ResidencyChange Change;
+		uint32_t Deficit = 0;
+	};
+
+	std::vector<Candidate> Upgrades;
+	std::vector<Candidate> Downgrades;
+	for (auto& Texture : Textures)
+	{
+		TextureState& State = Texture.second;
+
+		// A texture no object samples anymore only keeps its coarsest levels
+		auto Needed = NeededMips.find(Texture.first);
+		uint32_t NeededMip = Math::min(Needed != NeededMips.end() ? Needed->second : MaxLOD, State.MaxTopMip);
+
+		if (NeededMip < State.ResidentMip)
+		{
+			State.FramesOverResident = 0;
+			Upgrades.push_back({ { Texture.first, NeededMip }, State.ResidentMip - NeededMip });
+		}
+		else if (NeededMip > State.ResidentMip)
+		{
+			// Drops to the finest level needed while waiting, a texture that came close again shouldn't lose that level
+			State.FinestSinceOverResident = State.FramesOverResident == 0 ? NeededMip : Math::min(State.FinestSinceOverResident, NeededMip);
+			State.FramesOverResident++;
+
+			if (State.FramesOverResident >= Settings.DowngradeDelayFrames)
+				Downgrades.push_back({ { Texture.first, State.FinestSinceOverResident }, State.FinestSinceOverResident - State.ResidentMip });
+		}
+		else
+		{
+			State.FramesOverResident = 0;
+		}
+	}
+
+	// The blurriest textures first, the key keeps the order stable between runs
+	auto ByDeficit = [](const Candidate& A, const Candidate& B)
+	{
+		return A.Deficit != B.Deficit ? A.Deficit > B.Deficit : A.Change.Key < B.Change.Key;
+	};
+	std::sort(Upgrades.begin(), Upgrades.end(), ByDeficit);
+	std::sort(Downgrades.begin(), Downgrades.end(), ByDeficit);
+
+	const size_t NumCandidates = Upgrades.size() + Downgrades.size();
+	if (NumCandidates == 0)
+	{
+		PendingFrames = 0;
+		return {};
+	}
+
+	if (NumCandidates < Settings.MaxChangesPerFrame && ++PendingFrames < Settings.BatchFrames)
+		return {};
+
+	PendingFrames = 0;
+
+	std::vector<ResidencyChange> Changes;
+	for (const std::vector<Candidate>* Candidates : { &Upgrades, &Downgrades })
+	{
+		for (const Candidate& C : *Candidates)
+		{
+			if (Changes.size() >= Settings.MaxChangesPerFrame)
+				break;
+
+			TextureState& State = Textures.at(C.Change.Key);
+			if (C.Change.TopMip < State.ResidentMip)
+				NumUpgrades++;
+			else
+				NumDowngrades++;
+
+			State.ResidentMip = C.Change.TopMip;
+			State.FramesOverResident = 0;
+			Changes.push_back(C.Change);
+		}
+	}
+
+	return Changes;
+}
+
+void TextureResidency::SetResidentMip(const std::string& Key, uint32_t ResidentMip)
+{
+	auto Found = Textures.find(Key);
+	if (Found == Textures.end())
+		return;
+
+	Found->second.ResidentMip = Math::min(ResidentMip, Found->second.MaxTopMip);
+	Found->second.FramesOverResident = 0;
+}
+
+uint32_t TextureResidency::GetNeededMip(const std::string& Key) const
+{
+	auto Found = NeededMips.find(Key);
+	return Found != NeededMips.end() ? Found->second : 0;
+}
+
+uint64_t TextureResidency::GetResidentBytes() const
+{
+	uint64_t Bytes = 0;
+	for (auto const& Texture : Textures)
+		Bytes += SumMipBytes(Texture.second.MipBytes, Texture.second.ResidentMip);
+
+	return Bytes;
+}
+
+uint64_t TextureResidency::GetFullChainBytes() const
+{
+	uint64_t Bytes = 0;
+	for (auto const& Texture : Textures)
+		Bytes += SumMipBytes(Texture.second.MipBytes, 0);
+
+	return Bytes;
+}
+
+void TextureResidency::LogReport() const
+{
+	uint32_t NumAtMip[MaxLOD + 1] = {};
+	for (auto const& Texture : Textures)
+		NumAtMip[Math::min(Texture.second.ResidentMip, MaxLOD)]++;
+
+	CORE_INFO("Albedo residency: {0:.1f} MB resident instead of {1:.1f} MB for the full chains, {2} textures, {3} upgrades, {4} downgrades",
+		GetResidentBytes() / (1024.0 * 1024.0), GetFullChainBytes() / (1024.0 * 1024.0), Textures.size(), NumUpgrades, NumDowngrades);
+
+	for (uint32_t Mip = 0; Mip <= MaxLOD; Mip++)
+	{
+		if (NumAtMip[Mip] > 0)
+			CORE_TRACE("Albedo residency: {0} textures start at mip {1}", NumAtMip[Mip], Mip);
+	}
+}
+
+float TextureResidency::GetMinLOD(const TextureLODView& View, const BoundingBox& Bounds)
+{
+	const FoveationInfo& Info = View.Foveation;
+	Vector3f Forward = View.Forward;
+	Vector3f Right = View.Right;
+	Vector3f Up = View.Up;
+
+	const float Aspect = Info.LaunchWidth / Math::max(Info.LaunchHeight, 1.0f);
+	const float TanHalfFov = std::tan(Info.VerticalFOV * 0.5f * PI / 180.0f);
+	const float PixelSize = 1.0f / Math::max(Math::min(Info.LaunchWidth, Info.LaunchHeight), 1.0f);
+
+	// The cone is narrowest for rays leaning towards the right vector, so take the smallest of the centre and the corners
+	float Spread = GetConeSpread(Forward, Right, PixelSize);
+	for (float SX : { -1.0f, 1.0f })
+	{
+		for (float SY : { -1.0f, 1.0f })
+		{
+			Vector3f Corner = (Forward + Right * (SX * TanHalfFov * Aspect) + Up * (SY * TanHalfFov)).Normalized();
+			Spread = Math::min(Spread, GetConeSpread(Corner, Right, PixelSize));
+		}
+	}
+
+	float Bias = BaseLODBias;
+	if (View.IsDLSSEnabled && !View.IsFoveated)
+		Bias += std::log2(Info.LaunchWidth / Math::max(Info.OutputWidth, 1.0f)) - 1.0f;
+
+	// A bounce can hit anything from any pixel, including the one under the gaze, right in front of its origin
+	if (View.HasSecondaryRays)
+		return Bias + std::log2(Spread * ConeDistanceOffset);
+
+	// Project the corners into launch pixels the way RayGen builds its directions
+	float MinX = std::numeric_limits<float>::max();
+	float MinY = MinX;
+	float MaxX = -MinX;
+	float MaxY = -MinX;
+	uint32_t NumInFront = 0;
+	for (uint32_t i = 0; i < 8; i++)
+	{
+		Vector3f Corner((i & 1) ? Bounds.Max.X : Bounds.Min.X, (i & 2) ? Bounds.Max.Y : Bounds.Min.Y, (i & 4) ? Bounds.Max.Z : Bounds.Min.Z);
+		Vector3f ToCorner = Corner - View.Position;
+
+		float Z = ToCorner.Dot(Forward);
+		if (Z <= 1e-3f)
+			continue;
+
+		NumInFront++;
+		float PX = (ToCorner.Dot(Right) / (Z * TanHalfFov * Aspect) + 1.0f) * 0.5f * Info.LaunchWidth;
+		float PY = (-ToCorner.Dot(Up) / (Z * TanHalfFov) + 1.0f) * 0.5f * Info.LaunchHeight;
+		MinX = Math::min(MinX, PX);
+		MinY = Math::min(MinY, PY);
+		MaxX = Math::max(MaxX, PX);
+		MaxY = Math::max(MaxY, PY);
+	}
+
+	if (NumInFront == 0)
+		return std::numeric_limits<float>::infinity();
+
+	// Bounds reaching behind the camera can cover any pixel
+	float Radius = 0.0f;
+	if (NumInFront == 8)
+	{
+		if (MaxX < 0.0f || MaxY < 0.0f || MinX > Info.LaunchWidth || MinY > Info.LaunchHeight)
+			return std::numeric_limits<float>::infinity();
+
+		float FovealX = Info.FovealCenterX * Info.LaunchWidth;
+		float FovealY = Info.FovealCenterY * Info.LaunchHeight;
+		float DX = Math::max(Math::max(MinX - FovealX, FovealX - MaxX), 0.0f);
+		float DY = Math::max(Math::max(MinY - FovealY, FovealY - MaxY), 0.0f);
+		Radius = std::sqrt(DX * DX + DY * DY);
+	}
+
+	if (View.IsFoveated)
+		Bias += GetFoveationBias(Info, Radius);
+
+	// Facing the camera head on, the shader divides by the cosine and only ever gets coarser
+	return Bias + std::log2(Spread * (GetDistance(View.Position, Bounds) + ConeDistanceOffset));
+}
+
+uint32_t TextureResidency::GetMaxTopMip(uint32_t Width, uint32_t Height, uint32_t NumMips, bool IsBlockCompressed)
+{
+	uint32_t TopMip = 0;
+	while (TopMip + 1 < NumMips && TopMip + 1 <= MaxLOD)
+	{
+		uint32_t MipWidth = Math::max(Width >> (TopMip + 1), 1u);
+		uint32_t MipHeight = Math::max(Height >> (TopMip + 1), 1u);
+		if (IsBlockCompressed && (MipWidth % 4 != 0 || MipHeight % 4 != 0))
+			break;
+
+		TopMip++;
+	}
+
+	return TopMip;
+}
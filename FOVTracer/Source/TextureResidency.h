@@ -0,0 +1,146 @@
+#pragma once
+
+#include "BVH.h"
+#include "MeshLOD.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+/**
+* What the texture LOD in ClosestHit.hlsl depends on for one frame. Launch size, gaze and kernel come from the FoveationInfo,
+* the camera basis matches the view matrix Update_View_CB builds.
+*/
+struct TextureLODView
+{
+	FoveationInfo Foveation;
+
+	Vector3f Position;
+	Vector3f Forward = Vector3f(0.0f, 0.0f, 1.0f);
+	Vector3f Right = Vector3f(1.0f, 0.0f, 0.0f);
+	Vector3f Up = Vector3f(0.0f, 1.0f, 0.0f);
+
+	bool IsFoveated = false;
+	bool IsDLSSEnabled = false;
+
+	/**
+	* Reflections, refractions and indirect rays can hit any object from any pixel at any distance.
+	*/
+	bool HasSecondaryRays = false;
+};
+
+/**
+* Decides which mips of each albedo texture have to be on the GPU. Every frame the finest LOD any primary hit on an object
+* could sample is estimated on the CPU from the distance to its bounds and their eccentricity from the gaze point, the same
+* terms the shader uses. Finer levels than that are left out. Textures that need finer levels get them right away, textures
+* that need fewer keep theirs until they haven't needed them for a while, so a gaze moving back and forth doesn't re-upload.
+*/
+class TextureResidency
+{
+public:
+	struct ResidencySettings
+	{
+		/**
+		* Frames a texture has to need fewer mips before its finer levels are dropped.
+		*/
+		uint32_t DowngradeDelayFrames = 60;
+
+		/**
+		* Textures whose resident levels change per batch, textures that need finer levels go first.
+		*/
+		uint32_t MaxChangesPerFrame = 8;
+
+		/**
+		* Frames pending changes are held back to go out together, every batch stalls on the GPU once. A full batch goes
+		* right away.
+		*/
+		uint32_t BatchFrames = 4;
+	};
+
+	struct ResidencyChange
+	{
+		std::string Key;
+		uint32_t TopMip = 0;
+	};
+
+	/**
+	* The shader clamps its LOD to this.
+	*/
+	static constexpr uint32_t MaxLOD = 9;
+
+	void SetSettings(const ResidencySettings& InSettings) { Settings = InSettings; }
+
+	/**
+	* Registers an uploaded texture with the bytes of each of its levels and the level its resource starts at.
+	*/
+	void AddTexture(const std::string& Key, std::vector<uint64_t> MipBytes, uint32_t MaxTopMip, uint32_t ResidentMip);
+
+	/**
+	* An object sampling the texture Key, with its bounds in world space. NeedsTopLevel keeps level 0 for objects whose any hit
+	* shader loads texels of the top level directly, from now on.
+	*/
+	void AddObject(const std::string& Key, const BoundingBox& WorldBounds, bool NeedsTopLevel = false);
+
+	void Clear();
+
+	/**
+	* Estimates the needed levels for View and returns the textures whose resource should start at another level now, empty
+	* while a batch is still being collected. The changes count as applied, call SetResidentMip if one couldn't be.
+	*/
+	std::vector<ResidencyChange> Update(const TextureLODView& View);
+
+	void SetResidentMip(const std::string& Key, uint32_t ResidentMip);
+
+	/**
+	* Finest level the texture needed in the last Update, for textures that aren't uploaded yet as well. 0 before the first Update.
+	*/
+	uint32_t GetNeededMip(const std::string& Key) const;
+
+	uint64_t GetResidentBytes() const;
+	uint64_t GetFullChainBytes() const;
+	uint32_t GetNumUpgrades() const { return NumUpgrades; }
+	uint32_t GetNumDowngrades() const { return NumDowngrades; }
+
+	/**
+	* Logs the resident bytes against the full chains and the number of textures at each top level.
+	*/
+	void LogReport() const;
+
+	/**
+	* Lowest LOD ClosestHit can compute for a primary hit inside Bounds, infinite if Bounds is outside the view.
+	*/
+	static float GetMinLOD(const TextureLODView& View, const BoundingBox& Bounds);
+
+	/**
+	* Coarsest level a resource can start at. Block compressed top levels have to stay a multiple of 4 texels.
+	*/
+	static uint32_t GetMaxTopMip(uint32_t Width, uint32_t Height, uint32_t NumMips, bool IsBlockCompressed);
+
+private:
+	struct TextureState
+	{
+		std::vector<uint64_t> MipBytes;
+		uint32_t MaxTopMip = 0;
+		uint32_t ResidentMip = 0;
+		uint32_t FramesOverResident = 0;
+		uint32_t FinestSinceOverResident = 0;
+	};
+
+	struct ObjectBounds
+	{
+		std::string Key;
+		BoundingBox WorldBounds;
+		bool NeedsTopLevel = false;
+	};
+
+	ResidencySettings Settings;
+
+	std::unordered_map<std::string, TextureState> Textures;
+	std::unordered_map<std::string, uint32_t> NeededMips;
+	std::vector<ObjectBounds> Objects;
+
+	uint32_t PendingFrames = 0;
+	uint32_t NumUpgrades = 0;
+	uint32_t NumDowngrades = 0;
+};
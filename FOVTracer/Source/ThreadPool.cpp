@@ -0,0 +1,117 @@
+#include "pch.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t NumThreads)
+{
+	if (NumThreads == 0)
+		NumThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	Workers.reserve(NumThreads);
+	for (uint32_t i = 0; i < NumThreads; i++)
+		Workers.emplace_back([this]() { WorkerLoop(); });
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> Lock(QueueMutex);
+		IsStopping = true;
+	}
+
+	QueueCondition.notify_all();
+
+	for (std::thread& Worker : Workers)
+		Worker.join();
+}
+
+ThreadPool& ThreadPool::GetGlobal()
+{
+	static ThreadPool Instance;
+	return Instance;
+}
+
+void ThreadPool::Enqueue(std::function<void()> Task)
+{
+	{
+		std::lock_guard<std::mutex> Lock(QueueMutex);
+		Tasks.push_back(std::move(Task));
+	}
+
+	QueueCondition.notify_one();
+}
+
+void ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> Task;
+
+		{
+			std::unique_lock<std::mutex> Lock(QueueMutex);
+			QueueCondition.wait(Lock, [this]() { return IsStopping || !Tasks.empty(); });
+
+			if (IsStopping && Tasks.empty())
+				return;
+
+			Task = std::move(Tasks.front());
+			Tasks.pop_front();
+		}
+
+		Task();
+	}
+}
+
+void ThreadPool::ParallelFor(uint32_t Count, const std::function<void(uint32_t)>& Body)
+{
+	if (Count == 0)
+		return;
+
+	if (Count == 1)
+	{
+		Body(0);
+		return;
+	}
+
+	// Shared so that helpers which only get scheduled after we returned still have valid state to look at
+	struct ForState
+	{
+		std::function<void(uint32_t)> Body;
+		std::atomic<uint32_t> NextIndex{ 0 };
+		std::atomic<uint32_t> NumCompleted{ 0 };
+		uint32_t Count = 0;
+
+		std::mutex DoneMutex;
+		std::condition_variable DoneCondition;
+
+		void Run()
+		{
+			uint32_t Index;
+			while ((Index = NextIndex.fetch_add(1)) < Count)
+			{
+				Body(Index);
+
+				if (NumCompleted.fetch_add(1) + 1 == Count)
+				{
+					std::lock_guard<std::mutex> Lock(DoneMutex);
+					DoneCondition.notify_all();
+				}
+			}
+		}
+	};
+
+	auto State = std::make_shared<ForState>();
+	State->Body = Body;
+	State->Count = Count;
+
+	uint32_t NumHelpers = std::min(Count - 1, GetNumThreads());
+	for (uint32_t i = 0; i < NumHelpers; i++)
+		Enqueue([State]() { State->Run(); });
+
+	State->Run();
+
+	std::unique_lock<std::mutex> Lock(State->DoneMutex);
+	State->DoneCondition.wait(Lock, [&State]() { return State->NumCompleted.load() == State->Count; });
+}
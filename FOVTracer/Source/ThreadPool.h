@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+/**
+* Fixed size pool of worker threads used for load time work.
+*/
+class ThreadPool
+{
+public:
+	/**
+	* NumThreads = 0 uses one worker per hardware thread.
+	*/
+	explicit ThreadPool(uint32_t NumThreads = 0);
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	~ThreadPool();
+
+	/**
+	* Queues a task and returns a future for its result.
+	*/
+	template<class Func>
+	auto Submit(Func&& Task) -> std::future<decltype(Task())>
+	{
+		using ResultType = decltype(Task());
+
+		auto Packaged = std::make_shared<std::packaged_task<ResultType()>>(std::forward<Func>(Task));
+		std::future<ResultType> Result = Packaged->get_future();
+
+		Enqueue([Packaged]() { (*Packaged)(); });
+
+		return Result;
+	}
+
+	/**
+	* Runs Body(i) for every i in [0, Count) and blocks until all calls are done.
+	* The calling thread takes part in the work, so it is safe to call from inside a pool task.
+	*/
+	void ParallelFor(uint32_t Count, const std::function<void(uint32_t)>& Body);
+
+	uint32_t GetNumThreads() const { return static_cast<uint32_t>(Workers.size()); }
+
+	/**
+	* Shared pool for the whole application.
+	*/
+	static ThreadPool& GetGlobal();
+
+private:
+	void Enqueue(std::function<void()> Task);
+	void WorkerLoop();
+
+	std::vector<std::thread> Workers;
+	std::deque<std::function<void()>> Tasks;
+
+	std::mutex QueueMutex;
+	std::condition_variable QueueCondition;
+	bool IsStopping = false;
+};
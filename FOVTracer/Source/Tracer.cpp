@@ -2,15 +2,20 @@
 #include "Tracer.h"
 #include "Log.h"
 #include "Utils.h"
+#include "TextureFormat.h"
 #include "Application.h"
 
 #include <iomanip>
 #include <ctime>
 #include <sstream>
+#include <unordered_set>
 
 
 #define APP_ID 231313132
 
+// Streamed textures uploaded per frame, every upload waits for its mip generation on the GPU
+static const uint32_t MaxTextureUploadsPerFrame = 8;
+
 
 void Tracer::Init(TracerConfigInfo& config, HWND& window, Scene& scene) 
 {
@@ -43,10 +48,41 @@ void Tracer::Init(TracerConfigInfo& config, HWND& window, Scene& scene)
 
 	D3DResources::Create_Query_Heap(D3D, Resources);
 
+	StreamTextures = config.StreamTextures;
+	UseTextureResidency = config.FoveatedTextureResidency;
+	HostResidency::GetGlobal().SetBudget(config.HostMemoryBudget);
+	if (StreamTextures)
+	{
+		Utils::SFallbackTexture* Fallback = Utils::GetFallbackTexture();
+		FallbackTexture.textureInfo.width = Fallback->width;
+		FallbackTexture.textureInfo.height = Fallback->height;
+		FallbackTexture.textureInfo.stride = Fallback->stride;
+		FallbackTexture.textureInfo.pixels = ImageBuffer(nullptr, Fallback->texture, static_cast<size_t>(Fallback->width) * Fallback->height * Fallback->stride);
+
+		TextureMips::GenerateMipChain(FallbackTexture.textureInfo, TextureMips::MipSettings());
+		D3DResources::Create_Texture(D3D, FallbackTexture, FallbackTexture.textureInfo);
+
+		// Every pending texture is a copy of this, only the size is needed after the upload
+		FallbackTexture.textureInfo.pixels.Reset();
+	}
+
+	// Every decode starts up front so the pool works through them while the objects below wait for their own
+	if (!StreamTextures)
+	{
+		for (const SceneObject& SceneObj : scene.SceneObjects)
+			PrefetchTextures(SceneObj.Mesh);
+	}
+	const std::string BlueNoisePath = Utils::GetResourcePath(DX12Constants::blue_noise_tex_path);
+	Resources.blueNoiseTexKey = TextureCache::GetKey(BlueNoisePath, TextureFormat::TextureUsage::Noise);
+	TextureDecodes.Request(BlueNoisePath, TextureFormat::TextureUsage::Noise);
+
 	for (int i = 0; i < scene.SceneObjects.size(); i++)
 		AddObject(scene.SceneObjects[i], i);
 
-	LoadTexture(Utils::GetResourcePath(DX12Constants::blue_noise_tex_path));
+	SceneGeneration = scene.GetGeneration();
+
+	LoadTexture(BlueNoisePath, TextureFormat::TextureUsage::Noise);
+	LogTextureMemory();
 
 	D3DResources::Create_UIHeap(D3D, Resources);
 
@@ -54,7 +90,10 @@ void Tracer::Init(TracerConfigInfo& config, HWND& window, Scene& scene)
 	D3DResources::Create_ReadBackResources(D3D, Resources);
 
 	DXR::Create_Bottom_Level_AS(D3D, DXR, Resources, scene);
-	DXR::Create_Top_Level_AS(D3D, DXR, Resources);
+	DXR::Create_Top_Level_AS(D3D, DXR, Resources, scene);
+
+	ReleaseHostMeshes(scene);
+	HostResidency::GetGlobal().LogReport();
 
 	InitRenderPipeline(scene);
 	InitImGUI();
@@ -69,6 +108,8 @@ void Tracer::Update(Scene& scene, TracerParameters& params, ComputeParams& cPara
 		return;
 	}
 
+	StreamUpdate(scene);
+
 	//cParams.lastJitterOffset = DirectX::XMFLOAT2(DLSSConfigInfo.JitterOffset.X, DLSSConfigInfo.JitterOffset.Y);
 
 	if (DLSSConfigInfo.ShouldUseDLSS || !cParams.disableTAA)
@@ -93,6 +134,8 @@ void Tracer::Update(Scene& scene, TracerParameters& params, ComputeParams& cPara
 	params.viewportRatio = 1920  / D3D.Width;
 	params.isDLSSEnabled = DLSSConfigInfo.ShouldUseDLSS;
 
+	UpdateTextureResidency(scene, params);
+
 	//cParams.currentBufferIndex = params.outBufferIndex;
 	cParams.resoltion = DirectX::XMFLOAT2(D3D.Width, D3D.Height);
 	cParams.jitterOffset = DirectX::XMFLOAT2(DLSSConfigInfo.JitterOffset.X, DLSSConfigInfo.JitterOffset.Y);
@@ -308,6 +351,12 @@ float Tracer::Render(bool scrshotRequested, uint32_t groundTruthSqrtSpp, bool di
 
 void Tracer::Cleanup()
 {
+	TextureDecodes.Clear();
+	AlbedoResidency.Clear();
+
+	for (auto const& Texture : Resources.Textures)
+		HostResidency::GetGlobal().Remove(Texture.first);
+
 	NVSDK_NGX_D3D12_DestroyParameters(DLSSConfigInfo.Params);
 	D3D12::WaitForGPU(D3D);
 	CloseHandle(D3D.FenceEvent);
@@ -322,44 +371,480 @@ void Tracer::AddObject(SceneObject& SceneObj, uint32_t Index)
 {
 	Resources.sceneObjResources.emplace_back();
 
-	Resources.sceneObjResources[Index].diffuseTexKey = SceneObj.Mesh.MeshMaterial.TexturePath;
-	Resources.sceneObjResources[Index].normalTexKey = SceneObj.Mesh.MeshMaterial.NormalMapPath;
+	Resources.sceneObjResources[Index].diffuseTexKey = TextureCache::GetKey(SceneObj.Mesh.MeshMaterial.TexturePath, TextureFormat::TextureUsage::Albedo);
+	Resources.sceneObjResources[Index].normalTexKey = TextureCache::GetKey(SceneObj.Mesh.MeshMaterial.NormalMapPath, TextureFormat::TextureUsage::Normal);
 
-	D3DResources::Create_Vertex_Buffer(D3D, Resources, SceneObj, Index);
-	D3DResources::Create_Index_Buffer(D3D, Resources, SceneObj, Index);
+	// Instances of an already uploaded mesh reuse its buffers
+	auto const Owner = Resources.meshBufferOwners.find(SceneObj.Mesh.Vertices.data());
+	if (Owner != Resources.meshBufferOwners.end())
+	{
+		const SceneObjectResource& OwnerResources = Resources.sceneObjResources[Owner->second];
+		SceneObjectResource& ObjResources = Resources.sceneObjResources[Index];
+
+		ObjResources.vertexBuffer = OwnerResources.vertexBuffer;
+		ObjResources.vertexBufferView = OwnerResources.vertexBufferView;
+		ObjResources.indexBuffer = OwnerResources.indexBuffer;
+		ObjResources.indexBufferView = OwnerResources.indexBufferView;
+		ObjResources.vertexBuffer->AddRef();
+		ObjResources.indexBuffer->AddRef();
+	}
+	else
+	{
+		D3DResources::Create_Vertex_Buffer(D3D, Resources, SceneObj, Index);
+		D3DResources::Create_Index_Buffer(D3D, Resources, SceneObj, Index);
+		Resources.meshBufferOwners.emplace(SceneObj.Mesh.Vertices.data(), Index);
+	}
 
-	TextureResource DiffuseTexRes = LoadTexture(SceneObj.Mesh.MeshMaterial.TexturePath);
+	const Material& Mat = SceneObj.Mesh.MeshMaterial;
+
+	TextureResource DiffuseTexRes = StreamTextures ? RequestTexture(Mat.TexturePath) : LoadTexture(Mat.TexturePath);
 	SceneObj.Mesh.MeshMaterial.TextureResolution = Vector2f(static_cast<float>(DiffuseTexRes.textureInfo.width), static_cast<float>(DiffuseTexRes.textureInfo.height));
 
-	LoadTexture(SceneObj.Mesh.MeshMaterial.NormalMapPath);
+	// Bounds are taken now, the mesh data may be dropped once the objects are uploaded
+	if (!Mat.TexturePath.empty())
+	{
+		BoundingBox LocalBounds;
+		if (SceneObj.Mesh.Vertices.data() != nullptr)
+		{
+			for (const Vertex& V : SceneObj.Mesh.Vertices)
+				LocalBounds.Grow(V.Position);
+		}
+
+		BoundingBox WorldBounds;
+		for (uint32_t i = 0; i < 8; i++)
+		{
+			Vector3f Corner((i & 1) ? LocalBounds.Max.X : LocalBounds.Min.X, (i & 2) ? LocalBounds.Max.Y : LocalBounds.Min.Y, (i & 4) ? LocalBounds.Max.Z : LocalBounds.Min.Z);
+			WorldBounds.Grow(SceneObj.ObjectToWorld.TransformPoint(Corner));
+		}
+
+		// AlphaAnyHit loads albedo texels of level 0 directly, and an instance of an already dropped mesh has no bounds to go by
+		bool NeedsTopLevel = SceneObj.Mesh.HasTransparency || !LocalBounds.IsValid();
+		AlbedoResidency.AddObject(Resources.sceneObjResources[Index].diffuseTexKey, WorldBounds, NeedsTopLevel);
+	}
+
+	if (StreamTextures)
+		RequestTexture(Mat.NormalMapPath, TextureFormat::TextureUsage::Normal);
+	else
+		LoadTexture(Mat.NormalMapPath, TextureFormat::TextureUsage::Normal);
 
 	if (SceneObj.Mesh.HasTransparency)
 	{
 		//CORE_ERROR("Mesh has transparency!");
-		Resources.sceneObjResources[Index].opacityTexKey = SceneObj.Mesh.MeshMaterial.OpacityMapPath;
-		LoadTexture(SceneObj.Mesh.MeshMaterial.OpacityMapPath);
+		Resources.sceneObjResources[Index].opacityTexKey = TextureCache::GetKey(SceneObj.Mesh.MeshMaterial.OpacityMapPath, TextureFormat::TextureUsage::Opacity);
+
+		if (StreamTextures)
+			RequestTexture(Mat.OpacityMapPath, TextureFormat::TextureUsage::Opacity);
+		else
+			LoadTexture(Mat.OpacityMapPath, TextureFormat::TextureUsage::Opacity);
 	}
 
 	D3DResources::Create_Material_CB(D3D, Resources, SceneObj.Mesh.MeshMaterial, Index);
 }
 
-TextureResource Tracer::LoadTexture(std::string TextureName, bool GenMips)
+const TextureInfo* Tracer::LockHostTexture(const std::string& Key)
+{
+	if (Resources.Textures.count(Key) == 0 || !HostResidency::GetGlobal().Lock(Key))
+		return nullptr;
+
+	return &Resources.Textures.at(Key).textureInfo;
+}
+
+void Tracer::UnlockHostTexture(const std::string& Key)
+{
+	HostResidency::GetGlobal().Unlock(Key);
+}
+
+void Tracer::ReleaseHostTexture(const std::string& Key, const std::string& Path, TextureFormat::TextureUsage Usage)
+{
+	auto Release = [this, Key]()
+	{
+		Resources.Textures.at(Key).textureInfo.pixels.Reset();
+	};
+
+	// Usually mapped straight back in from the disk cache, the texel layout has to match what was uploaded
+	auto Reload = [this, Key, Path, Usage]() -> uint64_t
+	{
+		TextureInfo& Info = Resources.Textures.at(Key).textureInfo;
+		const TextureInfo& Decoded = TextureDecodes.Request(Path, Usage).Get();
+
+		uint64_t Bytes = 0;
+		if (Decoded.format == Info.format && Decoded.width == Info.width && Decoded.height == Info.height && Decoded.mips.size() == Info.mips.size())
+		{
+			Info.pixels = Decoded.pixels;
+			Bytes = Info.pixels.Size();
+		}
+		else
+		{
+			CORE_ERROR("{0} changed since it was uploaded, its CPU copy can't be reloaded", Path);
+		}
+
+		TextureDecodes.Release(Path, Usage);
+		return Bytes;
+	};
+
+	HostResidency::GetGlobal().Add(Key, HostMemoryCategory::Textures, Resources.Textures.at(Key).textureInfo.pixels.Size(), Release, Reload);
+	HostResidency::GetGlobal().Release(Key);
+}
+
+void Tracer::ReleaseHostMeshes(Scene& scene)
+{
+	scene.ReleaseHostMeshes();
+
+	// Dropped meshes don't point at their old data anymore, a later load could get the same address and match the wrong buffers
+	for (auto It = Resources.meshBufferOwners.begin(); It != Resources.meshBufferOwners.end();)
+	{
+		if (scene.SceneObjects[It->second].Mesh.Vertices.data() != It->first)
+			It = Resources.meshBufferOwners.erase(It);
+		else
+			++It;
+	}
+}
+
+void Tracer::AddAlbedoResidency(const std::string& Key, const TextureInfo& Info, uint32_t ResidentMip)
+{
+	// Chains built on the GPU by Generate_Mips have no CPU copy to recreate them from, they stay whole
+	uint32_t MaxTopMip = 0;
+	if (UseTextureResidency && !Info.mips.empty())
+		MaxTopMip = TextureResidency::GetMaxTopMip(Info.width, Info.height, static_cast<uint32_t>(Info.mips.size()), TextureFormat::IsBlockCompressed(Info.format));
+
+	std::vector<uint64_t> MipBytes;
+	for (const TextureMip& Mip : Info.mips)
+		MipBytes.push_back(TextureFormat::GetSurfaceSize(Info.format, Mip.width, Mip.height));
+
+	if (MipBytes.empty())
+		MipBytes.push_back(TextureFormat::GetSurfaceSize(Info.format, Info.width, Info.height));
+
+	AlbedoResidency.AddTexture(Key, std::move(MipBytes), MaxTopMip, ResidentMip);
+}
+
+void Tracer::UpdateTextureResidency(Scene& scene, const TracerParameters& params)
+{
+	if (!UseTextureResidency)
+		return;
+
+	Camera& Cam = scene.SceneCamera;
+
+	// Same basis as the view matrix Update_View_CB builds
+	TextureLODView View;
+	View.Position = Cam.Position;
+	View.Forward = Cam.GetForward();
+	View.Right = Cam.GetUpVector().Cross(View.Forward).Normalized();
+	View.Up = View.Forward.Cross(View.Right);
+	View.IsFoveated = params.isFoveatedRenderingEnabled != 0;
+	View.IsDLSSEnabled = params.isDLSSEnabled != 0;
+	View.HasSecondaryRays = params.recursionDepth > 1 || params.useIndirectIllum != 0;
+
+	View.Foveation.LaunchWidth = static_cast<float>(D3D.Width);
+	View.Foveation.LaunchHeight = static_cast<float>(D3D.Height);
+	View.Foveation.OutputWidth = static_cast<float>(TargetRes.Width);
+	View.Foveation.OutputHeight = static_cast<float>(TargetRes.Height);
+	View.Foveation.FovealCenterX = params.fovealCenter.x;
+	View.Foveation.FovealCenterY = params.fovealCenter.y;
+	View.Foveation.KernelAlpha = params.kernelAlpha;
+	View.Foveation.VerticalFOV = Cam.FOV;
+
+	std::vector<TextureResidency::ResidencyChange> Changes = AlbedoResidency.Update(View);
+	if (Changes.empty())
+		return;
+
+	// The old resources and the material constants are still in use by the frames in flight
+	D3D12::WaitForGPU(D3D);
+
+	// Only the albedo SRVs of the objects using a moved texture point at a released resource
+	std::vector<uint32_t> MovedObjects;
+	for (const TextureResidency::ResidencyChange& Change : Changes)
+	{
+		if (SetAlbedoTopMip(Change.Key, Change.TopMip, MovedObjects))
+			continue;
+
+		// The old resource stays, it holds the chain from its first level down
+		const TextureResource& Resident = Resources.Textures.at(Change.Key);
+		AlbedoResidency.SetResidentMip(Change.Key, static_cast<uint32_t>(Resident.textureInfo.mips.size()) - Resident.resourceDesc.MipLevels);
+	}
+
+	DXR::Update_Diffuse_Descriptors(D3D, Resources, MovedObjects);
+
+	CORE_TRACE("Moved {0} albedo textures, {1:.1f} MB of {2:.1f} MB resident", Changes.size(), AlbedoResidency.GetResidentBytes() / (1024.0 * 1024.0),
+		AlbedoResidency.GetFullChainBytes() / (1024.0 * 1024.0));
+}
+
+bool Tracer::SetAlbedoTopMip(const std::string& Key, uint32_t TopMip, std::vector<uint32_t>& OutObjects)
 {
-	if (Resources.Textures.count(TextureName) > 0)
-		return Resources.Textures.at(TextureName);
+	const TextureInfo* Full = LockHostTexture(Key);
+	if (Full == nullptr)
+	{
+		CORE_WARN("Couldn't reload {0} to move it to mip {1}", Key, TopMip);
+		return false;
+	}
 
 	TextureResource NewTexture;
+	TextureInfo UploadInfo = TextureMips::GetMipTail(*Full, TopMip);
+	D3DResources::Create_Texture(D3D, NewTexture, UploadInfo);
+	UnlockHostTexture(Key);
+
+	TextureResource& Resident = Resources.Textures.at(Key);
+	SAFE_RELEASE(Resident.texture);
+	SAFE_RELEASE(Resident.textureUploadResource);
+	Resident.texture = NewTexture.texture;
+	Resident.textureUploadResource = NewTexture.textureUploadResource;
+	Resident.resourceDesc = NewTexture.resourceDesc;
+
+	for (uint32_t i = 0; i < Resources.sceneObjResources.size(); i++)
+	{
+		SceneObjectResource& ObjResources = Resources.sceneObjResources[i];
+		if (ObjResources.diffuseTexKey != Key)
+			continue;
+
+		ObjResources.materialCBData.albedoMinMip = TopMip;
+		memcpy(ObjResources.materialCBStart, &ObjResources.materialCBData, sizeof(MaterialCB));
+		OutObjects.push_back(i);
+	}
+
+	return true;
+}
+
+void Tracer::PrefetchTextures(const StaticMesh& Mesh)
+{
+	const Material& Mat = Mesh.MeshMaterial;
+
+	std::string Paths[3] = { Mat.TexturePath, Mat.NormalMapPath, Mesh.HasTransparency ? Mat.OpacityMapPath : std::string() };
+	TextureFormat::TextureUsage Usages[3] = { TextureFormat::TextureUsage::Albedo, TextureFormat::TextureUsage::Normal, TextureFormat::TextureUsage::Opacity };
+	for (uint32_t i = 0; i < 3; i++)
+	{
+		if (!Paths[i].empty() && Resources.Textures.count(TextureCache::GetKey(Paths[i], Usages[i])) == 0)
+			TextureDecodes.Request(Paths[i], Usages[i]);
+	}
+}
+
+TextureResource Tracer::LoadTexture(std::string TextureName, TextureFormat::TextureUsage Usage, bool GenMips)
+{
+	const std::string Key = TextureCache::GetKey(TextureName, Usage);
+	if (Resources.Textures.count(Key) > 0)
+		return Resources.Textures.at(Key);
+
+	TextureResource NewTexture;
+
+	// Only blocks if the decode hasn't finished yet, once uploaded Resources.Textures takes over the deduplication
+	NewTexture.textureInfo = TextureDecodes.Request(TextureName, Usage).Get();
+	TextureDecodes.Release(TextureName, Usage);
 
-	NewTexture.textureInfo = Utils::LoadTexture(TextureName, Resources, 4);
 	D3DResources::Create_Texture(D3D, NewTexture, NewTexture.textureInfo);
 
-	//Generate mipmaps
-	if(GenMips)
+	//Generate mipmaps, the texture cache normally built them on the CPU already
+	if(GenMips && NewTexture.textureInfo.mips.empty())
 		D3DResources::Generate_Mips(NewTexture, D3D, DXCompute);
 
-	Resources.Textures.insert_or_assign(TextureName, NewTexture);
+	const TextureInfo& Uploaded = Resources.Textures.insert_or_assign(Key, std::move(NewTexture)).first->second.textureInfo;
+	if (Usage == TextureFormat::TextureUsage::Albedo)
+		AddAlbedoResidency(Key, Uploaded, 0);
+
+	ReleaseHostTexture(Key, TextureName, Usage);
+
+	return Resources.Textures.at(Key);
+}
+
+TextureResource Tracer::RequestTexture(const std::string& TextureName, TextureFormat::TextureUsage Usage)
+{
+	const std::string Key = TextureCache::GetKey(TextureName, Usage);
+	if (PendingTextures.count(Key) > 0)
+		return FallbackTexture;
+
+	auto const Resident = Resources.Textures.find(Key);
+	if (Resident != Resources.Textures.end())
+		return Resident->second;
+
+	// Nothing to decode, LoadTexture would end up with the fallback as well
+	Resources.Textures.insert_or_assign(Key, FallbackTexture);
+	if (TextureName.empty())
+		return FallbackTexture;
+
+	PendingTextures.emplace(Key, PendingTexture{ TextureName, Usage, TextureDecodes.Request(TextureName, Usage) });
+
+	return FallbackTexture;
+}
+
+void Tracer::StreamUpdate(Scene& scene)
+{
+	// The loader only marks the stream done after its last batch was queued, so the publish of that batch still sees the
+	// scene streaming and keeps the last arena. It goes once the stream is seen to be over.
+	const bool IsSceneStreaming = scene.IsStreaming();
+	const bool HasStreamFinished = WasSceneStreaming && !IsSceneStreaming;
+	WasSceneStreaming = IsSceneStreaming;
+
+	bool HasNewObjects = scene.GetGeneration() != SceneGeneration;
+	bool HasDecodedTextures = false;
+	for (auto const& Pending : PendingTextures)
+	{
+		if (Pending.second.Handle.IsReady())
+		{
+			HasDecodedTextures = true;
+			break;
+		}
+	}
+
+	if (HasStreamFinished && !HasNewObjects)
+		ReleaseHostMeshes(scene);
+
+	if (!HasNewObjects && !HasDecodedTextures)
+		return;
+
+	// Buffers, descriptors and material constants below are still in use by the frames in flight
+	D3D12::WaitForGPU(D3D);
+
+	bool HasNewTextures = UploadDecodedTextures();
+	uint32_t FirstDirtyObject = 0;
+
+	if (HasNewObjects)
+	{
+		if (scene.SceneObjects.size() < Resources.sceneObjResources.size())
+		{
+			CORE_ERROR("Scene lost objects while streaming, {0} uploaded but only {1} left", Resources.sceneObjResources.size(), scene.SceneObjects.size());
+			SceneGeneration = scene.GetGeneration();
+			return;
+		}
+
+		uint32_t FirstNewObject = static_cast<uint32_t>(Resources.sceneObjResources.size());
+		for (uint32_t i = FirstNewObject; i < scene.SceneObjects.size(); i++)
+			AddObject(scene.SceneObjects[i], i);
+
+		// Textures swapped under earlier objects or a moved TLAS invalidate their descriptors too
+		bool TLASMoved = UpdateAccelerationStructures(scene);
+		FirstDirtyObject = (HasNewTextures || TLASMoved) ? 0 : FirstNewObject;
+		SceneGeneration = scene.GetGeneration();
+
+		ReleaseHostMeshes(scene);
+
+		CORE_TRACE("Uploaded {0} streamed objects", scene.SceneObjects.size() - FirstNewObject);
+	}
+
+	if (HasNewObjects || HasNewTextures)
+		UpdateSceneDescriptors(scene, FirstDirtyObject);
+
+	if (!scene.IsStreaming() && PendingTextures.empty())
+		HostResidency::GetGlobal().LogReport();
+}
+
+bool Tracer::UploadDecodedTextures()
+{
+	std::vector<std::pair<std::string, PendingTexture>> Decoded;
+	for (auto const& Pending : PendingTextures)
+	{
+		if (Decoded.size() == MaxTextureUploadsPerFrame)
+			break;
+
+		if (Pending.second.Handle.IsReady())
+			Decoded.push_back(Pending);
+	}
+
+	for (auto& Entry : Decoded)
+	{
+		TextureResource NewTexture;
+		NewTexture.textureInfo = Entry.second.Handle.Get();
+		TextureDecodes.Release(Entry.second.Path, Entry.second.Usage);
+
+		// Albedo mips finer than the current view needs are never uploaded, the CPU copy keeps the full chain for later
+		const bool IsAlbedo = Entry.second.Usage == TextureFormat::TextureUsage::Albedo;
+		uint32_t TopMip = 0;
+		if (IsAlbedo && UseTextureResidency && !NewTexture.textureInfo.mips.empty())
+		{
+			const TextureInfo& Info = NewTexture.textureInfo;
+			TopMip = Math::min(AlbedoResidency.GetNeededMip(Entry.first), TextureResidency::GetMaxTopMip(Info.width, Info.height,
+				static_cast<uint32_t>(Info.mips.size()), TextureFormat::IsBlockCompressed(Info.format)));
+		}
+
+		TextureInfo UploadInfo = TextureMips::GetMipTail(NewTexture.textureInfo, TopMip);
+		D3DResources::Create_Texture(D3D, NewTexture, UploadInfo);
+		if (NewTexture.textureInfo.mips.empty())
+			D3DResources::Generate_Mips(NewTexture, D3D, DXCompute);
+
+		const TextureInfo& Uploaded = Resources.Textures.insert_or_assign(Entry.first, std::move(NewTexture)).first->second.textureInfo;
+		if (IsAlbedo)
+			AddAlbedoResidency(Entry.first, Uploaded, TopMip);
+
+		ReleaseHostTexture(Entry.first, Entry.second.Path, Entry.second.Usage);
+		PendingTextures.erase(Entry.first);
+
+		// Objects were set up with the resolution of the fallback texture
+		for (SceneObjectResource& ObjResources : Resources.sceneObjResources)
+		{
+			if (ObjResources.diffuseTexKey != Entry.first)
+				continue;
+
+			ObjResources.materialCBData.resolution = DirectX::XMFLOAT4(static_cast<float>(Uploaded.width), static_cast<float>(Uploaded.height), 0.f, 0.f);
+			ObjResources.materialCBData.albedoMinMip = TopMip;
+			memcpy(ObjResources.materialCBStart, &ObjResources.materialCBData, sizeof(MaterialCB));
+		}
+	}
+
+	if (!Decoded.empty())
+		CORE_TRACE("Uploaded {0} streamed textures, {1} still pending", Decoded.size(), PendingTextures.size());
+
+	return !Decoded.empty();
+}
+
+bool Tracer::UpdateAccelerationStructures(Scene& scene)
+{
+	// BLASes are only built for meshes that don't have one, the TLAS is rebuilt in place over all instances
+	DXR::Create_Bottom_Level_AS(D3D, DXR, Resources, scene);
+	return DXR::Create_Top_Level_AS(D3D, DXR, Resources, scene);
+}
+
+void Tracer::UpdateSceneDescriptors(Scene& scene, uint32_t FirstObject)
+{
+	// The shader table points into the descriptor heap, a new heap means every record has to be rewritten
+	bool HeapMoved = DXR::Create_Descriptor_Heaps(D3D, DXR, Resources, scene, FirstObject);
+	DXR::Create_Shader_Table(D3D, DXR, Resources, HeapMoved ? 0 : FirstObject);
+}
+
+void Tracer::LogTextureMemory() const
+{
+	struct UsageStats
+	{
+		uint32_t NumTextures = 0;
+		uint32_t NumCompressed = 0;
+		size_t ResidentBytes = 0;
+		size_t UncompressedBytes = 0;
+	};
+
+	const uint32_t NumUsages = static_cast<uint32_t>(TextureFormat::TextureUsage::Count);
+	UsageStats Stats[NumUsages + 1];
+	UsageStats& Total = Stats[NumUsages];
+
+	// Streamed textures that aren't resident yet all share the fallback
+	std::unordered_set<ID3D12Resource*> Counted;
+	for (auto const& Texture : Resources.Textures)
+	{
+		const D3D12_RESOURCE_DESC& Desc = Texture.second.resourceDesc;
+		if (Texture.second.texture == nullptr || Desc.Format == DXGI_FORMAT_UNKNOWN || !Counted.insert(Texture.second.texture).second)
+			continue;
+
+		const uint32_t Width = static_cast<uint32_t>(Desc.Width);
+		const uint32_t Height = Desc.Height;
+
+		size_t ResidentBytes = 0;
+		for (uint32_t Mip = 0; Mip < Desc.MipLevels; Mip++)
+			ResidentBytes += TextureFormat::GetSurfaceSize(Desc.Format, Math::max(Width >> Mip, 1u), Math::max(Height >> Mip, 1u));
+
+		for (UsageStats* UsageStat : { &Stats[static_cast<uint32_t>(Texture.second.textureInfo.usage)], &Total })
+		{
+			UsageStat->NumTextures++;
+			UsageStat->NumCompressed += TextureFormat::IsBlockCompressed(Desc.Format) ? 1 : 0;
+			UsageStat->ResidentBytes += ResidentBytes;
+			UsageStat->UncompressedBytes += TextureMips::GetMipChainSize(Width, Height, Desc.MipLevels);
+		}
+	}
+
+	for (uint32_t Usage = 0; Usage < NumUsages; Usage++)
+	{
+		if (Stats[Usage].NumTextures == 0)
+			continue;
+
+		CORE_INFO("{0} textures: {1}, {2} block compressed, {3:.1f} MB instead of {4:.1f} MB as RGBA8", TextureFormat::GetUsageName(static_cast<TextureFormat::TextureUsage>(Usage)),
+			Stats[Usage].NumTextures, Stats[Usage].NumCompressed, Stats[Usage].ResidentBytes / (1024.0 * 1024.0), Stats[Usage].UncompressedBytes / (1024.0 * 1024.0));
+	}
 
-	return NewTexture;
+	CORE_INFO("Textures: {0} resident, {1} block compressed, {2:.1f} MB instead of {3:.1f} MB as RGBA8", Total.NumTextures, Total.NumCompressed,
+		Total.ResidentBytes / (1024.0 * 1024.0), Total.UncompressedBytes / (1024.0 * 1024.0));
 }
 
 bool Tracer::CheckDLSSIsSupported()
@@ -563,6 +1048,7 @@ void Tracer::PipelineCleanup()
 	SAFE_RELEASE(Resources.Log2CartOutput);
 	//SAFE_RELEASE(Resources.cpuOnlyHeap);
 	SAFE_RELEASE(Resources.descriptorHeap);
+	Resources.descriptorHeapCapacity = 0;
 
 	SAFE_RELEASE(DXR.rgs.blob);
 	SAFE_RELEASE(DXR.rgs.pRootSignature);
@@ -581,6 +1067,7 @@ void Tracer::PipelineCleanup()
 	SAFE_RELEASE(DXR.rtpso);
 	SAFE_RELEASE(DXR.rtpsoInfo);
 	SAFE_RELEASE(DXR.shaderTable);
+	DXR.shaderTableCapacity = 0;
 
 	SAFE_RELEASE(DXCompute.paramCB);
 	SAFE_RELEASE(DXCompute.csProgram);
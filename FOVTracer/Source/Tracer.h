@@ -2,10 +2,15 @@
 
 #include "DX.h"
 #include "Scene.h"
+#include "TextureCache.h"
+#include "HostResidency.h"
+#include "TextureResidency.h"
 #include "dlss/nvsdk_ngx.h"
 #include "dlss/nvsdk_ngx_helpers.h"
 
 #include <string>
+#include <vector>
+#include <unordered_map>
 
 
 struct Resolution
@@ -22,6 +27,15 @@ struct TracerConfigInfo
 	bool Vsync = false;
 	std::string	Model = "";
 	HINSTANCE Instance = NULL;
+
+	// Decode textures in the background and render with the fallback texture until they are resident
+	bool StreamTextures = false;
+
+	// CPU copies of textures and meshes are dropped after upload, copies reloaded later stay around up to this many bytes
+	uint64_t HostMemoryBudget = HostResidency::DefaultBudgetBytes;
+
+	// Only keep the albedo mips the foveated texture LOD can reach on the GPU, see TextureResidency
+	bool FoveatedTextureResidency = true;
 };
 
 class Tracer
@@ -34,6 +48,20 @@ public:
 	void SetResolution(const char* ResolutionName, bool IsDLSSEnabled, float viewportRatio, bool useViewportRatio);
 	void AddTargetResolution(unsigned int Width, unsigned int Height, const std::string& Name);
 
+	/**
+	* True while streamed textures are still being decoded or waiting for upload.
+	*/
+	bool HasPendingTextures() const { return !PendingTextures.empty(); }
+
+	/**
+	* CPU copy of an uploaded texture, keyed by TextureCache::GetKey. Reloaded through the texture cache if it was dropped,
+	* nullptr if that fails. Stays valid until UnlockHostTexture.
+	*/
+	const TextureInfo* LockHostTexture(const std::string& Key);
+	void UnlockHostTexture(const std::string& Key);
+
+	const TextureResidency& GetTextureResidency() const { return AlbedoResidency; }
+
 	D3D12Global D3D = {};
 	D3D12Resources Resources = {};
 
@@ -52,7 +80,65 @@ protected:
 	void InitImGUI();
 
 	void AddObject(SceneObject& SceneObj, uint32_t Index);
-	TextureResource LoadTexture(std::string TextureName, bool GenMips = true);
+
+	/**
+	* Starts decoding the textures of a mesh on the thread pool, LoadTexture then only waits for the one it uploads.
+	*/
+	void PrefetchTextures(const StaticMesh& Mesh);
+	TextureResource LoadTexture(std::string TextureName, TextureFormat::TextureUsage Usage = TextureFormat::TextureUsage::Albedo, bool GenMips = true);
+
+	/**
+	* Streaming counterpart of LoadTexture. Queues a background decode and returns the fallback texture until it is resident.
+	*/
+	TextureResource RequestTexture(const std::string& TextureName, TextureFormat::TextureUsage Usage = TextureFormat::TextureUsage::Albedo);
+
+	/**
+	* Uploads new scene objects and decoded textures, then adds them to the acceleration structures and descriptors. Called once per frame from Update.
+	*/
+	void StreamUpdate(Scene& scene);
+	bool UploadDecodedTextures();
+
+	/**
+	* Builds BLASes for meshes new to the scene and rebuilds the TLAS in place. Returns true if the TLAS had to grow and moved.
+	*/
+	bool UpdateAccelerationStructures(Scene& scene);
+
+	/**
+	* Writes the descriptors and hit records of the scene objects from FirstObject on, all of them if the heap had to grow.
+	*/
+	void UpdateSceneDescriptors(Scene& scene, uint32_t FirstObject = 0);
+
+	/**
+	* Hands the CPU copy of an uploaded texture to HostResidency, which drops it right away.
+	*/
+	void ReleaseHostTexture(const std::string& Key, const std::string& Path, TextureFormat::TextureUsage Usage);
+
+	/**
+	* Drops the mesh data of the uploaded objects, see Scene::ReleaseHostMeshes.
+	*/
+	void ReleaseHostMeshes(Scene& scene);
+
+	/**
+	* Registers an uploaded albedo texture with AlbedoResidency, its resource holding the chain from ResidentMip down.
+	*/
+	void AddAlbedoResidency(const std::string& Key, const TextureInfo& Info, uint32_t ResidentMip);
+
+	/**
+	* Estimates the albedo mips the current view needs and moves the textures that should start at another level. Called once
+	* per frame from Update.
+	*/
+	void UpdateTextureResidency(Scene& scene, const TracerParameters& params);
+
+	/**
+	* Recreates the GPU texture of Key from mip TopMip down out of its CPU copy and points the materials using it at the new
+	* first level, adding those objects to OutObjects. The GPU has to be idle. False if the CPU copy couldn't be reloaded.
+	*/
+	bool SetAlbedoTopMip(const std::string& Key, uint32_t TopMip, std::vector<uint32_t>& OutObjects);
+
+	/**
+	* Logs the GPU memory of the resident textures per usage, next to what they would take as RGBA8.
+	*/
+	void LogTextureMemory() const;
 
 	bool CheckDLSSIsSupported();
 	bool CreateDLSSFeature(NVSDK_NGX_PerfQuality_Value Quality, Resolution OptimalRenderSize, Resolution DisplayOutSize, bool EnableSharpening);
@@ -73,4 +159,25 @@ protected:
 	bool disableDLSSForScreenShot = false;
 	bool disableFOVForScreenShot = false;
 	bool takingVideo = false;
+
+	// Streaming state, SceneGeneration is the last Scene generation whose objects were uploaded and WasSceneStreaming what
+	// Scene::IsStreaming said on the last StreamUpdate
+	bool StreamTextures = false;
+	uint64_t SceneGeneration = 0;
+	bool WasSceneStreaming = false;
+	TextureResource FallbackTexture;
+
+	TextureCache TextureDecodes;
+	struct PendingTexture
+	{
+		std::string Path;
+		TextureFormat::TextureUsage Usage;
+		TextureHandle Handle;
+	};
+
+	// Keyed by TextureCache::GetKey like Resources.Textures
+	std::unordered_map<std::string, PendingTexture> PendingTextures;
+
+	bool UseTextureResidency = true;
+	TextureResidency AlbedoResidency;
 };
@@ -1,2 +1,138 @@
 #include "pch.h"
 #include "Transform.h"
+
+void Transform::Translate(Vector3f InTranslation)
+{
+	Translation = Translation + InTranslation;
+}
+
+void Transform::Rotate(Vector3f EulerRotations)
+{
+	Rotation = Quaternion(EulerRotations.X, EulerRotations.Y, EulerRotations.Z) * Rotation;
+}
+
+void Transform::Rotate(float Angle, Vector3f Axis)
+{
+	Rotation = Quaternion(Angle, Axis.Normalized()) * Rotation;
+}
+
+void Transform::SetScale(float scale)
+{
+	Scale = scale;
+}
+
+Transform3x4 Transform::GetMatrix() const
+{
+	Quaternion RotationCopy = Rotation;
+	const Vector3f Axes[3] = { Vector3f(1.0f, 0.0f, 0.0f), Vector3f(0.0f, 1.0f, 0.0f), Vector3f(0.0f, 0.0f, 1.0f) };
+
+	Transform3x4 Result;
+	for (uint32_t Col = 0; Col < 3; Col++)
+	{
+		Vector3f Column = RotationCopy * Axes[Col];
+		Result.M[0][Col] = Column.X * Scale;
+		Result.M[1][Col] = Column.Y * Scale;
+		Result.M[2][Col] = Column.Z * Scale;
+	}
+
+	Result.M[0][3] = Translation.X;
+	Result.M[1][3] = Translation.Y;
+	Result.M[2][3] = Translation.Z;
+
+	return Result;
+}
+
+bool Transform3x4::IsIdentity() const
+{
+	for (uint32_t Row = 0; Row < 3; Row++)
+	{
+		for (uint32_t Col = 0; Col < 4; Col++)
+		{
+			if (M[Row][Col] != (Row == Col ? 1.0f : 0.0f))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+Vector3f Transform3x4::TransformPoint(const Vector3f& Point) const
+{
+	return Vector3f(
+		M[0][0] * Point.X + M[0][1] * Point.Y + M[0][2] * Point.Z + M[0][3],
+		M[1][0] * Point.X + M[1][1] * Point.Y + M[1][2] * Point.Z + M[1][3],
+		M[2][0] * Point.X + M[2][1] * Point.Y + M[2][2] * Point.Z + M[2][3]);
+}
+
+Vector3f Transform3x4::TransformVector(const Vector3f& Vector) const
+{
+	return Vector3f(
+		M[0][0] * Vector.X + M[0][1] * Vector.Y + M[0][2] * Vector.Z,
+		M[1][0] * Vector.X + M[1][1] * Vector.Y + M[1][2] * Vector.Z,
+		M[2][0] * Vector.X + M[2][1] * Vector.Y + M[2][2] * Vector.Z);
+}
+
+Transform3x4 Transform3x4::GetNormalTransform() const
+{
+	// Inverse transpose = cofactor matrix / determinant
+	float Cofactor[3][3];
+	for (uint32_t Row = 0; Row < 3; Row++)
+	{
+		for (uint32_t Col = 0; Col < 3; Col++)
+		{
+			uint32_t R0 = (Row + 1) % 3, R1 = (Row + 2) % 3;
+			uint32_t C0 = (Col + 1) % 3, C1 = (Col + 2) % 3;
+			Cofactor[Row][Col] = M[R0][C0] * M[R1][C1] - M[R0][C1] * M[R1][C0];
+		}
+	}
+
+	float Determinant = M[0][0] * Cofactor[0][0] + M[0][1] * Cofactor[0][1] + M[0][2] * Cofactor[0][2];
+	float InvDeterminant = Determinant != 0.0f ? 1.0f / Determinant : 0.0f;
+
+	Transform3x4 Result;
+	for (uint32_t Row = 0; Row < 3; Row++)
+	{
+		for (uint32_t Col = 0; Col < 3; Col++)
+			Result.M[Row][Col] = Cofactor[Row][Col] * InvDeterminant;
+
+		Result.M[Row][3] = 0.0f;
+	}
+
+	return Result;
+}
+
+Transform3x4 Transform3x4::GetInverse() const
+{
+	// The inverse of the upper 3x3 is the transposed normal transform, the translation is undone after it
+	Transform3x4 NormalTransform = GetNormalTransform();
+
+	Transform3x4 Result;
+	for (uint32_t Row = 0; Row < 3; Row++)
+	{
+		for (uint32_t Col = 0; Col < 3; Col++)
+			Result.M[Row][Col] = NormalTransform.M[Col][Row];
+	}
+
+	for (uint32_t Row = 0; Row < 3; Row++)
+		Result.M[Row][3] = -(Result.M[Row][0] * M[0][3] + Result.M[Row][1] * M[1][3] + Result.M[Row][2] * M[2][3]);
+
+	return Result;
+}
+
+Transform3x4 Transform3x4::operator*(const Transform3x4& Other) const
+{
+	Transform3x4 Result;
+	for (uint32_t Row = 0; Row < 3; Row++)
+	{
+		for (uint32_t Col = 0; Col < 4; Col++)
+		{
+			float Value = M[Row][0] * Other.M[0][Col] + M[Row][1] * Other.M[1][Col] + M[Row][2] * Other.M[2][Col];
+			if (Col == 3)
+				Value += M[Row][3];
+
+			Result.M[Row][Col] = Value;
+		}
+	}
+
+	return Result;
+}
@@ -3,6 +3,38 @@
 #include "Math.h"
 
 
+/**
+* Affine object to world transform as three rows of a 4x4 matrix, the layout DXR uses for Transform3x4.
+*/
+struct Transform3x4
+{
+	float M[3][4] = { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f } };
+
+	bool IsIdentity() const;
+
+	Vector3f TransformPoint(const Vector3f& Point) const;
+	Vector3f TransformVector(const Vector3f& Vector) const;
+
+	/**
+	* Inverse transpose of the upper 3x3, for transforming normals. The translation column is zero.
+	*/
+	Transform3x4 GetNormalTransform() const;
+
+	/**
+	* World to object transform for an object to world one. Singular transforms give a zero upper 3x3.
+	*/
+	Transform3x4 GetInverse() const;
+
+	/**
+	* This transform applied after Other.
+	*/
+	Transform3x4 operator*(const Transform3x4& Other) const;
+};
+
+/**
+* Placement of an object built up from moves. Rotations are in radians and applied after the current rotation, like the
+* camera orientation.
+*/
 class Transform
 {
 public:
@@ -10,13 +42,15 @@ public:
 	void Rotate(Vector3f EulerRotations);
 	void Rotate(float Angle, Vector3f Axis);
 	void SetScale(float scale);
-	void GetScale();
+	float GetScale() const { return Scale; }
 
-	void GetMatrix();
+	/**
+	* Scales, then rotates, then translates.
+	*/
+	Transform3x4 GetMatrix() const;
 
 private:
 	Vector3f Translation;
-	Vector3f Rotation;
-	Vector3f Scale;
+	Quaternion Rotation;
+	float Scale = 1.0f;
 };
-
@@ -13,6 +13,15 @@
 #include "stb_image_write.h"
 
 #include "Log.h"
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "MeshOptimizer.h"
+#include "TextureFormat.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <mutex>
 
 namespace Utils
 {
@@ -102,195 +111,724 @@ namespace Utils
 		}
 	}
 
-	//TODO: Make recursively process nodes if needed by important scenes later.
-	bool LoadStaticMeshes(const std::string& Filepath, std::vector<StaticMesh>& SMeshVector, bool GenVertexNormals)
+	enum class MeshConvertResult
 	{
-		bool LoadSucceeded = true;
+		Success,
+		MissingPositions,
+		MissingIndices,
+		MissingMaterial
+	};
 
-		uint32_t LoadFlags = aiProcess_Triangulate | aiProcess_MakeLeftHanded |
-			aiProcess_FlipUVs | aiProcess_FlipWindingOrder | aiProcess_SortByPType | aiProcess_CalcTangentSpace;
+	typedef void (*VertexConverter)(const aiMesh* pMesh, Vertex* Vertices, uint32_t First, uint32_t Count);
 
-		if (GenVertexNormals)
-			LoadFlags |= aiProcess_GenSmoothNormals;
+	/**
+	* Copies a range of vertices from an aiMesh. The attribute checks are resolved at compile time so the loop is branch free.
+	*/
+	template<bool HasTexcoords, bool HasNormals, bool HasTangents>
+	static void ConvertVertices(const aiMesh* pMesh, Vertex* Vertices, uint32_t First, uint32_t Count)
+	{
+		for (uint32_t j = First; j < First + Count; j++)
+		{
+			Vertex& Vtx = Vertices[j];
+
+			aiVector3D Vec = pMesh->mVertices[j];
+			Vtx.Position = Vector3f(Vec.x, Vec.y, Vec.z);
+
+			//Texture coords. Only single channel.
+			if constexpr (HasTexcoords)
+			{
+				Vec = pMesh->mTextureCoords[0][j];
+				Vtx.Texcoord = Vector2f(Vec.x, Vec.y);
+			}
+
+			if constexpr (HasNormals)
+			{
+				Vec = pMesh->mNormals[j];
+				Vtx.Normal = Vector3f(Vec.x, Vec.y, Vec.z);
+			}
+
+			if constexpr (HasTangents)
+			{
+				Vec = pMesh->mTangents[j];
+				Vtx.Tangent = Vector3f(Vec.x, Vec.y, Vec.z);
+
+				Vec = pMesh->mBitangents[j];
+				Vtx.Binormal = Vector3f(Vec.x, Vec.y, Vec.z);
+			}
+		}
+	}
+
+	static VertexConverter GetVertexConverter(bool HasTexcoords, bool HasNormals, bool HasTangents)
+	{
+		static const VertexConverter Converters[8] =
+		{
+			ConvertVertices<false, false, false>,
+			ConvertVertices<true, false, false>,
+			ConvertVertices<false, true, false>,
+			ConvertVertices<true, true, false>,
+			ConvertVertices<false, false, true>,
+			ConvertVertices<true, false, true>,
+			ConvertVertices<false, true, true>,
+			ConvertVertices<true, true, true>,
+		};
+
+		return Converters[(HasTexcoords ? 1 : 0) | (HasNormals ? 2 : 0) | (HasTangents ? 4 : 0)];
+	}
+
+	static void ConvertMaterial(const aiMaterial* pMat, const std::string& ParentFolder, StaticMesh& SMesh)
+	{
+		Material Mat;
+
+		Mat.Name = pMat->GetName().C_Str();
+
+		if (pMat->GetTextureCount(aiTextureType_DIFFUSE) > 0)
+		{
+			aiString path;
+			pMat->GetTexture(aiTextureType_DIFFUSE, 0, &path);
+
+			Mat.TexturePath = ParentFolder + std::string(path.C_Str());
+		}
+
+		if (pMat->GetTextureCount(aiTextureType_NORMALS) > 0)
+		{
+			aiString path;
+			pMat->GetTexture(aiTextureType_NORMALS, 0, &path);
+
+			Mat.NormalMapPath = ParentFolder + std::string(path.C_Str());
+		}
+
+		if (pMat->GetTextureCount(aiTextureType_OPACITY) > 0)
+		{
+			SMesh.HasTransparency = true;
+
+			aiString path;
+			pMat->GetTexture(aiTextureType_OPACITY, 0, &path);
+
+			Mat.OpacityMapPath = ParentFolder + std::string(path.C_Str());
+		}
+
+		aiColor3D ColorResult;
+		if (aiReturn_SUCCESS == pMat->Get(AI_MATKEY_COLOR_AMBIENT, ColorResult))
+			Mat.AmbientColor = Vector3f(ColorResult.r, ColorResult.g, ColorResult.b);
+
+		if (aiReturn_SUCCESS == pMat->Get(AI_MATKEY_COLOR_DIFFUSE, ColorResult))
+			Mat.DiffuseColor = Vector3f(ColorResult.r, ColorResult.g, ColorResult.b);
+
+		if (aiReturn_SUCCESS == pMat->Get(AI_MATKEY_COLOR_SPECULAR, ColorResult))
+			Mat.SpecularColor = Vector3f(ColorResult.r, ColorResult.g, ColorResult.b);
+
+		if (aiReturn_SUCCESS == pMat->Get(AI_MATKEY_COLOR_TRANSPARENT, ColorResult))
+			Mat.TransmitanceFilter = Vector3f(ColorResult.r, ColorResult.g, ColorResult.b);
+
+		ai_real FloatResult;
+		if (aiReturn_SUCCESS == pMat->Get(AI_MATKEY_SHININESS, FloatResult))
+			Mat.Shininess = FloatResult;
+
+		if (aiReturn_SUCCESS == pMat->Get(AI_MATKEY_REFRACTI, FloatResult))
+			Mat.RefractIndex = FloatResult;
+
+		SMesh.HasMaterial = true;
+		SMesh.MeshMaterial = Mat;
+	}
+
+	/**
+	* Number of indices of an aiMesh, counted per face unless the mesh is triangles only.
+	*/
+	static size_t GetNumIndices(const aiMesh* pMesh)
+	{
+		if (pMesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+			return static_cast<size_t>(pMesh->mNumFaces) * 3;
+
+		size_t NumIndices = 0;
+		for (uint32_t j = 0; j < pMesh->mNumFaces; j++)
+			NumIndices += pMesh->mFaces[j].mNumIndices;
+
+		return NumIndices;
+	}
+
+	/**
+	* Converts a single aiMesh into the arena ranges already assigned to SMesh. Only touches SMesh, so meshes can be converted concurrently.
+	*/
+	static MeshConvertResult ConvertMesh(const aiScene* pScene, const aiMesh* pMesh, const std::string& ParentFolder, StaticMesh& SMesh)
+	{
+		//Vertices in chunks of this size are converted as separate tasks
+		const uint32_t VertexRangeSize = 1 << 16;
+
+		if (!pMesh->HasPositions())
+			return MeshConvertResult::MissingPositions;
+
+		if (!pMesh->HasFaces())
+			return MeshConvertResult::MissingIndices;
+
+		if (!pScene->HasMaterials())
+			return MeshConvertResult::MissingMaterial;
+
+		SMesh.HasTexcoords = pMesh->HasTextureCoords(0);
+		SMesh.HasNormals = pMesh->HasNormals();
+		SMesh.HasTangents = pMesh->HasTangentsAndBitangents();
+		SMesh.HasBinormals = SMesh.HasTangents;
+
+		//Create vertices
+		VertexConverter Converter = GetVertexConverter(SMesh.HasTexcoords, SMesh.HasNormals, SMesh.HasTangents);
+		uint32_t NumRanges = (pMesh->mNumVertices + VertexRangeSize - 1) / VertexRangeSize;
+
+		ThreadPool::GetGlobal().ParallelFor(NumRanges, [&](uint32_t Range)
+		{
+			uint32_t First = Range * VertexRangeSize;
+			uint32_t Count = Math::min(VertexRangeSize, pMesh->mNumVertices - First);
+			Converter(pMesh, SMesh.Vertices.data(), First, Count);
+		});
+
+		//Set indices. Triangulated meshes take the fast path.
+		if (pMesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+		{
+			uint32_t* pIndices = SMesh.Indices.data();
+
+			for (uint32_t j = 0; j < pMesh->mNumFaces; j++)
+			{
+				const uint32_t* pFaceIndices = pMesh->mFaces[j].mIndices;
+				pIndices[j * 3] = pFaceIndices[0];
+				pIndices[j * 3 + 1] = pFaceIndices[1];
+				pIndices[j * 3 + 2] = pFaceIndices[2];
+			}
+		}
+		else
+		{
+			uint32_t* pIndices = SMesh.Indices.data();
+
+			for (uint32_t j = 0; j < pMesh->mNumFaces; j++)
+			{
+				const aiFace& Face = pMesh->mFaces[j];
+				memcpy(pIndices, Face.mIndices, Face.mNumIndices * sizeof(uint32_t));
+				pIndices += Face.mNumIndices;
+			}
+		}
+
+		//Set material. Currently single material with texture only.
+		ConvertMaterial(pScene->mMaterials[pMesh->mMaterialIndex], ParentFolder, SMesh);
+
+		return MeshConvertResult::Success;
+	}
+
+	static const uint32_t InvalidMeshIndex = ~0u;
+
+	// Meshes converted between two calls of a MeshBatchCallback
+	static const uint32_t MeshesPerStreamBatch = 64;
+
+	static uint64_t HashMeshContent(const StaticMesh& SMesh)
+	{
+		uint64_t Hash = HashBytes(SMesh.Vertices.data(), SMesh.Vertices.size_bytes());
+		return HashBytes(SMesh.Indices.data(), SMesh.Indices.size_bytes(), Hash);
+	}
+
+	static bool MaterialsEqual(const Material& A, const Material& B)
+	{
+		auto const ColorsEqual = [](const Vector3f& C0, const Vector3f& C1) { return C0.X == C1.X && C0.Y == C1.Y && C0.Z == C1.Z; };
+
+		return A.TexturePath == B.TexturePath && A.NormalMapPath == B.NormalMapPath && A.OpacityMapPath == B.OpacityMapPath &&
+			ColorsEqual(A.AmbientColor, B.AmbientColor) && ColorsEqual(A.DiffuseColor, B.DiffuseColor) &&
+			ColorsEqual(A.SpecularColor, B.SpecularColor) && ColorsEqual(A.TransmitanceFilter, B.TransmitanceFilter) &&
+			A.Shininess == B.Shininess && A.RefractIndex == B.RefractIndex;
+	}
+
+	/**
+	* True if two meshes can be drawn as instances of each other. Names don't matter, contents and material do.
+	*/
+	static bool MeshesEqual(const StaticMesh& A, const StaticMesh& B)
+	{
+		return A.Vertices.size() == B.Vertices.size() && A.Indices.size() == B.Indices.size() &&
+			A.HasMaterial == B.HasMaterial && A.HasNormals == B.HasNormals && A.HasTexcoords == B.HasTexcoords &&
+			A.HasTangents == B.HasTangents && A.HasBinormals == B.HasBinormals && A.HasTransparency == B.HasTransparency &&
+			memcmp(A.Vertices.data(), B.Vertices.data(), A.Vertices.size_bytes()) == 0 &&
+			memcmp(A.Indices.data(), B.Indices.data(), A.Indices.size_bytes()) == 0 &&
+			MaterialsEqual(A.MeshMaterial, B.MeshMaterial);
+	}
+
+	static Transform3x4 ToTransform3x4(const aiMatrix4x4& Matrix)
+	{
+		Transform3x4 Result;
+		for (uint32_t Row = 0; Row < 3; Row++)
+		{
+			for (uint32_t Col = 0; Col < 4; Col++)
+				Result.M[Row][Col] = Matrix[Row][Col];
+		}
+
+		return Result;
+	}
+
+	/**
+	* Walks the node tree and adds an instance for every mesh reference. MeshRemap maps aiMesh indices to SMeshVector.
+	*/
+	static void CollectInstances(const aiNode* pNode, const aiMatrix4x4& ParentTransform, const std::vector<uint32_t>& MeshRemap, std::vector<MeshInstance>& Instances)
+	{
+		aiMatrix4x4 NodeTransform = ParentTransform * pNode->mTransformation;
+
+		for (unsigned int i = 0; i < pNode->mNumMeshes; i++)
+		{
+			uint32_t MeshIndex = MeshRemap[pNode->mMeshes[i]];
+			if (MeshIndex == InvalidMeshIndex)
+				continue;
+
+			MeshInstance Instance;
+			Instance.MeshIndex = MeshIndex;
+			Instance.ObjectToWorld = ToTransform3x4(NodeTransform);
+			Instances.push_back(Instance);
+		}
+
+		for (unsigned int i = 0; i < pNode->mNumChildren; i++)
+			CollectInstances(pNode->mChildren[i], NodeTransform, MeshRemap, Instances);
+	}
+
+	/**
+	* Folder the texture paths of a mesh file are resolved against, with a trailing slash.
+	*/
+	static std::string GetParentFolder(const std::string& Filepath)
+	{
+		auto const end_of_basedir = Filepath.rfind("/");
+		return (end_of_basedir != std::string::npos ? Filepath.substr(0, end_of_basedir) : ".") + "/";
+	}
+
+	/**
+	* Hash of everything the imported meshes depend on, for the mesh cache key. Material libraries an OBJ file refers to are
+	* hashed along with it, and the parent folder is mixed in since every cached texture path starts with it.
+	*/
+	static bool HashMeshSources(const std::string& Filepath, uint64_t& OutHash)
+	{
+		MappedFile File;
+		if (!File.Open(Filepath))
+			return false;
+
+		const char* Text = reinterpret_cast<const char*>(File.Data());
+		const size_t Size = static_cast<size_t>(File.Size());
+
+		const std::string ParentFolder = GetParentFolder(Filepath);
+		uint64_t Hash = HashBytes(Text, Size);
+		Hash = HashBytes(ParentFolder.data(), ParentFolder.size(), Hash);
+
+		auto const UntilExtension = Filepath.rfind(".");
+		const bool IsObj = UntilExtension != std::string::npos && Filepath.compare(UntilExtension, std::string::npos, ".obj") == 0;
+
+		// Other formats keep their materials inside the file
+		static const char MaterialLibrary[] = "mtllib";
+		const size_t KeywordLength = sizeof(MaterialLibrary) - 1;
+		for (size_t LineStart = 0; IsObj && LineStart < Size;)
+		{
+			const char* pLineEnd = reinterpret_cast<const char*>(memchr(Text + LineStart, '\n', Size - LineStart));
+			const size_t LineEnd = pLineEnd ? static_cast<size_t>(pLineEnd - Text) : Size;
+
+			if (LineEnd - LineStart > KeywordLength && memcmp(Text + LineStart, MaterialLibrary, KeywordLength) == 0 &&
+				(Text[LineStart + KeywordLength] == ' ' || Text[LineStart + KeywordLength] == '\t'))
+			{
+				std::string Name(Text + LineStart + KeywordLength, LineEnd - LineStart - KeywordLength);
+				const size_t NameStart = Name.find_first_not_of(" \t\r");
+				Name = NameStart != std::string::npos ? Name.substr(NameStart, Name.find_last_not_of(" \t\r") - NameStart + 1) : std::string();
+
+				// A missing library hashes as 0, so the cache is rebuilt once it shows up
+				uint64_t LibraryHash = 0;
+				HashFile(ParentFolder + Name, LibraryHash);
+
+				Hash = HashBytes(Name.data(), Name.size(), Hash);
+				Hash = HashBytes(&LibraryHash, sizeof(LibraryHash), Hash);
+			}
+
+			LineStart = LineEnd + 1;
+		}
+
+		OutHash = Hash;
+		return true;
+	}
+
+	/**
+	* Sorts Instances by the mesh they reference, the instances of mesh i end up at OutGrouped[OutFirst[i]] up to OutFirst[i + 1].
+	*/
+	static void GroupInstancesByMesh(Span<const MeshInstance> Instances, uint32_t NumMeshes, std::vector<MeshInstance>& OutGrouped, std::vector<uint32_t>& OutFirst)
+	{
+		OutFirst.assign(NumMeshes + 1, 0);
+		for (const MeshInstance& Instance : Instances)
+			OutFirst[Instance.MeshIndex + 1]++;
+
+		for (uint32_t i = 0; i < NumMeshes; i++)
+			OutFirst[i + 1] += OutFirst[i];
+
+		std::vector<uint32_t> Next(OutFirst.begin(), OutFirst.end() - 1);
+		OutGrouped.resize(Instances.size());
+		for (const MeshInstance& Instance : Instances)
+			OutGrouped[Next[Instance.MeshIndex]++] = Instance;
+	}
+
+	static void LogInstancingStats(const std::string& Filepath, const std::vector<StaticMesh>& SMeshVector, const std::vector<MeshInstance>& Instances, size_t FirstMesh, size_t FirstInstance)
+	{
+		uint64_t UniqueTriangles = 0;
+		for (size_t i = FirstMesh; i < SMeshVector.size(); i++)
+			UniqueTriangles += SMeshVector[i].Indices.size() / 3;
+
+		uint64_t InstancedTriangles = 0;
+		for (size_t i = FirstInstance; i < Instances.size(); i++)
+			InstancedTriangles += SMeshVector[Instances[i].MeshIndex].Indices.size() / 3;
+
+		CORE_INFO("{0}: {1} unique meshes with {2} triangles, {3} instances with {4} triangles",
+			Filepath, SMeshVector.size() - FirstMesh, UniqueTriangles, Instances.size() - FirstInstance, InstancedTriangles);
+	}
+
+	/**
+	* Imports meshes with Assimp. LoadStaticMeshes takes care of the mesh cache on top of this.
+	* Meshes are converted in parallel but always come out in file order. Meshes with identical contents are
+	* only kept once, and the node tree is turned into one instance per mesh reference.
+	* With OnMeshBatch set the meshes are converted a batch at a time and the arena isn't compacted, see MeshBatchCallback.
+	*/
+	static bool ImportStaticMeshes(const std::string& Filepath, GeometryArena& Arena, std::vector<StaticMesh>& SMeshVector, std::vector<MeshInstance>& Instances, uint32_t LoadFlags, bool OptimizeMeshes, const MeshBatchCallback& OnMeshBatch)
+	{
+		bool LoadSucceeded = true;
 
 		Assimp::Importer Importer;
 		const aiScene* pScene = Importer.ReadFile(Filepath.c_str(), LoadFlags);
 
 		if (pScene && pScene->HasMeshes())
 		{
+			auto const parent_folder = GetParentFolder(Filepath);
+
+			std::vector<StaticMesh> Converted(pScene->mNumMeshes);
+
+			//Size the arena for the whole file once, then hand out the ranges in file order
+			size_t TotalVertices = 0;
+			size_t TotalIndices = 0;
+			for (unsigned int i = 0; i < pScene->mNumMeshes; i++)
+			{
+				TotalVertices += pScene->mMeshes[i]->mNumVertices;
+				TotalIndices += GetNumIndices(pScene->mMeshes[i]);
+			}
+
+			Arena.Reserve(TotalVertices, TotalIndices);
+			for (unsigned int i = 0; i < pScene->mNumMeshes; i++)
+			{
+				Converted[i].Vertices = Arena.AllocateVertices(pScene->mMeshes[i]->mNumVertices);
+				Converted[i].Indices = Arena.AllocateIndices(GetNumIndices(pScene->mMeshes[i]));
+			}
+			std::vector<MeshConvertResult> Results(pScene->mNumMeshes);
+			std::vector<MeshOptimizer::OptimizeStats> OptimizeStats(OptimizeMeshes ? pScene->mNumMeshes : 0);
+			std::vector<uint64_t> ContentHashes(pScene->mNumMeshes, 0);
+
+			uint64_t VerticesBefore = 0;
+			uint64_t VerticesAfter = 0;
+			double WeightedACMRBefore = 0.0;
+			double WeightedACMRAfter = 0.0;
+			uint64_t NumOptimizedTriangles = 0;
+
 			//reserve memory for new meshes
+			size_t FirstNewMesh = SMeshVector.size();
 			SMeshVector.reserve(SMeshVector.size() + pScene->mNumMeshes);
 
-			//Create static meshes
-			for (unsigned int i = 0; i < pScene->mNumMeshes; i++)
+			std::vector<uint32_t> MeshRemap(pScene->mNumMeshes, InvalidMeshIndex);
+			std::unordered_multimap<uint64_t, uint32_t> UniqueMeshes;
+			uint32_t NumDuplicates = 0;
+
+			// Streamed instances are handed out with the batch that holds their mesh, so they're collected up front
+			std::vector<MeshInstance> FileInstances;
+			std::vector<uint32_t> FirstFileInstance;
+			if (OnMeshBatch && pScene->mRootNode)
 			{
-				aiMesh* pMesh = pScene->mMeshes[i];
-			
-				if (!pMesh->HasPositions())
+				std::vector<uint32_t> FileMeshes(pScene->mNumMeshes);
+				for (uint32_t i = 0; i < pScene->mNumMeshes; i++)
+					FileMeshes[i] = i;
+
+				std::vector<MeshInstance> NodeInstances;
+				CollectInstances(pScene->mRootNode, aiMatrix4x4(), FileMeshes, NodeInstances);
+				GroupInstancesByMesh(Span<const MeshInstance>(NodeInstances.data(), NodeInstances.size()), pScene->mNumMeshes, FileInstances, FirstFileInstance);
+			}
+
+			const uint32_t BatchSize = OnMeshBatch ? MeshesPerStreamBatch : pScene->mNumMeshes;
+			for (uint32_t FirstInBatch = 0; FirstInBatch < pScene->mNumMeshes; FirstInBatch += BatchSize)
+			{
+				const uint32_t EndOfBatch = Math::min(FirstInBatch + BatchSize, pScene->mNumMeshes);
+				const size_t FirstBatchMesh = SMeshVector.size();
+
+				ThreadPool::GetGlobal().ParallelFor(EndOfBatch - FirstInBatch, [&](uint32_t BatchIndex)
 				{
-					CORE_ERROR("Mesh {0} from file \"{1}\" is missing vertex positions!", i, Filepath);
-					LoadSucceeded = false;
-					continue;
-				}
+					const uint32_t i = FirstInBatch + BatchIndex;
+					Results[i] = ConvertMesh(pScene, pScene->mMeshes[i], parent_folder, Converted[i]);
 
-				unsigned int j = 0;
-				StaticMesh SMesh;
-				SMesh.ReserveNumVertices(pMesh->mNumVertices);
+					if (Results[i] != MeshConvertResult::Success)
+						return;
 
-				//Create vertices
-				for (j = 0; j < pMesh->mNumVertices; j++)
+					// SortByPType leaves point and line meshes as they are, only pure triangle lists are optimized
+					if (OptimizeMeshes && pScene->mMeshes[i]->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+						OptimizeStats[i] = MeshOptimizer::Optimize(Converted[i]);
+
+					ContentHashes[i] = HashMeshContent(Converted[i]);
+				});
+
+				for (unsigned int i = FirstInBatch; i < EndOfBatch; i++)
 				{
-					Vertex Vtx;
-
-					aiVector3D Vec = pMesh->mVertices[j];
-					Vector3f VertPos(Vec.x, Vec.y, Vec.z);
-					Vtx.Position = VertPos;
-						
-					//Texture coords. Only single channel.
-					if (pMesh->HasTextureCoords(0))
-					{
-						SMesh.HasTexcoords = true;
+					const aiMesh* pMesh = pScene->mMeshes[i];
 
-						aiVector3D Vec = pMesh->mTextureCoords[0][j];
-						Vector2f Texcoord(Vec.x, Vec.y);
-						
-						Vtx.Texcoord = Texcoord;
+					switch (Results[i])
+					{
+					case MeshConvertResult::MissingPositions:
+						CORE_ERROR("Mesh {0} from file \"{1}\" is missing vertex positions!", i, Filepath);
+						LoadSucceeded = false;
+						continue;
+
+					case MeshConvertResult::MissingIndices:
+						CORE_ERROR("Missing indices for mesh {0} at {1}!", i, Filepath);
+						LoadSucceeded = false;
+						continue;
+
+					case MeshConvertResult::MissingMaterial:
+						CORE_ERROR("Missing material for mesh {0} at {1}!", i, Filepath);
+						LoadSucceeded = false;
+						continue;
+
+					default:
+						break;
 					}
 
-					//Vertex normals.
-					if (pMesh->HasNormals())
-					{
-						SMesh.HasNormals = true;
+					StaticMesh& SMesh = Converted[i];
 
-						aiVector3D Vec = pMesh->mNormals[j];
-						Vector3f Normal(Vec.x, Vec.y, Vec.z);
-						Vtx.Normal = Normal;
+					//Meshes with the same contents become instances of the first one
+					auto const Candidates = UniqueMeshes.equal_range(ContentHashes[i]);
+					for (auto It = Candidates.first; It != Candidates.second; ++It)
+					{
+						if (MeshesEqual(SMeshVector[It->second], SMesh))
+						{
+							MeshRemap[i] = It->second;
+							break;
+						}
 					}
 
-					//Vertex tangents and binormals.
-					if (pMesh->HasTangentsAndBitangents())
+					if (MeshRemap[i] != InvalidMeshIndex)
 					{
-						SMesh.HasTangents = true;
-						SMesh.HasBinormals = true;
-
-						aiVector3D Vec = pMesh->mTangents[j];
-						Vector3f Tangent(Vec.x, Vec.y, Vec.z);
-						Vtx.Tangent = Tangent;
+						NumDuplicates++;
+						continue;
+					}
 
-						Vec = pMesh->mBitangents[j];
-						Vector3f Bitangent(Vec.x, Vec.y, Vec.z);
-						Vtx.Binormal = Bitangent;
+					MeshRemap[i] = static_cast<uint32_t>(SMeshVector.size());
+					UniqueMeshes.emplace(ContentHashes[i], MeshRemap[i]);
+
+					CORE_TRACE("Loaded mesh {0} with {1} tris :: Normals {2}, Texcoords {3}, Material {4}",
+						pMesh->mName.C_Str(),
+						SMesh.Indices.size() / 3,
+						SMesh.HasNormals ? "available" : "N/A",
+						SMesh.HasTexcoords ? "available" : "N/A",
+						SMesh.HasMaterial ? "available" : "N/A"
+						);
+					if (OptimizeMeshes && pMesh->mPrimitiveTypes != aiPrimitiveType_TRIANGLE)
+					{
+						CORE_WARN("Mesh {0} from file \"{1}\" isn't a triangle list, it wasn't optimized", i, Filepath);
+					}
+					else if (OptimizeMeshes)
+					{
+						const MeshOptimizer::OptimizeStats& Stats = OptimizeStats[i];
+						VerticesBefore += Stats.VerticesBefore;
+						VerticesAfter += Stats.VerticesAfter;
+						WeightedACMRBefore += static_cast<double>(Stats.ACMRBefore) * Stats.NumTriangles;
+						WeightedACMRAfter += static_cast<double>(Stats.ACMRAfter) * Stats.NumTriangles;
+						NumOptimizedTriangles += Stats.NumTriangles;
 					}
 
-					SMesh.Vertices.push_back(Vtx);
+					SMeshVector.push_back(std::move(SMesh));
 				}
 
-				//Set indices
-				if (pMesh->HasFaces())
+				if (!OnMeshBatch)
+					continue;
+
+				const size_t FirstBatchInstance = Instances.size();
+				if (pScene->mRootNode)
 				{
-					for (j = 0; j < pMesh->mNumFaces; j++)
+					for (uint32_t i = FirstInBatch; i < EndOfBatch; i++)
 					{
-						for (uint32_t k = 0; k < pMesh->mFaces[j].mNumIndices; k++)
+						if (MeshRemap[i] == InvalidMeshIndex)
+							continue;
+
+						for (uint32_t j = FirstFileInstance[i]; j < FirstFileInstance[i + 1]; j++)
 						{
-							uint32_t Index = pMesh->mFaces[j].mIndices[k];
-							SMesh.Indices.push_back(Index);
+							MeshInstance Instance = FileInstances[j];
+							Instance.MeshIndex = MeshRemap[i];
+							Instances.push_back(Instance);
 						}
 					}
 				}
 				else
 				{
-					CORE_ERROR("Missing indices for mesh {0} at {1}!", i, Filepath);
-					LoadSucceeded = false;
-					continue;
+					for (uint32_t i = static_cast<uint32_t>(FirstBatchMesh); i < SMeshVector.size(); i++)
+					{
+						MeshInstance Instance;
+						Instance.MeshIndex = i;
+						Instances.push_back(Instance);
+					}
 				}
-					
-				//Set material. Currently single material with texture only.
-				if (pScene->HasMaterials())
+
+				OnMeshBatch(SMeshVector, Span<const MeshInstance>(Instances.data() + FirstBatchInstance, Instances.size() - FirstBatchInstance));
+			}
+
+			// Streamed meshes are already out, they have to stay where they are
+			if (!OnMeshBatch)
+			{
+				//Close the gaps left by skipped and duplicate meshes and welded vertices
+				Arena.Compact(Span<StaticMesh>(SMeshVector.data() + FirstNewMesh, SMeshVector.size() - FirstNewMesh));
+
+				if (pScene->mRootNode)
+				{
+					CollectInstances(pScene->mRootNode, aiMatrix4x4(), MeshRemap, Instances);
+				}
+				else
 				{
+					for (uint32_t i = static_cast<uint32_t>(FirstNewMesh); i < SMeshVector.size(); i++)
+					{
+						MeshInstance Instance;
+						Instance.MeshIndex = i;
+						Instances.push_back(Instance);
+					}
+				}
+			}
 
-					auto const end_of_basedir = Filepath.rfind("/");
-					auto const parent_folder = (end_of_basedir != std::string::npos ? Filepath.substr(0, end_of_basedir) : ".") + "/";
+			if (NumDuplicates > 0)
+				CORE_INFO("Merged {0} duplicate meshes in {1}", NumDuplicates, Filepath);
 
-					SMesh.HasMaterial = true;
+			if (OptimizeMeshes && NumOptimizedTriangles > 0)
+			{
+				CORE_INFO("Optimized meshes in {0}: vertices {1} -> {2}, ACMR {3:.3f} -> {4:.3f}",
+					Filepath, VerticesBefore, VerticesAfter,
+					WeightedACMRBefore / NumOptimizedTriangles, WeightedACMRAfter / NumOptimizedTriangles);
+			}
+		}
+		else
+		{
+			CORE_ERROR("Failed to load scene at {0}!", Filepath);
+			LoadSucceeded = false;
+		}
 
-					aiMaterial* pMat = pScene->mMaterials[pMesh->mMaterialIndex];
-					Material Mat;
+		return LoadSucceeded;
+	}
 
-					Mat.Name = pMat->GetName().C_Str();
+	bool LoadStaticMeshes(const std::string& Filepath, GeometryArena& Arena, std::vector<StaticMesh>& SMeshVector, std::vector<MeshInstance>& Instances, bool GenVertexNormals, bool OptimizeMeshes, bool UseMeshCache, const MeshBatchCallback& OnMeshBatch)
+	{
+		uint32_t LoadFlags = aiProcess_Triangulate | aiProcess_MakeLeftHanded |
+			aiProcess_FlipUVs | aiProcess_FlipWindingOrder | aiProcess_SortByPType | aiProcess_CalcTangentSpace;
 
-					if (pMat->GetTextureCount(aiTextureType_DIFFUSE) > 0)
-					{
-						aiString path;
-						pMat->GetTexture(aiTextureType_DIFFUSE, 0, &path);
+		if (GenVertexNormals)
+			LoadFlags |= aiProcess_GenSmoothNormals;
 
-						Mat.TexturePath = parent_folder + std::string(path.C_Str());
-					}
+		MeshCache::CacheKey Key;
+		Key.LoadFlags = LoadFlags;
+		Key.GenVertexNormals = GenVertexNormals ? 1 : 0;
+		Key.OptimizeMeshes = OptimizeMeshes ? 1 : 0;
 
-					if (pMat->GetTextureCount(aiTextureType_NORMALS) > 0)
-					{
-						aiString path;
-						pMat->GetTexture(aiTextureType_NORMALS, 0, &path);
+		UseMeshCache = UseMeshCache && HashMeshSources(Filepath, Key.SourceHash);
+		std::string CachePath = MeshCache::GetCachePath(Filepath);
 
-						Mat.NormalMapPath = parent_folder + std::string(path.C_Str());
+		if (UseMeshCache)
+		{
+			MeshCache::MappedMeshCache Cache;
+			if (Cache.Open(CachePath, Key))
+			{
+				uint32_t NumMeshes = Cache.GetNumMeshes();
+				size_t FirstCachedMesh = SMeshVector.size();
+				SMeshVector.reserve(SMeshVector.size() + NumMeshes);
+
+				// Meshes point straight into the mapping, the arena keeps it open for as long as they need it
+				Arena.Adopt(Cache.GetFile());
+
+				// Streamed instances go out with the batch that holds their mesh
+				Span<const MeshInstance> CachedInstances = Cache.GetInstances();
+				std::vector<MeshInstance> GroupedInstances;
+				std::vector<uint32_t> FirstGroupedInstance;
+				if (OnMeshBatch)
+					GroupInstancesByMesh(CachedInstances, NumMeshes, GroupedInstances, FirstGroupedInstance);
+
+				size_t FirstNewInstance = Instances.size();
+				const uint32_t BatchSize = OnMeshBatch ? MeshesPerStreamBatch : NumMeshes;
+				for (uint32_t FirstInBatch = 0; FirstInBatch < NumMeshes; FirstInBatch += BatchSize)
+				{
+					const uint32_t EndOfBatch = Math::min(FirstInBatch + BatchSize, NumMeshes);
+					for (uint32_t i = FirstInBatch; i < EndOfBatch; i++)
+					{
+						SMeshVector.emplace_back();
+						StaticMesh& SMesh = SMeshVector.back();
+						SMesh.Vertices = Arena.AdoptVertices(Cache.GetVertices(i));
+						SMesh.Indices = Arena.AdoptIndices(Cache.GetIndices(i));
+						Cache.GetMeshInfo(i, SMesh);
 					}
 
+					if (!OnMeshBatch)
+						continue;
 
-					if (pMat->GetTextureCount(aiTextureType_OPACITY) > 0)
+					const size_t FirstBatchInstance = Instances.size();
+					for (uint32_t j = FirstGroupedInstance[FirstInBatch]; j < FirstGroupedInstance[EndOfBatch]; j++)
 					{
-						SMesh.HasTransparency = true;
+						MeshInstance Instance = GroupedInstances[j];
+						Instance.MeshIndex += static_cast<uint32_t>(FirstCachedMesh);
+						Instances.push_back(Instance);
+					}
 
-						aiString path;
-						pMat->GetTexture(aiTextureType_OPACITY, 0, &path);
+					OnMeshBatch(SMeshVector, Span<const MeshInstance>(Instances.data() + FirstBatchInstance, Instances.size() - FirstBatchInstance));
+				}
 
-						Mat.OpacityMapPath = parent_folder + std::string(path.C_Str());
+				if (!OnMeshBatch)
+				{
+					for (MeshInstance Instance : CachedInstances)
+					{
+						Instance.MeshIndex += static_cast<uint32_t>(FirstCachedMesh);
+						Instances.push_back(Instance);
 					}
+				}
 
-					aiColor3D ColorResult;
-					if (aiReturn_SUCCESS == pMat->Get(AI_MATKEY_COLOR_AMBIENT, ColorResult))
-						Mat.AmbientColor = Vector3f(ColorResult.r, ColorResult.g, ColorResult.b);
+				CORE_INFO("Loaded {0} meshes from mesh cache {1}", NumMeshes, CachePath);
+				LogInstancingStats(Filepath, SMeshVector, Instances, FirstCachedMesh, FirstNewInstance);
+				return true;
+			}
+		}
 
-					if (aiReturn_SUCCESS == pMat->Get(AI_MATKEY_COLOR_DIFFUSE, ColorResult))
-						Mat.DiffuseColor = Vector3f(ColorResult.r, ColorResult.g, ColorResult.b);
+		size_t FirstNewMesh = SMeshVector.size();
+		size_t FirstNewInstance = Instances.size();
+		bool LoadSucceeded = ImportStaticMeshes(Filepath, Arena, SMeshVector, Instances, LoadFlags, OptimizeMeshes, OnMeshBatch);
 
-					if (aiReturn_SUCCESS == pMat->Get(AI_MATKEY_COLOR_SPECULAR, ColorResult))
-						Mat.SpecularColor = Vector3f(ColorResult.r, ColorResult.g, ColorResult.b);
+		// Only cache complete imports, a partial result would otherwise hide the errors on the next start
+		if (UseMeshCache && LoadSucceeded)
+		{
+			Span<const StaticMesh> NewMeshes(SMeshVector.data() + FirstNewMesh, SMeshVector.size() - FirstNewMesh);
 
-					if (aiReturn_SUCCESS == pMat->Get(AI_MATKEY_COLOR_TRANSPARENT, ColorResult))
-						Mat.TransmitanceFilter = Vector3f(ColorResult.r, ColorResult.g, ColorResult.b);
+			std::vector<MeshInstance> NewInstances(Instances.begin() + FirstNewInstance, Instances.end());
+			for (MeshInstance& Instance : NewInstances)
+				Instance.MeshIndex -= static_cast<uint32_t>(FirstNewMesh);
 
-					ai_real FloatResult;
-					if (aiReturn_SUCCESS == pMat->Get(AI_MATKEY_SHININESS, FloatResult))
-						Mat.Shininess = FloatResult;
+			MeshCache::Write(CachePath, Key, NewMeshes, Span<const MeshInstance>(NewInstances.data(), NewInstances.size()));
+		}
 
-					if (aiReturn_SUCCESS == pMat->Get(AI_MATKEY_REFRACTI, FloatResult))
-						Mat.RefractIndex = FloatResult;
+		LogInstancingStats(Filepath, SMeshVector, Instances, FirstNewMesh, FirstNewInstance);
 
-					SMesh.MeshMaterial = Mat;
-				}
-				else
-				{
-					CORE_ERROR("Missing material for mesh {0} at {1}!", i, Filepath);
-					LoadSucceeded = false;
-					continue;
-				}
+		return LoadSucceeded;
+	}
 
-				CORE_TRACE("Loaded mesh {0} with {1} tris :: Normals {2}, Texcoords {3}, Material {4}",
-					pMesh->mName.C_Str(),
-					SMesh.Indices.size() / 3,
-					SMesh.HasNormals ? "available" : "N/A",
-					SMesh.HasTexcoords ? "available" : "N/A",
-					SMesh.HasMaterial ? "available" : "N/A"
-					);
-				SMeshVector.push_back(SMesh);
-			}
-		}
-		else
+	uint64_t HashBytes(const void* Data, size_t Size, uint64_t Seed)
+	{
+		const uint64_t Prime = 1099511628211ull;
+		const uint8_t* Bytes = reinterpret_cast<const uint8_t*>(Data);
+
+		uint64_t Hash = Seed;
+		size_t NumWords = Size / sizeof(uint64_t);
+
+		for (size_t i = 0; i < NumWords; i++)
 		{
-			CORE_ERROR("Failed to load scene at {0}!", Filepath);
-			LoadSucceeded = false;
+			uint64_t Word;
+			memcpy(&Word, Bytes + i * sizeof(uint64_t), sizeof(uint64_t));
+			Hash = (Hash ^ Word) * Prime;
+			Hash ^= Hash >> 32;
 		}
 
-		return LoadSucceeded;
+		for (size_t i = NumWords * sizeof(uint64_t); i < Size; i++)
+			Hash = (Hash ^ Bytes[i]) * Prime;
+
+		return Hash ^ Size;
+	}
+
+	bool HashFile(const std::string& Filepath, uint64_t& OutHash)
+	{
+		MappedFile File;
+		if (!File.Open(Filepath))
+			return false;
+
+		OutHash = HashBytes(File.Data(), static_cast<size_t>(File.Size()));
+		return true;
 	}
 
 	std::string GetResourcePath(const std::string& ResourceName)
@@ -300,22 +838,24 @@ namespace Utils
 
 	SFallbackTexture* GetFallbackTexture()
 	{
-		if (FallbackTexture->texture)
-			return FallbackTexture;
-
-		FallbackTexture->texture = reinterpret_cast<UINT8*>(malloc(FallbackTexture->width * FallbackTexture->height * FallbackTexture->stride));
-		const UINT8 fallbackRed = 0xFF;
-		const UINT8 fallbackGreen = 0;
-		const UINT8 fallbackBlue = 0xFF;
-		const UINT8 fallbackAlpha = 0xFF;
-
-		for (uint32_t i = 0; i < FallbackTexture->width * FallbackTexture->height; i++)
+		// Failed decodes on several pool threads can ask for it at the same time
+		static std::once_flag FallbackInitialized;
+		std::call_once(FallbackInitialized, []()
 		{
-			FallbackTexture->texture[i * FallbackTexture->stride] = fallbackRed;
-			FallbackTexture->texture[i * FallbackTexture->stride + 1] = fallbackGreen;
-			FallbackTexture->texture[i * FallbackTexture->stride + 2] = fallbackBlue;
-			FallbackTexture->texture[i * FallbackTexture->stride + 3] = fallbackAlpha;
-		}
+			FallbackTexture->texture = reinterpret_cast<UINT8*>(malloc(FallbackTexture->width * FallbackTexture->height * FallbackTexture->stride));
+			const UINT8 fallbackRed = 0xFF;
+			const UINT8 fallbackGreen = 0;
+			const UINT8 fallbackBlue = 0xFF;
+			const UINT8 fallbackAlpha = 0xFF;
+
+			for (uint32_t i = 0; i < FallbackTexture->width * FallbackTexture->height; i++)
+			{
+				FallbackTexture->texture[i * FallbackTexture->stride] = fallbackRed;
+				FallbackTexture->texture[i * FallbackTexture->stride + 1] = fallbackGreen;
+				FallbackTexture->texture[i * FallbackTexture->stride + 2] = fallbackBlue;
+				FallbackTexture->texture[i * FallbackTexture->stride + 3] = fallbackAlpha;
+			}
+		});
 
 		return FallbackTexture;
 	}
@@ -360,31 +900,27 @@ namespace Utils
 
 	void FillTextureInfoFromScratchImage(DirectX::ScratchImage& Image, TextureInfo& TInfo)
 	{
-		TInfo.width = Image.GetImage(0, 0, 0)->width;
-		TInfo.height = Image.GetImage(0, 0, 0)->height;
-		TInfo.stride = Image.GetImage(0, 0, 0)->rowPitch / TInfo.width;
-
-		int numBytes = TInfo.width * TInfo.height * TInfo.stride;
-		TInfo.pixels.resize(numBytes);
-		for(int i = 0; i < numBytes; i++)
-			TInfo.pixels[i] = Image.GetImage(0, 0, 0)->pixels[i];
+		const DirectX::Image* level0 = Image.GetImage(0, 0, 0);
+		TInfo.width = static_cast<int>(level0->width);
+		TInfo.height = static_cast<int>(level0->height);
+		TInfo.stride = static_cast<int>(level0->rowPitch / level0->width);
+
+		const size_t numBytes = static_cast<size_t>(TInfo.width) * TInfo.height * TInfo.stride;
+		const UINT8* pixels = level0->pixels;
+
+		// The scratch image moves into the buffer's owner, its allocation stays where it is
+		TInfo.pixels = ImageBuffer(std::make_shared<DirectX::ScratchImage>(std::move(Image)), pixels, numBytes);
 	}
 
 	/**
 	* Load an image
 	*/
-	TextureInfo LoadTexture(std::string filepath, D3D12Resources& resources, UINT channelBytes)
+	TextureInfo LoadTexture(std::string filepath, UINT channelBytes)
 	{
-		//if (resources.Textures.count(filepath) > 0)
-		//	return resources.Textures.at(filepath).textureInfo;
-
 		TextureInfo result = {};
-		UINT8* pixels = nullptr;
 
 		CORE_TRACE("Attempting to loading texture from {0}", filepath);
 
-		bool LoadedWithSTBI = false;
-
 		auto const UntilExtension = filepath.rfind(".");
 		if (UntilExtension != std::string::npos)
 		{
@@ -399,57 +935,131 @@ namespace Utils
 				DirectX::LoadFromDDSFile(ws.c_str(), DirectX::DDS_FLAGS_NONE, &Metadata, ScImg);
 
 				result = GetDecompressedAndConvertedImage(ScImg);
-				pixels = result.pixels.data();
 			}
 			else
 			{
-				// Load image pixels with stb_image
-				pixels = stbi_load(filepath.c_str(), &result.width, &result.height, &result.stride, STBI_default);
-				LoadedWithSTBI = true;
+				// Load image pixels with stb_image, the texture takes over stb's allocation and frees it when it's done with it
+				UINT8* pixels = stbi_load(filepath.c_str(), &result.width, &result.height, &result.stride, STBI_default);
+				if (pixels)
+				{
+					const size_t numBytes = static_cast<size_t>(result.width) * result.height * result.stride;
+					result.pixels = ImageBuffer(std::shared_ptr<const void>(pixels, stbi_image_free), pixels, numBytes);
+				}
 			}
 		}
 
-		if (!pixels)
+		if (result.pixels.Empty())
 		{
 			CORE_ERROR("Failed to load texture at {0}", filepath);
 			SFallbackTexture* fallback = GetFallbackTexture();
 
-			pixels = fallback->texture;
 			result.width = fallback->width;
 			result.height = fallback->height;
 			result.stride = fallback->stride;
+
+			// The fallback is never freed, nothing needs to own it
+			result.pixels = ImageBuffer(nullptr, fallback->texture, static_cast<size_t>(fallback->width) * fallback->height * fallback->stride);
+		}
+
+		FormatTexture(result, channelBytes);
+
+		return result;
+	}
+
+	bool LoadNativeDDS(const std::string& filepath, bool requireMips, TextureInfo& result)
+	{
+		auto const UntilExtension = filepath.rfind(".");
+		if (UntilExtension == std::string::npos || filepath.compare(UntilExtension, std::string::npos, ".dds") != 0)
+			return false;
+
+		// Only the header is read to decide, the decompressing path would load the whole file again
+		std::wstring ws(filepath.begin(), filepath.end());
+		DirectX::TexMetadata Metadata = {};
+		if (FAILED(DirectX::GetMetadataFromDDSFile(ws.c_str(), DirectX::DDS_FLAGS_NONE, Metadata)))
+			return false;
+
+		// sRGB formats are uploaded as their UNORM twin, like every PNG, so the shaders see the same values as before
+		DXGI_FORMAT format = DirectX::MakeLinear(Metadata.format);
+		bool IsNative = TextureFormat::IsBlockCompressed(format) || format == DXGI_FORMAT_R8G8B8A8_UNORM;
+
+		// D3D12 wants block compressed textures in whole blocks at the top level
+		IsNative = IsNative && Metadata.dimension == DirectX::TEX_DIMENSION_TEXTURE2D && Metadata.arraySize == 1 && Metadata.depth == 1;
+		IsNative = IsNative && (!TextureFormat::IsBlockCompressed(format) || (Metadata.width % 4 == 0 && Metadata.height % 4 == 0));
+		IsNative = IsNative && (!requireMips || Metadata.mipLevels > 1);
+
+		if (!IsNative)
+			return false;
+
+		DirectX::ScratchImage ScImg;
+		if (FAILED(DirectX::LoadFromDDSFile(ws.c_str(), DirectX::DDS_FLAGS_NONE, &Metadata, ScImg)))
+			return false;
+
+		result = TextureInfo();
+		result.width = static_cast<int>(Metadata.width);
+		result.height = static_cast<int>(Metadata.height);
+		result.stride = TextureFormat::GetElementBytes(format);
+		result.format = format;
+		result.mips.resize(Metadata.mipLevels);
+
+		size_t totalSize = 0;
+		for (size_t mip = 0; mip < Metadata.mipLevels; mip++)
+		{
+			const DirectX::Image* Image = ScImg.GetImage(mip, 0, 0);
+			result.mips[mip].width = static_cast<int>(Image->width);
+			result.mips[mip].height = static_cast<int>(Image->height);
+			result.mips[mip].offset = totalSize;
+
+			totalSize += TextureFormat::GetSurfaceSize(format, static_cast<uint32_t>(Image->width), static_cast<uint32_t>(Image->height));
 		}
-		
-		FormatTexture(result, pixels, channelBytes);
 
-		if (LoadedWithSTBI)
+		// The levels of a single 2D texture are back to back in the scratch image with the same tight pitch, so it's adopted as is
+		const UINT8* pixels = ScImg.GetPixels();
+		for (size_t mip = 0; mip < Metadata.mipLevels; mip++)
 		{
-			stbi_image_free(pixels);
+			if (ScImg.GetImage(mip, 0, 0)->pixels != pixels + result.mips[mip].offset)
+			{
+				CORE_WARN("Unexpected level layout in {0}", filepath);
+				return false;
+			}
 		}
-		
 
-		return result;
+		result.pixels = ImageBuffer(std::make_shared<DirectX::ScratchImage>(std::move(ScImg)), pixels, totalSize);
+
+		CORE_TRACE("Loaded {0} natively, {1}x{2} with {3} mips", filepath, result.width, result.height, Metadata.mipLevels);
+		return true;
 	}
 
 	/**
-	* Format the loaded texture into the layout we use with D3D12.
+	* Format the loaded texture into the layout we use with D3D12. Only reads the channels the source has.
 	*/
-	void FormatTexture(TextureInfo& info, UINT8* pixels, UINT newStride)
+	void FormatTexture(TextureInfo& info, UINT newStride)
 	{
-		const UINT numPixels = (info.width * info.height);
+		const size_t numPixels = static_cast<size_t>(info.width) * info.height;
 		const UINT oldStride = info.stride;
-		const UINT oldSize = (numPixels * info.stride);
 
-		//const UINT newStride = 4;				// uploading textures to GPU as DXGI_FORMAT_R8G8B8A8_UNORM
-		const UINT newSize = (numPixels * newStride);
-		info.pixels.resize(newSize);
+		// Already in our layout, the decoded buffer is used as it is
+		if (oldStride == newStride)
+			return;
 
-		for (UINT i = 0; i < numPixels; i++)
+		//const UINT newStride = 4;				// uploading textures to GPU as DXGI_FORMAT_R8G8B8A8_UNORM
+		const ImageBuffer source = std::move(info.pixels);
+		const UINT8* pixels = source.Data();
+		info.pixels = ImageBuffer(numPixels * newStride);
+		UINT8* formatted = info.pixels.MutableData();
+
+		// Picked once per image, expands with the widest SIMD the CPU has
+		TextureFormat::ExpandFunc expand = newStride == 4 ? TextureFormat::GetExpander(oldStride) : nullptr;
+		if (expand)
 		{
-			info.pixels[i * newStride] = pixels[i * oldStride];		// R
-			info.pixels[i * newStride + 1] = pixels[i * oldStride + 1];	// G
-			info.pixels[i * newStride + 2] = pixels[i * oldStride + 2];	// B
-			info.pixels[i * newStride + 3] = pixels[i * oldStride + 3];	// A
+			expand(pixels, formatted, numPixels);
+		}
+		else
+		{
+			for (size_t i = 0; i < numPixels; i++)
+			{
+				for (UINT c = 0; c < newStride; c++)
+					formatted[i * newStride + c] = c < oldStride ? pixels[i * oldStride + c] : (c == 3 ? 0xFF : 0);
+			}
 		}
 
 		info.stride = newStride;
@@ -2,12 +2,15 @@
 
 #include "Platform.h"
 #include "StaticMesh.h"
+#include "GeometryArena.h"
 #include "dlss/nvsdk_ngx.h"
 
 #include "DirectXTex/DirectXTex.h"
 
 #include "DX.h"
 
+#include <functional>
+
 #define PATH_TO_RESOURCES "./Resources/"
 
 namespace Utils
@@ -25,16 +28,46 @@ namespace Utils
 	void ValidateNGX(NVSDK_NGX_Result nvr, std::string msg);
 
 	/**
-	* Loads meshes from filepath into SMeshVector.
+	* Called on the loading thread while LoadStaticMeshes is still running, with the instances added since the last call.
+	* Every mesh they refer to is complete and stays where it is in the arena.
+	*/
+	typedef std::function<void(const std::vector<StaticMesh>& SMeshVector, Span<const MeshInstance> NewInstances)> MeshBatchCallback;
+
+	/**
+	* Loads meshes from filepath into SMeshVector. Uses the binary mesh cache next to the file when it is up to date.
+	* OptimizeMeshes welds and reorders every mesh with MeshOptimizer.
+	* Arena is reset and holds the vertex and index data of the new meshes. On a cache hit it adopts the mapped cache file
+	* and the meshes point into that, read only.
+	* Meshes with identical contents are stored once. Instances gets one entry per mesh reference in the node tree,
+	* with its accumulated transform and an index into SMeshVector.
+	* With OnMeshBatch set, meshes are converted a batch at a time and their instances handed out as each batch is done. The
+	* arena then isn't compacted afterwards, since the meshes already handed out point into it.
+	*/
+	bool LoadStaticMeshes(const std::string& Filepath, GeometryArena& Arena, std::vector<StaticMesh>& SMeshVector, std::vector<MeshInstance>& Instances, bool GenVertexNormals, bool OptimizeMeshes = false, bool UseMeshCache = true,
+		const MeshBatchCallback& OnMeshBatch = MeshBatchCallback());
+
+	/**
+	* 64-bit FNV-1a style hash, consumed a word at a time.
+	*/
+	uint64_t HashBytes(const void* Data, size_t Size, uint64_t Seed = 14695981039346656037ull);
+
+	/**
+	* Hashes the full contents of a file. Returns false if the file can't be read.
+	*/
+	bool HashFile(const std::string& Filepath, uint64_t& OutHash);
+
+	/**
+	* Loads a texture with stb_image and returns its data. Safe to call from several threads, TextureCache decodes through this.
 	*/
-	bool LoadStaticMeshes(const std::string& Filepath, std::vector<StaticMesh>& SMeshVector, bool GenVertexNormals);
+	TextureInfo LoadTexture(std::string filepath, UINT channelBytes);
 
 	/**
-	* Loads a texture with stb_image and returns its data.
+	* Loads a DDS file as it is stored, block compressed formats and authored mips included, without decompressing anything.
+	* Returns false for other files, for formats we can't upload as is, and for files without mips when requireMips is set.
 	*/
-	TextureInfo LoadTexture(std::string filepath, D3D12Resources& resources, UINT channelBytes);
+	bool LoadNativeDDS(const std::string& filepath, bool requireMips, TextureInfo& result);
 
-	void FormatTexture(TextureInfo& info, UINT8* pixels, UINT newStride);
+	void FormatTexture(TextureInfo& info, UINT newStride);
 
 	TextureInfo GetDecompressedAndConvertedImage(DirectX::ScratchImage& SrcImage);
 
@@ -0,0 +1,228 @@
+#include "pch.h"
+#include "VertexFormat.h"
+
+#include <DirectXPackedVector.h>
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+
+static_assert(sizeof(Vertex) == 14 * sizeof(float), "Vertex is expected to be tightly packed");
+
+VertexLayout VertexLayout::Get(VertexFormat Format)
+{
+	VertexLayout Layout;
+	Layout.Format = Format;
+
+	if (Format == VertexFormat::Packed)
+	{
+		Layout.Stride = sizeof(PackedVertex);
+		Layout.TexcoordOffset = offsetof(PackedVertex, Texcoord);
+		Layout.TangentFrameOffset = offsetof(PackedVertex, TangentFrame);
+	}
+	else
+	{
+		Layout.Stride = sizeof(Vertex);
+		Layout.TexcoordOffset = 3 * sizeof(float);
+		Layout.NormalOffset = 5 * sizeof(float);
+		Layout.TangentOffset = 8 * sizeof(float);
+		Layout.BinormalOffset = 11 * sizeof(float);
+	}
+
+	return Layout;
+}
+
+namespace VertexPacking
+{
+	static const float RadToDeg = 57.29577951308232f;
+
+	static int16_t FloatToSnorm16(float Value)
+	{
+		Value = std::min(std::max(Value, -1.0f), 1.0f);
+		return static_cast<int16_t>(std::lround(Value * 32767.0f));
+	}
+
+	static float Snorm16ToFloat(int16_t Value)
+	{
+		return std::max(static_cast<float>(Value) / 32767.0f, -1.0f);
+	}
+
+	/**
+	* Any unit vector perpendicular to N, used when a vertex has no usable tangent.
+	*/
+	static Vector3f GetPerpendicular(Vector3f N)
+	{
+		Vector3f Axis = std::fabs(N.X) < 0.9f ? Vector3f(1.0f, 0.0f, 0.0f) : Vector3f(0.0f, 1.0f, 0.0f);
+		return N.Cross(Axis).Normalized();
+	}
+
+	/**
+	* Converts the rotation matrix with columns T, B, N into a quaternion (x, y, z, w).
+	*/
+	static void FrameToQuaternion(Vector3f T, Vector3f B, Vector3f N, float* Q)
+	{
+		float Trace = T.X + B.Y + N.Z;
+
+		if (Trace > 0.0f)
+		{
+			float S = std::sqrt(Trace + 1.0f) * 2.0f;
+			Q[3] = 0.25f * S;
+			Q[0] = (B.Z - N.Y) / S;
+			Q[1] = (N.X - T.Z) / S;
+			Q[2] = (T.Y - B.X) / S;
+		}
+		else if (T.X > B.Y && T.X > N.Z)
+		{
+			float S = std::sqrt(1.0f + T.X - B.Y - N.Z) * 2.0f;
+			Q[3] = (B.Z - N.Y) / S;
+			Q[0] = 0.25f * S;
+			Q[1] = (B.X + T.Y) / S;
+			Q[2] = (N.X + T.Z) / S;
+		}
+		else if (B.Y > N.Z)
+		{
+			float S = std::sqrt(1.0f + B.Y - T.X - N.Z) * 2.0f;
+			Q[3] = (N.X - T.Z) / S;
+			Q[0] = (B.X + T.Y) / S;
+			Q[1] = 0.25f * S;
+			Q[2] = (N.Y + B.Z) / S;
+		}
+		else
+		{
+			float S = std::sqrt(1.0f + N.Z - T.X - B.Y) * 2.0f;
+			Q[3] = (T.Y - B.X) / S;
+			Q[0] = (N.X + T.Z) / S;
+			Q[1] = (N.Y + B.Z) / S;
+			Q[2] = 0.25f * S;
+		}
+	}
+
+	PackedVertex Encode(const Vertex& Vtx)
+	{
+		PackedVertex Packed;
+		Packed.Position[0] = Vtx.Position.X;
+		Packed.Position[1] = Vtx.Position.Y;
+		Packed.Position[2] = Vtx.Position.Z;
+
+		Packed.Texcoord[0] = DirectX::PackedVector::XMConvertFloatToHalf(Vtx.Texcoord.X);
+		Packed.Texcoord[1] = DirectX::PackedVector::XMConvertFloatToHalf(Vtx.Texcoord.Y);
+
+		// Orthonormalise the frame around the normal
+		Vector3f N = Vtx.Normal;
+		N = N.Length() > 0.0f ? N.Normalized() : Vector3f(0.0f, 0.0f, 1.0f);
+
+		Vector3f T = Vtx.Tangent;
+		T = T - N * N.Dot(T);
+		T = T.Length() > 1e-6f ? T.Normalized() : GetPerpendicular(N);
+
+		Vector3f B = N.Cross(T);
+		float Handedness = B.Dot(Vtx.Binormal) < 0.0f ? -1.0f : 1.0f;
+
+		float Q[4];
+		FrameToQuaternion(T, B, N, Q);
+
+		// q and -q are the same rotation, so w is kept positive and its sign is free to store the handedness.
+		// w is clamped away from zero so the sign survives quantisation.
+		const float Bias = 1.0f / 32767.0f;
+		float Sign = Q[3] < 0.0f ? -1.0f : 1.0f;
+		for (uint32_t i = 0; i < 4; i++)
+			Q[i] *= Sign;
+
+		if (Q[3] < Bias)
+		{
+			float Scale = std::sqrt(1.0f - Bias * Bias);
+			Q[0] *= Scale;
+			Q[1] *= Scale;
+			Q[2] *= Scale;
+			Q[3] = Bias;
+		}
+
+		for (uint32_t i = 0; i < 4; i++)
+			Packed.TangentFrame[i] = FloatToSnorm16(Q[i] * Handedness);
+
+		return Packed;
+	}
+
+	Vertex Decode(const PackedVertex& Packed)
+	{
+		Vertex Vtx;
+		Vtx.Position = Vector3f(Packed.Position[0], Packed.Position[1], Packed.Position[2]);
+		Vtx.Texcoord = Vector2f(DirectX::PackedVector::XMConvertHalfToFloat(Packed.Texcoord[0]),
+			DirectX::PackedVector::XMConvertHalfToFloat(Packed.Texcoord[1]));
+
+		float X = Snorm16ToFloat(Packed.TangentFrame[0]);
+		float Y = Snorm16ToFloat(Packed.TangentFrame[1]);
+		float Z = Snorm16ToFloat(Packed.TangentFrame[2]);
+		float W = Snorm16ToFloat(Packed.TangentFrame[3]);
+
+		float InvLength = 1.0f / std::sqrt(X * X + Y * Y + Z * Z + W * W);
+		X *= InvLength;
+		Y *= InvLength;
+		Z *= InvLength;
+		W *= InvLength;
+
+		float Handedness = W < 0.0f ? -1.0f : 1.0f;
+
+		Vtx.Tangent = Vector3f(1.0f - 2.0f * (Y * Y + Z * Z), 2.0f * (X * Y + W * Z), 2.0f * (X * Z - W * Y));
+		Vtx.Binormal = Vector3f(2.0f * (X * Y - W * Z), 1.0f - 2.0f * (X * X + Z * Z), 2.0f * (Y * Z + W * X)) * Handedness;
+		Vtx.Normal = Vector3f(2.0f * (X * Z + W * Y), 2.0f * (Y * Z - W * X), 1.0f - 2.0f * (X * X + Y * Y));
+
+		return Vtx;
+	}
+
+	void EncodeVertices(Span<const Vertex> Vertices, PackedVertex* OutPacked)
+	{
+		for (size_t i = 0; i < Vertices.size(); i++)
+			OutPacked[i] = Encode(Vertices[i]);
+	}
+
+	/**
+	* Angle between two directions, or -1 if the reference has no length.
+	*/
+	static float AngleDegrees(Vector3f Reference, Vector3f Decoded)
+	{
+		float ReferenceLength = Reference.Length();
+		float DecodedLength = Decoded.Length();
+		if (ReferenceLength <= 0.0f || DecodedLength <= 0.0f)
+			return -1.0f;
+
+		float Cos = Reference.Dot(Decoded) / (ReferenceLength * DecodedLength);
+		return std::acos(std::min(std::max(Cos, -1.0f), 1.0f)) * RadToDeg;
+	}
+
+	void MeasureRoundTripError(Span<const Vertex> Vertices, RoundTripError& OutError)
+	{
+		double NormalDegreesSum = static_cast<double>(OutError.MeanNormalDegrees) * OutError.NumNormals;
+
+		for (const Vertex& Original : Vertices)
+		{
+			Vertex Decoded = Decode(Encode(Original));
+
+			Vector3f PositionDelta = Vector3f(Original.Position) - Decoded.Position;
+			OutError.MaxPositionError = std::max(OutError.MaxPositionError, PositionDelta.Length());
+
+			float TexcoordError = std::max(std::fabs(Original.Texcoord.X - Decoded.Texcoord.X), std::fabs(Original.Texcoord.Y - Decoded.Texcoord.Y));
+			OutError.MaxTexcoordError = std::max(OutError.MaxTexcoordError, TexcoordError);
+
+			float NormalDegrees = AngleDegrees(Original.Normal, Decoded.Normal);
+			if (NormalDegrees >= 0.0f)
+			{
+				OutError.MaxNormalDegrees = std::max(OutError.MaxNormalDegrees, NormalDegrees);
+				NormalDegreesSum += NormalDegrees;
+				OutError.NumNormals++;
+			}
+
+			OutError.MaxTangentDegrees = std::max(OutError.MaxTangentDegrees, AngleDegrees(Original.Tangent, Decoded.Tangent));
+
+			float BinormalDegrees = AngleDegrees(Original.Binormal, Decoded.Binormal);
+			OutError.MaxBinormalDegrees = std::max(OutError.MaxBinormalDegrees, BinormalDegrees);
+
+			if (BinormalDegrees > 90.0f)
+				OutError.NumHandednessFlips++;
+
+			OutError.NumVertices++;
+		}
+
+		OutError.MeanNormalDegrees = OutError.NumNormals > 0 ? static_cast<float>(NormalDegreesSum / OutError.NumNormals) : 0.0f;
+	}
+}
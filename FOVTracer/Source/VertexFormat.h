@@ -0,0 +1,73 @@
+#pragma once
+
+#include "StaticMesh.h"
+#include "Span.h"
+
+#include <cstdint>
+
+enum class VertexFormat : uint32_t
+{
+	Full = 0,
+	Packed = 1
+};
+
+/**
+* Byte layout of a vertex in the GPU vertex buffer. The hit shaders get these values as defines so the stride is never hard-coded.
+* Position always comes first as three floats, which is what the BLAS builds read.
+*/
+struct VertexLayout
+{
+	VertexFormat Format = VertexFormat::Full;
+	uint32_t Stride = 0;
+	uint32_t TexcoordOffset = 0;
+
+	// Full layout only
+	uint32_t NormalOffset = 0;
+	uint32_t TangentOffset = 0;
+	uint32_t BinormalOffset = 0;
+
+	// Packed layout only
+	uint32_t TangentFrameOffset = 0;
+
+	static VertexLayout Get(VertexFormat Format);
+};
+
+/**
+* 24 byte vertex. Full precision position, half float texcoords and the tangent frame as a snorm16 quaternion.
+* The sign of the quaternion w stores the handedness of the binormal.
+*/
+struct PackedVertex
+{
+	float Position[3];
+	uint16_t Texcoord[2];
+	int16_t TangentFrame[4];
+};
+
+static_assert(sizeof(PackedVertex) == 24, "PackedVertex must match the packed VertexLayout");
+
+namespace VertexPacking
+{
+	PackedVertex Encode(const Vertex& Vtx);
+	Vertex Decode(const PackedVertex& Packed);
+
+	void EncodeVertices(Span<const Vertex> Vertices, PackedVertex* OutPacked);
+
+	struct RoundTripError
+	{
+		uint64_t NumVertices = 0;
+		uint64_t NumNormals = 0;
+		float MaxPositionError = 0.0f;
+		float MaxTexcoordError = 0.0f;
+		float MaxNormalDegrees = 0.0f;
+		float MeanNormalDegrees = 0.0f;
+		float MaxTangentDegrees = 0.0f;
+		float MaxBinormalDegrees = 0.0f;
+		uint64_t NumHandednessFlips = 0;
+	};
+
+	/**
+	* Encodes and decodes every vertex and accumulates the error into OutError. Angles are in degrees.
+	* Tangents and binormals are compared against the originals, so non-orthogonal input frames show up as error.
+	*/
+	void MeasureRoundTripError(Span<const Vertex> Vertices, RoundTripError& OutError);
+}
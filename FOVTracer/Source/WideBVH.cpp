@@ -0,0 +1,221 @@
+#include "pch.h"
+#include "WideBVH.h"
+#include "TextureFormat.h"
+
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define WIDE_BVH_X86 1
+#include <immintrin.h>
+#else
+#define WIDE_BVH_X86 0
+#endif
+
+#if defined(_MSC_VER)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace
+{
+	float GetNodeArea(const BVHNode& Node)
+	{
+		BoundingBox Bounds;
+		Bounds.Min = Node.BoundsMin;
+		Bounds.Max = Node.BoundsMax;
+		return Bounds.GetSurfaceArea();
+	}
+
+	uint32_t IntersectChildrenScalar(const WideBVHNode& Node, const WideBVH::TraversalRay& Ray, float TMax, float OutTNear[8])
+	{
+		const float* Mins[3] = { Node.MinX, Node.MinY, Node.MinZ };
+		const float* Maxs[3] = { Node.MaxX, Node.MaxY, Node.MaxZ };
+
+		uint32_t HitMask = 0;
+		for (uint32_t i = 0; i < WideBVH::Width; i++)
+		{
+			float TNear = 0.0f;
+			float TFar = TMax;
+			float TEntry = -std::numeric_limits<float>::max();
+			for (uint32_t Axis = 0; Axis < 3; Axis++)
+			{
+				const float* NearPlanes = Ray.IsNegative[Axis] ? Maxs[Axis] : Mins[Axis];
+				const float* FarPlanes = Ray.IsNegative[Axis] ? Mins[Axis] : Maxs[Axis];
+
+				float TAxisNear = (NearPlanes[i] - Ray.Origin[Axis]) * Ray.InvDirection[Axis];
+				TEntry = Math::max(TEntry, TAxisNear);
+				TNear = Math::max(TNear, TAxisNear);
+				TFar = Math::min(TFar, (FarPlanes[i] - Ray.Origin[Axis]) * Ray.InvDirection[Axis]);
+			}
+
+			OutTNear[i] = TEntry;
+			if (TNear <= TFar && TEntry < TMax)
+				HitMask |= 1u << i;
+		}
+
+		return HitMask;
+	}
+
+#if WIDE_BVH_X86
+	TARGET_AVX2 uint32_t IntersectChildrenAVX2(const WideBVHNode& Node, const WideBVH::TraversalRay& Ray, float TMax, float OutTNear[8])
+	{
+		const float* Mins[3] = { Node.MinX, Node.MinY, Node.MinZ };
+		const float* Maxs[3] = { Node.MaxX, Node.MaxY, Node.MaxZ };
+
+		__m256 TNear = _mm256_setzero_ps();
+		__m256 TFar = _mm256_set1_ps(TMax);
+		__m256 TEntry = _mm256_set1_ps(-std::numeric_limits<float>::max());
+		for (uint32_t Axis = 0; Axis < 3; Axis++)
+		{
+			const float* NearPlanes = Ray.IsNegative[Axis] ? Maxs[Axis] : Mins[Axis];
+			const float* FarPlanes = Ray.IsNegative[Axis] ? Mins[Axis] : Maxs[Axis];
+
+			__m256 Origin = _mm256_set1_ps(Ray.Origin[Axis]);
+			__m256 InvDirection = _mm256_set1_ps(Ray.InvDirection[Axis]);
+
+			__m256 TAxisNear = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(NearPlanes), Origin), InvDirection);
+			__m256 TAxisFar = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(FarPlanes), Origin), InvDirection);
+
+			TEntry = _mm256_max_ps(TEntry, TAxisNear);
+			TNear = _mm256_max_ps(TNear, TAxisNear);
+			TFar = _mm256_min_ps(TFar, TAxisFar);
+		}
+
+		_mm256_storeu_ps(OutTNear, TEntry);
+
+		__m256 Overlaps = _mm256_cmp_ps(TNear, TFar, _CMP_LE_OQ);
+		__m256 BeforeTMax = _mm256_cmp_ps(TEntry, _mm256_set1_ps(TMax), _CMP_LT_OQ);
+		return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_and_ps(Overlaps, BeforeTMax)));
+	}
+#endif
+}
+
+void WideBVH::Build(const BVH& Binary)
+{
+	Clear();
+
+	Span<const BVHNode> BinaryNodes = Binary.GetNodes();
+	if (BinaryNodes.empty())
+		return;
+
+	Span<const uint32_t> BinaryIndices = Binary.GetPrimitiveIndices();
+	PrimitiveIndices.assign(BinaryIndices.begin(), BinaryIndices.end());
+
+	struct CollapseTask
+	{
+		uint32_t BinaryIndex;
+		uint32_t WideIndex;
+		uint32_t Depth;
+	};
+
+	std::vector<CollapseTask> Tasks;
+	Nodes.emplace_back();
+	Tasks.push_back({ 0, 0, 1 });
+
+	while (!Tasks.empty())
+	{
+		CollapseTask Task = Tasks.back();
+		Tasks.pop_back();
+		Depth = Math::max(Depth, Task.Depth);
+
+		uint32_t Children[Width];
+		uint32_t NumChildren = 0;
+
+		const BVHNode& Root = BinaryNodes[Task.BinaryIndex];
+		if (Root.IsLeaf())
+		{
+			Children[NumChildren++] = Task.BinaryIndex;
+		}
+		else
+		{
+			Children[NumChildren++] = Root.LeftFirst;
+			Children[NumChildren++] = Root.LeftFirst + 1;
+		}
+
+		// Opening the largest child first keeps the children's bounds as tight as the binary tree allows
+		while (NumChildren < Width)
+		{
+			uint32_t Largest = ~0u;
+			float LargestArea = -1.0f;
+			for (uint32_t c = 0; c < NumChildren; c++)
+			{
+				const BVHNode& Child = BinaryNodes[Children[c]];
+				float Area = GetNodeArea(Child);
+				if (!Child.IsLeaf() && Area > LargestArea)
+				{
+					Largest = c;
+					LargestArea = Area;
+				}
+			}
+
+			if (Largest == ~0u)
+				break;
+
+			uint32_t Left = BinaryNodes[Children[Largest]].LeftFirst;
+			Children[Largest] = Left;
+			Children[NumChildren++] = Left + 1;
+		}
+
+		WideBVHNode Node;
+		const float Inf = std::numeric_limits<float>::infinity();
+		for (uint32_t c = 0; c < Width; c++)
+		{
+			Node.MinX[c] = Node.MinY[c] = Node.MinZ[c] = Inf;
+			Node.MaxX[c] = Node.MaxY[c] = Node.MaxZ[c] = -Inf;
+			Node.Children[c] = 0;
+			Node.Counts[c] = 0;
+		}
+
+		for (uint32_t c = 0; c < NumChildren; c++)
+		{
+			const BVHNode& Child = BinaryNodes[Children[c]];
+			Node.MinX[c] = Child.BoundsMin.X;
+			Node.MinY[c] = Child.BoundsMin.Y;
+			Node.MinZ[c] = Child.BoundsMin.Z;
+			Node.MaxX[c] = Child.BoundsMax.X;
+			Node.MaxY[c] = Child.BoundsMax.Y;
+			Node.MaxZ[c] = Child.BoundsMax.Z;
+
+			if (Child.IsLeaf())
+			{
+				Node.Children[c] = Child.LeftFirst;
+				Node.Counts[c] = Child.Count;
+			}
+			else
+			{
+				Node.Children[c] = static_cast<uint32_t>(Nodes.size());
+				Nodes.emplace_back();
+				Tasks.push_back({ Children[c], Node.Children[c], Task.Depth + 1 });
+			}
+		}
+
+		Nodes[Task.WideIndex] = Node;
+	}
+}
+
+void WideBVH::Clear()
+{
+	Nodes.clear();
+	PrimitiveIndices.clear();
+	Depth = 0;
+}
+
+bool WideBVH::IsUsingAVX2()
+{
+#if WIDE_BVH_X86
+	return TextureFormat::GetSupportedSimdLevel() >= TextureFormat::SimdLevel::AVX2;
+#else
+	return false;
+#endif
+}
+
+WideBVH::IntersectChildrenFunc WideBVH::GetIntersectChildren()
+{
+#if WIDE_BVH_X86
+	if (IsUsingAVX2())
+		return IntersectChildrenAVX2;
+#endif
+
+	return IntersectChildrenScalar;
+}
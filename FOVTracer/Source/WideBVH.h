@@ -0,0 +1,174 @@
+#pragma once
+
+#include "BVH.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+* Eight children with their bounds stored per axis, so one AVX2 pass tests the ray against all of them. Children[i] is a
+* node index when Counts[i] is 0 and the first of Counts[i] primitives otherwise. Unused slots have inverted bounds and
+* never hit.
+*/
+struct alignas(32) WideBVHNode
+{
+	float MinX[8];
+	float MinY[8];
+	float MinZ[8];
+	float MaxX[8];
+	float MaxY[8];
+	float MaxZ[8];
+	uint32_t Children[8];
+	uint32_t Counts[8];
+};
+
+/**
+* BVH with eight children per node, collapsed from a binary BVH. Leaves and primitive order are the binary tree's, only the
+* interior levels are merged. Traversal tests all children of a node at once and visits the hits nearest first.
+*/
+class WideBVH
+{
+public:
+	static constexpr uint32_t Width = 8;
+
+	/**
+	* Each node takes in the children of its largest interior child until it has Width children or only leaves left.
+	*/
+	void Build(const BVH& Binary);
+
+	void Clear();
+
+	uint32_t GetNumNodes() const { return static_cast<uint32_t>(Nodes.size()); }
+	uint32_t GetDepth() const { return Depth; }
+
+	/**
+	* Same contract as BVH::Traverse. NodesVisited counts wide nodes.
+	*/
+	template<class IntersectFunc>
+	bool Traverse(Vector3f Origin, Vector3f Direction, float& TMax, IntersectFunc&& IntersectPrimitive, BVHTraversalStats& Stats) const
+	{
+		return TraverseImpl<false>(Origin, Direction, TMax, IntersectPrimitive, Stats);
+	}
+
+	template<class IntersectFunc>
+	bool TraverseAny(Vector3f Origin, Vector3f Direction, float& TMax, IntersectFunc&& IntersectPrimitive, BVHTraversalStats& Stats) const
+	{
+		return TraverseImpl<true>(Origin, Direction, TMax, IntersectPrimitive, Stats);
+	}
+
+	/**
+	* Whether the child test runs on AVX2 or falls back to scalar code, decided once per process.
+	*/
+	static bool IsUsingAVX2();
+
+	/**
+	* Ray data the child test needs, the bound planes a ray enters through depend on the sign of its direction.
+	*/
+	struct TraversalRay
+	{
+		float Origin[3];
+		float InvDirection[3];
+		uint32_t IsNegative[3];
+	};
+
+	/**
+	* Tests the ray against every child of Node. Returns a bit per child whose bounds overlap [0, TMax) and writes the entry
+	* distances of all children to OutTNear.
+	*/
+	typedef uint32_t (*IntersectChildrenFunc)(const WideBVHNode& Node, const TraversalRay& Ray, float TMax, float OutTNear[8]);
+
+private:
+	struct StackEntry
+	{
+		uint32_t Child;
+		uint32_t Count;
+		float TNear;
+	};
+
+	template<bool FirstHitOnly, class IntersectFunc>
+	bool TraverseImpl(Vector3f Origin, Vector3f Direction, float& TMax, IntersectFunc& IntersectPrimitive, BVHTraversalStats& Stats) const;
+
+	static IntersectChildrenFunc GetIntersectChildren();
+
+	std::vector<WideBVHNode> Nodes;
+	std::vector<uint32_t> PrimitiveIndices;
+	uint32_t Depth = 0;
+};
+
+template<bool FirstHitOnly, class IntersectFunc>
+bool WideBVH::TraverseImpl(Vector3f Origin, Vector3f Direction, float& TMax, IntersectFunc& IntersectPrimitive, BVHTraversalStats& Stats) const
+{
+	if (Nodes.empty())
+		return false;
+
+	static const IntersectChildrenFunc IntersectChildren = GetIntersectChildren();
+
+	// Same stand-in for a zero direction as the binary traversal
+	const float Huge = 1e30f;
+	const float Dir[3] = { Direction.X, Direction.Y, Direction.Z };
+
+	TraversalRay Ray;
+	Ray.Origin[0] = Origin.X;
+	Ray.Origin[1] = Origin.Y;
+	Ray.Origin[2] = Origin.Z;
+	for (uint32_t Axis = 0; Axis < 3; Axis++)
+	{
+		Ray.InvDirection[Axis] = Dir[Axis] != 0.0f ? 1.0f / Dir[Axis] : Huge;
+		Ray.IsNegative[Axis] = Ray.InvDirection[Axis] < 0.0f ? 1 : 0;
+	}
+
+	// Every level pushes at most Width - 1 entries more than it pops
+	StackEntry Stack[Width * BVH::MaxDepth];
+	uint32_t StackSize = 0;
+	Stack[StackSize++] = { 0, 0, 0.0f };
+	bool Hit = false;
+
+	while (StackSize > 0)
+	{
+		const StackEntry Entry = Stack[--StackSize];
+		if (Entry.TNear >= TMax)
+			continue;
+
+		if (Entry.Count > 0)
+		{
+			for (uint32_t i = 0; i < Entry.Count; i++)
+			{
+				Stats.PrimitivesTested++;
+				Hit |= IntersectPrimitive(PrimitiveIndices[Entry.Child + i], TMax);
+
+				if (FirstHitOnly && Hit)
+					return true;
+			}
+
+			continue;
+		}
+
+		const WideBVHNode& Node = Nodes[Entry.Child];
+		Stats.NodesVisited++;
+
+		float TNear[Width];
+		uint32_t HitMask = IntersectChildren(Node, Ray, TMax, TNear);
+
+		// Farthest hit goes on the stack first so the nearest is popped next
+		uint32_t FirstEntry = StackSize;
+		while (HitMask != 0)
+		{
+			uint32_t Slot = 0;
+			while ((HitMask & (1u << Slot)) == 0)
+				Slot++;
+			HitMask &= HitMask - 1;
+
+			StackEntry Child = { Node.Children[Slot], Node.Counts[Slot], TNear[Slot] };
+			uint32_t Insert = StackSize++;
+			while (Insert > FirstEntry && Stack[Insert - 1].TNear < Child.TNear)
+			{
+				Stack[Insert] = Stack[Insert - 1];
+				Insert--;
+			}
+
+			Stack[Insert] = Child;
+		}
+	}
+
+	return Hit;
+}